@@ -28,6 +28,32 @@
 		a. when a buffer is allocated, it is allocated before the write head
 		b. when an entry is freed, the read head of the buffers section moves
 
+	sharded mode:
+		when the cache is created with more than one shard, the memory that follows the 
+		fixed size headers is split to equal size regions, one per shard. each region has 
+		the layout of sections 2 & 3 above, and each shard has its own ngx_buffer_cache_sh_t, 
+		which contains its own rbtree, queues, stats and lock. the shard of a key is selected 
+		by its hash.
+		in sharded mode, fetch / release operations first try to perform the lookup without 
+		taking the lock - every change to the rbtree / entries is wrapped by 2 increments of 
+		the shard seq counter (seqlock), the lookup is retried with the lock in case the seq 
+		changed during the lookup, or in case a modification is in progress.
+
+	slab policy:
+		when the cache is created with the slab policy, the buffers section of each shard 
+		is managed as an array of fixed size pages (SLAB_PAGE_SIZE). the pages are mapped 
+		by an array of ngx_buffer_cache_page_t that is allocated, together with the size 
+		classes, before the entries section. each page is assigned to a size class on demand, 
+		and is split to equal size blocks (classes whose block size is larger than a page 
+		use a span of multiple pages, that holds a single block). a buffer is allocated from 
+		the free list of its class, when the free list is empty:
+		a. a new span is allocated for the class (free pages / growing the buffers section)
+		b. an entry of the class is evicted - each class has a segmented LRU, new entries are
+			inserted to the probation segment, entries that were fetched are promoted to the 
+			protected segment when they reach the head of the probation segment. locked 
+			entries are skipped, so a single locked entry does not block the eviction of 
+			other entries
+		c. the pages of other classes are reclaimed, in a round robin order
 */
 
 // Note: code taken from ngx_str_rbtree_insert_value, updated the node comparison
@@ -110,6 +136,166 @@ ngx_buffer_cache_rbtree_lookup(ngx_rbtree_t *rbtree, const u_char* key, uint32_t
 	return NULL;
 }
 
+// Note: same as ngx_buffer_cache_rbtree_lookup, but may be called without holding the lock - 
+//		the caller must validate the seq of the shard after calling this function.
+//		since the tree may be modified during the lookup, every node pointer is validated
+//		to point to an entry before it is dereferenced
+static ngx_buffer_cache_entry_t *
+ngx_buffer_cache_rbtree_lookup_lockless(ngx_buffer_cache_sh_t *cache, const u_char* key, uint32_t hash)
+{
+	ngx_buffer_cache_entry_t *n;
+	ngx_rbtree_node_t *node, *sentinel;
+	ngx_uint_t depth;
+	ngx_int_t rc;
+
+	node = cache->rbtree.root;
+	sentinel = &cache->sentinel;
+
+	for (depth = 0; depth < MAX_LOCKLESS_LOOKUP_DEPTH && node != sentinel; depth++)
+	{
+		n = (ngx_buffer_cache_entry_t *)node;
+		if (n < cache->entries_start || n >= cache->entries_end ||
+			((u_char*)n - (u_char*)cache->entries_start) % sizeof(*n) != 0)
+		{
+			return NULL;
+		}
+
+		if (hash != node->key) 
+		{
+			node = (hash < node->key) ? node->left : node->right;
+			continue;
+		}
+
+		rc = ngx_memcmp(key, n->key, BUFFER_CACHE_KEY_SIZE);
+		if (rc < 0) 
+		{
+			node = node->left;
+			continue;
+		}
+
+		if (rc > 0) 
+		{
+			node = node->right;
+			continue;
+		}
+
+		return n;
+	}
+
+	return NULL;
+}
+
+static ngx_buffer_cache_sh_t*
+ngx_buffer_cache_get_shard(ngx_buffer_cache_t* cache, uint32_t hash)
+{
+	return cache->sh + (hash % cache->shard_count);
+}
+
+/* Note: must be called with the mutex locked */
+static void
+ngx_buffer_cache_write_start(ngx_buffer_cache_sh_t *cache)
+{
+	(void)ngx_atomic_fetch_add(&cache->seq, 1);
+}
+
+/* Note: must be called with the mutex locked */
+static void
+ngx_buffer_cache_write_end(ngx_buffer_cache_sh_t *cache)
+{
+	(void)ngx_atomic_fetch_add(&cache->seq, 1);
+}
+
+static ngx_flag_t
+ngx_buffer_cache_entry_locked(ngx_buffer_cache_entry_t* entry)
+{
+	return entry->ref_count > 0 &&
+		ngx_time() < entry->access_time + ENTRY_LOCK_EXPIRATION;
+}
+
+/* Note: must be called with the mutex locked.
+	the ref count of an entry is never overwritten, since a lockless fetch that lost a race may still
+	decrement it. a count that remains after the lock of the entry expired belongs to a process that died
+	while holding the entry, it is replaced only if it did not change in the meantime */
+static ngx_flag_t
+ngx_buffer_cache_entry_lock_for_write(ngx_buffer_cache_entry_t* entry)
+{
+	ngx_atomic_uint_t ref_count;
+
+	ref_count = entry->ref_count;
+	ngx_memory_barrier();
+
+	if (ref_count != 0 && ngx_buffer_cache_entry_locked(entry))
+	{
+		return 0;
+	}
+
+	return ngx_atomic_cmp_set(&entry->ref_count, ref_count, 1);
+}
+
+static size_t
+ngx_buffer_cache_slab_block_size(ngx_uint_t index)
+{
+	ngx_uint_t shift = SLAB_MIN_SHIFT + (index >> 2);
+
+	return (size_t)(4 + (index & 3)) << (shift - 2);
+}
+
+static ngx_uint_t
+ngx_buffer_cache_slab_get_class(size_t size)
+{
+	ngx_uint_t index;
+
+	for (index = 0; index < SLAB_CLASS_COUNT; index++)
+	{
+		if (size <= ngx_buffer_cache_slab_block_size(index))
+		{
+			break;
+		}
+	}
+
+	return index;
+}
+
+static ngx_uint_t
+ngx_buffer_cache_slab_span_pages(ngx_uint_t index)
+{
+	return (ngx_buffer_cache_slab_block_size(index) + SLAB_PAGE_SIZE - 1) >> SLAB_PAGE_SHIFT;
+}
+
+static ngx_uint_t
+ngx_buffer_cache_slab_get_page(ngx_buffer_cache_sh_t *cache, u_char* ptr)
+{
+	return (ptr - cache->pages_start) >> SLAB_PAGE_SHIFT;
+}
+
+static void
+ngx_buffer_cache_slab_reset(ngx_buffer_cache_sh_t *cache)
+{
+	ngx_buffer_cache_slab_class_t* slab_class;
+	ngx_buffer_cache_page_t* page;
+	ngx_uint_t i;
+
+	for (i = 0; i < SLAB_CLASS_COUNT; i++)
+	{
+		slab_class = &cache->classes[i];
+		ngx_queue_init(&slab_class->free_blocks);
+		ngx_queue_init(&slab_class->probation);
+		ngx_queue_init(&slab_class->protected);
+		slab_class->entry_count = 0;
+		slab_class->protected_count = 0;
+	}
+
+	for (i = 0; i < cache->page_count; i++)
+	{
+		page = &cache->pages[i];
+		page->slab_class = SLAB_PAGE_FREE;
+		page->used = 0;
+	}
+
+	cache->pages_first = cache->page_count;
+	cache->reclaim_cursor = 0;
+}
+
 static void
 ngx_buffer_cache_reset(ngx_buffer_cache_sh_t *cache)
 {
@@ -121,6 +307,11 @@ ngx_buffer_cache_reset(ngx_buffer_cache_sh_t *cache)
 	ngx_queue_init(&cache->used_queue);
 	ngx_queue_init(&cache->free_queue);
 
+	if (cache->policy == BUFFER_CACHE_POLICY_SLAB)
+	{
+		ngx_buffer_cache_slab_reset(cache);
+	}
+
 	// update stats (everything is evicted)
 	cache->stats.evicted = cache->stats.store_ok;
 	cache->stats.evicted_bytes = cache->stats.store_bytes;
@@ -132,14 +323,22 @@ ngx_buffer_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 	ngx_buffer_cache_sh_t *sh;
 	ngx_buffer_cache_t *ocache = data;
 	ngx_buffer_cache_t *cache;
+	ngx_uint_t shard_count;
+	ngx_uint_t i;
+	size_t shard_size;
+	u_char* shards_start;
+	u_char* shard_end;
 	u_char* p;
 
 	cache = shm_zone->data;
 
+	// Note: when the shared memory is reused, the shard count is taken from the existing memory
 	if (ocache)
 	{
 		cache->sh = ocache->sh;
 		cache->shpool = ocache->shpool;
+		cache->shard_count = cache->sh->shard_count;
+		cache->policy = cache->sh->policy;
 		return NGX_OK;
 	}
 
@@ -148,6 +347,8 @@ ngx_buffer_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 	if (shm_zone->shm.exists) 
 	{
 		cache->sh = cache->shpool->data;
+		cache->shard_count = cache->sh->shard_count;
+		cache->policy = cache->sh->policy;
 		return NGX_OK;
 	}
 
@@ -159,25 +360,69 @@ ngx_buffer_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 	p = ngx_sprintf(cache->shpool->log_ctx, " in buffer cache \"%V\"%Z", &shm_zone->shm.name);
 
 	// allocate the shared cache state
+	shard_count = cache->shard_count;
+
 	p = ngx_align_ptr(p, sizeof(void *));
 	sh = (ngx_buffer_cache_sh_t*)p;
-	p += sizeof(*sh);
+	p += sizeof(*sh) * shard_count;
 	cache->sh = sh;
 
 	cache->shpool->data = sh;
 
 	// initialize fixed cache fields
-	p = ngx_align_ptr(p, sizeof(void *));
-	sh->entries_start = (ngx_buffer_cache_entry_t*)p;
-	sh->buffers_end = shm_zone->shm.addr + shm_zone->shm.size;
-	sh->access_time = 0;
+	shards_start = ngx_align_ptr(p, sizeof(void *));
+	shard_size = (shm_zone->shm.addr + shm_zone->shm.size - shards_start) / shard_count;
+
+	for (i = 0; i < shard_count; i++, sh++)
+	{
+		p = shards_start + shard_size * i;
+		shard_end = p + shard_size;
+		sh->policy = cache->policy;
 
-	// reset the stats
-	ngx_memzero(&sh->stats, sizeof(sh->stats));
+		if (sh->policy == BUFFER_CACHE_POLICY_SLAB)
+		{
+			// allocate the size classes and the page map
+			p = ngx_align_ptr(p, sizeof(void *));
+			sh->classes = (ngx_buffer_cache_slab_class_t*)p;
+			p += sizeof(sh->classes[0]) * SLAB_CLASS_COUNT;
+
+			sh->pages = (ngx_buffer_cache_page_t*)p;
+			sh->page_count = (shard_end - p - BUFFER_ALIGNMENT) / (SLAB_PAGE_SIZE + sizeof(sh->pages[0]));
+			p += sizeof(sh->pages[0]) * sh->page_count;
+
+			// Note: the pages are aligned to the end of the shard, the entries section grows into
+			//		the pages that were not allocated yet
+			sh->pages_start = (u_char*)((intptr_t)(shard_end - sh->page_count * SLAB_PAGE_SIZE) & (~(BUFFER_ALIGNMENT - 1)));
+			shard_end = sh->pages_start + sh->page_count * SLAB_PAGE_SIZE;
+		}
 
-	// reset the cache status
-	ngx_buffer_cache_reset(sh);
-	sh->reset = 0;
+		sh->entries_start = (ngx_buffer_cache_entry_t*)ngx_align_ptr(p, sizeof(void *));
+		sh->buffers_end = shard_end;
+		sh->access_time = 0;
+		sh->seq = 0;
+		sh->shard_count = shard_count;
+
+		if (shard_count > 1)
+		{
+			if (ngx_shmtx_create(&sh->shard_mutex, &sh->shard_lock, NULL) != NGX_OK)
+			{
+				return NGX_ERROR;
+			}
+
+			sh->mutex = &sh->shard_mutex;
+		}
+		else
+		{
+			sh->mutex = &cache->shpool->mutex;
+		}
+
+		// reset the stats
+		ngx_memzero(&sh->stats, sizeof(sh->stats));
+
+		// reset the cache status
+		ngx_buffer_cache_reset(sh);
+		sh->reset = 0;
+	}
 
 	return NGX_OK;
 }
@@ -196,9 +441,13 @@ ngx_buffer_cache_free_oldest_entry(ngx_buffer_cache_sh_t *cache, uint32_t expira
 
 	// verify the entry is not locked
 	entry = container_of(ngx_queue_head(&cache->used_queue), ngx_buffer_cache_entry_t, queue_node);
-	if (entry->ref_count > 0 &&
-		ngx_time() < entry->access_time + ENTRY_LOCK_EXPIRATION)
+	if (ngx_buffer_cache_entry_locked(entry))
 	{
+		if (!expiration)
+		{
+			// the entries behind the locked entry cannot be reclaimed
+			cache->stats.cache_evictions_blocked++;
+		}
 		return NULL;
 	}
 
@@ -260,6 +509,12 @@ ngx_buffer_cache_get_free_entry(ngx_buffer_cache_sh_t *cache)
 		ngx_queue_insert_tail(&cache->free_queue, &entry->queue_node);
 		return entry;
 	}
+
+	if (cache->policy == BUFFER_CACHE_POLICY_SLAB)
+	{
+		// the caller evicts an entry of the size class it allocates from
+		return NULL;
+	}
 	
 	return ngx_buffer_cache_free_oldest_entry(cache, 0);
 }
@@ -322,6 +577,513 @@ ngx_buffer_cache_get_free_buffer(
 	return NULL;
 }
 
+/* Note: must be called with the mutex locked */
+static void
+ngx_buffer_cache_slab_free_block(ngx_buffer_cache_sh_t *cache, ngx_uint_t class_index, u_char* block)
+{
+	ngx_queue_insert_head(&cache->classes[class_index].free_blocks, (ngx_queue_t*)block);
+	cache->pages[ngx_buffer_cache_slab_get_page(cache, block)].used--;
+}
+
+/* Note: must be called with the mutex locked */
+static void
+ngx_buffer_cache_slab_free_entry(ngx_buffer_cache_sh_t *cache, ngx_buffer_cache_entry_t* entry)
+{
+	ngx_buffer_cache_slab_class_t* slab_class = &cache->classes[entry->slab_class];
+
+	// update the state
+	entry->state = CES_FREE;
+
+	// remove from rb tree
+	ngx_rbtree_delete(&cache->rbtree, &entry->node);
+
+	// move from the class queue to free_queue
+	ngx_queue_remove(&entry->queue_node);
+	ngx_queue_insert_tail(&cache->free_queue, &entry->queue_node);
+
+	slab_class->entry_count--;
+	if (entry->protected_segment)
+	{
+		slab_class->protected_count--;
+	}
+
+	// return the block to the free list of the class
+	ngx_buffer_cache_slab_free_block(cache, entry->slab_class, entry->start_offset);
+
+	// update stats
+	cache->stats.evicted++;
+	cache->stats.evicted_bytes += entry->buffer_size;
+}
+
+/* Note: must be called with the mutex locked */
+static void
+ngx_buffer_cache_slab_demote(ngx_buffer_cache_slab_class_t* slab_class)
+{
+	ngx_buffer_cache_entry_t* entry;
+
+	for (;;)
+	{
+		entry = container_of(ngx_queue_head(&slab_class->protected), ngx_buffer_cache_entry_t, queue_node);
+		ngx_queue_remove(&entry->queue_node);
+
+		if (!entry->accessed)
+		{
+			break;
+		}
+
+		// the entry was fetched while in the protected segment, give it another round
+		entry->accessed = 0;
+		ngx_queue_insert_tail(&slab_class->protected, &entry->queue_node);
+	}
+
+	ngx_queue_insert_tail(&slab_class->probation, &entry->queue_node);
+	entry->protected_segment = 0;
+	slab_class->protected_count--;
+}
+
+/* Note: must be called with the mutex locked */
+static ngx_flag_t
+ngx_buffer_cache_slab_evict(ngx_buffer_cache_sh_t *cache, ngx_buffer_cache_slab_class_t* slab_class)
+{
+	ngx_buffer_cache_entry_t* entry;
+	ngx_uint_t attempts;
+
+	for (attempts = MAX_EVICTIONS_PER_STORE; attempts > 0; attempts--)
+	{
+		if (ngx_queue_empty(&slab_class->probation))
+		{
+			if (ngx_queue_empty(&slab_class->protected))
+			{
+				return 0;
+			}
+
+			ngx_buffer_cache_slab_demote(slab_class);
+			continue;
+		}
+
+		entry = container_of(ngx_queue_head(&slab_class->probation), ngx_buffer_cache_entry_t, queue_node);
+		if (entry->accessed)
+		{
+			// promote to the protected segment
+			entry->accessed = 0;
+			ngx_queue_remove(&entry->queue_node);
+			ngx_queue_insert_tail(&slab_class->protected, &entry->queue_node);
+			entry->protected_segment = 1;
+			slab_class->protected_count++;
+
+			if (slab_class->protected_count * 100 > slab_class->entry_count * SLAB_PROTECTED_PERCENT)
+			{
+				ngx_buffer_cache_slab_demote(slab_class);
+			}
+			continue;
+		}
+
+		if (ngx_buffer_cache_entry_locked(entry))
+		{
+			// skip the entry, the entries behind it can still be evicted
+			cache->stats.cache_evictions_blocked++;
+			ngx_queue_remove(&entry->queue_node);
+			ngx_queue_insert_tail(&slab_class->probation, &entry->queue_node);
+			continue;
+		}
+
+		ngx_buffer_cache_slab_free_entry(cache, entry);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Note: must be called with the mutex locked */
+static void
+ngx_buffer_cache_slab_init_span(ngx_buffer_cache_sh_t *cache, ngx_uint_t page_index, ngx_uint_t class_index)
+{
+	ngx_buffer_cache_slab_class_t* slab_class = &cache->classes[class_index];
+	ngx_uint_t span_pages;
+	ngx_uint_t i;
+	size_t block_size;
+	u_char* block;
+	u_char* end;
+
+	span_pages = ngx_buffer_cache_slab_span_pages(class_index);
+
+	cache->pages[page_index].slab_class = class_index;
+	cache->pages[page_index].used = 0;
+	for (i = 1; i < span_pages; i++)
+	{
+		cache->pages[page_index + i].slab_class = SLAB_PAGE_CONT;
+	}
+
+	// split the span to blocks
+	block_size = ngx_buffer_cache_slab_block_size(class_index);
+	block = cache->pages_start + (page_index << SLAB_PAGE_SHIFT);
+	end = block + (span_pages << SLAB_PAGE_SHIFT);
+	for (; block + block_size <= end; block += block_size)
+	{
+		ngx_queue_insert_tail(&slab_class->free_blocks, (ngx_queue_t*)block);
+	}
+}
+
+/* Note: must be called with the mutex locked */
+static ngx_flag_t
+ngx_buffer_cache_slab_alloc_span(ngx_buffer_cache_sh_t *cache, ngx_uint_t class_index)
+{
+	ngx_uint_t span_pages;
+	ngx_uint_t free_pages;
+	ngx_uint_t i;
+
+	span_pages = ngx_buffer_cache_slab_span_pages(class_index);
+
+	// look for free pages
+	free_pages = 0;
+	for (i = cache->pages_first; i < cache->page_count; i++)
+	{
+		if (cache->pages[i].slab_class != SLAB_PAGE_FREE)
+		{
+			free_pages = 0;
+			continue;
+		}
+
+		free_pages++;
+		if (free_pages >= span_pages)
+		{
+			ngx_buffer_cache_slab_init_span(cache, i + 1 - span_pages, class_index);
+			return 1;
+		}
+	}
+
+	// enlarge the buffers section
+	if (span_pages > cache->pages_first ||
+		cache->pages_start + ((cache->pages_first - span_pages) << SLAB_PAGE_SHIFT) < 
+		(u_char*)(cache->entries_end + ENTRIES_ALLOC_MARGIN))
+	{
+		return 0;
+	}
+
+	cache->pages_first -= span_pages;
+	cache->buffers_start = cache->pages_start + (cache->pages_first << SLAB_PAGE_SHIFT);
+
+	ngx_buffer_cache_slab_init_span(cache, cache->pages_first, class_index);
+	return 1;
+}
+
+/* Note: must be called with the mutex locked */
+static ngx_flag_t
+ngx_buffer_cache_slab_span_locked(ngx_buffer_cache_sh_t *cache, ngx_uint_t page_index)
+{
+	ngx_buffer_cache_slab_class_t* slab_class;
+	ngx_buffer_cache_entry_t* entry;
+	ngx_queue_t* queues[2];
+	ngx_queue_t* cur;
+	ngx_uint_t class_index;
+	ngx_uint_t i;
+	u_char* start;
+	u_char* end;
+
+	if (cache->pages[page_index].used <= 0)
+	{
+		return 0;
+	}
+
+	class_index = cache->pages[page_index].slab_class;
+	slab_class = &cache->classes[class_index];
+	start = cache->pages_start + (page_index << SLAB_PAGE_SHIFT);
+	end = start + (ngx_buffer_cache_slab_span_pages(class_index) << SLAB_PAGE_SHIFT);
+
+	queues[0] = &slab_class->probation;
+	queues[1] = &slab_class->protected;
+
+	for (i = 0; i < sizeof(queues) / sizeof(queues[0]); i++)
+	{
+		for (cur = ngx_queue_head(queues[i]); cur != ngx_queue_sentinel(queues[i]); cur = ngx_queue_next(cur))
+		{
+			entry = container_of(cur, ngx_buffer_cache_entry_t, queue_node);
+			if (entry->start_offset >= start && entry->start_offset < end &&
+				ngx_buffer_cache_entry_locked(entry))
+			{
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Note: must be called with the mutex locked, the span must not be locked (ngx_buffer_cache_slab_span_locked) */
+static void
+ngx_buffer_cache_slab_free_span(ngx_buffer_cache_sh_t *cache, ngx_uint_t page_index)
+{
+	ngx_buffer_cache_slab_class_t* slab_class;
+	ngx_buffer_cache_entry_t* entry;
+	ngx_queue_t* queues[2];
+	ngx_queue_t* cur;
+	ngx_queue_t* next;
+	ngx_uint_t class_index;
+	ngx_uint_t span_pages;
+	ngx_uint_t i;
+	size_t block_size;
+	u_char* start;
+	u_char* end;
+	u_char* block;
+
+	class_index = cache->pages[page_index].slab_class;
+	slab_class = &cache->classes[class_index];
+	span_pages = ngx_buffer_cache_slab_span_pages(class_index);
+	start = cache->pages_start + (page_index << SLAB_PAGE_SHIFT);
+	end = start + (span_pages << SLAB_PAGE_SHIFT);
+
+	queues[0] = &slab_class->probation;
+	queues[1] = &slab_class->protected;
+
+	if (cache->pages[page_index].used > 0)
+	{
+		// evict the entries of the span
+		for (i = 0; i < sizeof(queues) / sizeof(queues[0]); i++)
+		{
+			for (cur = ngx_queue_head(queues[i]); cur != ngx_queue_sentinel(queues[i]); cur = next)
+			{
+				next = ngx_queue_next(cur);
+
+				entry = container_of(cur, ngx_buffer_cache_entry_t, queue_node);
+				if (entry->start_offset >= start && entry->start_offset < end)
+				{
+					ngx_buffer_cache_slab_free_entry(cache, entry);
+				}
+			}
+		}
+	}
+
+	// remove the blocks from the free list of the class
+	block_size = ngx_buffer_cache_slab_block_size(class_index);
+	for (block = start; block + block_size <= end; block += block_size)
+	{
+		ngx_queue_remove((ngx_queue_t*)block);
+	}
+
+	for (i = 0; i < span_pages; i++)
+	{
+		cache->pages[page_index + i].slab_class = SLAB_PAGE_FREE;
+	}
+	cache->pages[page_index].used = 0;
+}
+
+/* Note: must be called with the mutex locked */
+static ngx_uint_t
+ngx_buffer_cache_slab_page_span(ngx_buffer_cache_sh_t *cache, ngx_uint_t page_index)
+{
+	if (cache->pages[page_index].slab_class == SLAB_PAGE_FREE)
+	{
+		return 1;
+	}
+
+	return ngx_buffer_cache_slab_span_pages(cache->pages[page_index].slab_class);
+}
+
+/* Note: must be called with the mutex locked */
+static ngx_flag_t
+ngx_buffer_cache_slab_reclaim(ngx_buffer_cache_sh_t *cache, ngx_uint_t class_index)
+{
+	ngx_uint_t span_pages;
+	ngx_uint_t cur_pages;
+	ngx_uint_t attempts;
+	ngx_uint_t start;
+	ngx_uint_t end;
+	ngx_uint_t i;
+
+	span_pages = ngx_buffer_cache_slab_span_pages(class_index);
+	if (span_pages > cache->page_count - cache->pages_first)
+	{
+		return 0;
+	}
+
+	for (attempts = SLAB_MAX_RECLAIM_ATTEMPTS; attempts > 0; attempts--)
+	{
+		// free a window of pages, starting from the reclaim cursor
+		start = cache->reclaim_cursor;
+		if (start < cache->pages_first || start + span_pages > cache->page_count)
+		{
+			start = cache->pages_first;
+		}
+
+		while (cache->pages[start].slab_class == SLAB_PAGE_CONT)
+		{
+			start--;
+		}
+
+		end = start + span_pages;
+		cache->reclaim_cursor = end;
+
+		// Note: the entries are evicted only once all the spans of the window are known to be unlocked,
+		//		otherwise the window cannot be used, and the evictions would be for nothing
+		for (i = start; i < end; i += ngx_buffer_cache_slab_page_span(cache, i))
+		{
+			if (ngx_buffer_cache_slab_span_locked(cache, i))
+			{
+				break;
+			}
+		}
+
+		if (i < end)
+		{
+			cache->stats.cache_evictions_blocked++;
+			continue;
+		}
+
+		for (i = start; i < end; i += cur_pages)
+		{
+			cur_pages = ngx_buffer_cache_slab_page_span(cache, i);
+			if (cache->pages[i].slab_class != SLAB_PAGE_FREE)
+			{
+				ngx_buffer_cache_slab_free_span(cache, i);
+			}
+		}
+
+		ngx_buffer_cache_slab_init_span(cache, start, class_index);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Note: must be called with the mutex locked */
+static u_char*
+ngx_buffer_cache_slab_alloc(
+	ngx_buffer_cache_sh_t *cache,
+	size_t size,
+	ngx_buffer_cache_entry_t** result)
+{
+	ngx_buffer_cache_slab_class_t* slab_class;
+	ngx_buffer_cache_entry_t* entry;
+	ngx_uint_t class_index;
+	ngx_queue_t* block;
+
+	class_index = ngx_buffer_cache_slab_get_class(size);
+	if (class_index >= SLAB_CLASS_COUNT)
+	{
+		return NULL;
+	}
+
+	slab_class = &cache->classes[class_index];
+
+	// allocate an entry
+	entry = ngx_buffer_cache_get_free_entry(cache);
+	if (entry == NULL)
+	{
+		if (!ngx_buffer_cache_slab_evict(cache, slab_class) &&
+			!ngx_buffer_cache_slab_reclaim(cache, class_index))
+		{
+			return NULL;
+		}
+
+		entry = ngx_buffer_cache_get_free_entry(cache);
+		if (entry == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	// allocate a block
+	if (ngx_queue_empty(&slab_class->free_blocks) &&
+		!ngx_buffer_cache_slab_alloc_span(cache, class_index) &&
+		!ngx_buffer_cache_slab_evict(cache, slab_class) &&
+		!ngx_buffer_cache_slab_reclaim(cache, class_index))
+	{
+		return NULL;
+	}
+
+	block = ngx_queue_head(&slab_class->free_blocks);
+	ngx_queue_remove(block);
+	cache->pages[ngx_buffer_cache_slab_get_page(cache, (u_char*)block)].used++;
+
+	entry->slab_class = class_index;
+	*result = entry;
+
+	return (u_char*)block;
+}
+
+static ngx_int_t
+ngx_buffer_cache_fetch_lockless(
+	ngx_buffer_cache_t* cache,
+	ngx_buffer_cache_sh_t *sh,
+	u_char* key,
+	uint32_t hash,
+	ngx_str_t* buffer,
+	uint32_t* token)
+{
+	ngx_buffer_cache_entry_t* entry;
+	ngx_atomic_uint_t ref_count;
+	ngx_atomic_uint_t seq;
+	time_t write_time;
+
+	seq = sh->seq;
+	ngx_memory_barrier();
+
+	if ((seq & 1) != 0 || sh->reset)
+	{
+		return NGX_AGAIN;
+	}
+
+	entry = ngx_buffer_cache_rbtree_lookup_lockless(sh, key, hash);
+	if (entry == NULL || entry->state != CES_READY ||
+		(cache->expiration != 0 && ngx_time() >= (time_t)(entry->write_time + cache->expiration)))
+	{
+		ngx_memory_barrier();
+		if (sh->seq != seq)
+		{
+			return NGX_AGAIN;
+		}
+
+		// update stats
+		(void)ngx_atomic_fetch_add(&sh->stats.fetch_miss, 1);
+		return NGX_DECLINED;
+	}
+
+	// Note: the ref count is incremented before validating the seq, if the seq did not change, 
+	//		any writer that will try to free the entry later will see the updated ref count.
+	//		the reference is taken with a compare and set on a ready entry, an entry that is being 
+	//		written is never referenced by a reader
+	entry->access_time = ngx_time();
+
+	for (;;)
+	{
+		ref_count = entry->ref_count;
+		ngx_memory_barrier();
+
+		if (entry->state != CES_READY)
+		{
+			return NGX_AGAIN;
+		}
+
+		if (ngx_atomic_cmp_set(&entry->ref_count, ref_count, ref_count + 1))
+		{
+			break;
+		}
+	}
+
+	entry->accessed = 1;
+
+	buffer->data = entry->start_offset;
+	buffer->len = entry->buffer_size;
+	write_time = entry->write_time;
+
+	ngx_memory_barrier();
+
+	if (sh->seq != seq)
+	{
+		(void)ngx_atomic_fetch_add(&entry->ref_count, -1);
+		return NGX_AGAIN;
+	}
+
+	*token = write_time;
+	sh->access_time = ngx_time();
+
+	// update stats
+	(void)ngx_atomic_fetch_add(&sh->stats.fetch_hit, 1);
+	(void)ngx_atomic_fetch_add(&sh->stats.fetch_bytes, buffer->len);
+
+	return NGX_OK;
+}
+
 ngx_flag_t
 ngx_buffer_cache_fetch(
 	ngx_buffer_cache_t* cache,
@@ -330,13 +1092,25 @@ ngx_buffer_cache_fetch(
 	uint32_t* token)
 {
 	ngx_buffer_cache_entry_t* entry;
-	ngx_buffer_cache_sh_t *sh = cache->sh;
+	ngx_buffer_cache_sh_t *sh;
 	ngx_flag_t result = 0;
+	ngx_int_t rc;
 	uint32_t hash;
 
 	hash = ngx_crc32_short(key, BUFFER_CACHE_KEY_SIZE);
 
-	ngx_shmtx_lock(&cache->shpool->mutex);
+	sh = ngx_buffer_cache_get_shard(cache, hash);
+
+	if (cache->shard_count > 1)
+	{
+		rc = ngx_buffer_cache_fetch_lockless(cache, sh, key, hash, buffer, token);
+		if (rc != NGX_AGAIN)
+		{
+			return rc == NGX_OK;
+		}
+	}
+
+	ngx_shmtx_lock(sh->mutex);
 
 	if (!sh->reset)
 	{
@@ -347,8 +1121,8 @@ ngx_buffer_cache_fetch(
 			result = 1;
 
 			// update stats
-			sh->stats.fetch_hit++;
-			sh->stats.fetch_bytes += entry->buffer_size;
+			(void)ngx_atomic_fetch_add(&sh->stats.fetch_hit, 1);
+			(void)ngx_atomic_fetch_add(&sh->stats.fetch_bytes, entry->buffer_size);
 
 			// copy buffer pointer and size
 			buffer->data = entry->start_offset;
@@ -358,16 +1132,17 @@ ngx_buffer_cache_fetch(
 			// Note: setting the access time of the entry and cache to prevent it 
 			//		from being freed while the caller uses the buffer
 			sh->access_time = entry->access_time = ngx_time();
+			entry->accessed = 1;
 			(void)ngx_atomic_fetch_add(&entry->ref_count, 1);
 		}
 		else
 		{
 			// update stats
-			sh->stats.fetch_miss++;
+			(void)ngx_atomic_fetch_add(&sh->stats.fetch_miss, 1);
 		}
 	}
 
-	ngx_shmtx_unlock(&cache->shpool->mutex);
+	ngx_shmtx_unlock(sh->mutex);
 
 	return result;
 }
@@ -379,12 +1154,37 @@ ngx_buffer_cache_release(
 	uint32_t token)
 {
 	ngx_buffer_cache_entry_t* entry;
-	ngx_buffer_cache_sh_t *sh = cache->sh;
+	ngx_buffer_cache_sh_t *sh;
+	ngx_atomic_uint_t seq;
 	uint32_t hash;
 
 	hash = ngx_crc32_short(key, BUFFER_CACHE_KEY_SIZE);
 
-	ngx_shmtx_lock(&cache->shpool->mutex);
+	sh = ngx_buffer_cache_get_shard(cache, hash);
+
+	if (cache->shard_count > 1)
+	{
+		seq = sh->seq;
+		ngx_memory_barrier();
+
+		if ((seq & 1) == 0 && !sh->reset)
+		{
+			entry = ngx_buffer_cache_rbtree_lookup_lockless(sh, key, hash);
+			ngx_memory_barrier();
+
+			if (sh->seq == seq)
+			{
+				// Note: the entry cannot be freed before the ref count is decremented
+				if (entry != NULL && entry->state == CES_READY && (uint32_t)entry->write_time == token)
+				{
+					(void)ngx_atomic_fetch_add(&entry->ref_count, -1);
+				}
+				return;
+			}
+		}
+	}
+
+	ngx_shmtx_lock(sh->mutex);
 
 	if (!sh->reset)
 	{
@@ -395,7 +1195,7 @@ ngx_buffer_cache_release(
 		}
 	}
 
-	ngx_shmtx_unlock(&cache->shpool->mutex);
+	ngx_shmtx_unlock(sh->mutex);
 }
 
 ngx_flag_t
@@ -405,8 +1205,9 @@ ngx_buffer_cache_store_gather(
 	ngx_str_t* buffers,
 	size_t buffer_count)
 {
+	ngx_buffer_cache_slab_class_t* slab_class;
 	ngx_buffer_cache_entry_t* entry;
-	ngx_buffer_cache_sh_t *sh = cache->sh;
+	ngx_buffer_cache_sh_t *sh;
 	ngx_str_t* cur_buffer;
 	ngx_str_t* last_buffer;
 	size_t buffer_size;
@@ -416,7 +1217,9 @@ ngx_buffer_cache_store_gather(
 
 	hash = ngx_crc32_short(key, BUFFER_CACHE_KEY_SIZE);
 
-	ngx_shmtx_lock(&cache->shpool->mutex);
+	sh = ngx_buffer_cache_get_shard(cache, hash);
+
+	ngx_shmtx_lock(sh->mutex);
 
 	if (sh->reset)
 	{
@@ -426,10 +1229,12 @@ ngx_buffer_cache_store_gather(
 		// writing to the cache
 		if (ngx_time() < sh->access_time + CACHE_LOCK_EXPIRATION)
 		{
-			ngx_shmtx_unlock(&cache->shpool->mutex);
+			ngx_shmtx_unlock(sh->mutex);
 			return 0;
 		}
 
+		ngx_buffer_cache_write_start(sh);
+
 		// reset the cache, leave the reset flag enabled
 		ngx_buffer_cache_reset(sh);
 
@@ -438,8 +1243,12 @@ ngx_buffer_cache_store_gather(
 	}
 	else
 	{
+		// enable the reset flag before we start making any changes
+		ngx_buffer_cache_write_start(sh);
+		sh->reset = 1;
+
 		// remove expired entries
-		if (cache->expiration)
+		if (cache->expiration && sh->policy == BUFFER_CACHE_POLICY_RING)
 		{
 			for (evictions = MAX_EVICTIONS_PER_STORE; evictions > 0; evictions--)
 			{
@@ -452,22 +1261,24 @@ ngx_buffer_cache_store_gather(
 
 		// make sure the entry does not already exist
 		entry = ngx_buffer_cache_rbtree_lookup(&sh->rbtree, key, hash);
+		if (entry != NULL && sh->policy == BUFFER_CACHE_POLICY_SLAB && cache->expiration &&
+			ngx_time() >= (time_t)(entry->write_time + cache->expiration) &&
+			!ngx_buffer_cache_entry_locked(entry))
+		{
+			// Note: with the slab policy, the entries are not ordered by write time, 
+			//		expired entries are freed when they are replaced or evicted
+			ngx_buffer_cache_slab_free_entry(sh, entry);
+			entry = NULL;
+		}
+
 		if (entry != NULL)
 		{
 			sh->stats.store_exists++;
-			ngx_shmtx_unlock(&cache->shpool->mutex);
+			sh->reset = 0;
+			ngx_buffer_cache_write_end(sh);
+			ngx_shmtx_unlock(sh->mutex);
 			return 0;
 		}
-
-		// enable the reset flag before we start making any changes
-		sh->reset = 1;
-	}
-
-	// allocate a new entry
-	entry = ngx_buffer_cache_get_free_entry(sh);
-	if (entry == NULL)
-	{
-		goto error;
 	}
 
 	// calculate the buffer size
@@ -478,27 +1289,72 @@ ngx_buffer_cache_store_gather(
 		buffer_size += cur_buffer->len;
 	}
 
-	// allocate a buffer to hold the data
-	target_buffer = ngx_buffer_cache_get_free_buffer(sh, buffer_size + 1);
-	if (target_buffer == NULL)
+	if (sh->policy == BUFFER_CACHE_POLICY_SLAB)
+	{
+		// allocate a new entry and a buffer to hold the data
+		target_buffer = ngx_buffer_cache_slab_alloc(sh, buffer_size + 1, &entry);
+		if (target_buffer == NULL)
+		{
+			goto error;
+		}
+	}
+	else
 	{
+		// allocate a new entry
+		entry = ngx_buffer_cache_get_free_entry(sh);
+		if (entry == NULL)
+		{
+			goto error;
+		}
+
+		// allocate a buffer to hold the data
+		target_buffer = ngx_buffer_cache_get_free_buffer(sh, buffer_size + 1);
+		if (target_buffer == NULL)
+		{
+			goto error;
+		}
+	}
+
+	// lock the entry
+	if (!ngx_buffer_cache_entry_lock_for_write(entry))
+	{
+		// a lockless fetch that lost a race still holds a reference to the entry, it will be reused later
+		ngx_queue_remove(&entry->queue_node);
+		ngx_queue_insert_tail(&sh->free_queue, &entry->queue_node);
+
+		if (sh->policy == BUFFER_CACHE_POLICY_SLAB)
+		{
+			ngx_buffer_cache_slab_free_block(sh, entry->slab_class, target_buffer);
+		}
 		goto error;
 	}
 
 	// initialize the entry
 	entry->state = CES_ALLOCATED;
-	entry->ref_count = 1;
 	entry->node.key = hash;
 	memcpy(entry->key, key, BUFFER_CACHE_KEY_SIZE);
 	entry->start_offset = target_buffer;
 	entry->buffer_size = buffer_size;
+	entry->accessed = 0;
 
-	// update the write position
-	sh->buffers_write = target_buffer;
-
-	// move from free_queue to used_queue
 	ngx_queue_remove(&entry->queue_node);
-	ngx_queue_insert_tail(&sh->used_queue, &entry->queue_node);
+
+	if (sh->policy == BUFFER_CACHE_POLICY_SLAB)
+	{
+		// insert to the probation segment of the class
+		slab_class = &sh->classes[entry->slab_class];
+		ngx_queue_insert_tail(&slab_class->probation, &entry->queue_node);
+		entry->protected_segment = 0;
+		slab_class->entry_count++;
+	}
+	else
+	{
+		// update the write position
+		sh->buffers_write = target_buffer;
+
+		// move from free_queue to used_queue
+		ngx_queue_insert_tail(&sh->used_queue, &entry->queue_node);
+	}
 
 	// insert to rbtree
 	ngx_rbtree_insert(&sh->rbtree, &entry->node);
@@ -513,7 +1369,8 @@ ngx_buffer_cache_store_gather(
 	entry->write_time = ngx_time();
 
 	sh->reset = 0;
-	ngx_shmtx_unlock(&cache->shpool->mutex);
+	ngx_buffer_cache_write_end(sh);
+	ngx_shmtx_unlock(sh->mutex);
 
 	for (cur_buffer = buffers; cur_buffer < last_buffer; cur_buffer++)
 	{
@@ -522,6 +1379,7 @@ ngx_buffer_cache_store_gather(
 	*target_buffer = '\0';
 
 	// Note: no need to obtain the lock since state is ngx_atomic_t
+	ngx_memory_barrier();
 	entry->state = CES_READY;
 	(void)ngx_atomic_fetch_add(&entry->ref_count, -1);
 
@@ -530,7 +1388,8 @@ ngx_buffer_cache_store_gather(
 error:
 	sh->stats.store_err++;
 	sh->reset = 0;
-	ngx_shmtx_unlock(&cache->shpool->mutex);
+	ngx_buffer_cache_write_end(sh);
+	ngx_shmtx_unlock(sh->mutex);
 	return 0;
 }
 
@@ -554,30 +1413,50 @@ ngx_buffer_cache_get_stats(
 	ngx_buffer_cache_t* cache,
 	ngx_buffer_cache_stats_t* stats)
 {
-	ngx_buffer_cache_sh_t *sh = cache->sh;
+	ngx_buffer_cache_sh_t *sh_end = cache->sh + cache->shard_count;
+	ngx_buffer_cache_sh_t *sh;
+	ngx_atomic_t* src;
+	ngx_atomic_t* dest;
+	ngx_atomic_t* dest_end;
 
-	ngx_shmtx_lock(&cache->shpool->mutex);
+	ngx_memzero(stats, sizeof(*stats));
 
-	memcpy(stats, &sh->stats, sizeof(sh->stats));
+	dest_end = (ngx_atomic_t*)&stats->entries;		// entries & data_size are calculated
 
-	stats->entries = sh->entries_end - sh->entries_start;
-	stats->data_size = sh->buffers_end - sh->buffers_start;
+	for (sh = cache->sh; sh < sh_end; sh++)
+	{
+		ngx_shmtx_lock(sh->mutex);
 
-	ngx_shmtx_unlock(&cache->shpool->mutex);
+		for (src = (ngx_atomic_t*)&sh->stats, dest = (ngx_atomic_t*)stats; dest < dest_end; src++, dest++)
+		{
+			*dest += *src;
+		}
+
+		stats->entries += sh->entries_end - sh->entries_start;
+		stats->data_size += sh->buffers_end - sh->buffers_start;
+
+		ngx_shmtx_unlock(sh->mutex);
+	}
 }
 
 void
 ngx_buffer_cache_reset_stats(ngx_buffer_cache_t* cache)
 {
-	ngx_shmtx_lock(&cache->shpool->mutex);
+	ngx_buffer_cache_sh_t *sh_end = cache->sh + cache->shard_count;
+	ngx_buffer_cache_sh_t *sh;
 
-	ngx_memzero(&cache->sh->stats, sizeof(cache->sh->stats));
+	for (sh = cache->sh; sh < sh_end; sh++)
+	{
+		ngx_shmtx_lock(sh->mutex);
 
-	ngx_shmtx_unlock(&cache->shpool->mutex);
+		ngx_memzero(&sh->stats, sizeof(sh->stats));
+
+		ngx_shmtx_unlock(sh->mutex);
+	}
 }
 
 ngx_buffer_cache_t*
-ngx_buffer_cache_create(ngx_conf_t *cf, ngx_str_t *name, size_t size, time_t expiration, void *tag)
+ngx_buffer_cache_create(ngx_conf_t *cf, ngx_str_t *name, size_t size, time_t expiration, ngx_uint_t shard_count, ngx_uint_t policy, void *tag)
 {
 	ngx_buffer_cache_t* cache;
 
@@ -588,6 +1467,20 @@ ngx_buffer_cache_create(ngx_conf_t *cf, ngx_str_t *name, size_t size, time_t exp
 	}
 
 	cache->expiration = expiration;
+	cache->policy = policy;
+
+#if (NGX_HAVE_ATOMIC_OPS)
+	cache->shard_count = shard_count;
+#else
+	// Note: without atomic ops, shared memory mutexes are implemented with lock files
+	if (shard_count > 1)
+	{
+		ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+			"sharded buffer cache is not supported on this platform, using a single shard");
+	}
+
+	cache->shard_count = 1;
+#endif // NGX_HAVE_ATOMIC_OPS
 
 	cache->shm_zone = ngx_shared_memory_add(cf, name, size, tag);
 	if (cache->shm_zone == NULL)
@@ -6,6 +6,15 @@
 
 // constants
 #define BUFFER_CACHE_KEY_SIZE (16)
+#define BUFFER_CACHE_MAX_SHARDS (64)
+#define BUFFER_CACHE_MIN_SHARD_SIZE (1024 * 1024)
+#define BUFFER_CACHE_MIN_SLAB_SHARD_SIZE (8 * 1024 * 1024)
+
+// enums
+enum {
+	BUFFER_CACHE_POLICY_RING,
+	BUFFER_CACHE_POLICY_SLAB,
+};
 
 // typedefs
 struct ngx_buffer_cache_s;
@@ -21,6 +30,7 @@ typedef struct {
 	ngx_atomic_t fetch_miss;
 	ngx_atomic_t evicted;
 	ngx_atomic_t evicted_bytes;
+	ngx_atomic_t cache_evictions_blocked;
 	ngx_atomic_t reset;
 
 	// updated only when the stats are fetched
@@ -63,6 +73,8 @@ ngx_buffer_cache_t* ngx_buffer_cache_create(
 	ngx_str_t *name, 
 	size_t size, 
 	time_t expiration, 
+	ngx_uint_t shard_count,
+	ngx_uint_t policy,
 	void *tag);
 
 #endif // _NGX_BUFFER_CACHE_H_INCLUDED_
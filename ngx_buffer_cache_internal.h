@@ -13,6 +13,17 @@
 #define ENTRIES_ALLOC_MARGIN (1024)		// 1K entries ~= 100KB, we reserve this space to make sure allocating entries does not become the bottleneck
 #define BUFFER_ALIGNMENT (16)
 #define MAX_EVICTIONS_PER_STORE (128)
+#define MAX_LOCKLESS_LOOKUP_DEPTH (128)	// much larger than the depth of any valid rbtree that fits in memory
+
+#define SLAB_MIN_SHIFT (8)				// smallest block size is 256 bytes
+#define SLAB_MAX_SHIFT (30)
+#define SLAB_CLASS_COUNT (4 * (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT))	// 4 classes per power of 2
+#define SLAB_PAGE_SHIFT (20)
+#define SLAB_PAGE_SIZE (1 << SLAB_PAGE_SHIFT)
+#define SLAB_PAGE_FREE (0xffffffff)
+#define SLAB_PAGE_CONT (0xfffffffe)		// a non-first page of a multi page span
+#define SLAB_PROTECTED_PERCENT (80)		// max share of the protected segment out of the entries of a class
+#define SLAB_MAX_RECLAIM_ATTEMPTS (4)
 
 // enums
 enum {
@@ -31,9 +42,25 @@ typedef struct {
 	ngx_atomic_t ref_count;
 	time_t access_time;
 	time_t write_time;
+	ngx_atomic_t accessed;		// set on fetch, used by the slab policy to promote the entry to the protected segment
+	uint32_t slab_class;
+	uint32_t protected_segment;
 	u_char key[BUFFER_CACHE_KEY_SIZE];
 } ngx_buffer_cache_entry_t;
 
+typedef struct {
+	ngx_queue_t free_blocks;
+	ngx_queue_t probation;
+	ngx_queue_t protected;
+	ngx_uint_t entry_count;
+	ngx_uint_t protected_count;
+} ngx_buffer_cache_slab_class_t;
+
+typedef struct {
+	uint32_t slab_class;		// SLAB_PAGE_FREE / SLAB_PAGE_CONT / index of the class that owns the span
+	uint32_t used;				// number of allocated blocks, set on the first page of the span
+} ngx_buffer_cache_page_t;
+
 typedef struct {
 	ngx_atomic_t reset;
 	time_t access_time;
@@ -48,13 +75,29 @@ typedef struct {
 	u_char* buffers_read;
 	u_char* buffers_write;
 	ngx_buffer_cache_stats_t stats;
+	ngx_shmtx_t* mutex;
+	ngx_shmtx_t shard_mutex;	// used only when the cache is sharded, otherwise mutex points to the slab pool mutex
+	ngx_shmtx_sh_t shard_lock;
+	ngx_atomic_t seq;			// odd while the rbtree / entries are being modified, used for lockless lookups
+	ngx_uint_t shard_count;		// set on the first shard only
+	ngx_uint_t policy;
+
+	// slab policy only
+	ngx_buffer_cache_slab_class_t* classes;
+	ngx_buffer_cache_page_t* pages;
+	u_char* pages_start;
+	ngx_uint_t page_count;
+	ngx_uint_t pages_first;		// index of the first page of the buffers section
+	ngx_uint_t reclaim_cursor;
 } ngx_buffer_cache_sh_t;
 
 struct ngx_buffer_cache_s {
-	ngx_buffer_cache_sh_t *sh;
+	ngx_buffer_cache_sh_t *sh;		// array of shard_count shards
 	ngx_slab_pool_t *shpool;
 
 	uint32_t expiration;
+	ngx_uint_t shard_count;
+	ngx_uint_t policy;
 
 	ngx_shm_zone_t *shm_zone;
 };
@@ -91,6 +91,7 @@ ngx_file_reader_update_state_file_info(ngx_file_reader_state_t* state, ngx_open_
 
 	state->file.fd = of->fd;
 	state->file_size = of->size;
+	state->file_mtime = of->mtime;
 
 	return NGX_OK;
 }
@@ -112,7 +113,7 @@ ngx_file_reader_init(
 	state->file.name = *path;
 	state->file.log = r->connection->log;
 	state->directio = clcf->directio;
-	state->log_not_found = clcf->log_not_found;
+	state->log_not_found = clcf->log_not_found && (flags & OPEN_FILE_NO_LOG_NOT_FOUND) == 0;
 	state->log = r->connection->log;
 #if (NGX_HAVE_FILE_AIO)
 	state->use_aio = clcf->aio;
@@ -154,7 +155,10 @@ ngx_file_reader_async_open_callback(void* ctx, ngx_int_t rc)
 	ngx_connection_t *c = r->connection;
 
 	r->main->blocked--;
-	r->aio = 0;
+	if (r->main->blocked == 0)
+	{
+		r->aio = 0;		// Note: several files may be opened concurrently, see vod_parallel_open_files
+	}
 
 	rc = ngx_file_reader_update_state_file_info(state, &context->of, rc);
 
@@ -183,7 +187,7 @@ ngx_file_reader_init_async(
 	state->file.name = *path;
 	state->file.log = r->connection->log;
 	state->directio = clcf->directio;
-	state->log_not_found = clcf->log_not_found;
+	state->log_not_found = clcf->log_not_found && (flags & OPEN_FILE_NO_LOG_NOT_FOUND) == 0;
 	state->log = r->connection->log;
 #if (NGX_HAVE_FILE_AIO)
 	state->use_aio = clcf->aio;
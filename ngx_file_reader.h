@@ -13,6 +13,7 @@
 
 // constants
 #define OPEN_FILE_NO_CACHE (0x1)
+#define OPEN_FILE_NO_LOG_NOT_FOUND (0x2)
 
 // typedefs
 typedef void (*ngx_async_read_callback_t)(void* context, ngx_int_t rc, ngx_buf_t* buf, ssize_t bytes_read);
@@ -24,6 +25,7 @@ typedef struct {
 	ngx_flag_t log_not_found;
 	ngx_log_t* log;
 	off_t file_size;
+	time_t file_mtime;
 #if (NGX_HAVE_FILE_AIO)
 	ngx_flag_t use_aio;
 	ngx_async_read_callback_t read_callback;
@@ -11,8 +11,13 @@
 #include "vod/common.h"
 #include "vod/udrm.h"
 
+#if (NGX_HAVE_OPENSSL_EVP)
+#include "vod/aes_cipher_cache.h"
+#endif // NGX_HAVE_OPENSSL_EVP
+
 #if (NGX_HAVE_LIB_AV_CODEC)
 #include "ngx_http_vod_thumb.h"
+#include "vod/codec_context_pool.h"
 #endif // NGX_HAVE_LIB_AV_CODEC
 
 // globals
@@ -84,10 +89,12 @@ ngx_http_vod_create_loc_conf(ngx_conf_t *cf)
 	conf->force_sequence_index = NGX_CONF_UNSET;
 	conf->initial_read_size = NGX_CONF_UNSET_SIZE;
 	conf->max_metadata_size = NGX_CONF_UNSET_SIZE;
+	conf->metadata_index = NGX_CONF_UNSET;
 	conf->max_frames_size = NGX_CONF_UNSET_SIZE;
 	conf->max_frame_count = NGX_CONF_UNSET_UINT;
 	conf->segment_max_frame_count = NGX_CONF_UNSET_UINT;
 	conf->cache_buffer_size = NGX_CONF_UNSET_SIZE;
+	conf->read_ahead_buffers = NGX_CONF_UNSET_UINT;
 	conf->max_upstream_headers_size = NGX_CONF_UNSET_SIZE;
 	conf->ignore_edit_list = NGX_CONF_UNSET;
 	conf->parse_hdlr_name = NGX_CONF_UNSET;
@@ -95,7 +102,12 @@ ngx_http_vod_create_loc_conf(ngx_conf_t *cf)
 	conf->max_mapping_response_size = NGX_CONF_UNSET_SIZE;
 
 	conf->metadata_cache = NGX_CONF_UNSET_PTR;
+	conf->audio_filter_cache = NGX_CONF_UNSET_PTR;
+	conf->segment_cache = NGX_CONF_UNSET_PTR;
+	conf->segment_cache_max_size = NGX_CONF_UNSET_SIZE;
+	conf->segment_cache_min_uses = NGX_CONF_UNSET_UINT;
 	conf->dynamic_mapping_cache = NGX_CONF_UNSET_PTR;
+	conf->mapping_cache_binary = NGX_CONF_UNSET;
 	for (type = 0; type < CACHE_TYPE_COUNT; type++)
 	{
 		conf->response_cache[type] = NGX_CONF_UNSET_PTR;
@@ -117,6 +129,8 @@ ngx_http_vod_create_loc_conf(ngx_conf_t *cf)
 
 #if (NGX_THREADS)
 	conf->open_file_thread_pool = NGX_CONF_UNSET_PTR;
+	conf->parallel_open_files = NGX_CONF_UNSET;
+	conf->audio_filter_thread_pool = NGX_CONF_UNSET_PTR;
 #endif // NGX_THREADS
 
 	// submodules
@@ -190,7 +204,18 @@ ngx_http_vod_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 	}
 
 	ngx_conf_merge_ptr_value(conf->metadata_cache, prev->metadata_cache, NULL);
+	ngx_conf_merge_ptr_value(conf->audio_filter_cache, prev->audio_filter_cache, NULL);
+#if (NGX_HAVE_LIB_AV_CODEC)
+	if (conf->codec_context_pool == NULL)
+	{
+		conf->codec_context_pool = prev->codec_context_pool;
+	}
+#endif // NGX_HAVE_LIB_AV_CODEC
+	ngx_conf_merge_ptr_value(conf->segment_cache, prev->segment_cache, NULL);
+	ngx_conf_merge_size_value(conf->segment_cache_max_size, prev->segment_cache_max_size, 4 * 1024 * 1024);
+	ngx_conf_merge_uint_value(conf->segment_cache_min_uses, prev->segment_cache_min_uses, 2);
 	ngx_conf_merge_ptr_value(conf->dynamic_mapping_cache, prev->dynamic_mapping_cache, NULL);
+	ngx_conf_merge_value(conf->mapping_cache_binary, prev->mapping_cache_binary, 0);
 
 	for (type = 0; type < CACHE_TYPE_COUNT; type++)
 	{
@@ -205,10 +230,12 @@ ngx_http_vod_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 
 	ngx_conf_merge_size_value(conf->initial_read_size, prev->initial_read_size, 4096);
 	ngx_conf_merge_size_value(conf->max_metadata_size, prev->max_metadata_size, 128 * 1024 * 1024);
+	ngx_conf_merge_value(conf->metadata_index, prev->metadata_index, 0);
 	ngx_conf_merge_size_value(conf->max_frames_size, prev->max_frames_size, 16 * 1024 * 1024);
 	ngx_conf_merge_uint_value(conf->max_frame_count, prev->max_frame_count, 1024 * 1024);
 	ngx_conf_merge_uint_value(conf->segment_max_frame_count, prev->segment_max_frame_count, 64 * 1024);
 	ngx_conf_merge_size_value(conf->cache_buffer_size, prev->cache_buffer_size, 256 * 1024);
+	ngx_conf_merge_uint_value(conf->read_ahead_buffers, prev->read_ahead_buffers, 0);
 	ngx_conf_merge_size_value(conf->max_upstream_headers_size, prev->max_upstream_headers_size, 4 * 1024);
 
 	if (conf->output_buffer_pool == NULL)
@@ -293,6 +320,10 @@ ngx_http_vod_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 	ngx_conf_merge_str_value(conf->drm_upstream_location, prev->drm_upstream_location, "");
 	ngx_conf_merge_size_value(conf->drm_max_info_length, prev->drm_max_info_length, 4096);
 	ngx_conf_merge_ptr_value(conf->drm_info_cache, prev->drm_info_cache, NULL);
+	if (conf->drm_cipher_cache == NULL)
+	{
+		conf->drm_cipher_cache = prev->drm_cipher_cache;
+	}
 	if (conf->drm_request_uri == NULL)
 	{
 		conf->drm_request_uri = prev->drm_request_uri;
@@ -313,6 +344,8 @@ ngx_http_vod_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 
 #if (NGX_THREADS)
 	ngx_conf_merge_ptr_value(conf->open_file_thread_pool, prev->open_file_thread_pool, NULL);
+	ngx_conf_merge_value(conf->parallel_open_files, prev->parallel_open_files, 0);
+	ngx_conf_merge_ptr_value(conf->audio_filter_thread_pool, prev->audio_filter_thread_pool, NULL);
 #endif // NGX_THREADS
 
 	// validate vod_upstream / vod_upstream_host_header used when needed
@@ -326,6 +359,20 @@ ngx_http_vod_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 		}
 	}
 
+	if (conf->segment_cache_min_uses < 1 || conf->segment_cache_min_uses > MAX_SEGMENT_CACHE_MIN_USES)
+	{
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+			"\"vod_segment_cache_min_uses\" must be between 1 and %d", MAX_SEGMENT_CACHE_MIN_USES);
+		return NGX_CONF_ERROR;
+	}
+
+	if ((uint64_t)conf->cache_buffer_size * (conf->read_ahead_buffers + 1) > NGX_MAX_UINT32_VALUE)
+	{
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+			"\"vod_read_ahead_buffers\" multiplied by \"vod_cache_buffer_size\" must not exceed 4G");
+		return NGX_CONF_ERROR;
+	}
+
 	if (conf->segmenter.segment_duration <= 0)
 	{
 		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
@@ -638,6 +685,9 @@ ngx_http_vod_cache_command(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
 	ngx_buffer_cache_t **cache = (ngx_buffer_cache_t **)((u_char*)conf + cmd->offset);
 	ngx_str_t  *value;
+	ngx_int_t shard_count;
+	ngx_uint_t policy;
+	ngx_uint_t i;
 	ssize_t size;
 	time_t expiration;
 
@@ -669,22 +719,74 @@ ngx_http_vod_cache_command(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 		return NGX_CONF_ERROR;
 	}
 
-	if (cf->args->nelts > 3)
+	expiration = 0;
+	shard_count = 1;
+	policy = BUFFER_CACHE_POLICY_RING;
+
+	for (i = 3; i < cf->args->nelts; i++)
 	{
-		expiration = ngx_parse_time(&value[3], 1);
+		if (ngx_strncmp(value[i].data, "shards=", sizeof("shards=") - 1) == 0)
+		{
+			shard_count = ngx_atoi(value[i].data + sizeof("shards=") - 1, value[i].len - (sizeof("shards=") - 1));
+			if (shard_count == NGX_ERROR || shard_count < 1 || shard_count > BUFFER_CACHE_MAX_SHARDS)
+			{
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+					"invalid shard count \"%V\", must be between 1 and %d", &value[i], BUFFER_CACHE_MAX_SHARDS);
+				return NGX_CONF_ERROR;
+			}
+
+			if ((size_t)size / shard_count < BUFFER_CACHE_MIN_SHARD_SIZE)
+			{
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+					"cache size %V is too small for %i shards, each shard must be at least 1m", &value[2], shard_count);
+				return NGX_CONF_ERROR;
+			}
+			continue;
+		}
+
+		if (ngx_strncmp(value[i].data, "alloc=", sizeof("alloc=") - 1) == 0)
+		{
+			if (ngx_strcmp(value[i].data, "alloc=ring") == 0)
+			{
+				policy = BUFFER_CACHE_POLICY_RING;
+			}
+			else if (ngx_strcmp(value[i].data, "alloc=slab") == 0)
+			{
+				policy = BUFFER_CACHE_POLICY_SLAB;
+			}
+			else
+			{
+				ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+					"invalid allocation policy \"%V\", must be ring or slab", &value[i]);
+				return NGX_CONF_ERROR;
+			}
+			continue;
+		}
+
+		if (i > 3)
+		{
+			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+				"invalid parameter \"%V\"", &value[i]);
+			return NGX_CONF_ERROR;
+		}
+
+		expiration = ngx_parse_time(&value[i], 1);
 		if (expiration == (time_t)NGX_ERROR) 
 		{
 			ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-				"invalid expiration %V", &value[3]);
+				"invalid expiration %V", &value[i]);
 			return NGX_CONF_ERROR;
 		}
 	}
-	else
+
+	if (policy == BUFFER_CACHE_POLICY_SLAB && (size_t)size / shard_count < BUFFER_CACHE_MIN_SLAB_SHARD_SIZE)
 	{
-		expiration = 0;
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+			"cache size %V is too small for alloc=slab, each shard must be at least 8m", &value[2]);
+		return NGX_CONF_ERROR;
 	}
 
-	*cache = ngx_buffer_cache_create(cf, &value[1], size, expiration, &ngx_http_vod_module);
+	*cache = ngx_buffer_cache_create(cf, &value[1], size, expiration, shard_count, policy, &ngx_http_vod_module);
 	if (*cache == NULL)
 	{
 		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
@@ -761,6 +863,68 @@ ngx_http_vod_buffer_pool_command(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 	return NGX_CONF_OK;
 }
 
+#if (NGX_HAVE_OPENSSL_EVP)
+static char*
+ngx_http_vod_cipher_cache_command(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+	aes_cipher_cache_t** cipher_cache = (aes_cipher_cache_t **)((u_char*)conf + cmd->offset);
+	ngx_str_t  *value;
+	ngx_int_t size;
+
+	if (*cipher_cache != NULL)
+	{
+		return "is duplicate";
+	}
+
+	value = cf->args->elts;
+
+	size = ngx_atoi(value[1].data, value[1].len);
+	if (size == NGX_ERROR || size <= 0 || size > NGX_MAX_UINT32_VALUE)
+	{
+		return "invalid size";
+	}
+
+	*cipher_cache = aes_cipher_cache_create(cf->pool, cf->log, size);
+	if (*cipher_cache == NULL)
+	{
+		return NGX_CONF_ERROR;
+	}
+
+	return NGX_CONF_OK;
+}
+#endif // NGX_HAVE_OPENSSL_EVP
+
+#if (NGX_HAVE_LIB_AV_CODEC)
+static char*
+ngx_http_vod_codec_context_pool_command(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+	codec_context_pool_t** codec_context_pool = (codec_context_pool_t **)((u_char*)conf + cmd->offset);
+	ngx_str_t  *value;
+	ngx_int_t size;
+
+	if (*codec_context_pool != NULL)
+	{
+		return "is duplicate";
+	}
+
+	value = cf->args->elts;
+
+	size = ngx_atoi(value[1].data, value[1].len);
+	if (size == NGX_ERROR || size <= 0 || size > NGX_MAX_UINT32_VALUE)
+	{
+		return "invalid size";
+	}
+
+	*codec_context_pool = codec_context_pool_create(cf->pool, cf->log, size);
+	if (*codec_context_pool == NULL)
+	{
+		return NGX_CONF_ERROR;
+	}
+
+	return NGX_CONF_OK;
+}
+#endif // NGX_HAVE_LIB_AV_CODEC
+
 static char *
 ngx_http_vod(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -992,26 +1156,63 @@ ngx_command_t ngx_http_vod_commands[] = {
 	
 	// mp4 reading parameters
 	{ ngx_string("vod_metadata_cache"),
-	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE123,
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
 	ngx_http_vod_cache_command,
 	NGX_HTTP_LOC_CONF_OFFSET,
 	offsetof(ngx_http_vod_loc_conf_t, metadata_cache),
 	NULL },
 
+	{ ngx_string("vod_audio_filter_cache"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
+	ngx_http_vod_cache_command,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, audio_filter_cache),
+	NULL },
+
+#if (NGX_HAVE_LIB_AV_CODEC)
+	{ ngx_string("vod_codec_context_pool"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_http_vod_codec_context_pool_command,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, codec_context_pool),
+	NULL },
+#endif // NGX_HAVE_LIB_AV_CODEC
+
 	{ ngx_string("vod_response_cache"),
-	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE123,
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
 	ngx_http_vod_cache_command,
 	NGX_HTTP_LOC_CONF_OFFSET,
 	offsetof(ngx_http_vod_loc_conf_t, response_cache[CACHE_TYPE_VOD]),
 	NULL },
 
 	{ ngx_string("vod_live_response_cache"),
-	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE123,
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
 	ngx_http_vod_cache_command,
 	NGX_HTTP_LOC_CONF_OFFSET,
 	offsetof(ngx_http_vod_loc_conf_t, response_cache[CACHE_TYPE_LIVE]),
 	NULL },
 
+	{ ngx_string("vod_segment_cache"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
+	ngx_http_vod_cache_command,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, segment_cache),
+	NULL },
+
+	{ ngx_string("vod_segment_cache_max_size"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_size_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, segment_cache_max_size),
+	NULL },
+
+	{ ngx_string("vod_segment_cache_min_uses"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_num_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, segment_cache_min_uses),
+	NULL },
+
 	{ ngx_string("vod_initial_read_size"),
 	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
 	ngx_conf_set_size_slot,
@@ -1026,6 +1227,13 @@ ngx_command_t ngx_http_vod_commands[] = {
 	offsetof(ngx_http_vod_loc_conf_t, max_metadata_size),
 	NULL },
 
+	{ ngx_string("vod_metadata_index"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_FLAG,
+	ngx_conf_set_flag_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, metadata_index),
+	NULL },
+
 	{ ngx_string("vod_max_frames_size"),
 	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
 	ngx_conf_set_size_slot,
@@ -1054,6 +1262,13 @@ ngx_command_t ngx_http_vod_commands[] = {
 	offsetof(ngx_http_vod_loc_conf_t, cache_buffer_size),
 	NULL },
 
+	{ ngx_string("vod_read_ahead_buffers"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_num_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, read_ahead_buffers),
+	NULL },
+
 	{ ngx_string("vod_ignore_edit_list"),
 	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
 	ngx_conf_set_flag_slot,
@@ -1106,26 +1321,33 @@ ngx_command_t ngx_http_vod_commands[] = {
 
 	// path request parameters - mapped mode only
 	{ ngx_string("vod_mapping_cache"),
-	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE123,
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
 	ngx_http_vod_cache_command,
 	NGX_HTTP_LOC_CONF_OFFSET,
 	offsetof(ngx_http_vod_loc_conf_t, mapping_cache[CACHE_TYPE_VOD]),
 	NULL },
 
 	{ ngx_string("vod_live_mapping_cache"),
-	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE123,
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
 	ngx_http_vod_cache_command,
 	NGX_HTTP_LOC_CONF_OFFSET,
 	offsetof(ngx_http_vod_loc_conf_t, mapping_cache[CACHE_TYPE_LIVE]),
 	NULL },
 
 	{ ngx_string("vod_dynamic_mapping_cache"),
-	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE123,
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
 	ngx_http_vod_cache_command,
 	NGX_HTTP_LOC_CONF_OFFSET,
 	offsetof(ngx_http_vod_loc_conf_t, dynamic_mapping_cache),
 	NULL },
 
+	{ ngx_string("vod_mapping_cache_binary"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_FLAG,
+	ngx_conf_set_flag_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, mapping_cache_binary),
+	NULL },
+
 	{ ngx_string("vod_path_response_prefix"),
 	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
 	ngx_conf_set_str_slot,
@@ -1293,12 +1515,19 @@ ngx_command_t ngx_http_vod_commands[] = {
 	NULL },
 
 	{ ngx_string("vod_drm_info_cache"),
-	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE123,
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_1MORE,
 	ngx_http_vod_cache_command,
 	NGX_HTTP_LOC_CONF_OFFSET,
 	offsetof(ngx_http_vod_loc_conf_t, drm_info_cache),
 	NULL },
 
+	{ ngx_string("vod_drm_cipher_cache"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_http_vod_cipher_cache_command,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, drm_cipher_cache),
+	NULL },
+
 	{ ngx_string("vod_drm_request_uri"),
 	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
 	ngx_http_set_complex_value_slot,
@@ -1378,6 +1607,20 @@ ngx_command_t ngx_http_vod_commands[] = {
 	NGX_HTTP_LOC_CONF_OFFSET,
 	offsetof(ngx_http_vod_loc_conf_t, open_file_thread_pool),
 	NULL },
+
+	{ ngx_string("vod_parallel_open_files"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_flag_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, parallel_open_files),
+	NULL },
+
+	{ ngx_string("vod_audio_filter_thread_pool"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_NOARGS | NGX_CONF_TAKE1,
+	ngx_http_vod_thread_pool_command,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	offsetof(ngx_http_vod_loc_conf_t, audio_filter_thread_pool),
+	NULL },
 #endif // NGX_THREADS
 
 #include "ngx_http_vod_dash_commands.h"
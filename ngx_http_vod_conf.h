@@ -15,6 +15,9 @@
 #include "ngx_http_vod_volume_map_conf.h"
 #endif // NGX_HAVE_LIB_AV_CODEC
 
+// constants
+#define MAX_SEGMENT_CACHE_MIN_USES (16)
+
 // enum
 enum {
 	EXPIRES_TYPE_VOD,
@@ -47,13 +50,22 @@ struct ngx_http_vod_loc_conf_s {
 	ngx_http_complex_value_t *base_url;
 	ngx_http_complex_value_t *segments_base_url;
 	ngx_buffer_cache_t* metadata_cache;
+	ngx_buffer_cache_t* audio_filter_cache;
+#if (NGX_HAVE_LIB_AV_CODEC)
+	codec_context_pool_t* codec_context_pool;
+#endif // NGX_HAVE_LIB_AV_CODEC
 	ngx_buffer_cache_t* response_cache[CACHE_TYPE_COUNT];
+	ngx_buffer_cache_t* segment_cache;
+	size_t segment_cache_max_size;
+	ngx_uint_t segment_cache_min_uses;
 	size_t initial_read_size;
 	size_t max_metadata_size;
+	ngx_flag_t metadata_index;
 	size_t max_frames_size;
 	ngx_uint_t max_frame_count;
 	ngx_uint_t segment_max_frame_count;
 	size_t cache_buffer_size;
+	ngx_uint_t read_ahead_buffers;
 	buffer_pool_t* output_buffer_pool;
 	size_t max_upstream_headers_size;
 	ngx_flag_t ignore_edit_list;
@@ -63,6 +75,7 @@ struct ngx_http_vod_loc_conf_s {
 	ngx_http_complex_value_t *upstream_extra_args;
 	ngx_buffer_cache_t* mapping_cache[CACHE_TYPE_COUNT];
 	ngx_buffer_cache_t* dynamic_mapping_cache;
+	ngx_flag_t mapping_cache_binary;
 	ngx_str_t path_response_prefix;
 	ngx_str_t path_response_postfix;
 	size_t max_mapping_response_size;
@@ -90,6 +103,7 @@ struct ngx_http_vod_loc_conf_s {
 	ngx_str_t drm_upstream_location;
 	size_t drm_max_info_length;
 	ngx_buffer_cache_t* drm_info_cache;
+	aes_cipher_cache_t* drm_cipher_cache;
 	ngx_http_complex_value_t *drm_request_uri;
 	ngx_uint_t min_single_nalu_per_frame_segment;
 
@@ -104,6 +118,8 @@ struct ngx_http_vod_loc_conf_s {
 
 #if (NGX_THREADS)
 	ngx_thread_pool_t *open_file_thread_pool;
+	ngx_flag_t parallel_open_files;
+	ngx_thread_pool_t *audio_filter_thread_pool;
 #endif // NGX_THREADS
 
 	// derived fields
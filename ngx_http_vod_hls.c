@@ -226,6 +226,7 @@ ngx_http_vod_hls_init_segment_encryption(
 {
 	aes_cbc_encrypt_context_t* encrypted_write_context;
 	buffer_pool_t* buffer_pool;
+	bool_t encrypt_in_place;
 	vod_status_t rc;
 
 	rc = ngx_http_vod_hls_init_encryption_params(encryption_params, submodule_context, container_format);
@@ -241,12 +242,17 @@ ngx_http_vod_hls_init_segment_encryption(
 
 	if (container_format == HLS_CONTAINER_MPEGTS)
 	{
+		// Note: the ts muxer does not reuse its output buffers, so they can be encrypted in place
 		buffer_pool = submodule_context->request_context.output_buffer_pool;
+		encrypt_in_place = TRUE;
 	}
 	else
 	{
-		// Note: should not use buffer pool for fmp4 since the buffers have varying sizes
+		// Note: should not use buffer pool for fmp4 since the buffers have varying sizes.
+		//		the fmp4 writers may pass buffers they do not own (e.g. read cache / frames source buffers),
+		//		so these must not be encrypted in place
 		buffer_pool = NULL;
+		encrypt_in_place = FALSE;
 	}
 
 	rc = aes_cbc_encrypt_init(
@@ -255,6 +261,7 @@ ngx_http_vod_hls_init_segment_encryption(
 		segment_writer->write_tail,
 		segment_writer->context,
 		buffer_pool,
+		encrypt_in_place,
 		encryption_params->key,
 		encryption_params->iv);
 	if (rc != VOD_OK)
@@ -610,8 +617,8 @@ ngx_http_vod_hls_init_ts_frame_processor(
 	hls_encryption_params_t encryption_params;
 	hls_mpegts_muxer_conf_t muxer_conf;
 	hls_muxer_state_t* state;
+	size_t cached_size = *response_size;
 	vod_status_t rc;
-	bool_t reuse_output_buffers;
 
 #if (NGX_HAVE_OPENSSL_EVP)
 	rc = ngx_http_vod_hls_init_segment_encryption(
@@ -631,10 +638,8 @@ ngx_http_vod_hls_init_ts_frame_processor(
 		return ngx_http_vod_status_to_ngx_error(submodule_context->r, VOD_BAD_REQUEST);
 	}
 
-	reuse_output_buffers = encryption_params.type == HLS_ENC_AES_128;
 #else
 	encryption_params.type = HLS_ENC_NONE;
-	reuse_output_buffers = FALSE;
 #endif // NGX_HAVE_OPENSSL_EVP
 
 	rc = ngx_http_vod_hls_init_muxer_conf(submodule_context, &muxer_conf);
@@ -651,7 +656,7 @@ ngx_http_vod_hls_init_ts_frame_processor(
 		&submodule_context->media_set,
 		segment_writer->write_tail,
 		segment_writer->context,
-		reuse_output_buffers,
+		FALSE,		// aes_cbc_encrypt_write encrypts the ts buffers in place, they must not be reused
 		response_size, 
 		output_buffer,
 		&state);
@@ -662,8 +667,10 @@ ngx_http_vod_hls_init_ts_frame_processor(
 		return ngx_http_vod_status_to_ngx_error(submodule_context->r, rc);
 	}
 
+	// Note: a cached size is the size that was returned by a previous request, it already includes the aes padding
 	if (encryption_params.type == HLS_ENC_AES_128 && 
-		*response_size != 0)
+		*response_size != 0 &&
+		cached_size == 0)
 	{
 		*response_size = aes_round_up_to_block(*response_size);
 	}
@@ -762,6 +769,7 @@ ngx_http_vod_hls_handle_mp4_init_segment(
 			NULL,
 			NULL,
 			NULL,
+			FALSE,
 			encryption_params.key,
 			encryption_params.iv);
 		if (rc != VOD_OK)
@@ -1044,7 +1052,7 @@ static const ngx_http_vod_request_t hls_enc_key_request = {
 };
 
 static const ngx_http_vod_request_t hls_ts_segment_request = {
-	REQUEST_FLAG_SINGLE_TRACK_PER_MEDIA_TYPE,
+	REQUEST_FLAG_SINGLE_TRACK_PER_MEDIA_TYPE | REQUEST_FLAG_CACHE_RESPONSE_SIZE,
 	PARSE_FLAG_FRAMES_ALL | PARSE_FLAG_PARSED_EXTRA_DATA | PARSE_FLAG_INITIAL_PTS_DELAY,
 	REQUEST_CLASS_SEGMENT,
 	SUPPORTED_CODECS_TS,
@@ -25,8 +25,10 @@
 #include "vod/filters/rate_filter.h"
 #include "vod/filters/filter.h"
 #include "vod/media_set_parser.h"
+#include "vod/json_binary.h"
 #include "vod/manifest_utils.h"
 #include "vod/input/silence_generator.h"
+#include "vod/input/metadata_index.h"
 
 #if (NGX_HAVE_LIB_AV_CODEC)
 #include "ngx_http_vod_thumb.h"
@@ -40,10 +42,28 @@
 #include "vod/subtitle/dfxp_format.h"
 #endif // NGX_HAVE_LIBXML2
 
+#if (NGX_HAVE_OPENSSL_EVP)
+#include "vod/aes_cipher_cache.h"
+#endif // NGX_HAVE_OPENSSL_EVP
+
 // macros
 #define DEFINE_VAR(name) \
 	{ ngx_string("vod_" #name), ngx_http_vod_set_##name##_var, 0 }
 
+#define PC_MASK(type) (1 << PC_##type)
+
+#ifdef NGX_PERF_COUNTERS_ENABLED
+// Note: in addition to the shared counters, the durations are saved on the request context, for the time variables
+#define ngx_http_vod_perf_counter_end(ctx, pcctx, type)						\
+	if (ctx->perf_counters != NULL)											\
+	{																		\
+		ngx_perf_counter_end(ctx->perf_counters, pcctx, type);				\
+		ctx->perf_counter_times[type] += ngx_perf_counter_get_delta(pcctx);	\
+	}
+#else
+#define ngx_http_vod_perf_counter_end(ctx, pcctx, type)
+#endif // NGX_PERF_COUNTERS_ENABLED
+
 // constants
 #define OPEN_FILE_FALLBACK_ENABLED (0x80000000)
 #define MAX_STALE_RETRIES (2)
@@ -57,6 +77,9 @@ enum {
 	// main state machine
 	STATE_READ_DRM_INFO,
 	STATE_READ_METADATA_INITIAL,
+	STATE_READ_METADATA_OPEN_INDEX,
+	STATE_READ_METADATA_INDEX_OPEN_FILE,
+	STATE_READ_METADATA_INDEX_READ,
 	STATE_READ_METADATA_OPEN_FILE,
 	STATE_READ_METADATA_READ,
 	STATE_READ_FRAMES_OPEN_FILE,
@@ -74,6 +97,17 @@ enum {
 	READER_COUNT
 };
 
+enum {
+	CACHE_STATUS_RESPONSE,
+	CACHE_STATUS_MAPPING,
+	CACHE_STATUS_DRM_INFO,
+	CACHE_STATUS_METADATA,
+	CACHE_STATUS_SEGMENT_BOUNDARIES,
+	CACHE_STATUS_AUDIO_FILTER,
+
+	CACHE_STATUS_COUNT
+};
+
 // typedefs
 struct ngx_http_vod_ctx_s;
 typedef struct ngx_http_vod_ctx_s ngx_http_vod_ctx_t;
@@ -105,6 +139,8 @@ typedef struct {
 	ngx_chain_t* chain_head;
 	ngx_chain_t* chain_end;
 	size_t total_size;
+	u_char* cache_buffer;			// copy of the response for the segment cache, used when the header is sent in advance
+	size_t cache_buffer_size;
 } ngx_http_vod_write_segment_context_t;
 
 typedef struct {
@@ -127,6 +163,8 @@ typedef struct {
 	size_t max_response_size;
 	ngx_http_vod_mapping_get_uri_t get_uri;
 	ngx_http_vod_mapping_apply_t apply;
+
+	ngx_str_t cache_value;			// when set by apply, stored in the cache instead of the raw response
 } ngx_http_vod_mapping_context_t;
 
 struct ngx_http_vod_reader_s {
@@ -158,6 +196,16 @@ struct ngx_http_vod_ctx_s {
 	ngx_perf_counters_t* perf_counters;
 	ngx_perf_counter_context(perf_counter_context);
 	ngx_perf_counter_context(total_perf_counter_context);
+#ifdef NGX_PERF_COUNTERS_ENABLED
+	ngx_atomic_uint_t perf_counter_times[PC_COUNT];
+#endif // NGX_PERF_COUNTERS_ENABLED
+
+	// request stats
+	uint32_t cache_hits[CACHE_STATUS_COUNT];
+	uint32_t cache_misses[CACHE_STATUS_COUNT];
+	uint32_t metadata_reads;
+	uint32_t metadata_bytes_read;
+	uint32_t frames_reads;
 
 	// mapping
 	ngx_http_vod_mapping_context_t mapping;
@@ -173,10 +221,14 @@ struct ngx_http_vod_ctx_s {
 	void* metadata_reader_context;
 	ngx_str_t* metadata_parts;
 	size_t metadata_part_count;
+	ngx_file_reader_state_t* metadata_index_reader;
 
 	// read frames state
 	media_base_metadata_t* base_metadata;
 	media_format_read_request_t frames_read_req;
+	u_char segment_boundaries_key[BUFFER_CACHE_KEY_SIZE];
+	ngx_flag_t segment_boundaries_store;
+	ngx_str_t segment_boundaries;
 
 	// clipper
 	media_clipper_parse_result_t* clipper_parse_result;
@@ -186,6 +238,10 @@ struct ngx_http_vod_ctx_s {
 	// read state - file
 #if (NGX_THREADS)
 	void* async_open_context;
+	ngx_uint_t pending_open_count;
+	ngx_int_t pending_open_rc;
+	ngx_flag_t pending_open_fallback;
+	ngx_thread_task_t* frame_task;
 #endif // NGX_THREADS
 
 	// read state - http
@@ -203,6 +259,7 @@ struct ngx_http_vod_ctx_s {
 	ngx_http_vod_write_segment_context_t write_segment_buffer_context;
 	media_notification_t* notification;
 	uint32_t frames_bytes_read;
+	ngx_flag_t segment_cache_store;
 };
 
 // typedefs
@@ -221,6 +278,8 @@ static void ngx_http_vod_exit_process();
 static ngx_int_t ngx_http_vod_init_file_reader_with_fallback(ngx_http_request_t *r, ngx_str_t* path, uint32_t flags, void** context);
 static ngx_int_t ngx_http_vod_init_file_reader(ngx_http_request_t *r, ngx_str_t* path, uint32_t flags, void** context);
 static ngx_int_t ngx_http_vod_dump_file(void* context);
+static ngx_int_t ngx_http_vod_dump_request_to_fallback(ngx_http_request_t *r);
+static void ngx_http_vod_handle_read_completed(void* context, ngx_int_t rc, ngx_buf_t* buf, ssize_t bytes_read);
 
 static ngx_int_t ngx_http_vod_http_reader_open_file(ngx_http_request_t* r, ngx_str_t* path, uint32_t flags, void** context);
 static ngx_int_t ngx_http_vod_dump_http_part(void* context, off_t start, off_t end);
@@ -248,6 +307,15 @@ static ngx_str_t options_content_type = ngx_string("text/plain");
 static ngx_str_t empty_file_string = ngx_string("empty");
 static ngx_str_t empty_string = ngx_null_string;
 
+static ngx_str_t cache_status_names[] = {
+	ngx_string("response"),
+	ngx_string("mapping"),
+	ngx_string("drm_info"),
+	ngx_string("metadata"),
+	ngx_string("segment_boundaries"),
+	ngx_string("audio_filter"),
+};
+
 static media_format_t* media_formats[] = {
 	&mp4_format,
 	// XXXXX add &mkv_format,
@@ -749,6 +817,125 @@ ngx_http_vod_set_uint32_var(ngx_http_request_t *r, ngx_http_variable_value_t *v,
 	return NGX_OK;
 }
 
+static ngx_int_t
+ngx_http_vod_set_cache_status_var(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data)
+{
+	ngx_http_vod_ctx_t *ctx;
+	ngx_uint_t i;
+	size_t size;
+	u_char* p;
+
+	ctx = ngx_http_get_module_ctx(r, ngx_http_vod_module);
+	if (ctx == NULL)
+	{
+		v->not_found = 1;
+		return NGX_OK;
+	}
+
+	size = 0;
+	for (i = 0; i < CACHE_STATUS_COUNT; i++)
+	{
+		size += cache_status_names[i].len + sizeof("=partial,") - 1;
+	}
+
+	p = ngx_pnalloc(r->pool, size);
+	if (p == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_set_cache_status_var: ngx_pnalloc failed");
+		return NGX_ERROR;
+	}
+
+	v->data = p;
+
+	// Note: 'partial' is returned when the cache was accessed multiple times (e.g. several source files) with mixed results
+	for (i = 0; i < CACHE_STATUS_COUNT; i++)
+	{
+		if (ctx->cache_hits[i] == 0 && ctx->cache_misses[i] == 0)
+		{
+			continue;
+		}
+
+		if (p > v->data)
+		{
+			*p++ = ',';
+		}
+
+		p = ngx_copy(p, cache_status_names[i].data, cache_status_names[i].len);
+		*p++ = '=';
+
+		if (ctx->cache_misses[i] == 0)
+		{
+			p = ngx_copy(p, "hit", sizeof("hit") - 1);
+		}
+		else if (ctx->cache_hits[i] == 0)
+		{
+			p = ngx_copy(p, "miss", sizeof("miss") - 1);
+		}
+		else
+		{
+			p = ngx_copy(p, "partial", sizeof("partial") - 1);
+		}
+	}
+
+	if (p == v->data)
+	{
+		v->not_found = 1;
+		return NGX_OK;
+	}
+
+	v->len = p - v->data;
+	v->valid = 1;
+	v->no_cacheable = 1;
+	v->not_found = 0;
+
+	return NGX_OK;
+}
+
+#ifdef NGX_PERF_COUNTERS_ENABLED
+static ngx_int_t
+ngx_http_vod_set_time_var(ngx_http_request_t *r, ngx_http_variable_value_t *v, uintptr_t data)
+{
+	ngx_http_vod_ctx_t *ctx;
+	ngx_atomic_uint_t value;
+	ngx_uint_t i;
+	u_char* p;
+
+	ctx = ngx_http_get_module_ctx(r, ngx_http_vod_module);
+	if (ctx == NULL || ctx->perf_counters == NULL)
+	{
+		v->not_found = 1;
+		return NGX_OK;
+	}
+
+	p = ngx_pnalloc(r->pool, NGX_ATOMIC_T_LEN);
+	if (p == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_set_time_var: ngx_pnalloc failed");
+		return NGX_ERROR;
+	}
+
+	// Note: data is a bit mask of the perf counters that are summed
+	value = 0;
+	for (i = 0; i < PC_COUNT; i++)
+	{
+		if (data & (1 << i))
+		{
+			value += ctx->perf_counter_times[i];
+		}
+	}
+
+	v->data = p;
+	v->len = ngx_sprintf(p, "%uA", value) - p;
+	v->valid = 1;
+	v->no_cacheable = 1;
+	v->not_found = 0;
+
+	return NGX_OK;
+}
+#endif // NGX_PERF_COUNTERS_ENABLED
+
 static ngx_http_vod_variable_t ngx_http_vod_variables[] = {
 	DEFINE_VAR(status),
 	DEFINE_VAR(filepath),
@@ -761,7 +948,18 @@ static ngx_http_vod_variable_t ngx_http_vod_variables[] = {
 	DEFINE_VAR(notification_id),
 	DEFINE_VAR(segment_time),
 	DEFINE_VAR(segment_duration),
+	DEFINE_VAR(cache_status),
 	{ ngx_string("vod_frames_bytes_read"), ngx_http_vod_set_uint32_var, offsetof(ngx_http_vod_ctx_t, frames_bytes_read) },
+	{ ngx_string("vod_frames_reads"), ngx_http_vod_set_uint32_var, offsetof(ngx_http_vod_ctx_t, frames_reads) },
+	{ ngx_string("vod_metadata_bytes_read"), ngx_http_vod_set_uint32_var, offsetof(ngx_http_vod_ctx_t, metadata_bytes_read) },
+	{ ngx_string("vod_metadata_reads"), ngx_http_vod_set_uint32_var, offsetof(ngx_http_vod_ctx_t, metadata_reads) },
+#ifdef NGX_PERF_COUNTERS_ENABLED
+	{ ngx_string("vod_time_mapping"), ngx_http_vod_set_time_var, PC_MASK(MAP_PATH) | PC_MASK(PARSE_MEDIA_SET) | PC_MASK(GET_DRM_INFO) },
+	{ ngx_string("vod_time_open"), ngx_http_vod_set_time_var, PC_MASK(OPEN_FILE) | PC_MASK(ASYNC_OPEN_FILE) },
+	{ ngx_string("vod_time_read"), ngx_http_vod_set_time_var, PC_MASK(READ_FILE) | PC_MASK(ASYNC_READ_FILE) },
+	{ ngx_string("vod_time_parse"), ngx_http_vod_set_time_var, PC_MASK(MEDIA_PARSE) },
+	{ ngx_string("vod_time_process"), ngx_http_vod_set_time_var, PC_MASK(BUILD_MANIFEST) | PC_MASK(INIT_FRAME_PROCESS) | PC_MASK(PROCESS_FRAMES) | PC_MASK(ASYNC_PROCESS_FRAMES) },
+#endif // NGX_PERF_COUNTERS_ENABLED
 };
 
 ngx_int_t
@@ -805,6 +1003,19 @@ ngx_http_vod_preconfiguration(ngx_conf_t *cf)
 
 ////// Perf counter wrappers
 
+static void
+ngx_http_vod_update_cache_status(ngx_http_vod_ctx_t* ctx, ngx_uint_t cache, ngx_flag_t hit)
+{
+	if (hit)
+	{
+		ctx->cache_hits[cache]++;
+	}
+	else
+	{
+		ctx->cache_misses[cache]++;
+	}
+}
+
 static ngx_flag_t
 ngx_buffer_cache_fetch_perf(
 	ngx_perf_counters_t* perf_counters,
@@ -1170,6 +1381,110 @@ ngx_http_vod_send_header(
 	return NGX_OK;
 }
 
+static void
+ngx_http_vod_update_perf_counter_dims(
+	ngx_perf_counters_t* perf_counters,
+	ngx_http_request_t* r,
+	const ngx_http_vod_request_t* request,
+	ngx_http_vod_ctx_t* ctx,
+	ngx_atomic_uint_t total_time)
+{
+	const ngx_http_vod_submodule_t** cur_module;
+	ngx_http_vod_loc_conf_t* conf;
+	ngx_perf_counter_dim_t* dim;
+	ngx_uint_t submodule_index;
+	ngx_uint_t class_index;
+	ngx_uint_t format_index;
+
+	if (request == NULL)
+	{
+		return;
+	}
+
+	// submodule
+	conf = ngx_http_get_module_loc_conf(r, ngx_http_vod_module);
+	for (cur_module = submodules; ; cur_module++)
+	{
+		if (*cur_module == NULL)
+		{
+			return;
+		}
+
+		if ((*cur_module)->name == conf->submodule.name)
+		{
+			break;
+		}
+	}
+
+	submodule_index = cur_module - submodules;
+	if (submodule_index >= PC_DIM_SUBMODULE_COUNT)
+	{
+		return;
+	}
+
+	// request class
+	switch (request->request_class)
+	{
+	case REQUEST_CLASS_MANIFEST:
+		class_index = PC_DIM_CLASS_MANIFEST;
+		break;
+
+	case REQUEST_CLASS_SEGMENT:
+		class_index = PC_DIM_CLASS_SEGMENT;
+		break;
+
+	case REQUEST_CLASS_THUMB:
+		class_index = PC_DIM_CLASS_THUMB;
+		break;
+
+	default:
+		class_index = PC_DIM_CLASS_OTHER;
+		break;
+	}
+
+	// container format
+	if (ctx == NULL || ctx->format == NULL)
+	{
+		format_index = PC_DIM_FORMAT_NONE;
+	}
+	else
+	{
+		switch (ctx->format->id)
+		{
+		case FORMAT_ID_MP4:
+			format_index = PC_DIM_FORMAT_MP4;
+			break;
+
+		case FORMAT_ID_MKV:
+			format_index = PC_DIM_FORMAT_MKV;
+			break;
+
+		default:
+			format_index = PC_DIM_FORMAT_SUBTITLES;
+			break;
+		}
+	}
+
+	dim = &perf_counters->dims[submodule_index][class_index][format_index];
+
+	(void)ngx_atomic_fetch_add(&dim->count, 1);
+	(void)ngx_atomic_fetch_add(&dim->total, total_time);
+
+	if (ctx != NULL)
+	{
+		(void)ngx_atomic_fetch_add(&dim->process, 
+			ctx->perf_counter_times[PC_BUILD_MANIFEST] + 
+			ctx->perf_counter_times[PC_INIT_FRAME_PROCESS] + 
+			ctx->perf_counter_times[PC_PROCESS_FRAMES]);
+		(void)ngx_atomic_fetch_add(&dim->bytes_in, ctx->frames_bytes_read);
+	}
+
+	if (!r->header_only && r->headers_out.content_length_n > 0)
+	{
+		(void)ngx_atomic_fetch_add(&dim->bytes_out, r->headers_out.content_length_n);
+	}
+}
+
 static void
 ngx_http_vod_finalize_request(ngx_http_vod_ctx_t *ctx, ngx_int_t rc)
 {
@@ -1180,6 +1495,16 @@ ngx_http_vod_finalize_request(ngx_http_vod_ctx_t *ctx, ngx_int_t rc)
 
 	ngx_perf_counter_end(ctx->perf_counters, ctx->total_perf_counter_context, PC_TOTAL);
 
+	if (ctx->perf_counters != NULL && rc == NGX_OK)
+	{
+		ngx_http_vod_update_perf_counter_dims(
+			ctx->perf_counters,
+			ctx->submodule_context.r,
+			ctx->request,
+			ctx,
+			ngx_perf_counter_get_delta(ctx->total_perf_counter_context));
+	}
+
 	ngx_http_finalize_request(ctx->submodule_context.r, rc);
 }
 
@@ -1263,7 +1588,7 @@ ngx_http_vod_drm_info_request_finished(void* context, ngx_int_t rc, ngx_buf_t* r
 		goto finalize_request;
 	}
 
-	ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_GET_DRM_INFO);
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_GET_DRM_INFO);
 
 	drm_info.data = response->pos;
 	drm_info.len = content_length;
@@ -1382,6 +1707,8 @@ ngx_http_vod_state_machine_get_drm_info(ngx_http_vod_ctx_t *ctx)
 				ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
 					"ngx_http_vod_state_machine_get_drm_info: drm info cache hit, size is %uz", drm_info.len);
 
+				ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_DRM_INFO, 1);
+
 				rc = conf->submodule.parse_drm_info(&ctx->submodule_context, &drm_info, &ctx->cur_sequence->drm_info);
 				if (rc != NGX_OK)
 				{
@@ -1407,6 +1734,8 @@ ngx_http_vod_state_machine_get_drm_info(ngx_http_vod_ctx_t *ctx)
 			{
 				ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
 					"ngx_http_vod_state_machine_get_drm_info: drm info cache miss");
+
+				ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_DRM_INFO, 0);
 			}
 		}
 
@@ -1660,6 +1989,7 @@ ngx_http_vod_init_parse_params_frames(
 	{
 		// thumbnail request
 		get_ranges_params.time = ctx->submodule_context.request_params.segment_time;
+		get_ranges_params.time_span = ctx->submodule_context.request_params.segment_time_span;
 
 		rc = segmenter_get_start_end_ranges_gop(
 			&get_ranges_params,
@@ -1700,69 +2030,292 @@ ngx_http_vod_init_parse_params_frames(
 	return NGX_OK;
 }
 
-static ngx_int_t 
-ngx_http_vod_parse_metadata(
-	ngx_http_vod_ctx_t *ctx, 
-	ngx_flag_t fetched_from_cache)
+////// Segment boundaries
+
+static ngx_flag_t
+ngx_http_vod_segment_boundaries_enabled(ngx_http_vod_ctx_t *ctx, media_parse_params_t* parse_params)
 {
-	media_parse_params_t parse_params;
-	const ngx_http_vod_request_t* request = ctx->request;
-	media_clip_source_t* cur_source = ctx->cur_source;
-	request_context_t* request_context = &ctx->submodule_context.request_context;
-	media_range_t range;
-	vod_status_t rc;
-	track_mask_t tracks_mask[MEDIA_TYPE_COUNT];
+	segmenter_conf_t* segmenter = ctx->submodule_context.media_set.segmenter_conf;
 
-	// initialize clipping params
-	if (cur_source->clip_to == ULLONG_MAX)
-	{
-		if (cur_source->clip_from >= UINT_MAX)
-		{
-			ngx_log_error(NGX_LOG_ERR, request_context->log, 0,
-				"ngx_http_vod_parse_metadata: clip from value %uL too large", cur_source->clip_from);
-			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_BAD_REQUEST);
-		}
+	// Note: the boundaries are used only in manifest requests that need the frames only for
+	//		segmenter_get_segment_durations_accurate. the boundaries are calculated on the source
+	//		tracks, so they can not be used when the source is filtered (e.g. rate filter)
+	return ctx->submodule_context.conf->metadata_cache != NULL &&
+		ctx->request->request_class == REQUEST_CLASS_MANIFEST &&
+		segmenter->parse_type != 0 &&
+		(parse_params->parse_type & segmenter->parse_type) != 0 &&
+		((ctx->request->parse_type | ctx->submodule_context.conf->parse_flags) & PARSE_FLAG_FRAMES_ALL) == 0 &&
+		ctx->cur_source->base.parent == NULL;
+}
 
-		parse_params.clip_to = UINT_MAX;
+static void
+ngx_http_vod_get_segment_boundaries_key(
+	ngx_http_vod_ctx_t *ctx,
+	media_parse_params_t* parse_params,
+	u_char* key)
+{
+	segmenter_conf_t* segmenter = ctx->submodule_context.media_set.segmenter_conf;
+	ngx_md5_t md5;
+
+	ngx_md5_init(&md5);
+	ngx_md5_update(&md5, "sbix", sizeof("sbix") - 1);
+	ngx_md5_update(&md5, ctx->cur_source->file_key, sizeof(ctx->cur_source->file_key));
+	ngx_md5_update(&md5, &parse_params->parse_type, sizeof(parse_params->parse_type));
+	ngx_md5_update(&md5, &parse_params->codecs_mask, sizeof(parse_params->codecs_mask));
+	ngx_md5_update(&md5, &parse_params->clip_from, sizeof(parse_params->clip_from));
+	ngx_md5_update(&md5, &parse_params->clip_to, sizeof(parse_params->clip_to));
+	ngx_md5_update(&md5, parse_params->required_tracks_mask, sizeof(track_mask_t) * MEDIA_TYPE_COUNT);
+	if (parse_params->langs_mask != NULL)
+	{
+		ngx_md5_update(&md5, parse_params->langs_mask, sizeof(parse_params->langs_mask[0]) * LANG_MASK_SIZE);
 	}
-	else
+	ngx_md5_update(&md5, &segmenter->segment_duration, sizeof(segmenter->segment_duration));
+	ngx_md5_update(&md5, &segmenter->align_to_key_frames, sizeof(segmenter->align_to_key_frames));
+	if (segmenter->bootstrap_segments_count > 0)
 	{
-		if (cur_source->clip_to >= UINT_MAX)
-		{
-			ngx_log_error(NGX_LOG_ERR, request_context->log, 0,
-				"ngx_http_vod_parse_metadata: clip to value %uL too large", cur_source->clip_to);
-			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_BAD_REQUEST);
-		}
+		ngx_md5_update(&md5, segmenter->bootstrap_segments_end, 
+			sizeof(segmenter->bootstrap_segments_end[0]) * segmenter->bootstrap_segments_count);
+	}
+	ngx_md5_final(key, &md5);
+}
 
-		parse_params.clip_to = cur_source->clip_to;
+static ngx_int_t
+ngx_http_vod_fetch_segment_boundaries(ngx_http_vod_ctx_t *ctx)
+{
+	ngx_http_vod_loc_conf_t* conf = ctx->submodule_context.conf;
+	request_context_t* request_context = &ctx->submodule_context.request_context;
+	ngx_str_t cache_buffer;
+	uint32_t cache_token;
+
+	if (!ngx_buffer_cache_fetch_perf(
+		ctx->perf_counters,
+		conf->metadata_cache,
+		ctx->segment_boundaries_key,
+		&cache_buffer,
+		&cache_token))
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_fetch_segment_boundaries: segment boundaries cache miss");
+		ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_SEGMENT_BOUNDARIES, 0);
+		ctx->segment_boundaries_store = 1;
+		return NGX_DECLINED;
 	}
-	parse_params.clip_from = cur_source->clip_from;
 
-	ngx_http_vod_init_parse_params_metadata(
-		ctx,
-		tracks_mask,
-		&parse_params);
+	// Note: copying the buffer since the tracks point to it, and the cache entry can not be 
+	//		locked while reading the frames
+	ctx->segment_boundaries.data = ngx_palloc(request_context->pool, cache_buffer.len);
+	if (ctx->segment_boundaries.data != NULL)
+	{
+		ngx_memcpy(ctx->segment_boundaries.data, cache_buffer.data, cache_buffer.len);
+		ctx->segment_boundaries.len = cache_buffer.len;
+	}
 
-	if (request == NULL)
+	ngx_buffer_cache_release(conf->metadata_cache, ctx->segment_boundaries_key, cache_token);
+
+	if (ctx->segment_boundaries.data == NULL)
 	{
-		// Note: the other fields in parse_params are not required here
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_fetch_segment_boundaries: ngx_palloc failed");
+		return NGX_DECLINED;
+	}
 
-		if (ctx->format->clipper_parse == NULL)
-		{
-			ngx_log_error(NGX_LOG_ERR, request_context->log, 0,
-				"ngx_http_vod_parse_metadata: clipping not supported for %V", &ctx->format->name);
-			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_BAD_REQUEST);
-		}
+	ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+		"ngx_http_vod_fetch_segment_boundaries: segment boundaries cache hit");
 
-		rc = ctx->format->clipper_parse(
-			request_context,
-			&parse_params,
-			ctx->metadata_parts,
-			ctx->metadata_part_count,
-			fetched_from_cache,
-			&ctx->clipper_parse_result);
-		if (rc != VOD_OK)
-		{
+	ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_SEGMENT_BOUNDARIES, 1);
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_store_segment_boundaries(ngx_http_vod_ctx_t *ctx)
+{
+	media_clip_source_t* cur_source = ctx->cur_source;
+	request_context_t* request_context = &ctx->submodule_context.request_context;
+	segment_boundaries_t* boundaries;
+	media_track_t* cur_track;
+	vod_status_t rc;
+	uint32_t media_type;
+	u_char* buffer;
+	u_char* end;
+	size_t size;
+	bool_t found[MEDIA_TYPE_COUNT];
+
+	// calculate the boundaries of the first video / audio track, 
+	// these are the only tracks that can be used as the main track of the segmenter
+	ngx_memzero(found, sizeof(found));
+
+	for (cur_track = cur_source->track_array.first_track; 
+		cur_track < cur_source->track_array.last_track; 
+		cur_track++)
+	{
+		media_type = cur_track->media_info.media_type;
+		if ((media_type != MEDIA_TYPE_VIDEO && media_type != MEDIA_TYPE_AUDIO) ||
+			found[media_type])
+		{
+			continue;
+		}
+
+		found[media_type] = TRUE;
+
+		boundaries = ngx_palloc(request_context->pool, sizeof(*boundaries));
+		if (boundaries == NULL)
+		{
+			ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+				"ngx_http_vod_store_segment_boundaries: ngx_palloc failed (1)");
+			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_ALLOC_FAILED);
+		}
+
+		rc = segmenter_get_segment_boundaries(
+			request_context,
+			ctx->submodule_context.media_set.segmenter_conf,
+			cur_track,
+			boundaries);
+		if (rc != VOD_OK)
+		{
+			ngx_log_debug1(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+				"ngx_http_vod_store_segment_boundaries: segmenter_get_segment_boundaries failed %i", rc);
+			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
+		}
+
+		cur_track->segment_boundaries = boundaries;
+	}
+
+	size = segmenter_segment_boundaries_get_size(&cur_source->track_array);
+
+	buffer = ngx_palloc(request_context->pool, size);
+	if (buffer == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_store_segment_boundaries: ngx_palloc failed (2)");
+		return NGX_OK;
+	}
+
+	end = segmenter_segment_boundaries_write(buffer, &cur_source->track_array);
+	if ((size_t)(end - buffer) != size)
+	{
+		ngx_log_error(NGX_LOG_ALERT, request_context->log, 0,
+			"ngx_http_vod_store_segment_boundaries: result length %uz different than allocated length %uz",
+			(size_t)(end - buffer), size);
+	}
+	else if (ngx_buffer_cache_store_perf(
+		ctx->perf_counters,
+		ctx->submodule_context.conf->metadata_cache,
+		ctx->segment_boundaries_key,
+		buffer,
+		size))
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_store_segment_boundaries: stored segment boundaries in cache");
+	}
+	else
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_store_segment_boundaries: failed to store segment boundaries in cache");
+	}
+
+	ngx_pfree(request_context->pool, buffer);
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_update_segment_boundaries(ngx_http_vod_ctx_t *ctx)
+{
+	request_context_t* request_context = &ctx->submodule_context.request_context;
+	vod_status_t rc;
+
+	if (ctx->segment_boundaries_store)
+	{
+		ctx->segment_boundaries_store = 0;
+		return ngx_http_vod_store_segment_boundaries(ctx);
+	}
+
+	if (ctx->segment_boundaries.len == 0)
+	{
+		return NGX_OK;
+	}
+
+	// Note: the frames were not parsed, so failing to read the boundaries is an error
+	rc = segmenter_segment_boundaries_read(
+		request_context,
+		&ctx->segment_boundaries,
+		&ctx->cur_source->track_array);
+	if (rc != VOD_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_update_segment_boundaries: segmenter_segment_boundaries_read failed %i", rc);
+		return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
+	}
+
+	ngx_str_null(&ctx->segment_boundaries);
+
+	return NGX_OK;
+}
+
+static ngx_int_t 
+ngx_http_vod_parse_metadata(
+	ngx_http_vod_ctx_t *ctx, 
+	ngx_flag_t fetched_from_cache)
+{
+	media_parse_params_t parse_params;
+	const ngx_http_vod_request_t* request = ctx->request;
+	media_clip_source_t* cur_source = ctx->cur_source;
+	request_context_t* request_context = &ctx->submodule_context.request_context;
+	media_range_t range;
+	vod_status_t rc;
+	track_mask_t tracks_mask[MEDIA_TYPE_COUNT];
+
+	// initialize clipping params
+	if (cur_source->clip_to == ULLONG_MAX)
+	{
+		if (cur_source->clip_from >= UINT_MAX)
+		{
+			ngx_log_error(NGX_LOG_ERR, request_context->log, 0,
+				"ngx_http_vod_parse_metadata: clip from value %uL too large", cur_source->clip_from);
+			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_BAD_REQUEST);
+		}
+
+		parse_params.clip_to = UINT_MAX;
+	}
+	else
+	{
+		if (cur_source->clip_to >= UINT_MAX)
+		{
+			ngx_log_error(NGX_LOG_ERR, request_context->log, 0,
+				"ngx_http_vod_parse_metadata: clip to value %uL too large", cur_source->clip_to);
+			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_BAD_REQUEST);
+		}
+
+		parse_params.clip_to = cur_source->clip_to;
+	}
+	parse_params.clip_from = cur_source->clip_from;
+
+	ngx_http_vod_init_parse_params_metadata(
+		ctx,
+		tracks_mask,
+		&parse_params);
+
+	if (request == NULL)
+	{
+		// Note: the other fields in parse_params are not required here
+
+		if (ctx->format->clipper_parse == NULL)
+		{
+			ngx_log_error(NGX_LOG_ERR, request_context->log, 0,
+				"ngx_http_vod_parse_metadata: clipping not supported for %V", &ctx->format->name);
+			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_BAD_REQUEST);
+		}
+
+		rc = ctx->format->clipper_parse(
+			request_context,
+			&parse_params,
+			ctx->metadata_parts,
+			ctx->metadata_part_count,
+			fetched_from_cache,
+			&ctx->clipper_parse_result);
+		if (rc != VOD_OK)
+		{
 			ngx_log_debug2(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
 				"ngx_http_vod_parse_metadata: clipper_parse(%V) failed %i", &ctx->format->name, rc);
 			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
@@ -1771,6 +2324,21 @@ ngx_http_vod_parse_metadata(
 		return NGX_OK;
 	}
 
+	// try to fetch the segment boundaries from cache
+	ctx->segment_boundaries_store = 0;
+	ngx_str_null(&ctx->segment_boundaries);
+
+	if (ngx_http_vod_segment_boundaries_enabled(ctx, &parse_params))
+	{
+		ngx_http_vod_get_segment_boundaries_key(ctx, &parse_params, ctx->segment_boundaries_key);
+
+		if (ngx_http_vod_fetch_segment_boundaries(ctx) == NGX_OK)
+		{
+			// the frames are not needed
+			parse_params.parse_type &= ~ctx->submodule_context.media_set.segmenter_conf->parse_type;
+		}
+	}
+
 	ngx_perf_counter_start(ctx->perf_counter_context);
 
 	// parse the basic metadata
@@ -1834,9 +2402,15 @@ ngx_http_vod_parse_metadata(
 		return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
 	}
 
+	rc = ngx_http_vod_update_segment_boundaries(ctx);
+	if (rc != NGX_OK)
+	{
+		return rc;
+	}
+
 	ngx_http_vod_update_source_tracks(request_context, cur_source);
 
-	ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_MEDIA_PARSE);
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_MEDIA_PARSE);
 
 	return NGX_OK;
 }
@@ -2010,7 +2584,10 @@ ngx_http_vod_async_read(ngx_http_vod_ctx_t* ctx, media_format_read_request_t* re
 		return rc;
 	}
 
-	ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_READ_FILE);
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_READ_FILE);
+
+	ctx->metadata_reads++;
+	ctx->metadata_bytes_read += ctx->read_buffer.last - ctx->read_buffer.pos;
 
 	return NGX_OK;
 }
@@ -2291,6 +2868,12 @@ ngx_http_vod_read_frames(ngx_http_vod_ctx_t *ctx)
 		}
 	}
 
+	rc = ngx_http_vod_update_segment_boundaries(ctx);
+	if (rc != NGX_OK)
+	{
+		return rc;
+	}
+
 	ngx_http_vod_update_source_tracks(request_context, ctx->cur_source);
 
 	return NGX_OK;
@@ -2315,8 +2898,8 @@ ngx_http_vod_get_alloc_params(ngx_http_vod_ctx_t* ctx, ngx_http_vod_reader_t* re
 	}
 }
 
-static ngx_int_t
-ngx_http_vod_open_file(ngx_http_vod_ctx_t* ctx, media_clip_source_t* source)
+static void
+ngx_http_vod_init_source_reader(ngx_http_vod_ctx_t* ctx, media_clip_source_t* source)
 {
 	switch (source->source_type)
 	{
@@ -2334,99 +2917,507 @@ ngx_http_vod_open_file(ngx_http_vod_ctx_t* ctx, media_clip_source_t* source)
 	}
 
 	ngx_http_vod_get_alloc_params(ctx, source->reader, &source->alignment, &source->alloc_extra_size);
+}
 
-	return source->reader->open(ctx->submodule_context.r, &source->mapped_uri, 0, &source->reader_context);
+static ngx_flag_t
+ngx_http_vod_is_file_reader(ngx_http_vod_reader_t* reader)
+{
+	return reader == &reader_file || reader == &reader_file_with_fallback;
 }
 
-static ngx_int_t
-ngx_http_vod_state_machine_parse_metadata(ngx_http_vod_ctx_t *ctx)
+#if (NGX_THREADS)
+static void
+ngx_http_vod_parallel_open_completed_internal(void* context, ngx_int_t rc, ngx_flag_t fallback)
 {
-	ngx_http_vod_loc_conf_t* conf = ctx->submodule_context.conf;
-	multipart_cache_header_t multipart_header;
-	media_clip_source_t* cur_source;
-	ngx_http_request_t* r = ctx->submodule_context.r;
-	ngx_int_t rc;
-	uint32_t cache_token;
-	bool_t metadata_loaded;
+	ngx_http_vod_ctx_t *ctx = (ngx_http_vod_ctx_t *)context;
 
-	if (ctx->cur_source == NULL)
+	if (rc != NGX_OK && ctx->pending_open_rc == NGX_OK)
 	{
-		return NGX_OK;
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+			"ngx_http_vod_parallel_open_completed_internal: open failed %i", rc);
+		ctx->pending_open_rc = rc;
+		ctx->pending_open_fallback = fallback && rc == NGX_HTTP_NOT_FOUND;
 	}
 
-	for (;;)
+	ctx->pending_open_count--;
+	if (ctx->pending_open_count > 0)
 	{
-		switch (ctx->state)
-		{
-		case STATE_READ_METADATA_INITIAL:
-			metadata_loaded = FALSE;
-			cache_token = 0;
-			cur_source = ctx->cur_source;
-
-			if (cur_source->mapped_uri.len == empty_file_string.len &&
-				ngx_strncasecmp(cur_source->mapped_uri.data, empty_file_string.data, empty_file_string.len) == 0)
-			{
-				// the string "empty" identifies an empty srt file
-				ctx->metadata_parts = ngx_palloc(ctx->submodule_context.request_context.pool,
-					sizeof(*ctx->metadata_parts) + 1);
-				if (ctx->metadata_parts == NULL)
-				{
-					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-						"ngx_http_vod_state_machine_parse_metadata: ngx_palloc failed");
-					return ngx_http_vod_status_to_ngx_error(r, VOD_ALLOC_FAILED);
-				}
+		return;
+	}
 
-				ctx->metadata_parts[0].len = 0;
-				ctx->metadata_parts[0].data = (void*)(ctx->metadata_parts + 1);
-				ctx->metadata_parts[0].data[0] = '\0';
-				multipart_header.type = FORMAT_ID_WEBVTT;
-				metadata_loaded = TRUE;
-			}
-			else if (conf->metadata_cache != NULL)
+	if (ctx->pending_open_rc != NGX_OK)
+	{
+		if (ctx->pending_open_fallback)
+		{
+			// try the fallback
+			rc = ngx_http_vod_dump_request_to_fallback(ctx->submodule_context.r);
+			if (rc == NGX_AGAIN)
 			{
-				// try to fetch from cache
-				if (ngx_buffer_cache_fetch_multipart_perf(
-					ctx,
-					conf->metadata_cache,
-					cur_source->file_key,
-					&multipart_header,
-					&ctx->metadata_parts,
-					&cache_token))
-				{
-					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-						"ngx_http_vod_state_machine_parse_metadata: metadata cache hit");
-					metadata_loaded = TRUE;
-				}
-				else
-				{
-					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-						"ngx_http_vod_state_machine_parse_metadata: metadata cache miss");
-				}
+				return;
 			}
 
-			if (metadata_loaded)
-			{
-				// parse the metadata
-				rc = ngx_http_vod_init_format(ctx, multipart_header.type);
-				if (rc != NGX_OK)
-				{
-					return rc;
-				}
+			rc = NGX_HTTP_NOT_FOUND;
+			goto finalize_request;
+		}
 
-				rc = ngx_http_vod_parse_metadata(ctx, 1);
+		rc = ctx->pending_open_rc;
+		goto finalize_request;
+	}
 
-				if (cache_token && 
-					ctx->request != NULL)		// in case of progressive, the metadata parts are used in clipper_build_header
-				{
-					ngx_buffer_cache_release(
-						conf->metadata_cache,
-						cur_source->file_key,
-						cache_token);
-				}
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_ASYNC_OPEN_FILE);
 
-				if (rc == NGX_OK)
-				{
-					ctx->cur_source = cur_source->next;
+	// run the state machine
+	rc = ctx->state_machine(ctx);
+	if (rc == NGX_AGAIN)
+	{
+		return;
+	}
+
+finalize_request:
+
+	ngx_http_vod_finalize_request(ctx, rc);
+}
+
+static void
+ngx_http_vod_parallel_open_completed(void* context, ngx_int_t rc)
+{
+	ngx_http_vod_parallel_open_completed_internal(context, rc, 0);
+}
+
+static void
+ngx_http_vod_parallel_open_completed_with_fallback(void* context, ngx_int_t rc)
+{
+	ngx_http_vod_parallel_open_completed_internal(context, rc, 1);
+}
+
+// Note: opens the local files of the source and all the sources that follow it concurrently on the thread pool,
+//		the state machine resumes only after all the opens complete. this is a parallel open only - the metadata
+//		reads share ctx->read_buffer and a single pending aio, so they are still issued one source after the other,
+//		and the metadata latency of a multi-source request remains the sum of the reads. sources that use other
+//		readers (e.g. reader_http) are skipped, they are opened one by one when the state machine reaches them.
+static ngx_int_t
+ngx_http_vod_open_files_parallel(ngx_http_vod_ctx_t* ctx, media_clip_source_t* first_source)
+{
+	ngx_http_core_loc_conf_t *clcf;
+	ngx_file_reader_state_t* state;
+	media_clip_source_t* cur_source;
+	ngx_http_request_t* r = ctx->submodule_context.r;
+	void* open_context;
+	ngx_flag_t fallback;
+	ngx_int_t rc;
+
+	clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+	ctx->pending_open_count = 0;
+	ctx->pending_open_rc = NGX_OK;
+	ctx->pending_open_fallback = 0;
+
+	ngx_perf_counter_start(ctx->perf_counter_context);
+
+	for (cur_source = first_source; cur_source != NULL; cur_source = cur_source->next)
+	{
+		if (cur_source->reader_context != NULL)
+		{
+			continue;
+		}
+
+		ngx_http_vod_init_source_reader(ctx, cur_source);
+		if (!ngx_http_vod_is_file_reader(cur_source->reader))
+		{
+			continue;
+		}
+
+		fallback = cur_source->reader == &reader_file_with_fallback;
+
+		state = ngx_pcalloc(r->pool, sizeof(*state));
+		if (state == NULL)
+		{
+			ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+				"ngx_http_vod_open_files_parallel: ngx_pcalloc failed");
+			rc = ngx_http_vod_status_to_ngx_error(r, VOD_ALLOC_FAILED);
+			goto failed;
+		}
+
+		cur_source->reader_context = state;
+
+		open_context = NULL;		// each open requires its own thread task
+
+		rc = ngx_file_reader_init_async(
+			state,
+			&open_context,
+			ctx->submodule_context.conf->open_file_thread_pool,
+			fallback ? ngx_http_vod_parallel_open_completed_with_fallback : ngx_http_vod_parallel_open_completed,
+			ngx_http_vod_handle_read_completed,
+			ctx,
+			r,
+			clcf,
+			&cur_source->mapped_uri,
+			fallback ? OPEN_FILE_FALLBACK_ENABLED : 0);
+		switch (rc)
+		{
+		case NGX_OK:
+			break;
+
+		case NGX_AGAIN:
+			ctx->pending_open_count++;
+			break;
+
+		default:
+			ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+				"ngx_http_vod_open_files_parallel: ngx_file_reader_init_async failed %i", rc);
+			ctx->pending_open_fallback = fallback && rc == NGX_HTTP_NOT_FOUND;
+			goto failed;
+		}
+	}
+
+	if (ctx->pending_open_count > 0)
+	{
+		return NGX_AGAIN;
+	}
+
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_OPEN_FILE);
+
+	return NGX_OK;
+
+failed:
+
+	if (ctx->pending_open_count > 0)
+	{
+		// the request is finalized (or dumped to the fallback) when the pending opens complete
+		ctx->pending_open_rc = rc;
+		return NGX_AGAIN;
+	}
+
+	if (ctx->pending_open_fallback)
+	{
+		// try the fallback
+		rc = ngx_http_vod_dump_request_to_fallback(r);
+		if (rc != NGX_AGAIN)
+		{
+			return NGX_HTTP_NOT_FOUND;
+		}
+	}
+
+	return rc;
+}
+#endif // NGX_THREADS
+
+static ngx_int_t
+ngx_http_vod_open_file(ngx_http_vod_ctx_t* ctx, media_clip_source_t* source)
+{
+	if (source->reader_context != NULL)
+	{
+		// already opened by ngx_http_vod_open_files_parallel
+		return NGX_OK;
+	}
+
+	ngx_http_vod_init_source_reader(ctx, source);
+
+#if (NGX_THREADS)
+	if (ngx_http_vod_is_file_reader(source->reader) &&
+		ctx->submodule_context.conf->parallel_open_files &&
+		ctx->submodule_context.conf->open_file_thread_pool != NULL)
+	{
+		return ngx_http_vod_open_files_parallel(ctx, source);
+	}
+#endif // NGX_THREADS
+
+	return source->reader->open(ctx->submodule_context.r, &source->mapped_uri, 0, &source->reader_context);
+}
+
+#if (NGX_THREADS)
+static void
+ngx_http_vod_metadata_index_open_completed(void* context, ngx_int_t rc)
+{
+	ngx_http_vod_ctx_t *ctx = (ngx_http_vod_ctx_t *)context;
+
+	if (rc != NGX_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.r->connection->log, 0,
+			"ngx_http_vod_metadata_index_open_completed: no index %i", rc);
+
+		// read the metadata from the media file
+		ctx->state = STATE_READ_METADATA_OPEN_FILE;
+	}
+	else
+	{
+		ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_ASYNC_OPEN_FILE);
+	}
+
+	// run the state machine
+	rc = ctx->state_machine(ctx);
+	if (rc == NGX_AGAIN)
+	{
+		return;
+	}
+
+	ngx_http_vod_finalize_request(ctx, rc);
+}
+#endif // NGX_THREADS
+
+static ngx_int_t
+ngx_http_vod_open_metadata_index(ngx_http_vod_ctx_t* ctx, media_clip_source_t* source)
+{
+	ngx_http_core_loc_conf_t *clcf;
+	ngx_http_request_t* r = ctx->submodule_context.r;
+	ngx_str_t path;
+	ngx_int_t rc;
+	u_char* p;
+
+	path.len = source->mapped_uri.len + sizeof(METADATA_INDEX_FILE_EXT) - 1;
+	path.data = ngx_pnalloc(r->pool, path.len + 1);
+	if (path.data == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_open_metadata_index: ngx_pnalloc failed (1)");
+		return ngx_http_vod_status_to_ngx_error(r, VOD_ALLOC_FAILED);
+	}
+
+	p = ngx_copy(path.data, source->mapped_uri.data, source->mapped_uri.len);
+	ngx_memcpy(p, METADATA_INDEX_FILE_EXT, sizeof(METADATA_INDEX_FILE_EXT));
+
+	ctx->metadata_index_reader = ngx_pcalloc(r->pool, sizeof(*ctx->metadata_index_reader));
+	if (ctx->metadata_index_reader == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_open_metadata_index: ngx_pcalloc failed (2)");
+		return ngx_http_vod_status_to_ngx_error(r, VOD_ALLOC_FAILED);
+	}
+
+	clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+	ngx_perf_counter_start(ctx->perf_counter_context);
+
+	// Note: the index is opened the same way as the media file - using the open file cache, and on the
+	//		thread pool when vod_open_file_thread_pool is set. a missing index is the common case, not an error
+#if (NGX_THREADS)
+	if (ctx->submodule_context.conf->open_file_thread_pool != NULL)
+	{
+		rc = ngx_file_reader_init_async(
+			ctx->metadata_index_reader,
+			&ctx->async_open_context,
+			ctx->submodule_context.conf->open_file_thread_pool,
+			ngx_http_vod_metadata_index_open_completed,
+			ngx_http_vod_handle_read_completed,
+			ctx,
+			r,
+			clcf,
+			&path,
+			OPEN_FILE_NO_LOG_NOT_FOUND);
+	}
+	else
+#endif // NGX_THREADS
+	{
+		rc = ngx_file_reader_init(
+			ctx->metadata_index_reader,
+			ngx_http_vod_handle_read_completed,
+			ctx,
+			r,
+			clcf,
+			&path,
+			OPEN_FILE_NO_LOG_NOT_FOUND);
+	}
+
+	switch (rc)
+	{
+	case NGX_OK:
+		break;
+
+	case NGX_AGAIN:
+		return rc;
+
+	default:
+		ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_open_metadata_index: no index for \"%V\" %i", &path, rc);
+		return NGX_DECLINED;
+	}
+
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_OPEN_FILE);
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_read_metadata_index(ngx_http_vod_ctx_t* ctx, media_clip_source_t* source)
+{
+	ngx_http_request_t* r = ctx->submodule_context.r;
+	ngx_int_t rc;
+	size_t size;
+
+	size = ngx_file_reader_get_size(ctx->metadata_index_reader);
+	if (size <= 0)
+	{
+		return NGX_DECLINED;
+	}
+
+	if (size > ctx->submodule_context.conf->max_metadata_size)
+	{
+		ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+			"ngx_http_vod_read_metadata_index: index size %uz exceeds the max metadata size", size);
+		return NGX_DECLINED;
+	}
+
+	rc = ngx_http_vod_alloc_read_buffer(ctx, size + source->alloc_extra_size, source->alignment);
+	if (rc != NGX_OK)
+	{
+		return rc;
+	}
+
+	ctx->state = STATE_READ_METADATA_INDEX_READ;
+
+	ngx_perf_counter_start(ctx->perf_counter_context);
+
+	rc = ngx_async_file_read(ctx->metadata_index_reader, &ctx->read_buffer, size, 0);
+	if (rc != NGX_OK)
+	{
+		if (rc != NGX_AGAIN)
+		{
+			ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+				"ngx_http_vod_read_metadata_index: async_read failed %i", rc);
+		}
+		return rc;
+	}
+
+	// read completed synchronously
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_READ_FILE);
+
+	ctx->metadata_reads++;
+	ctx->metadata_bytes_read += ctx->read_buffer.last - ctx->read_buffer.pos;
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_parse_metadata_index(ngx_http_vod_ctx_t* ctx, media_clip_source_t* source, uint32_t* format_id)
+{
+	metadata_index_source_t index_source;
+	ngx_file_reader_state_t* media_file = source->reader_context;
+	vod_status_t rc;
+	vod_str_t buffer;
+	uint32_t part_count;
+
+	buffer.data = ctx->read_buffer.pos;
+	buffer.len = ctx->read_buffer.last - ctx->read_buffer.pos;
+
+	// Note: the size and modification time are taken from the open media file, no additional stat is needed
+	index_source.size = media_file->file_size;
+	index_source.mtime = media_file->file_mtime;
+
+	rc = metadata_index_read(
+		&ctx->submodule_context.request_context,
+		&buffer,
+		&index_source,
+		format_id,
+		&ctx->metadata_parts,
+		&part_count);
+	if (rc != VOD_OK)
+	{
+		if (rc == VOD_ALLOC_FAILED)
+		{
+			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
+		}
+		return NGX_DECLINED;
+	}
+
+	ctx->metadata_part_count = part_count;
+
+	// the metadata parts point to the read buffer, make sure it is not reused
+	ctx->read_buffer.start = NULL;
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_state_machine_parse_metadata(ngx_http_vod_ctx_t *ctx)
+{
+	ngx_http_vod_loc_conf_t* conf = ctx->submodule_context.conf;
+	multipart_cache_header_t multipart_header;
+	media_clip_source_t* cur_source;
+	ngx_http_request_t* r = ctx->submodule_context.r;
+	ngx_int_t rc;
+	uint32_t cache_token;
+	bool_t metadata_loaded;
+
+	if (ctx->cur_source == NULL)
+	{
+		return NGX_OK;
+	}
+
+	for (;;)
+	{
+		switch (ctx->state)
+		{
+		case STATE_READ_METADATA_INITIAL:
+			metadata_loaded = FALSE;
+			cache_token = 0;
+			cur_source = ctx->cur_source;
+
+			if (cur_source->mapped_uri.len == empty_file_string.len &&
+				ngx_strncasecmp(cur_source->mapped_uri.data, empty_file_string.data, empty_file_string.len) == 0)
+			{
+				// the string "empty" identifies an empty srt file
+				ctx->metadata_parts = ngx_palloc(ctx->submodule_context.request_context.pool,
+					sizeof(*ctx->metadata_parts) + 1);
+				if (ctx->metadata_parts == NULL)
+				{
+					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+						"ngx_http_vod_state_machine_parse_metadata: ngx_palloc failed");
+					return ngx_http_vod_status_to_ngx_error(r, VOD_ALLOC_FAILED);
+				}
+
+				ctx->metadata_parts[0].len = 0;
+				ctx->metadata_parts[0].data = (void*)(ctx->metadata_parts + 1);
+				ctx->metadata_parts[0].data[0] = '\0';
+				multipart_header.type = FORMAT_ID_WEBVTT;
+				metadata_loaded = TRUE;
+			}
+			else if (conf->metadata_cache != NULL)
+			{
+				// try to fetch from cache
+				if (ngx_buffer_cache_fetch_multipart_perf(
+					ctx,
+					conf->metadata_cache,
+					cur_source->file_key,
+					&multipart_header,
+					&ctx->metadata_parts,
+					&cache_token))
+				{
+					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+						"ngx_http_vod_state_machine_parse_metadata: metadata cache hit");
+					metadata_loaded = TRUE;
+				}
+				else
+				{
+					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+						"ngx_http_vod_state_machine_parse_metadata: metadata cache miss");
+				}
+
+				ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_METADATA, metadata_loaded);
+			}
+
+			if (metadata_loaded)
+			{
+				// parse the metadata
+				rc = ngx_http_vod_init_format(ctx, multipart_header.type);
+				if (rc != NGX_OK)
+				{
+					return rc;
+				}
+
+				rc = ngx_http_vod_parse_metadata(ctx, 1);
+
+				if (cache_token && 
+					ctx->request != NULL)		// in case of progressive, the metadata parts are used in clipper_build_header
+				{
+					ngx_buffer_cache_release(
+						conf->metadata_cache,
+						cur_source->file_key,
+						cache_token);
+				}
+
+				if (rc == NGX_OK)
+				{
+					ctx->cur_source = cur_source->next;
 					if (ctx->cur_source == NULL)
 					{
 						return NGX_OK;
@@ -2443,6 +3434,10 @@ ngx_http_vod_state_machine_parse_metadata(ngx_http_vod_ctx_t *ctx)
 
 				ctx->state = STATE_READ_FRAMES_OPEN_FILE;
 			}
+			else if (conf->metadata_index)
+			{
+				ctx->state = STATE_READ_METADATA_OPEN_INDEX;
+			}
 			else
 			{
 				ctx->state = STATE_READ_METADATA_OPEN_FILE;
@@ -2461,6 +3456,112 @@ ngx_http_vod_state_machine_parse_metadata(ngx_http_vod_ctx_t *ctx)
 			}
 			break;
 
+		case STATE_READ_METADATA_OPEN_INDEX:
+			// the media file is open, try loading the metadata from the index file
+			cur_source = ctx->cur_source;
+			if (!ngx_http_vod_is_file_reader(cur_source->reader))
+			{
+				ctx->state = STATE_READ_METADATA_OPEN_FILE;
+				break;
+			}
+
+			ctx->state = STATE_READ_METADATA_INDEX_OPEN_FILE;
+
+			rc = ngx_http_vod_open_metadata_index(ctx, cur_source);
+			if (rc == NGX_DECLINED)
+			{
+				ctx->state = STATE_READ_METADATA_OPEN_FILE;
+				break;
+			}
+
+			if (rc != NGX_OK)
+			{
+				return rc;
+			}
+			// fall through
+
+		case STATE_READ_METADATA_INDEX_OPEN_FILE:
+			r->connection->log->action = "reading metadata index";
+
+			rc = ngx_http_vod_read_metadata_index(ctx, ctx->cur_source);
+			if (rc == NGX_DECLINED)
+			{
+				ctx->state = STATE_READ_METADATA_OPEN_FILE;
+				break;
+			}
+
+			if (rc != NGX_OK)
+			{
+				return rc;
+			}
+			// fall through
+
+		case STATE_READ_METADATA_INDEX_READ:
+			cur_source = ctx->cur_source;
+
+			rc = ngx_http_vod_parse_metadata_index(ctx, cur_source, &multipart_header.type);
+			if (rc == NGX_DECLINED)
+			{
+				ctx->state = STATE_READ_METADATA_OPEN_FILE;
+				break;
+			}
+
+			if (rc != NGX_OK)
+			{
+				return rc;
+			}
+
+			ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+				"ngx_http_vod_state_machine_parse_metadata: loaded metadata from index");
+
+			if (conf->metadata_cache != NULL)
+			{
+				multipart_header.part_count = ctx->metadata_part_count;
+
+				if (!ngx_buffer_cache_store_multipart_perf(
+					ctx,
+					conf->metadata_cache,
+					cur_source->file_key,
+					&multipart_header,
+					ctx->metadata_parts))
+				{
+					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+						"ngx_http_vod_state_machine_parse_metadata: failed to store metadata in cache");
+				}
+			}
+
+			// parse the metadata
+			rc = ngx_http_vod_init_format(ctx, multipart_header.type);
+			if (rc != NGX_OK)
+			{
+				return rc;
+			}
+
+			rc = ngx_http_vod_parse_metadata(ctx, 1);
+			if (rc == NGX_OK)
+			{
+				// move to the next source
+				ctx->state = STATE_READ_METADATA_INITIAL;
+
+				ctx->cur_source = cur_source->next;
+				if (ctx->cur_source == NULL)
+				{
+					return NGX_OK;
+				}
+				break;
+			}
+
+			if (rc != NGX_AGAIN)
+			{
+				ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+					"ngx_http_vod_state_machine_parse_metadata: ngx_http_vod_parse_metadata failed %i", rc);
+				return rc;
+			}
+
+			// the media file is already open, read the frames
+			ctx->state = STATE_READ_FRAMES_OPEN_FILE;
+			break;
+
 		case STATE_READ_METADATA_OPEN_FILE:
 			// allocate the initial read buffer
 			cur_source = ctx->cur_source;
@@ -2495,7 +3596,10 @@ ngx_http_vod_state_machine_parse_metadata(ngx_http_vod_ctx_t *ctx)
 			}
 
 			// read completed synchronously
-			ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_READ_FILE);
+			ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_READ_FILE);
+
+			ctx->metadata_reads++;
+			ctx->metadata_bytes_read += ctx->read_buffer.last - ctx->read_buffer.pos;
 			// fall through
 
 		case STATE_READ_METADATA_READ:
@@ -2672,164 +3776,6 @@ ngx_http_vod_validate_streams(ngx_http_vod_ctx_t *ctx)
 	return NGX_OK;
 }
 
-static ngx_int_t
-ngx_http_vod_update_track_timescale(
-	ngx_http_vod_ctx_t *ctx, 
-	media_track_t* track, 
-	uint32_t new_timescale, 
-	uint32_t pts_delay)
-{
-	frame_list_part_t* part;
-	input_frame_t* last_frame;
-	input_frame_t* cur_frame;
-	uint64_t next_scaled_dts;
-	uint64_t last_frame_dts;
-	uint64_t clip_start_dts;
-	uint64_t clip_end_pts;
-	uint64_t clip_end_dts;
-	uint64_t scaled_dts;
-	uint64_t scaled_pts;
-	uint64_t dts;
-	uint64_t pts;
-	uint32_t cur_timescale = track->media_info.timescale;
-
-	// frames
-	dts = track->first_frame_time_offset;
-	scaled_dts = rescale_time(dts, cur_timescale, new_timescale);
-	clip_start_dts = scaled_dts;
-
-	track->first_frame_time_offset = scaled_dts;
-	track->total_frames_duration = 0;
-
-	// initialize the first part
-	part = &track->frames;
-	cur_frame = part->first_frame;
-	last_frame = part->last_frame;
-	if (part->clip_to != UINT_MAX && cur_frame < last_frame)
-	{
-		clip_end_dts = rescale_time(part->clip_to, 1000, new_timescale);
-		if (track->media_info.media_type == MEDIA_TYPE_VIDEO)
-		{
-			clip_end_pts = clip_end_dts + rescale_time(track->media_info.u.video.initial_pts_delay,
-				cur_timescale, new_timescale);
-		}
-		else
-		{
-			clip_end_pts = ULLONG_MAX;
-		}
-	}
-	else
-	{
-		clip_end_dts = ULLONG_MAX;
-		clip_end_pts = ULLONG_MAX;
-	}
-
-	for (;; cur_frame++)
-	{
-		if (cur_frame >= last_frame)
-		{
-			if (clip_end_dts != ULLONG_MAX)
-			{
-				clip_end_dts = rescale_time(part->clip_to, 1000, new_timescale);
-				last_frame_dts = scaled_dts - cur_frame[-1].duration;
-
-				if (clip_end_dts > last_frame_dts)
-				{
-					cur_frame[-1].duration = clip_end_dts - last_frame_dts;
-					scaled_dts = clip_end_dts;
-				}
-				else
-				{
-					ngx_log_error(NGX_LOG_WARN, ctx->submodule_context.request_context.log, 0,
-						"ngx_http_vod_update_track_timescale: last frame dts %uL greater than clip end dts %uL",
-						last_frame_dts, clip_end_dts);
-				}
-
-				track->total_frames_duration += scaled_dts - clip_start_dts;
-
-				dts = 0;
-				scaled_dts = 0;
-				clip_start_dts = 0;
-			}
-
-			if (part->next == NULL)
-			{
-				break;
-			}
-
-			// initialize the next part
-			part = part->next;
-			cur_frame = part->first_frame;
-			last_frame = part->last_frame;
-			if (part->clip_to != UINT_MAX && cur_frame < last_frame)
-			{
-				clip_end_dts = rescale_time(part->clip_to, 1000, new_timescale);
-				if (track->media_info.media_type == MEDIA_TYPE_VIDEO)
-				{
-					clip_end_pts = clip_end_dts + rescale_time(track->media_info.u.video.initial_pts_delay,
-						cur_timescale, new_timescale);
-				}
-			}
-			else
-			{
-				clip_end_dts = ULLONG_MAX;
-				clip_end_pts = ULLONG_MAX;
-			}
-		}
-
-		// get the pts delay
-		pts = dts + cur_frame->pts_delay;
-		scaled_pts = rescale_time(pts, cur_timescale, new_timescale);
-		if (scaled_pts > clip_end_pts)
-		{
-			scaled_pts = ngx_max(clip_end_pts, scaled_dts);
-		}
-		cur_frame->pts_delay = scaled_pts - scaled_dts + pts_delay;
-
-		// get the duration
-		dts += cur_frame->duration;
-		next_scaled_dts = rescale_time(dts, cur_timescale, new_timescale);
-		cur_frame->duration = next_scaled_dts - scaled_dts;
-		scaled_dts = next_scaled_dts;
-	}
-
-	track->total_frames_duration += scaled_dts - clip_start_dts;
-	track->clip_from_frame_offset = rescale_time(track->clip_from_frame_offset, cur_timescale, new_timescale);
-
-	// media info
-	track->media_info.duration = rescale_time(track->media_info.duration, cur_timescale, new_timescale);
-	track->media_info.full_duration = rescale_time(track->media_info.full_duration, cur_timescale, new_timescale);
-	if (track->media_info.full_duration == 0)
-	{
-		ngx_log_error(NGX_LOG_ERR, ctx->submodule_context.request_context.log, 0,
-			"ngx_http_vod_update_track_timescale: full duration is zero following rescale");
-		return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_BAD_DATA);
-	}
-
-	if (track->media_info.media_type == MEDIA_TYPE_VIDEO)
-	{
-		if (track->media_info.min_frame_duration != 0)
-		{
-			track->media_info.min_frame_duration =
-				rescale_time(track->media_info.min_frame_duration, cur_timescale, new_timescale);
-			if (track->media_info.min_frame_duration == 0)
-			{
-				ngx_log_error(NGX_LOG_WARN, ctx->submodule_context.request_context.log, 0,
-					"ngx_http_vod_update_track_timescale: min frame duration is zero following rescale");
-				track->media_info.min_frame_duration = 1;
-			}
-		}
-
-		track->media_info.u.video.initial_pts_delay =
-			rescale_time(track->media_info.u.video.initial_pts_delay, cur_timescale, new_timescale);
-	}
-
-	track->media_info.timescale = new_timescale;
-	track->media_info.frames_timescale = new_timescale;
-
-	return NGX_OK;
-}
-
 static ngx_int_t
 ngx_http_vod_update_timescale(ngx_http_vod_ctx_t *ctx)
 {
@@ -2839,14 +3785,14 @@ ngx_http_vod_update_timescale(ngx_http_vod_ctx_t *ctx)
 
 	for (track = media_set->filtered_tracks; track < media_set->filtered_tracks_end; track++)
 	{
-		rc = ngx_http_vod_update_track_timescale(
-			ctx, 
+		rc = media_format_update_track_timescale(
+			&ctx->submodule_context.request_context,
 			track, 
 			ctx->request->timescale, 
 			ctx->submodule_context.request_params.pts_delay);
-		if (rc != NGX_OK)
+		if (rc != VOD_OK)
 		{
-			return rc;
+			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
 		}
 	}
 
@@ -2891,7 +3837,7 @@ ngx_http_vod_handle_metadata_request(ngx_http_vod_ctx_t *ctx)
 		return rc;
 	}
 
-	ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_BUILD_MANIFEST);
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_BUILD_MANIFEST);
 
 	if (ctx->submodule_context.media_set.original_type != MEDIA_SET_LIVE ||
 		(ctx->request->flags & REQUEST_FLAG_TIME_DEPENDENT_ON_LIVE) == 0)
@@ -3079,6 +4025,19 @@ ngx_http_vod_write_segment_buffer(void* ctx, u_char* buffer, uint32_t size)
 		out.buf = b;
 		out.next = NULL;
 
+		// Note: the buffer must be copied before it is sent, since it may be recycled by the output buffer pool
+		if (context->cache_buffer != NULL)
+		{
+			if (context->total_size + size <= context->cache_buffer_size)
+			{
+				ngx_memcpy(context->cache_buffer + context->total_size, buffer, size);
+			}
+			else
+			{
+				context->cache_buffer = NULL;
+			}
+		}
+
 		rc = ngx_http_output_filter(context->r, &out);
 		if (rc != NGX_OK && rc != NGX_AGAIN)
 		{
@@ -3091,26 +4050,90 @@ ngx_http_vod_write_segment_buffer(void* ctx, u_char* buffer, uint32_t size)
 	}
 	else
 	{
-		// headers not sent yet, add the buffer to the chain
-		if (context->chain_end->buf != NULL)
-		{
-			chain = ngx_alloc_chain_link(context->r->pool);
-			if (chain == NULL) 
-			{
-				ngx_log_debug0(NGX_LOG_DEBUG_HTTP, context->r->connection->log, 0,
-					"ngx_http_vod_write_segment_buffer: ngx_alloc_chain_link failed");
-				return VOD_ALLOC_FAILED;
-			}
-
-			context->chain_end->next = chain;
-			context->chain_end = chain;
-		}
-		context->chain_end->buf = b;
+		// headers not sent yet, add the buffer to the chain
+		if (context->chain_end->buf != NULL)
+		{
+			chain = ngx_alloc_chain_link(context->r->pool);
+			if (chain == NULL) 
+			{
+				ngx_log_debug0(NGX_LOG_DEBUG_HTTP, context->r->connection->log, 0,
+					"ngx_http_vod_write_segment_buffer: ngx_alloc_chain_link failed");
+				return VOD_ALLOC_FAILED;
+			}
+
+			context->chain_end->next = chain;
+			context->chain_end = chain;
+		}
+		context->chain_end->buf = b;
+	}
+
+	context->total_size += size;
+
+	return VOD_OK;
+}
+
+// Note: the size of a segment is saved to the segment cache, keyed by a variation of the segment key.
+//		this saves the need to recalculate the size (e.g. simulate the muxing of an hls segment) on requests
+//		that are not served from the segment cache - HEAD / range requests, segments that were not admitted yet
+static void
+ngx_http_vod_get_response_size_key(ngx_http_vod_ctx_t *ctx, u_char* key)
+{
+	ngx_md5_t md5;
+
+	ngx_md5_init(&md5);
+	ngx_md5_update(&md5, "size", sizeof("size") - 1);
+	ngx_md5_update(&md5, ctx->request_key, sizeof(ctx->request_key));
+	ngx_md5_final(key, &md5);
+}
+
+static size_t
+ngx_http_vod_fetch_response_size(ngx_http_vod_ctx_t *ctx, u_char* key)
+{
+	ngx_buffer_cache_t* cache = ctx->submodule_context.conf->segment_cache;
+	ngx_str_t cache_buffer;
+	uint32_t token;
+	size_t result;
+
+	if (!ngx_buffer_cache_fetch_perf(ctx->perf_counters, cache, key, &cache_buffer, &token))
+	{
+		return 0;
+	}
+
+	if (cache_buffer.len == sizeof(result))
+	{
+		ngx_memcpy(&result, cache_buffer.data, sizeof(result));
+	}
+	else
+	{
+		result = 0;
 	}
 
-	context->total_size += size;
+	ngx_buffer_cache_release(cache, key, token);
 
-	return VOD_OK;
+	ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+		"ngx_http_vod_fetch_response_size: response size cache hit, size is %uz", result);
+
+	return result;
+}
+
+static void
+ngx_http_vod_store_response_size(ngx_http_vod_ctx_t *ctx, u_char* key)
+{
+	if (ngx_buffer_cache_store_perf(
+		ctx->perf_counters,
+		ctx->submodule_context.conf->segment_cache,
+		key,
+		(u_char*)&ctx->content_length,
+		sizeof(ctx->content_length)))
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+			"ngx_http_vod_store_response_size: stored response size in cache");
+	}
+	else
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+			"ngx_http_vod_store_response_size: failed to store response size in cache");
+	}
 }
 
 static ngx_int_t 
@@ -3122,6 +4145,8 @@ ngx_http_vod_init_frame_processing(ngx_http_vod_ctx_t *ctx)
 	ngx_int_t rc;
 	off_t range_start;
 	off_t range_end;
+	u_char size_key[BUFFER_CACHE_KEY_SIZE];
+	size_t cached_size;
 
 	rc = ngx_http_vod_update_timescale(ctx);
 	if (rc != NGX_OK)
@@ -3138,6 +4163,21 @@ ngx_http_vod_init_frame_processing(ngx_http_vod_ctx_t *ctx)
 	ctx->segment_writer.write_head = ngx_http_vod_write_segment_header_buffer;
 	ctx->segment_writer.context = &ctx->write_segment_buffer_context;
 
+	// get the size of the response from a previous request
+	if ((ctx->request->flags & REQUEST_FLAG_CACHE_RESPONSE_SIZE) != 0 &&
+		ctx->submodule_context.conf->segment_cache != NULL)
+	{
+		ngx_http_vod_get_response_size_key(ctx, size_key);
+
+		ctx->content_length = ngx_http_vod_fetch_response_size(ctx, size_key);
+	}
+	else
+	{
+		ctx->content_length = 0;
+	}
+
+	cached_size = ctx->content_length;
+
 	// initialize the protocol specific frame processor
 	ngx_perf_counter_start(ctx->perf_counter_context);
 
@@ -3156,12 +4196,44 @@ ngx_http_vod_init_frame_processing(ngx_http_vod_ctx_t *ctx)
 		return rc;
 	}
 
-	ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_INIT_FRAME_PROCESS);
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_INIT_FRAME_PROCESS);
+
+	if (cached_size == 0 && ctx->content_length != 0 &&
+		(ctx->request->flags & REQUEST_FLAG_CACHE_RESPONSE_SIZE) != 0 &&
+		ctx->submodule_context.conf->segment_cache != NULL)
+	{
+		ngx_http_vod_store_response_size(ctx, size_key);
+	}
 
 	r->headers_out.content_type_len = content_type.len;
 	r->headers_out.content_type.len = content_type.len;
 	r->headers_out.content_type.data = content_type.data;
 
+	// check whether the response should be saved to the segment cache
+	if (ctx->segment_cache_store)
+	{
+		if (r->headers_in.range != NULL ||
+			r->method == NGX_HTTP_HEAD ||
+			ctx->submodule_context.media_set.original_type != MEDIA_SET_VOD ||
+			ctx->content_length > ctx->submodule_context.conf->segment_cache_max_size)
+		{
+			ctx->segment_cache_store = 0;
+		}
+		else if (ctx->content_length != 0)
+		{
+			// the response is sent while it's being built, keep a copy of it
+			ctx->write_segment_buffer_context.cache_buffer = ngx_palloc(r->pool, ctx->content_length);
+			if (ctx->write_segment_buffer_context.cache_buffer == NULL)
+			{
+				ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+					"ngx_http_vod_init_frame_processing: ngx_palloc failed");
+				return ngx_http_vod_status_to_ngx_error(r, VOD_ALLOC_FAILED);
+			}
+
+			ctx->write_segment_buffer_context.cache_buffer_size = ctx->content_length;
+		}
+	}
+
 	// if the frame processor can't determine the size in advance we have to build the whole response before we can start sending it
 	if (ctx->content_length != 0)
 	{
@@ -3221,6 +4293,109 @@ ngx_http_vod_init_frame_processing(ngx_http_vod_ctx_t *ctx)
 	return NGX_OK;
 }
 
+#if (NGX_THREADS)
+typedef struct {
+	ngx_http_vod_ctx_t* ctx;
+	ngx_http_vod_frame_task_t frame_task;
+	vod_status_t rc;
+} ngx_http_vod_frame_task_ctx_t;
+
+static void
+ngx_http_vod_frame_task_handler(void *data, ngx_log_t *log)
+{
+	ngx_http_vod_frame_task_ctx_t* task_ctx = data;
+
+	task_ctx->rc = task_ctx->frame_task.handler(task_ctx->frame_task.context);
+}
+
+static void
+ngx_http_vod_frame_task_completed(ngx_event_t *ev)
+{
+	ngx_http_vod_frame_task_ctx_t* task_ctx = ev->data;
+	ngx_http_vod_ctx_t* ctx = task_ctx->ctx;
+	ngx_http_request_t* r = ctx->submodule_context.r;
+	ngx_connection_t* c = r->connection;
+	ngx_int_t rc;
+
+	r->main->blocked--;
+	r->aio = 0;
+
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_ASYNC_PROCESS_FRAMES);
+
+	if (task_ctx->rc != VOD_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+			"ngx_http_vod_frame_task_completed: frame task failed %i", task_ctx->rc);
+		rc = ngx_http_vod_status_to_ngx_error(r, task_ctx->rc);
+		goto finalize_request;
+	}
+
+	// run the state machine, calls the frame processor again
+	rc = ctx->state_machine(ctx);
+	if (rc == NGX_AGAIN)
+	{
+		goto done;
+	}
+
+finalize_request:
+
+	ngx_http_vod_finalize_request(ctx, rc);
+
+done:
+
+	ngx_http_run_posted_requests(c);
+}
+
+static ngx_int_t
+ngx_http_vod_post_frame_task(ngx_http_vod_ctx_t *ctx)
+{
+	ngx_http_vod_frame_task_ctx_t* task_ctx;
+	ngx_http_request_t* r = ctx->submodule_context.r;
+	ngx_thread_task_t* task;
+
+	task = ctx->frame_task;
+	if (task == NULL)
+	{
+		task = ngx_thread_task_alloc(r->pool, sizeof(*task_ctx));
+		if (task == NULL)
+		{
+			ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+				"ngx_http_vod_post_frame_task: ngx_thread_task_alloc failed");
+			return ngx_http_vod_status_to_ngx_error(r, VOD_ALLOC_FAILED);
+		}
+
+		task->handler = ngx_http_vod_frame_task_handler;
+
+		ctx->frame_task = task;
+	}
+
+	task_ctx = task->ctx;
+	task_ctx->ctx = ctx;
+	task_ctx->frame_task = ctx->submodule_context.frame_task;
+	task_ctx->rc = VOD_UNEXPECTED;
+
+	// the frame processor is called again on completion, clear the task so that it won't be posted again
+	ctx->submodule_context.frame_task.handler = NULL;
+
+	task->event.data = task_ctx;
+	task->event.handler = ngx_http_vod_frame_task_completed;
+
+	ngx_perf_counter_start(ctx->perf_counter_context);
+
+	if (ngx_thread_task_post(task_ctx->frame_task.thread_pool, task) != NGX_OK)
+	{
+		ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+			"ngx_http_vod_post_frame_task: ngx_thread_task_post failed");
+		return ngx_http_vod_status_to_ngx_error(r, VOD_UNEXPECTED);
+	}
+
+	r->main->blocked++;
+	r->aio = 1;
+
+	return NGX_AGAIN;
+}
+#endif // NGX_THREADS
+
 static ngx_int_t 
 ngx_http_vod_process_media_frames(ngx_http_vod_ctx_t *ctx)
 {
@@ -3234,11 +4409,18 @@ ngx_http_vod_process_media_frames(ngx_http_vod_ctx_t *ctx)
 
 		rc = ctx->frame_processor(ctx->frame_processor_state);
 
-		ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_PROCESS_FRAMES);
-
+		ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_PROCESS_FRAMES);
+	
 		switch (rc)
 		{
 		case VOD_OK:
+#if (NGX_THREADS)
+			if (ctx->submodule_context.frame_task.handler != NULL)
+			{
+				return ngx_http_vod_post_frame_task(ctx);
+			}
+#endif // NGX_THREADS
+
 			// we're done
 			return NGX_OK;
 
@@ -3264,13 +4446,14 @@ ngx_http_vod_process_media_frames(ngx_http_vod_ctx_t *ctx)
 			&ctx->read_cache_state,
 			&read_buf);
 
-		cache_buffer_size = ctx->submodule_context.conf->cache_buffer_size;
+		// Note: the read ahead space is allocated only when the read cache extended the read (sequential access),
+		//		other reads use buffers of the configured size
+		cache_buffer_size = ngx_max(ctx->submodule_context.conf->cache_buffer_size, read_buf.size);
 
+		// Note: the slot buffer may have been allocated by an earlier read that was not extended, use its actual
+		//		capacity so that ngx_http_vod_alloc_read_buffer reallocates it when the read ahead does not fit
 		ctx->read_buffer.start = read_buf.buffer;
-		if (read_buf.buffer != NULL)
-		{
-			ctx->read_buffer.end = read_buf.buffer + cache_buffer_size;
-		}
+		ctx->read_buffer.end = read_buf.buffer_end;
 
 		rc = ngx_http_vod_alloc_read_buffer(ctx, cache_buffer_size + read_buf.source->alloc_extra_size, read_buf.source->alignment);
 		if (rc != NGX_OK)
@@ -3296,17 +4479,80 @@ ngx_http_vod_process_media_frames(ngx_http_vod_ctx_t *ctx)
 			return rc;
 		}
 
-		ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_READ_FILE);
+		ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_READ_FILE);
+
+		ctx->frames_reads++;
+		ctx->frames_bytes_read += (ctx->read_buffer.last - ctx->read_buffer.pos);
 
 		// read completed synchronously, update the read cache
 		read_cache_read_completed(&ctx->read_cache_state, &ctx->read_buffer);
 	}
 }
 
+static void
+ngx_http_vod_segment_cache_store(ngx_http_vod_ctx_t *ctx, ngx_chain_t* chain)
+{
+	response_cache_header_t cache_header;
+	ngx_http_request_t *r = ctx->submodule_context.r;
+	ngx_str_t* cache_buffers;
+	ngx_str_t* cur_buffer;
+	ngx_chain_t* cl;
+	size_t buffer_count;
+
+	if (ctx->write_segment_buffer_context.total_size > ctx->submodule_context.conf->segment_cache_max_size)
+	{
+		return;
+	}
+
+	buffer_count = 2;
+	for (cl = chain; cl != NULL; cl = cl->next)
+	{
+		buffer_count++;
+	}
+
+	cache_buffers = ngx_palloc(r->pool, sizeof(cache_buffers[0]) * buffer_count);
+	if (cache_buffers == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_segment_cache_store: ngx_palloc failed");
+		return;
+	}
+
+	cache_header.content_type_len = r->headers_out.content_type.len;
+	cache_header.media_set_type = MEDIA_SET_VOD;
+
+	cur_buffer = cache_buffers;
+	cur_buffer->data = (u_char*)&cache_header;
+	cur_buffer->len = sizeof(cache_header);
+	cur_buffer++;
+
+	*cur_buffer++ = r->headers_out.content_type;
+
+	for (cl = chain; cl != NULL; cl = cl->next)
+	{
+		cur_buffer->data = cl->buf->pos;
+		cur_buffer->len = cl->buf->last - cl->buf->pos;
+		cur_buffer++;
+	}
+
+	if (ngx_buffer_cache_store_gather_perf(ctx->perf_counters, ctx->submodule_context.conf->segment_cache, ctx->request_key, cache_buffers, buffer_count))
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_segment_cache_store: stored in segment cache");
+	}
+	else
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_segment_cache_store: failed to store segment in cache");
+	}
+}
+
 static ngx_int_t
 ngx_http_vod_finalize_segment_response(ngx_http_vod_ctx_t *ctx)
 {
 	ngx_http_request_t *r = ctx->submodule_context.r;
+	ngx_chain_t cache_chain;
+	ngx_buf_t cache_buf;
 	ngx_int_t rc;
 
 	rc = ctx->segment_writer.write_tail(ctx->segment_writer.context, NULL, 0);
@@ -3327,6 +4573,17 @@ ngx_http_vod_finalize_segment_response(ngx_http_vod_ctx_t *ctx)
 				"ngx_http_vod_finalize_segment_response: actual content length %uz is different than reported length %uz",
 				ctx->write_segment_buffer_context.total_size, ctx->content_length);
 		}
+		else if (ctx->write_segment_buffer_context.cache_buffer != NULL &&
+			ctx->write_segment_buffer_context.total_size == ctx->write_segment_buffer_context.cache_buffer_size)
+		{
+			ngx_memzero(&cache_buf, sizeof(cache_buf));
+			cache_buf.pos = ctx->write_segment_buffer_context.cache_buffer;
+			cache_buf.last = cache_buf.pos + ctx->write_segment_buffer_context.cache_buffer_size;
+			cache_chain.buf = &cache_buf;
+			cache_chain.next = NULL;
+
+			ngx_http_vod_segment_cache_store(ctx, &cache_chain);
+		}
 
 		rc = ngx_http_send_special(r, NGX_HTTP_LAST);
 		if (rc != NGX_OK && rc != NGX_AGAIN)
@@ -3349,6 +4606,11 @@ ngx_http_vod_finalize_segment_response(ngx_http_vod_ctx_t *ctx)
 	ctx->write_segment_buffer_context.chain_end->next = NULL;
 	ctx->write_segment_buffer_context.chain_end->buf->last_buf = 1;
 
+	if (ctx->segment_cache_store)
+	{
+		ngx_http_vod_segment_cache_store(ctx, &ctx->out);
+	}
+
 	// send the response header
 	rc = ngx_http_vod_send_header(r, ctx->write_segment_buffer_context.total_size, NULL, MEDIA_SET_VOD, NULL);
 	if (rc != NGX_OK)
@@ -3563,68 +4825,212 @@ ngx_http_vod_run_generators(ngx_http_vod_ctx_t *ctx)
 		parse_params.clip_to = cur_source->clip_to;
 		parse_params.clip_from = 0;
 
-		ngx_http_vod_init_parse_params_metadata(ctx, tracks_mask, &parse_params);
+		ngx_http_vod_init_parse_params_metadata(ctx, tracks_mask, &parse_params);
+
+		// Note: currently, the only generator is the silence generator
+		generator = &silence_generator;
+
+		if (!ngx_http_vod_generator_matches(
+			&parse_params,
+			generator))
+		{
+			ngx_memzero(&cur_source->track_array, sizeof(cur_source->track_array));
+			continue;
+		}
+
+		if (parse_params.langs_mask != NULL &&
+			!vod_is_bit_set(parse_params.langs_mask, cur_source->sequence->tags.language))
+		{
+			ngx_memzero(&cur_source->track_array, sizeof(cur_source->track_array));
+			continue;
+		}
+
+		rc = ngx_http_vod_init_parse_params_frames(
+			ctx,
+			&range,
+			&parse_params);
+		switch (rc)
+		{
+		case NGX_OK:
+			break;		// handled outside the switch
+
+		case NGX_DONE:
+			ngx_memzero(&cur_source->track_array, sizeof(cur_source->track_array));
+			continue;
+
+		default:
+			return rc;
+		}
+
+		rc = generator->generate(
+			&ctx->submodule_context.request_context,
+			&parse_params,
+			&cur_source->track_array);
+		if (rc != VOD_OK)
+		{
+			ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+				"ngx_http_vod_run_generators: generator failed %i", rc);
+			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
+		}
+
+		ngx_http_vod_update_source_tracks(&ctx->submodule_context.request_context, ctx->cur_source);
+	}
+
+	ctx->cur_source = NULL;
+
+	return NGX_OK;
+}
+
+static bool_t
+ngx_http_vod_audio_filter_cache_fetch(void* context, vod_str_t* key, vod_str_t* result)
+{
+	ngx_http_vod_ctx_t* ctx = context;
+	u_char cache_key[BUFFER_CACHE_KEY_SIZE];
+	ngx_md5_t md5;
+
+	ngx_md5_init(&md5);
+	ngx_md5_update(&md5, key->data, key->len);
+	ngx_md5_final(cache_key, &md5);
+
+	if (ngx_buffer_cache_fetch_copy_perf(
+		ctx->submodule_context.r,
+		ctx->perf_counters,
+		&ctx->submodule_context.conf->audio_filter_cache,
+		1,
+		cache_key,
+		result) < 0)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+			"ngx_http_vod_audio_filter_cache_fetch: audio filter cache miss");
+		ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_AUDIO_FILTER, 0);
+		return FALSE;
+	}
+
+	ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+		"ngx_http_vod_audio_filter_cache_fetch: audio filter cache hit");
+	ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_AUDIO_FILTER, 1);
+	return TRUE;
+}
+
+static void
+ngx_http_vod_audio_filter_cache_store(void* context, vod_str_t* key, vod_str_t* buffer)
+{
+	ngx_http_vod_ctx_t* ctx = context;
+	u_char cache_key[BUFFER_CACHE_KEY_SIZE];
+	ngx_md5_t md5;
+
+	ngx_md5_init(&md5);
+	ngx_md5_update(&md5, key->data, key->len);
+	ngx_md5_final(cache_key, &md5);
+
+	if (ngx_buffer_cache_store_perf(
+		ctx->perf_counters,
+		ctx->submodule_context.conf->audio_filter_cache,
+		cache_key,
+		buffer->data,
+		buffer->len))
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+			"ngx_http_vod_audio_filter_cache_store: stored filtered audio in cache");
+	}
+	else
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+			"ngx_http_vod_audio_filter_cache_store: failed to store filtered audio in cache");
+	}
+}
+
+#if (NGX_THREADS)
+typedef struct {
+	ngx_http_vod_submodule_context_t* submodule_context;
+	void* filter_state;
+} ngx_http_vod_deferred_filter_t;
+
+static void
+ngx_http_vod_destroy_pool(void* data)
+{
+	ngx_destroy_pool(data);
+}
 
-		// Note: currently, the only generator is the silence generator
-		generator = &silence_generator;
+static vod_status_t
+ngx_http_vod_run_deferred_filter(void* context)
+{
+	ngx_http_vod_deferred_filter_t* state = context;
+	ngx_http_vod_frame_task_t* frame_task;
+	vod_status_t rc;
 
-		if (!ngx_http_vod_generator_matches(
-			&parse_params,
-			generator))
-		{
-			ngx_memzero(&cur_source->track_array, sizeof(cur_source->track_array));
-			continue;
-		}
+	rc = filter_run_state_machine(state->filter_state);
+	if (rc != VOD_OK || !filter_has_deferred(state->filter_state))
+	{
+		return rc;
+	}
 
-		if (parse_params.langs_mask != NULL &&
-			!vod_is_bit_set(parse_params.langs_mask, cur_source->sequence->tags.language))
-		{
-			ngx_memzero(&cur_source->track_array, sizeof(cur_source->track_array));
-			continue;
-		}
+	// the input frames were read, decode / filter / encode on the thread pool
+	frame_task = &state->submodule_context->frame_task;
+	frame_task->thread_pool = state->submodule_context->conf->audio_filter_thread_pool;
+	frame_task->handler = filter_run_deferred;
+	frame_task->context = state->filter_state;
 
-		rc = ngx_http_vod_init_parse_params_frames(
-			ctx,
-			&range,
-			&parse_params);
-		switch (rc)
-		{
-		case NGX_OK:
-			break;		// handled outside the switch
+	return VOD_OK;
+}
 
-		case NGX_DONE:
-			ngx_memzero(&cur_source->track_array, sizeof(cur_source->track_array));
-			continue;
+static ngx_int_t
+ngx_http_vod_init_deferred_filter_context(ngx_http_vod_ctx_t *ctx, request_context_t** result)
+{
+	request_context_t* request_context = &ctx->submodule_context.request_context;
+	request_context_t* deferred_context;
+	ngx_pool_cleanup_t* cln;
+	ngx_pool_t* pool;
 
-		default:
-			return rc;
-		}
+	deferred_context = ngx_palloc(request_context->pool, sizeof(*deferred_context));
+	if (deferred_context == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_init_deferred_filter_context: ngx_palloc failed");
+		return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_ALLOC_FAILED);
+	}
 
-		rc = generator->generate(
-			&ctx->submodule_context.request_context,
-			&parse_params,
-			&cur_source->track_array);
-		if (rc != VOD_OK)
-		{
-			ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
-				"ngx_http_vod_run_generators: generator failed %i", rc);
-			return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
-		}
+	cln = ngx_pool_cleanup_add(request_context->pool, 0);
+	if (cln == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_init_deferred_filter_context: ngx_pool_cleanup_add failed");
+		return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_ALLOC_FAILED);
+	}
 
-		ngx_http_vod_update_source_tracks(&ctx->submodule_context.request_context, ctx->cur_source);
+	// Note: the audio filter allocates from a private pool, since it may run on a thread
+	//		while the event loop is using the request pool
+	pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, request_context->log);
+	if (pool == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_init_deferred_filter_context: ngx_create_pool failed");
+		return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_ALLOC_FAILED);
 	}
 
-	ctx->cur_source = NULL;
+	cln->handler = ngx_http_vod_destroy_pool;
+	cln->data = pool;
+
+	*deferred_context = *request_context;
+	deferred_context->pool = pool;
+
+	*result = deferred_context;
 
 	return NGX_OK;
 }
+#endif // NGX_THREADS
 
 static ngx_int_t
 ngx_http_vod_run_state_machine(ngx_http_vod_ctx_t *ctx)
 {
+	request_context_t* deferred_context;
+	filter_cache_t* filter_cache;
 	ngx_int_t rc;
 	uint32_t max_frame_count;
 	uint32_t output_codec_id;
+#if (NGX_THREADS)
+	ngx_http_vod_deferred_filter_t* deferred_filter;
+#endif // NGX_THREADS
 
 	switch (ctx->state)
 	{
@@ -3704,6 +5110,10 @@ ngx_http_vod_run_state_machine(ngx_http_vod_ctx_t *ctx)
 				&ctx->read_cache_state,
 				&ctx->submodule_context.request_context,
 				ctx->submodule_context.conf->cache_buffer_size);
+
+			read_cache_set_read_ahead(
+				&ctx->read_cache_state,
+				ctx->submodule_context.conf->read_ahead_buffers);
 		}
 
 		ctx->state = STATE_OPEN_FILE;
@@ -3776,12 +5186,42 @@ ngx_http_vod_run_state_machine(ngx_http_vod_ctx_t *ctx)
 				output_codec_id = VOD_CODEC_ID_AAC;
 			}
 
+			filter_cache = NULL;
+			if (ctx->submodule_context.conf->audio_filter_cache != NULL)
+			{
+				filter_cache = ngx_palloc(ctx->submodule_context.request_context.pool, sizeof(*filter_cache));
+				if (filter_cache == NULL)
+				{
+					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+						"ngx_http_vod_run_state_machine: ngx_palloc failed");
+					return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_ALLOC_FAILED);
+				}
+
+				filter_cache->fetch = ngx_http_vod_audio_filter_cache_fetch;
+				filter_cache->store = ngx_http_vod_audio_filter_cache_store;
+				filter_cache->context = ctx;
+			}
+
+			deferred_context = NULL;
+#if (NGX_THREADS)
+			if (ctx->submodule_context.conf->audio_filter_thread_pool != NULL)
+			{
+				rc = ngx_http_vod_init_deferred_filter_context(ctx, &deferred_context);
+				if (rc != NGX_OK)
+				{
+					return rc;
+				}
+			}
+#endif // NGX_THREADS
+
 			rc = filter_init_state(
 				&ctx->submodule_context.request_context,
 				&ctx->read_cache_state,
 				&ctx->submodule_context.media_set,
 				max_frame_count,
 				output_codec_id,
+				deferred_context,
+				filter_cache,
 				&ctx->frame_processor_state);
 			if (rc != VOD_OK)
 			{
@@ -3791,6 +5231,25 @@ ngx_http_vod_run_state_machine(ngx_http_vod_ctx_t *ctx)
 			}
 
 			ctx->frame_processor = filter_run_state_machine;
+
+#if (NGX_THREADS)
+			if (deferred_context != NULL)
+			{
+				deferred_filter = ngx_palloc(ctx->submodule_context.request_context.pool, sizeof(*deferred_filter));
+				if (deferred_filter == NULL)
+				{
+					ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
+						"ngx_http_vod_run_state_machine: ngx_palloc failed (2)");
+					return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, VOD_ALLOC_FAILED);
+				}
+
+				deferred_filter->submodule_context = &ctx->submodule_context;
+				deferred_filter->filter_state = ctx->frame_processor_state;
+
+				ctx->frame_processor = ngx_http_vod_run_deferred_filter;
+				ctx->frame_processor_state = deferred_filter;
+			}
+#endif // NGX_THREADS
 		}
 
 		// fall through
@@ -3934,7 +5393,7 @@ ngx_http_vod_handle_read_completed(void* context, ngx_int_t rc, ngx_buf_t* buf,
 		}
 	}
 
-	ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, ctx->perf_counter_async_read);
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, ctx->perf_counter_async_read);
 
 	switch (ctx->state)
 	{
@@ -3944,10 +5403,21 @@ ngx_http_vod_handle_read_completed(void* context, ngx_int_t rc, ngx_buf_t* buf,
 		{
 			buf = &ctx->read_buffer;
 		}
+		ctx->frames_reads++;
 		ctx->frames_bytes_read += (buf->last - buf->pos);
 		read_cache_read_completed(&ctx->read_cache_state, buf);
 		break;
 
+	case STATE_READ_METADATA_INDEX_READ:
+	case STATE_READ_METADATA_READ:
+	case STATE_READ_FRAMES_READ:
+		ctx->metadata_reads++;
+		if (bytes_read > 0)
+		{
+			ctx->metadata_bytes_read += bytes_read;
+		}
+		// fall through
+
 	default:
 		if (buf != NULL)
 		{
@@ -4204,7 +5674,7 @@ ngx_http_vod_file_open_completed_internal(void* context, ngx_int_t rc, ngx_flag_
 		goto finalize_request;
 	}
 
-	ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_ASYNC_OPEN_FILE);
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_ASYNC_OPEN_FILE);
 
 	// run the state machine
 	rc = ctx->state_machine(ctx);
@@ -4304,7 +5774,7 @@ ngx_http_vod_init_file_reader_internal(ngx_http_request_t *r, ngx_str_t* path, v
 		return rc;
 	}
 
-	ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_OPEN_FILE);
+	ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_OPEN_FILE);
 
 	return NGX_OK;
 }
@@ -4583,6 +6053,8 @@ ngx_http_vod_map_run_step(ngx_http_vod_ctx_t *ctx)
 		ngx_md5_update(&md5, uri.data, uri.len);
 		ngx_md5_final(ctx->mapping.cache_key, &md5);
 
+		ctx->mapping.cache_value.len = 0;
+
 		// try getting the mapping from cache
 		fetch_cache_index = ngx_buffer_cache_fetch_multi_perf(
 			ctx->perf_counters,
@@ -4596,6 +6068,8 @@ ngx_http_vod_map_run_step(ngx_http_vod_ctx_t *ctx)
 			ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
 				"ngx_http_vod_map_run_step: mapping cache hit %V", &mapping);
 
+			ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_MAPPING, 1);
+
 			rc = ctx->mapping.apply(ctx, &mapping, &store_cache_index);
 
 			ngx_buffer_cache_release(
@@ -4614,6 +6088,8 @@ ngx_http_vod_map_run_step(ngx_http_vod_ctx_t *ctx)
 		{
 			ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
 				"ngx_http_vod_map_run_step: mapping cache miss");
+
+			ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_MAPPING, 0);
 		}
 
 		// open the mapping file
@@ -4681,7 +6157,7 @@ ngx_http_vod_map_run_step(ngx_http_vod_ctx_t *ctx)
 			return rc;
 		}
 
-		ngx_perf_counter_end(ctx->perf_counters, ctx->perf_counter_context, PC_MAP_PATH);
+		ngx_http_vod_perf_counter_end(ctx, ctx->perf_counter_context, PC_MAP_PATH);
 
 		// fall through
 
@@ -4727,14 +6203,20 @@ ngx_http_vod_map_run_step(ngx_http_vod_ctx_t *ctx)
 			cache = NULL;
 		}
 
+		if (ctx->mapping.cache_value.len <= 0)
+		{
+			ctx->mapping.cache_value.data = response->pos;
+			ctx->mapping.cache_value.len = response->last - response->pos;
+		}
+
 		if (cache != NULL)
 		{
 			if (ngx_buffer_cache_store_perf(
 				ctx->perf_counters,
 				cache,
 				ctx->mapping.cache_key,
-				response->pos,
-				response->last - response->pos))
+				ctx->mapping.cache_value.data,
+				ctx->mapping.cache_value.len))
 			{
 				ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ctx->submodule_context.request_context.log, 0,
 					"ngx_http_vod_map_run_step: stored in mapping cache");
@@ -5161,6 +6643,52 @@ ngx_http_vod_handle_thumb_redirect(
 }
 #endif // NGX_HAVE_LIB_AV_CODEC
 
+static vod_status_t
+ngx_http_vod_map_media_set_parse(ngx_http_vod_ctx_t *ctx, ngx_str_t* mapping, vod_json_value_t* result)
+{
+	request_context_t* request_context = &ctx->submodule_context.request_context;
+	vod_status_t rc;
+	u_char error[128];
+
+	if (vod_json_binary_detect(mapping))
+	{
+		// pre-tokenized mapping - stored by a previous request or returned by the upstream
+		rc = vod_json_binary_decode(request_context->pool, mapping, result, error, sizeof(error));
+		if (rc != VOD_JSON_OK)
+		{
+			ngx_log_error(NGX_LOG_ERR, request_context->log, 0,
+				"ngx_http_vod_map_media_set_parse: failed to decode binary mapping %i: %s", rc, error);
+			return VOD_BAD_MAPPING;
+		}
+
+		return VOD_OK;
+	}
+
+	rc = vod_json_parse(request_context->pool, mapping->data, result, error, sizeof(error));
+	if (rc != VOD_JSON_OK)
+	{
+		ngx_log_error(NGX_LOG_ERR, request_context->log, 0,
+			"ngx_http_vod_map_media_set_parse: failed to parse json %i: %s", rc, error);
+		return VOD_BAD_MAPPING;
+	}
+
+	if (!ctx->submodule_context.conf->mapping_cache_binary || ctx->state != STATE_MAP_READ)
+	{
+		return VOD_OK;
+	}
+
+	// Note: encoding before the override json is applied, since the override may depend on the request
+	rc = vod_json_binary_encode(request_context->pool, result, &ctx->mapping.cache_value);
+	if (rc != VOD_JSON_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, request_context->log, 0,
+			"ngx_http_vod_map_media_set_parse: vod_json_binary_encode failed %i, caching the json", rc);
+		ctx->mapping.cache_value.len = 0;
+	}
+
+	return VOD_OK;
+}
+
 static ngx_int_t
 ngx_http_vod_map_media_set_apply(ngx_http_vod_ctx_t *ctx, ngx_str_t* mapping, int* cache_index)
 {
@@ -5170,6 +6698,7 @@ ngx_http_vod_map_media_set_apply(ngx_http_vod_ctx_t *ctx, ngx_str_t* mapping, in
 	media_clip_source_t* mapped_source;
 	media_sequence_t* sequence;
 	media_set_t mapped_media_set;
+	vod_json_value_t json;
 	ngx_str_t override;
 	ngx_str_t src_path;
 	ngx_str_t path;
@@ -5206,7 +6735,8 @@ ngx_http_vod_map_media_set_apply(ngx_http_vod_ctx_t *ctx, ngx_str_t* mapping, in
 	}
 
 	// optimization for the case of simple mapping response
-	if (mapping->len >= conf->path_response_prefix.len + conf->path_response_postfix.len &&
+	if (!vod_json_binary_detect(mapping) &&
+		mapping->len >= conf->path_response_prefix.len + conf->path_response_postfix.len &&
 		ngx_memcmp(mapping->data, conf->path_response_prefix.data, conf->path_response_prefix.len) == 0 &&
 		ngx_memcmp(mapping->data + mapping->len - conf->path_response_postfix.len,
 			conf->path_response_postfix.data, conf->path_response_postfix.len) == 0 &&
@@ -5279,15 +6809,19 @@ ngx_http_vod_map_media_set_apply(ngx_http_vod_ctx_t *ctx, ngx_str_t* mapping, in
 		request_flags |= REQUEST_FLAG_FORCE_PLAYLIST_TYPE_VOD;
 	}
 
-	rc = media_set_parse_json(
-		&ctx->submodule_context.request_context,
-		mapping->data,
-		override_str,
-		&ctx->submodule_context.request_params,
-		ctx->submodule_context.media_set.segmenter_conf,
-		cur_source,
-		request_flags,
-		&mapped_media_set);
+	rc = ngx_http_vod_map_media_set_parse(ctx, mapping, &json);
+	if (rc == VOD_OK)
+	{
+		rc = media_set_parse_json_value(
+			&ctx->submodule_context.request_context,
+			&json,
+			override_str,
+			&ctx->submodule_context.request_params,
+			ctx->submodule_context.media_set.segmenter_conf,
+			cur_source,
+			request_flags,
+			&mapped_media_set);
+	}
 
 	switch (rc)
 	{
@@ -5314,7 +6848,7 @@ ngx_http_vod_map_media_set_apply(ngx_http_vod_ctx_t *ctx, ngx_str_t* mapping, in
 		return ngx_http_vod_status_to_ngx_error(ctx->submodule_context.r, rc);
 	}
 
-	ngx_perf_counter_end(ctx->perf_counters, perf_counter_context, PC_PARSE_MEDIA_SET);
+	ngx_http_vod_perf_counter_end(ctx, perf_counter_context, PC_PARSE_MEDIA_SET);
 
 	if (mapped_media_set.sequence_count == 1 &&
 		mapped_media_set.timing.durations == NULL &&
@@ -5571,16 +7105,48 @@ ngx_http_vod_parse_uri(
 	return NGX_OK;
 }
 
+// Note: in order to avoid filling the segment cache with segments that are requested only once, a segment is
+//		saved to the cache only on its min_uses-th request. the previous requests are tracked by saving small
+//		marker entries to the segment cache, keyed by a variation of the segment key.
+static ngx_flag_t
+ngx_http_vod_segment_cache_admit(ngx_http_vod_loc_conf_t* conf, u_char* request_key)
+{
+	u_char marker_key[BUFFER_CACHE_KEY_SIZE];
+	u_char marker = 0;
+	ngx_str_t buffer;
+	ngx_uint_t i;
+	uint32_t token;
+
+	ngx_memcpy(marker_key, request_key, sizeof(marker_key));
+
+	for (i = 1; i < conf->segment_cache_min_uses; i++)
+	{
+		marker_key[BUFFER_CACHE_KEY_SIZE - 1] = request_key[BUFFER_CACHE_KEY_SIZE - 1] ^ (u_char)i;
+
+		if (ngx_buffer_cache_fetch(conf->segment_cache, marker_key, &buffer, &token))
+		{
+			ngx_buffer_cache_release(conf->segment_cache, marker_key, token);
+			continue;
+		}
+
+		ngx_buffer_cache_store(conf->segment_cache, marker_key, &marker, sizeof(marker));
+		return 0;
+	}
+
+	return 1;
+}
+
 ngx_int_t
 ngx_http_vod_handler(ngx_http_request_t *r)
 {
 	ngx_perf_counter_context(pcctx);
 	response_cache_header_t cache_header;
 	ngx_perf_counters_t* perf_counters;
-	ngx_http_vod_ctx_t *ctx;
+	ngx_buffer_cache_t** caches;
+	ngx_http_vod_ctx_t *ctx = NULL;
 	request_params_t request_params;
 	media_set_t media_set;
-	const ngx_http_vod_request_t* request;
+	const ngx_http_vod_request_t* request = NULL;
 	ngx_http_vod_loc_conf_t *conf;
 	u_char request_key[BUFFER_CACHE_KEY_SIZE];
 	ngx_md5_t md5;
@@ -5588,7 +7154,9 @@ ngx_http_vod_handler(ngx_http_request_t *r)
 	ngx_str_t content_type;
 	ngx_str_t response;
 	ngx_str_t base_url;
+	ngx_flag_t segment_cache_store = 0;
 	ngx_int_t rc;
+	uint32_t cache_count;
 	int cache_type;
 #if (NGX_DEBUG)
 	ngx_str_t time_str;
@@ -5676,8 +7244,58 @@ ngx_http_vod_handler(ngx_http_request_t *r)
 		}
 	}
 
+	// initialize the context
+	// Note: the context is created before the response cache lookup, so that the request variables (e.g. $vod_cache_status) are available on cache hits
+	ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_vod_ctx_t));
+	if (ctx == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_handler: ngx_pcalloc failed");
+		rc = NGX_HTTP_INTERNAL_SERVER_ERROR;
+		goto done;
+	}
+
+	ctx->submodule_context.r = r;
+	ctx->submodule_context.conf = conf;
+	ctx->submodule_context.request_params = request_params;
+	ctx->submodule_context.media_set = media_set;
+	ctx->submodule_context.media_set.segmenter_conf = &conf->segmenter;
+	ctx->submodule_context.media_set.version = request_params.version;
+	ctx->request = request;
+	ctx->cur_source = media_set.sources_head;
+	ctx->submodule_context.request_context.pool = r->pool;
+	ctx->submodule_context.request_context.log = r->connection->log;
+	ctx->submodule_context.request_context.output_buffer_pool = conf->output_buffer_pool;
+#if (NGX_HAVE_OPENSSL_EVP)
+	if (conf->drm_cipher_cache != NULL)
+	{
+		// Note: the cache is per process, the stats are shared - the zone may differ between locations
+		aes_cipher_cache_set_stats(conf->drm_cipher_cache, perf_counters != NULL ? &perf_counters->cipher_cache : NULL);
+		ctx->submodule_context.request_context.cipher_cache = conf->drm_cipher_cache;
+	}
+#endif // NGX_HAVE_OPENSSL_EVP
+#if (NGX_HAVE_LIB_AV_CODEC)
+	if (conf->codec_context_pool != NULL)
+	{
+		codec_context_pool_set_stats(conf->codec_context_pool, perf_counters != NULL ? &perf_counters->codec_context_pool : NULL);
+		ctx->submodule_context.request_context.codec_context_pool = conf->codec_context_pool;
+	}
+#endif // NGX_HAVE_LIB_AV_CODEC
+	ctx->perf_counters = perf_counters;
+	ngx_perf_counter_copy(ctx->total_perf_counter_context, pcctx);
+
+#if (NGX_DEBUG)
+	// in debug builds allow overriding the server time
+	if (ngx_http_arg(r, (u_char *) "time", sizeof("time") - 1, &time_str) == NGX_OK)
+	{
+		ctx->submodule_context.request_context.time = ngx_atotm(time_str.data, time_str.len);
+	}
+#endif // NGX_DEBUG
+
+	ngx_http_set_ctx(r, ctx, ngx_http_vod_module);
+
 	if (request != NULL &&
-		request->handle_metadata_request != NULL)
+		(request->handle_metadata_request != NULL || conf->segment_cache != NULL))
 	{
 		// calc request key from host + uri
 		ngx_md5_init(&md5);
@@ -5706,11 +7324,22 @@ ngx_http_vod_handler(ngx_http_request_t *r)
 		ngx_md5_final(request_key, &md5);
 
 		// try to fetch from cache
+		if (request->handle_metadata_request != NULL)
+		{
+			caches = conf->response_cache;
+			cache_count = CACHE_TYPE_COUNT;
+		}
+		else
+		{
+			caches = &conf->segment_cache;
+			cache_count = 1;
+		}
+
 		cache_type = ngx_buffer_cache_fetch_copy_perf(
 			r,
 			perf_counters,
-			conf->response_cache,
-			CACHE_TYPE_COUNT,
+			caches,
+			cache_count,
 			request_key,
 			&cache_buffer);
 		if (cache_type >= 0 &&
@@ -5719,6 +7348,8 @@ ngx_http_vod_handler(ngx_http_request_t *r)
 			ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
 				"ngx_http_vod_handler: response cache hit, size is %uz", cache_buffer.len);
 
+			ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_RESPONSE, 1);
+
 			// extract the content type
 			ngx_memcpy(&cache_header, cache_buffer.data, sizeof(cache_header));
 			cache_buffer.data += sizeof(cache_header);
@@ -5752,43 +7383,18 @@ ngx_http_vod_handler(ngx_http_request_t *r)
 		{
 			ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
 				"ngx_http_vod_handler: response cache miss");
-		}
-	}
-
-	// initialize the context
-	ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_vod_ctx_t));
-	if (ctx == NULL)
-	{
-		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-			"ngx_http_vod_handler: ngx_pcalloc failed");
-		rc = NGX_HTTP_INTERNAL_SERVER_ERROR;
-		goto done;
-	}
 
-	ngx_memcpy(ctx->request_key, request_key, sizeof(request_key));
-	ctx->submodule_context.r = r;
-	ctx->submodule_context.conf = conf;
-	ctx->submodule_context.request_params = request_params;
-	ctx->submodule_context.media_set = media_set;
-	ctx->submodule_context.media_set.segmenter_conf = &conf->segmenter;
-	ctx->submodule_context.media_set.version = request_params.version;
-	ctx->request = request;
-	ctx->cur_source = media_set.sources_head;
-	ctx->submodule_context.request_context.pool = r->pool;
-	ctx->submodule_context.request_context.log = r->connection->log;
-	ctx->submodule_context.request_context.output_buffer_pool = conf->output_buffer_pool;
-	ctx->perf_counters = perf_counters;
-	ngx_perf_counter_copy(ctx->total_perf_counter_context, pcctx);
+			ngx_http_vod_update_cache_status(ctx, CACHE_STATUS_RESPONSE, 0);
 
-#if (NGX_DEBUG)
-	// in debug builds allow overriding the server time
-	if (ngx_http_arg(r, (u_char *) "time", sizeof("time") - 1, &time_str) == NGX_OK)
-	{
-		ctx->submodule_context.request_context.time = ngx_atotm(time_str.data, time_str.len);
+			if (request->handle_metadata_request == NULL)
+			{
+				segment_cache_store = ngx_http_vod_segment_cache_admit(conf, request_key);
+			}
+		}
 	}
-#endif // NGX_DEBUG
 
-	ngx_http_set_ctx(r, ctx, ngx_http_vod_module);
+	ngx_memcpy(ctx->request_key, request_key, sizeof(request_key));
+	ctx->segment_cache_store = segment_cache_store;
 
 	// call the mode specific handler (remote/mapped/local)
 	rc = conf->request_handler(r);
@@ -5803,6 +7409,16 @@ done:
 	else
 	{
 		ngx_perf_counter_end(perf_counters, pcctx, PC_TOTAL);
+
+		if (perf_counters != NULL && (rc == NGX_OK || rc == NGX_DONE))
+		{
+			ngx_http_vod_update_perf_counter_dims(
+				perf_counters,
+				r,
+				request,
+				ctx,
+				ngx_perf_counter_get_delta(pcctx));
+		}
 	}
 
 	ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0, "ngx_http_vod_handler: done");
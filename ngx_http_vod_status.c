@@ -12,7 +12,8 @@
 // constants
 #define PATH_PERF_COUNTERS_OPEN "<performance_counters>\r\n"
 #define PATH_PERF_COUNTERS_CLOSE "</performance_counters>\r\n"
-#define PERF_COUNTER_FORMAT "<sum>%uA</sum>\r\n<count>%uA</count>\r\n<max>%uA</max>\r\n<max_time>%uA</max_time>\r\n<max_pid>%uA</max_pid>\r\n"
+#define PERF_COUNTER_FORMAT "<sum>%uA</sum>\r\n<count>%uA</count>\r\n<max>%uA</max>\r\n<max_time>%uA</max_time>\r\n<max_pid>%uA</max_pid>\r\n" \
+	"<p50>%uA</p50>\r\n<p90>%uA</p90>\r\n<p99>%uA</p99>\r\n<p999>%uA</p999>\r\n"
 
 #define PROM_STATUS_PREFIX								\
 	"nginx_vod_build_info{version=\"" NGINX_VOD_VERSION "\"} 1\n\n"
@@ -24,6 +25,45 @@
 	"vod_perf_counter_max_time{action=\"%V\"} %uA\n"	\
 	"vod_perf_counter_max_pid{action=\"%V\"} %uA\n\n"	\
 
+#define PROM_PERF_COUNTER_HIST_TYPE						\
+	"# TYPE vod_perf_counter_duration_microseconds histogram\n"
+#define PROM_PERF_COUNTER_HIST_BUCKET					\
+	"vod_perf_counter_duration_microseconds_bucket{action=\"%V\",le=\"%uA\"} %uA\n"
+#define PROM_PERF_COUNTER_HIST_END						\
+	"vod_perf_counter_duration_microseconds_bucket{action=\"%V\",le=\"+Inf\"} %uA\n"	\
+	"vod_perf_counter_duration_microseconds_sum{action=\"%V\"} %uA\n"	\
+	"vod_perf_counter_duration_microseconds_count{action=\"%V\"} %uA\n\n"
+
+#define PATH_PERF_COUNTER_DIMS_OPEN "<request_stats>\r\n"
+#define PATH_PERF_COUNTER_DIMS_CLOSE "</request_stats>\r\n"
+#define PERF_COUNTER_DIM_FORMAT "<request submodule=\"%*s\" class=\"%V\" format=\"%V\">\r\n"	\
+	"<count>%uA</count>\r\n<total>%uA</total>\r\n<process>%uA</process>\r\n"		\
+	"<bytes_in>%uA</bytes_in>\r\n<bytes_out>%uA</bytes_out>\r\n</request>\r\n"
+
+#define PROM_PERF_COUNTER_DIM_LABELS "{submodule=\"%*s\",class=\"%V\",format=\"%V\"}"
+#define PROM_PERF_COUNTER_DIM_METRICS											\
+	"vod_request_count" PROM_PERF_COUNTER_DIM_LABELS " %uA\n"					\
+	"vod_request_total_microseconds" PROM_PERF_COUNTER_DIM_LABELS " %uA\n"		\
+	"vod_request_process_microseconds" PROM_PERF_COUNTER_DIM_LABELS " %uA\n"		\
+	"vod_request_bytes_in" PROM_PERF_COUNTER_DIM_LABELS " %uA\n"					\
+	"vod_request_bytes_out" PROM_PERF_COUNTER_DIM_LABELS " %uA\n\n"
+
+#if (NGX_HAVE_OPENSSL_EVP)
+#define CIPHER_CACHE_FORMAT "<cipher_cache>\r\n<hit>%uA</hit>\r\n<miss>%uA</miss>\r\n<evicted>%uA</evicted>\r\n</cipher_cache>\r\n"
+#define PROM_CIPHER_CACHE_METRICS						\
+	"vod_cipher_cache_hit %uA\n"						\
+	"vod_cipher_cache_miss %uA\n"						\
+	"vod_cipher_cache_evicted %uA\n\n"
+#endif // NGX_HAVE_OPENSSL_EVP
+
+#if (NGX_HAVE_LIB_AV_CODEC)
+#define CODEC_CONTEXT_POOL_FORMAT "<codec_context_pool>\r\n<hit>%uA</hit>\r\n<miss>%uA</miss>\r\n<evicted>%uA</evicted>\r\n</codec_context_pool>\r\n"
+#define PROM_CODEC_CONTEXT_POOL_METRICS					\
+	"vod_codec_context_pool_hit %uA\n"					\
+	"vod_codec_context_pool_miss %uA\n"					\
+	"vod_codec_context_pool_evicted %uA\n\n"
+#endif // NGX_HAVE_LIB_AV_CODEC
+
 // typedefs
 typedef struct {
 	int conf_offset;
@@ -47,6 +87,20 @@ static ngx_str_t xml_content_type = ngx_string("text/xml");
 static ngx_str_t text_content_type = ngx_string("text/plain");
 static ngx_str_t reset_response = ngx_string("OK\r\n");
 
+static ngx_str_t perf_counter_dim_classes[] = {
+	ngx_string("manifest"),
+	ngx_string("segment"),
+	ngx_string("thumb"),
+	ngx_string("other"),
+};
+
+static ngx_str_t perf_counter_dim_formats[] = {
+	ngx_string("mp4"),
+	ngx_string("mkv"),
+	ngx_string("subtitles"),
+	ngx_string("none"),
+};
+
 static ngx_http_vod_stat_def_t buffer_cache_stat_defs[] = {
 	DEFINE_STAT(store_ok),
 	DEFINE_STAT(store_bytes),
@@ -57,6 +111,7 @@ static ngx_http_vod_stat_def_t buffer_cache_stat_defs[] = {
 	DEFINE_STAT(fetch_miss),
 	DEFINE_STAT(evicted),
 	DEFINE_STAT(evicted_bytes),
+	DEFINE_STAT(cache_evictions_blocked),
 	DEFINE_STAT(reset),
 	DEFINE_STAT(entries),
 	DEFINE_STAT(data_size),
@@ -69,6 +124,11 @@ static ngx_http_vod_cache_info_t cache_infos[] = {
 		ngx_string("<metadata_cache>\r\n"),
 		ngx_string("</metadata_cache>\r\n"),
 	},
+	{
+		offsetof(ngx_http_vod_loc_conf_t, audio_filter_cache),
+		ngx_string("<audio_filter_cache>\r\n"),
+		ngx_string("</audio_filter_cache>\r\n"),
+	},
 	{
 		offsetof(ngx_http_vod_loc_conf_t, response_cache[CACHE_TYPE_VOD]),
 		ngx_string("<response_cache>\r\n"),
@@ -79,6 +139,11 @@ static ngx_http_vod_cache_info_t cache_infos[] = {
 		ngx_string("<live_response_cache>\r\n"),
 		ngx_string("</live_response_cache>\r\n"),
 	},
+	{
+		offsetof(ngx_http_vod_loc_conf_t, segment_cache),
+		ngx_string("<segment_cache>\r\n"),
+		ngx_string("</segment_cache>\r\n"),
+	},
 	{
 		offsetof(ngx_http_vod_loc_conf_t, mapping_cache[CACHE_TYPE_VOD]),
 		ngx_string("<mapping_cache>\r\n"),
@@ -125,6 +190,80 @@ ngx_http_vod_append_cache_stats(u_char* p, ngx_buffer_cache_stats_t* stats)
 	return p;
 }
 
+static size_t
+ngx_http_vod_get_perf_counter_dims_size(size_t format_size)
+{
+	const ngx_http_vod_submodule_t** cur_module;
+	size_t result = 0;
+	unsigned i;
+	unsigned j;
+
+	for (cur_module = submodules; *cur_module != NULL && cur_module - submodules < PC_DIM_SUBMODULE_COUNT; cur_module++)
+	{
+		for (i = 0; i < PC_DIM_CLASS_COUNT; i++)
+		{
+			for (j = 0; j < PC_DIM_FORMAT_COUNT; j++)
+			{
+				result += format_size + 
+					((*cur_module)->name_len + perf_counter_dim_classes[i].len + perf_counter_dim_formats[j].len + NGX_ATOMIC_T_LEN) * 5;
+			}
+		}
+	}
+
+	return result;
+}
+
+static u_char*
+ngx_http_vod_append_perf_counter_dims(u_char* p, ngx_perf_counters_t* perf_counters, ngx_flag_t prom)
+{
+	const ngx_http_vod_submodule_t** cur_module;
+	ngx_perf_counter_dim_t* dim;
+	ngx_str_t* class_name;
+	ngx_str_t* format_name;
+	unsigned i;
+	unsigned j;
+
+	for (cur_module = submodules; *cur_module != NULL && cur_module - submodules < PC_DIM_SUBMODULE_COUNT; cur_module++)
+	{
+		for (i = 0; i < PC_DIM_CLASS_COUNT; i++)
+		{
+			for (j = 0; j < PC_DIM_FORMAT_COUNT; j++)
+			{
+				dim = &perf_counters->dims[cur_module - submodules][i][j];
+				if (dim->count == 0)
+				{
+					continue;
+				}
+
+				class_name = &perf_counter_dim_classes[i];
+				format_name = &perf_counter_dim_formats[j];
+
+				if (prom)
+				{
+					p = ngx_sprintf(p, PROM_PERF_COUNTER_DIM_METRICS,
+						(*cur_module)->name_len, (*cur_module)->name, class_name, format_name, dim->count,
+						(*cur_module)->name_len, (*cur_module)->name, class_name, format_name, dim->total,
+						(*cur_module)->name_len, (*cur_module)->name, class_name, format_name, dim->process,
+						(*cur_module)->name_len, (*cur_module)->name, class_name, format_name, dim->bytes_in,
+						(*cur_module)->name_len, (*cur_module)->name, class_name, format_name, dim->bytes_out);
+				}
+				else
+				{
+					p = ngx_sprintf(p, PERF_COUNTER_DIM_FORMAT,
+						(*cur_module)->name_len, (*cur_module)->name, class_name, format_name,
+						dim->count,
+						dim->total,
+						dim->process,
+						dim->bytes_in,
+						dim->bytes_out);
+				}
+			}
+		}
+	}
+
+	return p;
+}
+
 static ngx_int_t
 ngx_http_vod_status_reset(ngx_http_request_t *r)
 {
@@ -151,12 +290,17 @@ ngx_http_vod_status_reset(ngx_http_request_t *r)
 	{
 		for (i = 0; i < PC_COUNT; i++)
 		{
-			perf_counters->counters[i].sum = 0;
-			perf_counters->counters[i].count = 0;
-			perf_counters->counters[i].max = 0;
-			perf_counters->counters[i].max_time = 0;
-			perf_counters->counters[i].max_pid = 0;
+			ngx_memzero(&perf_counters->counters[i], sizeof(perf_counters->counters[i]));
 		}
+
+		ngx_memzero(perf_counters->dims, sizeof(perf_counters->dims));
+
+#if (NGX_HAVE_OPENSSL_EVP)
+		ngx_memzero(&perf_counters->cipher_cache, sizeof(perf_counters->cipher_cache));
+#endif // NGX_HAVE_OPENSSL_EVP
+#if (NGX_HAVE_LIB_AV_CODEC)
+		ngx_memzero(&perf_counters->codec_context_pool, sizeof(perf_counters->codec_context_pool));
+#endif // NGX_HAVE_LIB_AV_CODEC
 	}
 
 	return ngx_http_vod_send_response(r, &reset_response, &text_content_type);
@@ -169,7 +313,9 @@ ngx_http_vod_status_xml_handler(ngx_http_request_t *r)
 	ngx_http_vod_loc_conf_t *conf;
 	ngx_http_vod_stat_def_t* cur_stat;
 	ngx_perf_counters_t* perf_counters;
+	ngx_perf_counter_t* cur_counter;
 	ngx_buffer_cache_t *cur_cache;
+	ngx_atomic_uint_t count;
 	ngx_str_t response;
 	u_char* p;
 	size_t cache_stats_len = 0;
@@ -202,9 +348,18 @@ ngx_http_vod_status_xml_handler(ngx_http_request_t *r)
 		result_size += sizeof(PATH_PERF_COUNTERS_OPEN);
 		for (i = 0; i < PC_COUNT; i++)
 		{
-			result_size += perf_counters_open_tags[i].len + sizeof(PERF_COUNTER_FORMAT) + 5 * NGX_ATOMIC_T_LEN + perf_counters_close_tags[i].len;
+			result_size += perf_counters_open_tags[i].len + sizeof(PERF_COUNTER_FORMAT) + 9 * NGX_ATOMIC_T_LEN + perf_counters_close_tags[i].len;
 		}
 		result_size += sizeof(PATH_PERF_COUNTERS_CLOSE);
+		result_size += sizeof(PATH_PERF_COUNTER_DIMS_OPEN) + 
+			ngx_http_vod_get_perf_counter_dims_size(sizeof(PERF_COUNTER_DIM_FORMAT)) +
+			sizeof(PATH_PERF_COUNTER_DIMS_CLOSE);
+#if (NGX_HAVE_OPENSSL_EVP)
+		result_size += sizeof(CIPHER_CACHE_FORMAT) + 3 * NGX_ATOMIC_T_LEN;
+#endif // NGX_HAVE_OPENSSL_EVP
+#if (NGX_HAVE_LIB_AV_CODEC)
+		result_size += sizeof(CODEC_CONTEXT_POOL_FORMAT) + 3 * NGX_ATOMIC_T_LEN;
+#endif // NGX_HAVE_LIB_AV_CODEC
 	}
 
 	result_size += sizeof(status_postfix);
@@ -241,16 +396,38 @@ ngx_http_vod_status_xml_handler(ngx_http_request_t *r)
 		p = ngx_copy(p, PATH_PERF_COUNTERS_OPEN, sizeof(PATH_PERF_COUNTERS_OPEN) - 1);
 		for (i = 0; i < PC_COUNT; i++)
 		{
+			cur_counter = &perf_counters->counters[i];
+			count = ngx_perf_counter_get_count(cur_counter);
+
 			p = ngx_copy(p, perf_counters_open_tags[i].data, perf_counters_open_tags[i].len);
 			p = ngx_sprintf(p, PERF_COUNTER_FORMAT, 
-				perf_counters->counters[i].sum, 
-				perf_counters->counters[i].count, 
-				perf_counters->counters[i].max, 
-				perf_counters->counters[i].max_time, 
-				perf_counters->counters[i].max_pid);
+				cur_counter->sum, 
+				count, 
+				cur_counter->max, 
+				cur_counter->max_time, 
+				cur_counter->max_pid,
+				ngx_perf_counter_get_percentile(cur_counter, count, 500),
+				ngx_perf_counter_get_percentile(cur_counter, count, 900),
+				ngx_perf_counter_get_percentile(cur_counter, count, 990),
+				ngx_perf_counter_get_percentile(cur_counter, count, 999));
 			p = ngx_copy(p, perf_counters_close_tags[i].data, perf_counters_close_tags[i].len);
 		}
 		p = ngx_copy(p, PATH_PERF_COUNTERS_CLOSE, sizeof(PATH_PERF_COUNTERS_CLOSE) - 1);
+		p = ngx_copy(p, PATH_PERF_COUNTER_DIMS_OPEN, sizeof(PATH_PERF_COUNTER_DIMS_OPEN) - 1);
+		p = ngx_http_vod_append_perf_counter_dims(p, perf_counters, 0);
+		p = ngx_copy(p, PATH_PERF_COUNTER_DIMS_CLOSE, sizeof(PATH_PERF_COUNTER_DIMS_CLOSE) - 1);
+#if (NGX_HAVE_OPENSSL_EVP)
+		p = ngx_sprintf(p, CIPHER_CACHE_FORMAT,
+			perf_counters->cipher_cache.hit,
+			perf_counters->cipher_cache.miss,
+			perf_counters->cipher_cache.evicted);
+#endif // NGX_HAVE_OPENSSL_EVP
+#if (NGX_HAVE_LIB_AV_CODEC)
+		p = ngx_sprintf(p, CODEC_CONTEXT_POOL_FORMAT,
+			perf_counters->codec_context_pool.hit,
+			perf_counters->codec_context_pool.miss,
+			perf_counters->codec_context_pool.evicted);
+#endif // NGX_HAVE_LIB_AV_CODEC
 	}
 
 	p = ngx_copy(p, status_postfix, sizeof(status_postfix) - 1);
@@ -275,11 +452,14 @@ ngx_http_vod_status_prom_handler(ngx_http_request_t *r)
 	ngx_http_vod_stat_def_t* cur_stat;
 	ngx_http_vod_loc_conf_t *conf;
 	ngx_perf_counters_t* perf_counters;
+	ngx_perf_counter_t* cur_counter;
 	ngx_buffer_cache_t *cur_cache;
+	ngx_atomic_uint_t count;
 	ngx_str_t response;
 	ngx_str_t cache_name;
 	ngx_str_t action;
 	unsigned i;
+	unsigned j;
 	u_char* p;
 	size_t result_size;
 	size_t names_len;
@@ -308,10 +488,21 @@ ngx_http_vod_status_prom_handler(ngx_http_request_t *r)
 
 	if (perf_counters != NULL)
 	{
+		result_size += sizeof(PROM_PERF_COUNTER_HIST_TYPE) - 1;
 		for (i = 0; i < PC_COUNT; i++)
 		{
 			result_size += sizeof(PROM_PERF_COUNTER_METRICS) - 1 + (perf_counters_open_tags[i].len + NGX_ATOMIC_T_LEN) * 5;
+			result_size += (sizeof(PROM_PERF_COUNTER_HIST_BUCKET) - 1 + perf_counters_open_tags[i].len + 2 * NGX_ATOMIC_T_LEN) *
+				(NGX_PERF_COUNTER_HIST_SIZE - 1);
+			result_size += sizeof(PROM_PERF_COUNTER_HIST_END) - 1 + (perf_counters_open_tags[i].len + NGX_ATOMIC_T_LEN) * 3;
 		}
+		result_size += ngx_http_vod_get_perf_counter_dims_size(sizeof(PROM_PERF_COUNTER_DIM_METRICS) - 1);
+#if (NGX_HAVE_OPENSSL_EVP)
+		result_size += sizeof(PROM_CIPHER_CACHE_METRICS) - 1 + 3 * NGX_ATOMIC_T_LEN;
+#endif // NGX_HAVE_OPENSSL_EVP
+#if (NGX_HAVE_LIB_AV_CODEC)
+		result_size += sizeof(PROM_CODEC_CONTEXT_POOL_METRICS) - 1 + 3 * NGX_ATOMIC_T_LEN;
+#endif // NGX_HAVE_LIB_AV_CODEC
 	}
 
 	// allocate the buffer
@@ -351,16 +542,56 @@ ngx_http_vod_status_prom_handler(ngx_http_request_t *r)
 	{
 		for (i = 0; i < PC_COUNT; i++)
 		{
+			cur_counter = &perf_counters->counters[i];
+
 			action.data = perf_counters_open_tags[i].data + 1;
 			action.len = perf_counters_open_tags[i].len - 4;
 
 			p = ngx_sprintf(p, PROM_PERF_COUNTER_METRICS,
-				&action, perf_counters->counters[i].sum,
-				&action, perf_counters->counters[i].count,
-				&action, perf_counters->counters[i].max,
-				&action, perf_counters->counters[i].max_time,
-				&action, perf_counters->counters[i].max_pid);
+				&action, cur_counter->sum,
+				&action, ngx_perf_counter_get_count(cur_counter),
+				&action, cur_counter->max,
+				&action, cur_counter->max_time,
+				&action, cur_counter->max_pid);
 		}
+
+		p = ngx_copy(p, PROM_PERF_COUNTER_HIST_TYPE, sizeof(PROM_PERF_COUNTER_HIST_TYPE) - 1);
+		for (i = 0; i < PC_COUNT; i++)
+		{
+			cur_counter = &perf_counters->counters[i];
+
+			action.data = perf_counters_open_tags[i].data + 1;
+			action.len = perf_counters_open_tags[i].len - 4;
+
+			// Note: the last bucket is unbounded, it is reported only as +Inf
+			count = 0;
+			for (j = 0; j < NGX_PERF_COUNTER_HIST_SIZE - 1; j++)
+			{
+				count += cur_counter->hist[j];
+				p = ngx_sprintf(p, PROM_PERF_COUNTER_HIST_BUCKET,
+					&action, ngx_perf_counter_get_bucket_limit(j), count);
+			}
+			count += cur_counter->hist[j];
+
+			p = ngx_sprintf(p, PROM_PERF_COUNTER_HIST_END,
+				&action, count,
+				&action, cur_counter->sum,
+				&action, count);
+		}
+
+		p = ngx_http_vod_append_perf_counter_dims(p, perf_counters, 1);
+#if (NGX_HAVE_OPENSSL_EVP)
+		p = ngx_sprintf(p, PROM_CIPHER_CACHE_METRICS,
+			perf_counters->cipher_cache.hit,
+			perf_counters->cipher_cache.miss,
+			perf_counters->cipher_cache.evicted);
+#endif // NGX_HAVE_OPENSSL_EVP
+#if (NGX_HAVE_LIB_AV_CODEC)
+		p = ngx_sprintf(p, PROM_CODEC_CONTEXT_POOL_METRICS,
+			perf_counters->codec_context_pool.hit,
+			perf_counters->codec_context_pool.miss,
+			perf_counters->codec_context_pool.evicted);
+#endif // NGX_HAVE_LIB_AV_CODEC
 	}
 
 	response.len = p - response.data;
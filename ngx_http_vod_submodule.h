@@ -41,12 +41,26 @@ typedef char* (*ngx_http_vod_merge_loc_conf_t)(
 	void *conf, 
 	void *prev);
 
+#if (NGX_THREADS)
+// Note: when a frame processor sets a frame task and returns VOD_OK, the handler is executed on the thread pool,
+//		and the frame processor is called again once the task completes. the handler must not use the request
+//		pool or any other nginx api.
+typedef struct {
+	ngx_thread_pool_t* thread_pool;
+	vod_status_t (*handler)(void* context);
+	void* context;
+} ngx_http_vod_frame_task_t;
+#endif // NGX_THREADS
+
 typedef struct {
 	request_context_t request_context;
 	media_set_t media_set;
 	request_params_t request_params;
 	ngx_http_request_t* r;
 	struct ngx_http_vod_loc_conf_s* conf;
+#if (NGX_THREADS)
+	ngx_http_vod_frame_task_t frame_task;
+#endif // NGX_THREADS
 } ngx_http_vod_submodule_context_t;
 
 // submodule request
@@ -64,6 +78,8 @@ struct ngx_http_vod_request_s {
 		ngx_str_t* response,
 		ngx_str_t* content_type);
 		
+	// Note: in requests that have REQUEST_FLAG_CACHE_RESPONSE_SIZE, response_size is also an input -
+	//		the size of the response as returned by a previous request (including any padding), or 0 if unknown
 	ngx_int_t (*init_frame_processor)(
 		// in
 		ngx_http_vod_submodule_context_t* submodule_context,
@@ -2,6 +2,7 @@
 #include "ngx_http_vod_submodule.h"
 #include "ngx_http_vod_utils.h"
 #include "vod/thumb/thumb_grabber.h"
+#include "vod/hls/m3u8_builder.h"
 #include "vod/manifest_utils.h"
 #include "vod/parse_utils.h"
 
@@ -25,6 +26,13 @@
 static const u_char jpg_file_ext[] = ".jpg";
 static u_char jpeg_content_type[] = "image/jpeg";
 
+#if (NGX_HAVE_LIB_SW_SCALE)
+static const u_char m3u8_file_ext[] = ".m3u8";
+static const u_char vtt_file_ext[] = ".vtt";
+static u_char m3u8_content_type[] = "application/vnd.apple.mpegurl";
+static u_char vtt_content_type[] = "text/vtt";
+#endif // NGX_HAVE_LIB_SW_SCALE
+
 ngx_int_t 
 ngx_http_vod_thumb_get_url(
 	ngx_http_vod_submodule_context_t* submodule_context,
@@ -72,7 +80,7 @@ ngx_http_vod_thumb_get_url(
 
 	// get the result size
 	result_size = base_url.len + conf->thumb.file_name_prefix.len + 
-		1 + VOD_INT64_LEN + request_params_str.len + sizeof(jpg_file_ext) - 1;
+		1 + VOD_INT64_LEN + sizeof("-k") - 1 + request_params_str.len + sizeof(jpg_file_ext) - 1;
 
 	// allocate the result buffer
 	p = ngx_pnalloc(submodule_context->request_context.pool, result_size);
@@ -93,6 +101,10 @@ ngx_http_vod_thumb_get_url(
 
 	p = vod_copy(p, conf->thumb.file_name_prefix.data, conf->thumb.file_name_prefix.len);
 	p = vod_sprintf(p, "-%uL", request_params->segment_time);
+	if (request_params->thumb_fast_mode)
+	{
+		p = vod_copy(p, "-k", sizeof("-k") - 1);
+	}
 	p = vod_copy(p, request_params_str.data, request_params_str.len);
 	p = vod_copy(p, jpg_file_ext, sizeof(jpg_file_ext) - 1);
 
@@ -109,6 +121,57 @@ ngx_http_vod_thumb_get_url(
 	return NGX_OK;
 }
 
+static thumb_grabber_mode_t
+ngx_http_vod_thumb_get_mode(ngx_http_vod_submodule_context_t* submodule_context)
+{
+	ngx_http_vod_thumb_loc_conf_t* conf = &submodule_context->conf->thumb;
+
+	if (conf->fast_mode || submodule_context->request_params.thumb_fast_mode)
+	{
+		return THUMB_GRABBER_MODE_FAST;
+	}
+
+	return conf->accurate ? THUMB_GRABBER_MODE_ACCURATE : THUMB_GRABBER_MODE_KEY_FRAME;
+}
+
+#if (NGX_THREADS)
+typedef struct {
+	ngx_http_vod_submodule_context_t* submodule_context;
+	void* grabber_state;
+	ngx_flag_t encoded;
+} ngx_http_vod_thumb_deferred_state_t;
+
+static vod_status_t
+ngx_http_vod_thumb_process_deferred(void* context)
+{
+	ngx_http_vod_thumb_deferred_state_t* state = context;
+	ngx_http_vod_frame_task_t* frame_task;
+	vod_status_t rc;
+
+	if (state->encoded)
+	{
+		// back from the thread pool
+		return thumb_grabber_write(state->grabber_state);
+	}
+
+	rc = thumb_grabber_process(state->grabber_state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	// all frames were read, decode / resize / encode on the thread pool
+	frame_task = &state->submodule_context->frame_task;
+	frame_task->thread_pool = state->submodule_context->conf->thumb.thread_pool;
+	frame_task->handler = thumb_grabber_encode;
+	frame_task->context = state->grabber_state;
+
+	state->encoded = 1;
+
+	return VOD_OK;
+}
+#endif // NGX_THREADS
+
 static ngx_int_t
 ngx_http_vod_thumb_init_frame_processor(
 	ngx_http_vod_submodule_context_t* submodule_context,
@@ -119,13 +182,20 @@ ngx_http_vod_thumb_init_frame_processor(
 	size_t* response_size,
 	ngx_str_t* content_type)
 {
+	bool_t deferred = FALSE;
 	vod_status_t rc;
+#if (NGX_THREADS)
+	ngx_http_vod_thumb_deferred_state_t* state;
+
+	deferred = submodule_context->conf->thumb.thread_pool != NULL;
+#endif // NGX_THREADS
 
 	rc = thumb_grabber_init_state(
 		&submodule_context->request_context,
 		submodule_context->media_set.filtered_tracks,
 		&submodule_context->request_params,
-		submodule_context->conf->thumb.accurate,
+		ngx_http_vod_thumb_get_mode(submodule_context),
+		deferred,
 		segment_writer->write_tail,
 		segment_writer->context,
 		frame_processor_state);
@@ -138,6 +208,26 @@ ngx_http_vod_thumb_init_frame_processor(
 
 	*frame_processor = (ngx_http_vod_frame_processor_t)thumb_grabber_process;
 
+#if (NGX_THREADS)
+	if (deferred)
+	{
+		state = ngx_palloc(submodule_context->request_context.pool, sizeof(*state));
+		if (state == NULL)
+		{
+			ngx_log_debug0(NGX_LOG_DEBUG_HTTP, submodule_context->request_context.log, 0,
+				"ngx_http_vod_thumb_init_frame_processor: ngx_palloc failed");
+			return ngx_http_vod_status_to_ngx_error(submodule_context->r, VOD_ALLOC_FAILED);
+		}
+
+		state->submodule_context = submodule_context;
+		state->grabber_state = *frame_processor_state;
+		state->encoded = 0;
+
+		*frame_processor = ngx_http_vod_thumb_process_deferred;
+		*frame_processor_state = state;
+	}
+#endif // NGX_THREADS
+
 	content_type->len = sizeof(jpeg_content_type) - 1;
 	content_type->data = (u_char *)jpeg_content_type;
 
@@ -154,12 +244,294 @@ static const ngx_http_vod_request_t thumb_request = {
 	ngx_http_vod_thumb_init_frame_processor,
 };
 
+#if (NGX_HAVE_LIB_SW_SCALE)
+static ngx_int_t
+ngx_http_vod_thumb_get_tile_layout(
+	ngx_http_vod_submodule_context_t* submodule_context,
+	thumb_tile_layout_t* layout)
+{
+	media_set_t* media_set = &submodule_context->media_set;
+	vod_status_t rc;
+
+	rc = thumb_tile_get_layout(
+		&submodule_context->request_context,
+		&submodule_context->conf->thumb.tile,
+		&media_set->filtered_tracks->media_info,
+		media_set->timing.total_duration,
+		layout);
+	if (rc != VOD_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, submodule_context->request_context.log, 0,
+			"ngx_http_vod_thumb_get_tile_layout: thumb_tile_get_layout failed %i", rc);
+		return ngx_http_vod_status_to_ngx_error(submodule_context->r, rc);
+	}
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_thumb_init_tile_frame_processor(
+	ngx_http_vod_submodule_context_t* submodule_context,
+	segment_writer_t* segment_writer,
+	ngx_http_vod_frame_processor_t* frame_processor,
+	void** frame_processor_state,
+	ngx_str_t* output_buffer,
+	size_t* response_size,
+	ngx_str_t* content_type)
+{
+	thumb_tile_layout_t layout;
+	bool_t deferred = FALSE;
+	vod_status_t rc;
+#if (NGX_THREADS)
+	ngx_http_vod_thumb_deferred_state_t* state;
+
+	deferred = submodule_context->conf->thumb.thread_pool != NULL;
+#endif // NGX_THREADS
+
+	rc = ngx_http_vod_thumb_get_tile_layout(submodule_context, &layout);
+	if (rc != NGX_OK)
+	{
+		return rc;
+	}
+
+	rc = thumb_grabber_init_tile_state(
+		&submodule_context->request_context,
+		submodule_context->media_set.filtered_tracks,
+		&layout,
+		submodule_context->request_params.segment_time,
+		ngx_http_vod_thumb_get_mode(submodule_context),
+		deferred,
+		segment_writer->write_tail,
+		segment_writer->context,
+		frame_processor_state);
+	if (rc != VOD_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, submodule_context->request_context.log, 0,
+			"ngx_http_vod_thumb_init_tile_frame_processor: thumb_grabber_init_tile_state failed %i", rc);
+		return ngx_http_vod_status_to_ngx_error(submodule_context->r, rc);
+	}
+
+	*frame_processor = (ngx_http_vod_frame_processor_t)thumb_grabber_process;
+
+#if (NGX_THREADS)
+	if (deferred)
+	{
+		state = ngx_palloc(submodule_context->request_context.pool, sizeof(*state));
+		if (state == NULL)
+		{
+			ngx_log_debug0(NGX_LOG_DEBUG_HTTP, submodule_context->request_context.log, 0,
+				"ngx_http_vod_thumb_init_tile_frame_processor: ngx_palloc failed");
+			return ngx_http_vod_status_to_ngx_error(submodule_context->r, VOD_ALLOC_FAILED);
+		}
+
+		state->submodule_context = submodule_context;
+		state->grabber_state = *frame_processor_state;
+		state->encoded = 0;
+
+		*frame_processor = ngx_http_vod_thumb_process_deferred;
+		*frame_processor_state = state;
+	}
+#endif // NGX_THREADS
+
+	content_type->len = sizeof(jpeg_content_type) - 1;
+	content_type->data = (u_char *)jpeg_content_type;
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_thumb_get_tile_url_parts(
+	ngx_http_vod_submodule_context_t* submodule_context,
+	ngx_str_t* base_url,
+	ngx_str_t* name_suffix)
+{
+	ngx_http_vod_loc_conf_t* conf = submodule_context->conf;
+	request_params_t* request_params = &submodule_context->request_params;
+	ngx_str_t request_params_str;
+	vod_status_t rc;
+	u_char* p;
+
+	// the tile urls are relative, unless a segments base url was configured
+	if (conf->segments_base_url != NULL)
+	{
+		rc = ngx_http_vod_get_base_url(
+			submodule_context->r,
+			conf->segments_base_url,
+			&submodule_context->r->uri,
+			base_url);
+		if (rc != NGX_OK)
+		{
+			return rc;
+		}
+	}
+
+	// get the request params string
+	rc = manifest_utils_build_request_params_string(
+		&submodule_context->request_context,
+		request_params->tracks_mask,
+		INVALID_SEGMENT_INDEX,
+		request_params->sequences_mask,
+		NULL,
+		NULL,
+		request_params->tracks_mask,
+		&request_params_str);
+	if (rc != VOD_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, submodule_context->request_context.log, 0,
+			"ngx_http_vod_thumb_get_tile_url_parts: manifest_utils_build_request_params_string failed %i", rc);
+		return ngx_http_vod_status_to_ngx_error(submodule_context->r, rc);
+	}
+
+	p = ngx_pnalloc(submodule_context->request_context.pool, request_params_str.len + sizeof(jpg_file_ext) - 1);
+	if (p == NULL)
+	{
+		ngx_log_debug0(NGX_LOG_DEBUG_HTTP, submodule_context->request_context.log, 0,
+			"ngx_http_vod_thumb_get_tile_url_parts: ngx_pnalloc failed");
+		return ngx_http_vod_status_to_ngx_error(submodule_context->r, VOD_ALLOC_FAILED);
+	}
+
+	name_suffix->data = p;
+	p = vod_copy(p, request_params_str.data, request_params_str.len);
+	p = vod_copy(p, jpg_file_ext, sizeof(jpg_file_ext) - 1);
+	name_suffix->len = p - name_suffix->data;
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_thumb_handle_tile_playlist(
+	ngx_http_vod_submodule_context_t* submodule_context,
+	ngx_str_t* response,
+	ngx_str_t* content_type)
+{
+	thumb_tile_layout_t layout;
+	ngx_str_t base_url = ngx_null_string;
+	ngx_str_t name_suffix;
+	vod_status_t rc;
+
+	rc = ngx_http_vod_thumb_get_tile_layout(submodule_context, &layout);
+	if (rc != NGX_OK)
+	{
+		return rc;
+	}
+
+	rc = ngx_http_vod_thumb_get_tile_url_parts(submodule_context, &base_url, &name_suffix);
+	if (rc != NGX_OK)
+	{
+		return rc;
+	}
+
+	rc = m3u8_builder_build_image_playlist(
+		&submodule_context->request_context,
+		&layout,
+		&base_url,
+		&submodule_context->conf->thumb.tile_file_name_prefix,
+		&name_suffix,
+		response);
+	if (rc != VOD_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, submodule_context->request_context.log, 0,
+			"ngx_http_vod_thumb_handle_tile_playlist: m3u8_builder_build_image_playlist failed %i", rc);
+		return ngx_http_vod_status_to_ngx_error(submodule_context->r, rc);
+	}
+
+	content_type->data = m3u8_content_type;
+	content_type->len = sizeof(m3u8_content_type) - 1;
+
+	return NGX_OK;
+}
+
+static ngx_int_t
+ngx_http_vod_thumb_handle_tile_vtt(
+	ngx_http_vod_submodule_context_t* submodule_context,
+	ngx_str_t* response,
+	ngx_str_t* content_type)
+{
+	thumb_tile_layout_t layout;
+	ngx_str_t base_url = ngx_null_string;
+	ngx_str_t name_suffix;
+	vod_status_t rc;
+
+	rc = ngx_http_vod_thumb_get_tile_layout(submodule_context, &layout);
+	if (rc != NGX_OK)
+	{
+		return rc;
+	}
+
+	rc = ngx_http_vod_thumb_get_tile_url_parts(submodule_context, &base_url, &name_suffix);
+	if (rc != NGX_OK)
+	{
+		return rc;
+	}
+
+	rc = thumb_tile_build_webvtt(
+		&submodule_context->request_context,
+		&layout,
+		&base_url,
+		&submodule_context->conf->thumb.tile_file_name_prefix,
+		&name_suffix,
+		response);
+	if (rc != VOD_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, submodule_context->request_context.log, 0,
+			"ngx_http_vod_thumb_handle_tile_vtt: thumb_tile_build_webvtt failed %i", rc);
+		return ngx_http_vod_status_to_ngx_error(submodule_context->r, rc);
+	}
+
+	content_type->data = vtt_content_type;
+	content_type->len = sizeof(vtt_content_type) - 1;
+
+	return NGX_OK;
+}
+
+static const ngx_http_vod_request_t tile_request = {
+	REQUEST_FLAG_SINGLE_TRACK,
+	PARSE_FLAG_FRAMES_ALL | PARSE_FLAG_EXTRA_DATA,
+	REQUEST_CLASS_THUMB,
+	VOD_CODEC_FLAG(AVC) | VOD_CODEC_FLAG(HEVC) | VOD_CODEC_FLAG(VP8) | VOD_CODEC_FLAG(VP9) | VOD_CODEC_FLAG(AV1),
+	THUMB_TIMESCALE,
+	NULL,
+	ngx_http_vod_thumb_init_tile_frame_processor,
+};
+
+static const ngx_http_vod_request_t tile_playlist_request = {
+	REQUEST_FLAG_SINGLE_TRACK,
+	PARSE_BASIC_METADATA_ONLY,
+	REQUEST_CLASS_OTHER,
+	VOD_CODEC_FLAG(AVC) | VOD_CODEC_FLAG(HEVC) | VOD_CODEC_FLAG(VP8) | VOD_CODEC_FLAG(VP9) | VOD_CODEC_FLAG(AV1),
+	THUMB_TIMESCALE,
+	ngx_http_vod_thumb_handle_tile_playlist,
+	NULL,
+};
+
+static const ngx_http_vod_request_t tile_vtt_request = {
+	REQUEST_FLAG_SINGLE_TRACK,
+	PARSE_BASIC_METADATA_ONLY,
+	REQUEST_CLASS_OTHER,
+	VOD_CODEC_FLAG(AVC) | VOD_CODEC_FLAG(HEVC) | VOD_CODEC_FLAG(VP8) | VOD_CODEC_FLAG(VP9) | VOD_CODEC_FLAG(AV1),
+	THUMB_TIMESCALE,
+	ngx_http_vod_thumb_handle_tile_vtt,
+	NULL,
+};
+#endif // NGX_HAVE_LIB_SW_SCALE
+
 static void
 ngx_http_vod_thumb_create_loc_conf(
 	ngx_conf_t *cf,
 	ngx_http_vod_thumb_loc_conf_t *conf)
 {
 	conf->accurate = NGX_CONF_UNSET;
+	conf->fast_mode = NGX_CONF_UNSET;
+#if (NGX_HAVE_LIB_SW_SCALE)
+	conf->tile.columns = NGX_CONF_UNSET_UINT;
+	conf->tile.rows = NGX_CONF_UNSET_UINT;
+	conf->tile.interval = NGX_CONF_UNSET_UINT;
+	conf->tile.width = NGX_CONF_UNSET_UINT;
+	conf->tile.height = NGX_CONF_UNSET_UINT;
+#endif // NGX_HAVE_LIB_SW_SCALE
+#if (NGX_THREADS)
+	conf->thread_pool = NGX_CONF_UNSET_PTR;
+#endif // NGX_THREADS
 }
 
 static char *
@@ -171,6 +543,36 @@ ngx_http_vod_thumb_merge_loc_conf(
 {
 	ngx_conf_merge_str_value(conf->file_name_prefix, prev->file_name_prefix, "thumb");
 	ngx_conf_merge_value(conf->accurate, prev->accurate, 1);
+	ngx_conf_merge_value(conf->fast_mode, prev->fast_mode, 0);
+#if (NGX_HAVE_LIB_SW_SCALE)
+	ngx_conf_merge_str_value(conf->tile_file_name_prefix, prev->tile_file_name_prefix, "tile");
+	ngx_conf_merge_uint_value(conf->tile.columns, prev->tile.columns, 5);
+	ngx_conf_merge_uint_value(conf->tile.rows, prev->tile.rows, 5);
+	ngx_conf_merge_uint_value(conf->tile.interval, prev->tile.interval, 10000);
+	ngx_conf_merge_uint_value(conf->tile.width, prev->tile.width, 160);
+	ngx_conf_merge_uint_value(conf->tile.height, prev->tile.height, 0);
+#endif // NGX_HAVE_LIB_SW_SCALE
+#if (NGX_THREADS)
+	ngx_conf_merge_ptr_value(conf->thread_pool, prev->thread_pool, NULL);
+#endif // NGX_THREADS
+
+#if (NGX_HAVE_LIB_SW_SCALE)
+	if (conf->tile.columns <= 0 || conf->tile.rows <= 0 ||
+		conf->tile.columns * conf->tile.rows > THUMB_TILE_MAX_THUMBNAILS)
+	{
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+			"\"vod_thumb_tile_columns\" x \"vod_thumb_tile_rows\" must be between 1 and %d", THUMB_TILE_MAX_THUMBNAILS);
+		return NGX_CONF_ERROR;
+	}
+
+	if (conf->tile.interval <= 0)
+	{
+		ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+			"\"vod_thumb_tile_interval\" must be positive");
+		return NGX_CONF_ERROR;
+	}
+#endif // NGX_HAVE_LIB_SW_SCALE
+
 	return NGX_CONF_OK;
 }
 
@@ -222,6 +624,81 @@ ngx_http_vod_thumb_parse_dimensions(
 }
 #endif // NGX_HAVE_LIB_SW_SCALE
 
+#if (NGX_HAVE_LIB_SW_SCALE)
+static ngx_int_t
+ngx_http_vod_thumb_parse_tile_uri_file_name(
+	ngx_http_request_t *r,
+	ngx_http_vod_loc_conf_t *conf,
+	u_char* start_pos,
+	u_char* end_pos,
+	request_params_t* request_params,
+	const ngx_http_vod_request_t** request)
+{
+	ngx_http_vod_thumb_loc_conf_t* thumb = &conf->thumb;
+	uint32_t tile_index = 0;
+	ngx_int_t rc;
+
+	if (ngx_http_vod_match_prefix_postfix(start_pos, end_pos, &thumb->tile_file_name_prefix, jpg_file_ext))
+	{
+		start_pos += thumb->tile_file_name_prefix.len;
+		end_pos -= (sizeof(jpg_file_ext) - 1);
+		*request = &tile_request;
+
+		// parse the tile index
+		if (start_pos < end_pos && *start_pos == '-')
+		{
+			start_pos++;		// skip the -
+		}
+
+		start_pos = parse_utils_extract_uint32_token(start_pos, end_pos, &tile_index);
+		if (tile_index <= 0)
+		{
+			ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+				"ngx_http_vod_thumb_parse_tile_uri_file_name: failed to parse tile index");
+			return ngx_http_vod_status_to_ngx_error(r, VOD_BAD_REQUEST);
+		}
+	}
+	else if (ngx_http_vod_match_prefix_postfix(start_pos, end_pos, &thumb->tile_file_name_prefix, m3u8_file_ext))
+	{
+		start_pos += thumb->tile_file_name_prefix.len;
+		end_pos -= (sizeof(m3u8_file_ext) - 1);
+		*request = &tile_playlist_request;
+	}
+	else if (ngx_http_vod_match_prefix_postfix(start_pos, end_pos, &thumb->tile_file_name_prefix, vtt_file_ext))
+	{
+		start_pos += thumb->tile_file_name_prefix.len;
+		end_pos -= (sizeof(vtt_file_ext) - 1);
+		*request = &tile_vtt_request;
+	}
+	else
+	{
+		return NGX_DECLINED;
+	}
+
+	// parse the required tracks string
+	rc = ngx_http_vod_parse_uri_file_name(r, start_pos, end_pos, 0, request_params);
+	if (rc != NGX_OK)
+	{
+		ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+			"ngx_http_vod_thumb_parse_tile_uri_file_name: ngx_http_vod_parse_uri_file_name failed %i", rc);
+		return rc;
+	}
+
+	if (tile_index > 0)
+	{
+		request_params->segment_time = (uint64_t)(tile_index - 1) *
+			thumb->tile.columns * thumb->tile.rows * thumb->tile.interval;
+		request_params->segment_time_type = SEGMENT_TIME_START_RELATIVE;
+		request_params->segment_time_span = thumb->tile.columns * thumb->tile.rows * thumb->tile.interval;
+	}
+
+	vod_track_mask_reset_all_bits(request_params->tracks_mask[MEDIA_TYPE_AUDIO]);
+	vod_track_mask_reset_all_bits(request_params->tracks_mask[MEDIA_TYPE_SUBTITLE]);
+
+	return NGX_OK;
+}
+#endif // NGX_HAVE_LIB_SW_SCALE
+
 static ngx_int_t
 ngx_http_vod_thumb_parse_uri_file_name(
 	ngx_http_request_t *r,
@@ -235,6 +712,14 @@ ngx_http_vod_thumb_parse_uri_file_name(
 	int64_t time;
 	ngx_int_t rc;
 
+#if (NGX_HAVE_LIB_SW_SCALE)
+	rc = ngx_http_vod_thumb_parse_tile_uri_file_name(r, conf, start_pos, end_pos, request_params, request);
+	if (rc != NGX_DECLINED)
+	{
+		return rc;
+	}
+#endif // NGX_HAVE_LIB_SW_SCALE
+
 	if (ngx_http_vod_match_prefix_postfix(start_pos, end_pos, &conf->thumb.file_name_prefix, jpg_file_ext))
 	{
 		start_pos += conf->thumb.file_name_prefix.len;
@@ -301,6 +786,18 @@ ngx_http_vod_thumb_parse_uri_file_name(
 	}
 #endif // NGX_HAVE_LIB_SW_SCALE
 
+	// fast mode
+	if (start_pos < end_pos && *start_pos == '-')
+	{
+		start_pos++;		// skip the -
+	}
+
+	if (start_pos < end_pos && *start_pos == 'k')
+	{
+		start_pos++;		// skip the k
+		request_params->thumb_fast_mode = TRUE;
+	}
+
 	// parse the required tracks string
 	rc = ngx_http_vod_parse_uri_file_name(r, start_pos, end_pos, 0, request_params);
 	if (rc != NGX_OK)
@@ -14,4 +14,64 @@
 	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, accurate),
 	NULL },
 
+	{ ngx_string("vod_thumb_fast_mode"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_flag_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, fast_mode),
+	NULL },
+
+#if (NGX_HAVE_LIB_SW_SCALE)
+	{ ngx_string("vod_thumb_tile_file_name_prefix"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_str_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, tile_file_name_prefix),
+	NULL },
+
+	{ ngx_string("vod_thumb_tile_columns"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_num_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, tile.columns),
+	NULL },
+
+	{ ngx_string("vod_thumb_tile_rows"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_num_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, tile.rows),
+	NULL },
+
+	{ ngx_string("vod_thumb_tile_interval"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_num_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, tile.interval),
+	NULL },
+
+	{ ngx_string("vod_thumb_tile_width"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_num_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, tile.width),
+	NULL },
+
+	{ ngx_string("vod_thumb_tile_height"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+	ngx_conf_set_num_slot,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, tile.height),
+	NULL },
+#endif // NGX_HAVE_LIB_SW_SCALE
+
+#if (NGX_THREADS)
+	{ ngx_string("vod_thumb_thread_pool"),
+	NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_NOARGS | NGX_CONF_TAKE1,
+	ngx_http_vod_thread_pool_command,
+	NGX_HTTP_LOC_CONF_OFFSET,
+	BASE_OFFSET + offsetof(ngx_http_vod_thumb_loc_conf_t, thread_pool),
+	NULL },
+#endif // NGX_THREADS
+
 #undef BASE_OFFSET
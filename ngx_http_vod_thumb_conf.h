@@ -3,12 +3,21 @@
 
 // includes
 #include <ngx_http.h>
+#include "vod/thumb/thumb_tile.h"
 
 // typedefs
 typedef struct
 {
 	ngx_str_t file_name_prefix;
 	ngx_flag_t accurate;
+	ngx_flag_t fast_mode;
+#if (NGX_HAVE_LIB_SW_SCALE)
+	ngx_str_t tile_file_name_prefix;
+	thumb_tile_conf_t tile;
+#endif // NGX_HAVE_LIB_SW_SCALE
+#if (NGX_THREADS)
+	ngx_thread_pool_t* thread_pool;
+#endif // NGX_THREADS
 } ngx_http_vod_thumb_loc_conf_t;
 
 #endif // _NGX_HTTP_VOD_THUMB_CONF_H_INCLUDED_
@@ -70,3 +70,61 @@ ngx_perf_counters_create_zone(ngx_conf_t *cf, ngx_str_t *name, void *tag)
 	result->init = ngx_perf_counters_init;
 	return result;
 }
+
+ngx_atomic_uint_t
+ngx_perf_counter_get_bucket_limit(ngx_uint_t index)
+{
+	ngx_uint_t shift;
+
+	// returns the largest value that is counted in the bucket
+	if (index < NGX_PERF_COUNTER_HIST_SUB_COUNT)
+	{
+		return index;
+	}
+
+	shift = index / NGX_PERF_COUNTER_HIST_SUB_COUNT - 1;
+
+	return ((ngx_atomic_uint_t)(NGX_PERF_COUNTER_HIST_SUB_COUNT + index % NGX_PERF_COUNTER_HIST_SUB_COUNT + 1) << shift) - 1;
+}
+
+ngx_atomic_uint_t
+ngx_perf_counter_get_count(ngx_perf_counter_t* counter)
+{
+	ngx_atomic_uint_t result = 0;
+	ngx_uint_t i;
+
+	for (i = 0; i < NGX_PERF_COUNTER_HIST_SIZE; i++)
+	{
+		result += counter->hist[i];
+	}
+
+	return result;
+}
+
+ngx_atomic_uint_t
+ngx_perf_counter_get_percentile(ngx_perf_counter_t* counter, ngx_atomic_uint_t count, ngx_uint_t permille)
+{
+	ngx_atomic_uint_t target;
+	ngx_atomic_uint_t cur;
+	ngx_uint_t i;
+
+	if (count <= 0)
+	{
+		return 0;
+	}
+
+	// Note: the buckets may be updated while reading them, the result is the upper limit of
+	//		the bucket that contains the percentile, or the last bucket if not found
+	target = (count * permille + 999) / 1000;
+	cur = 0;
+	for (i = 0; i < NGX_PERF_COUNTER_HIST_SIZE - 1; i++)
+	{
+		cur += counter->hist[i];
+		if (cur >= target)
+		{
+			break;
+		}
+	}
+
+	return ngx_perf_counter_get_bucket_limit(i);
+}
@@ -4,6 +4,14 @@
 // includes
 #include <ngx_core.h>
 
+#if (NGX_HAVE_OPENSSL_EVP)
+#include "vod/aes_cipher_cache.h"
+#endif // NGX_HAVE_OPENSSL_EVP
+
+#if (NGX_HAVE_LIB_AV_CODEC)
+#include "vod/codec_context_pool.h"
+#endif // NGX_HAVE_LIB_AV_CODEC
+
 // comment the line below to remove the support for performance counters
 #define NGX_PERF_COUNTERS_ENABLED
 
@@ -28,6 +36,17 @@ typedef struct timeval ngx_tick_count_t;
 	
 #endif // NGX_HAVE_CLOCK_GETTIME
 
+// histogram constants
+// Note: the histograms are log-linear (HDR-style) - values below NGX_PERF_COUNTER_HIST_SUB_COUNT get
+//		a bucket each, larger values get NGX_PERF_COUNTER_HIST_SUB_COUNT buckets per power of 2, so the
+//		relative error is at most 1/NGX_PERF_COUNTER_HIST_SUB_COUNT. values of 2^NGX_PERF_COUNTER_HIST_MAX_BITS
+//		microseconds (~71 minutes) and above are counted in the last bucket
+#define NGX_PERF_COUNTER_HIST_SUB_BITS (2)
+#define NGX_PERF_COUNTER_HIST_SUB_COUNT (1 << NGX_PERF_COUNTER_HIST_SUB_BITS)
+#define NGX_PERF_COUNTER_HIST_MAX_BITS (32)
+#define NGX_PERF_COUNTER_HIST_SIZE \
+	((NGX_PERF_COUNTER_HIST_MAX_BITS - NGX_PERF_COUNTER_HIST_SUB_BITS + 1) * NGX_PERF_COUNTER_HIST_SUB_COUNT)
+
 #ifdef NGX_PERF_COUNTERS_ENABLED
 
 // perf counters macros
@@ -44,6 +63,7 @@ typedef struct timeval ngx_tick_count_t;
 //		and the assignment are not performed atomically. however, the value of max is expected to
 //		converge quickly so that its updates will be performed less and less frequently, so it 
 //		should be accurate enough.
+//		the count is not updated here, it is the sum of the histogram buckets
 #define ngx_perf_counter_end(state, ctx, type)						\
 	if (state != NULL)												\
 	{																\
@@ -54,7 +74,8 @@ typedef struct timeval ngx_tick_count_t;
 																	\
 		__delta = ngx_tick_count_diff(ctx.start, __end);			\
 		(void)ngx_atomic_fetch_add(&state->counters[type].sum, __delta);	\
-		(void)ngx_atomic_fetch_add(&state->counters[type].count, 1);		\
+		(void)ngx_atomic_fetch_add(										\
+			&state->counters[type].hist[ngx_perf_counter_get_bucket(__delta)], 1);	\
 		if (__delta > state->counters[type].max)					\
 		{															\
 			struct timeval __tv;									\
@@ -63,8 +84,13 @@ typedef struct timeval ngx_tick_count_t;
 			state->counters[type].max_time = __tv.tv_sec;			\
 			state->counters[type].max_pid = ngx_pid;				\
 		}															\
+		ctx.delta = __delta;										\
 	}
 
+// Note: returns the duration measured by the last ngx_perf_counter_end on the context,
+//		the value is valid only when the perf counters state is not null
+#define ngx_perf_counter_get_delta(ctx) (ctx.delta)
+
 #define ngx_perf_counter_copy(target, source)	target = source
 
 // typedefs
@@ -78,6 +104,7 @@ enum {
 
 typedef struct {
 	ngx_tick_count_t start;
+	ngx_atomic_uint_t delta;
 } ngx_perf_counter_context_t;
 
 #else
@@ -88,22 +115,60 @@ typedef struct {
 #define ngx_perf_counter_start(ctx)
 #define ngx_perf_counter_end(state, ctx, type)
 #define ngx_perf_counter_copy(target, source)
+#define ngx_perf_counter_get_delta(ctx) (0)
 
 #define PC_COUNT (0)
 
 #endif // NGX_PERF_COUNTERS_ENABLED
 
+// dimensions
+// Note: the submodule dimension is the index of the submodule in the submodules array
+#define PC_DIM_SUBMODULE_COUNT (6)
+
+enum {
+	PC_DIM_CLASS_MANIFEST,
+	PC_DIM_CLASS_SEGMENT,
+	PC_DIM_CLASS_THUMB,
+	PC_DIM_CLASS_OTHER,
+
+	PC_DIM_CLASS_COUNT
+};
+
+enum {
+	PC_DIM_FORMAT_MP4,
+	PC_DIM_FORMAT_MKV,
+	PC_DIM_FORMAT_SUBTITLES,
+	PC_DIM_FORMAT_NONE,			// no media file was parsed, e.g. response served from cache
+
+	PC_DIM_FORMAT_COUNT
+};
+
 // typedefs
 typedef struct {
 	ngx_atomic_t sum;
-	ngx_atomic_t count;
 	ngx_atomic_t max;
 	ngx_atomic_t max_time;
 	ngx_atomic_t max_pid;
+	ngx_atomic_t hist[NGX_PERF_COUNTER_HIST_SIZE];
 } ngx_perf_counter_t;
 
+typedef struct {
+	ngx_atomic_t count;
+	ngx_atomic_t total;			// total request time, in microseconds
+	ngx_atomic_t process;		// time spent building manifests / processing frames, in microseconds
+	ngx_atomic_t bytes_in;		// media frames bytes read
+	ngx_atomic_t bytes_out;		// response bytes
+} ngx_perf_counter_dim_t;
+
 typedef struct {
 	ngx_perf_counter_t counters[PC_COUNT];
+	ngx_perf_counter_dim_t dims[PC_DIM_SUBMODULE_COUNT][PC_DIM_CLASS_COUNT][PC_DIM_FORMAT_COUNT];
+#if (NGX_HAVE_OPENSSL_EVP)
+	aes_cipher_cache_stats_t cipher_cache;
+#endif // NGX_HAVE_OPENSSL_EVP
+#if (NGX_HAVE_LIB_AV_CODEC)
+	codec_context_pool_stats_t codec_context_pool;
+#endif // NGX_HAVE_LIB_AV_CODEC
 } ngx_perf_counters_t;
 
 // globals
@@ -111,6 +176,44 @@ extern const ngx_str_t perf_counters_open_tags[];
 extern const ngx_str_t perf_counters_close_tags[];
 
 // functions
+static ngx_inline ngx_uint_t
+ngx_perf_counter_get_bucket(uint64_t value)
+{
+	ngx_uint_t shift;
+	ngx_uint_t bits;
+
+	if (value < NGX_PERF_COUNTER_HIST_SUB_COUNT)
+	{
+		return value;
+	}
+
+	if (value >= (uint64_t)1 << NGX_PERF_COUNTER_HIST_MAX_BITS)
+	{
+		return NGX_PERF_COUNTER_HIST_SIZE - 1;
+	}
+
+	// find the shift that brings the value to [sub count, 2 * sub count)
+	shift = 0;
+	for (bits = 16; bits > 0; bits >>= 1)
+	{
+		if ((value >> (shift + bits)) >= NGX_PERF_COUNTER_HIST_SUB_COUNT)
+		{
+			shift += bits;
+		}
+	}
+
+	return (shift + 1) * NGX_PERF_COUNTER_HIST_SUB_COUNT + (value >> shift) - NGX_PERF_COUNTER_HIST_SUB_COUNT;
+}
+
 ngx_shm_zone_t* ngx_perf_counters_create_zone(ngx_conf_t *cf, ngx_str_t *name, void *tag);
 
+ngx_atomic_uint_t ngx_perf_counter_get_bucket_limit(ngx_uint_t index);
+
+ngx_atomic_uint_t ngx_perf_counter_get_count(ngx_perf_counter_t* counter);
+
+ngx_atomic_uint_t ngx_perf_counter_get_percentile(
+	ngx_perf_counter_t* counter, 
+	ngx_atomic_uint_t count, 
+	ngx_uint_t permille);
+
 #endif // _NGX_PERF_COUNTERS_H_INCLUDED_
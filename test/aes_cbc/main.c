@@ -0,0 +1,494 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ngx_core.h>
+#include <vod/mp4/mp4_cbcs_encrypt.h>
+#include <vod/hls/aes_cbc_encrypt.h>
+#include <vod/avc_hevc_parser.h>
+#include <vod/hevc_parser.h>
+#include <vod/avc_parser.h>
+
+#define FRAME_COUNT (32)
+#define MAX_NAL_UNITS_PER_FRAME (8)
+#define MAX_NAL_UNIT_SIZE (64 * 1024)
+#define NAL_PACKET_SIZE_LENGTH (4)
+#define ENCRYPTED_BLOCK_PERIOD (10)
+#define MAX_SLICE_HEADER_SIZE (128)
+#define TEST_ITERATIONS (20)
+
+volatile ngx_cycle_t  *ngx_cycle;
+ngx_log_t ngx_log;
+
+#if (NGX_HAVE_VARIADIC_MACROS)
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, ...)
+
+#else
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, va_list args)
+
+#endif
+{
+}
+
+// slice parser stubs - the test does not use real sps/pps, the slice header size is derived from
+// the first byte that follows the nal type, and nal types 1 / 5 are slices
+vod_status_t
+avc_hevc_parser_init_ctx(request_context_t* request_context, void** result)
+{
+	*result = NULL;
+	return VOD_OK;
+}
+
+vod_status_t
+avc_parser_parse_extra_data(void* ctx, vod_str_t* extra_data, uint32_t* nal_packet_size_length, uint32_t* min_packet_size)
+{
+	*nal_packet_size_length = NAL_PACKET_SIZE_LENGTH;
+	*min_packet_size = NAL_PACKET_SIZE_LENGTH + 1;
+	return VOD_OK;
+}
+
+vod_status_t
+avc_parser_is_slice(void* ctx, uint8_t nal_type, bool_t* is_slice)
+{
+	nal_type &= 0x1f;
+	*is_slice = nal_type == 1 || nal_type == 5;
+	return VOD_OK;
+}
+
+static uint32_t
+test_get_slice_header_size(const u_char* buffer, uint32_t size)
+{
+	uint32_t result;
+
+	result = 2 + buffer[1] % 64;
+	return vod_min(result, size);
+}
+
+vod_status_t
+avc_parser_get_slice_header_size(void* ctx, const u_char* buffer, uint32_t size, uint32_t* result)
+{
+	*result = test_get_slice_header_size(buffer, size);
+	return VOD_OK;
+}
+
+vod_status_t
+hevc_parser_parse_extra_data(void* ctx, vod_str_t* extra_data, uint32_t* nal_packet_size_length, uint32_t* min_packet_size)
+{
+	return VOD_UNEXPECTED;
+}
+
+vod_status_t
+hevc_parser_is_slice(void* ctx, uint8_t nal_type, bool_t* is_slice)
+{
+	return VOD_UNEXPECTED;
+}
+
+vod_status_t
+hevc_parser_get_slice_header_size(void* ctx, const u_char* buffer, uint32_t size, uint32_t* result)
+{
+	return VOD_UNEXPECTED;
+}
+
+// output collection
+typedef struct {
+	u_char* data;
+	size_t size;
+} output_t;
+
+static vod_status_t
+output_write(void* context, u_char* buffer, uint32_t size)
+{
+	output_t* output = context;
+
+	memcpy(output->data + output->size, buffer, size);
+	output->size += size;
+	return VOD_OK;
+}
+
+// reference implementation - every protected block is encrypted separately, the way the
+// cbcs video writer worked before batching the pattern periods
+static void
+reference_encrypt_cbcs(
+	EVP_CIPHER_CTX* cipher,
+	const u_char* iv,
+	u_char* dest,
+	const u_char* src,
+	size_t size)
+{
+	const u_char* src_end = src + size;
+	uint32_t slice_header_size;
+	uint32_t packet_size;
+	uint32_t data_size;
+	uint32_t offset;
+	bool_t is_slice;
+	int out_size;
+
+	memcpy(dest, src, size);
+
+	while (src < src_end)
+	{
+		packet_size = (src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3];
+		src += NAL_PACKET_SIZE_LENGTH;
+		dest += NAL_PACKET_SIZE_LENGTH;
+
+		avc_parser_is_slice(NULL, src[0], &is_slice);
+		if (is_slice && packet_size - 1 >= 1 + AES_BLOCK_SIZE)
+		{
+			slice_header_size = test_get_slice_header_size(src, vod_min(MAX_SLICE_HEADER_SIZE, packet_size));
+			data_size = packet_size - slice_header_size;
+			if (data_size >= AES_BLOCK_SIZE)
+			{
+				EVP_EncryptInit_ex(cipher, NULL, NULL, NULL, iv);
+
+				for (offset = 0; offset + AES_BLOCK_SIZE <= data_size; offset += ENCRYPTED_BLOCK_PERIOD * AES_BLOCK_SIZE)
+				{
+					EVP_EncryptUpdate(cipher,
+						dest + slice_header_size + offset,
+						&out_size,
+						src + slice_header_size + offset,
+						AES_BLOCK_SIZE);
+				}
+			}
+		}
+
+		src += packet_size;
+		dest += packet_size;
+	}
+}
+
+// builds frames of random nal units, some of them are not slices / too small to be encrypted
+static size_t
+build_frames(u_char* buffer, input_frame_t* frames, uint32_t frame_count)
+{
+	static const uint8_t nal_types[] = { 0x65, 0x41, 0x06, 0x09 };
+	uint32_t nal_unit_count;
+	uint32_t packet_size;
+	uint32_t i;
+	uint32_t j;
+	uint32_t k;
+	u_char* frame_start;
+	u_char* p = buffer;
+
+	for (i = 0; i < frame_count; i++)
+	{
+		frame_start = p;
+		nal_unit_count = 1 + rand() % MAX_NAL_UNITS_PER_FRAME;
+
+		for (j = 0; j < nal_unit_count; j++)
+		{
+			switch (rand() % 4)
+			{
+			case 0:
+				packet_size = 1 + rand() % 64;
+				break;
+
+			case 1:
+				packet_size = 1 + rand() % 1024;
+				break;
+
+			default:
+				packet_size = 1 + rand() % MAX_NAL_UNIT_SIZE;
+				break;
+			}
+
+			*p++ = (packet_size >> 24) & 0xff;
+			*p++ = (packet_size >> 16) & 0xff;
+			*p++ = (packet_size >> 8) & 0xff;
+			*p++ = packet_size & 0xff;
+			*p++ = nal_types[rand() % (sizeof(nal_types) / sizeof(nal_types[0]))];
+			for (k = 1; k < packet_size; k++)
+			{
+				*p++ = (u_char)rand();
+			}
+		}
+
+		frames[i].offset = frame_start - buffer;
+		frames[i].size = p - frame_start;
+	}
+
+	return p - buffer;
+}
+
+static bool_t
+test_cbcs_video(request_context_t* request_context, const u_char* key, const u_char* iv, uint32_t max_chunk_size)
+{
+	static input_frame_t frames[FRAME_COUNT];
+	segment_writer_t segment_writer;
+	segment_writer_t* writers;
+	media_track_t track;
+	media_set_t media_set;
+	EVP_CIPHER_CTX* cipher;
+	output_t output;
+	u_char* reference_output;
+	u_char* input_copy;
+	u_char* input;
+	size_t input_size;
+	size_t offset;
+	size_t cur_size;
+	bool_t result = FALSE;
+
+	input = malloc(FRAME_COUNT * MAX_NAL_UNITS_PER_FRAME * (MAX_NAL_UNIT_SIZE + NAL_PACKET_SIZE_LENGTH + 1));
+	if (input == NULL)
+	{
+		printf("Error: allocation failed\n");
+		return FALSE;
+	}
+
+	input_size = build_frames(input, frames, FRAME_COUNT);
+
+	input_copy = malloc(input_size);
+	reference_output = malloc(input_size);
+	output.data = malloc(input_size);
+	output.size = 0;
+	cipher = EVP_CIPHER_CTX_new();
+	if (input_copy == NULL || reference_output == NULL || output.data == NULL || cipher == NULL)
+	{
+		printf("Error: allocation failed\n");
+		goto done;
+	}
+
+	memcpy(input_copy, input, input_size);
+
+	// reference
+	if (1 != EVP_EncryptInit_ex(cipher, EVP_aes_128_cbc(), NULL, key, NULL))
+	{
+		printf("Error: failed to initialize the reference cipher\n");
+		goto done;
+	}
+
+	EVP_CIPHER_CTX_set_padding(cipher, 0);
+
+	reference_encrypt_cbcs(cipher, iv, reference_output, input, input_size);
+
+	// writer
+	ngx_memzero(&track, sizeof(track));
+	track.media_info.media_type = MEDIA_TYPE_VIDEO;
+	track.media_info.codec_id = VOD_CODEC_ID_AVC;
+	track.frames.first_frame = frames;
+	track.frames.last_frame = frames + FRAME_COUNT;
+
+	ngx_memzero(&media_set, sizeof(media_set));
+	media_set.total_track_count = 1;
+	media_set.clip_count = 1;
+	media_set.filtered_tracks = &track;
+	media_set.filtered_tracks_end = &track + 1;
+
+	segment_writer.write_tail = output_write;
+	segment_writer.write_head = NULL;
+	segment_writer.context = &output;
+
+	if (mp4_cbcs_encrypt_get_writers(request_context, &media_set, &segment_writer, key, iv, &writers) != VOD_OK)
+	{
+		printf("Error: mp4_cbcs_encrypt_get_writers failed\n");
+		goto done;
+	}
+
+	for (offset = 0; offset < input_size; offset += cur_size)
+	{
+		cur_size = 1 + rand() % max_chunk_size;
+		cur_size = vod_min(cur_size, input_size - offset);
+
+		if (writers[0].write_tail(writers[0].context, input + offset, cur_size) != VOD_OK)
+		{
+			printf("Error: cbcs write failed\n");
+			goto done;
+		}
+	}
+
+	if (output.size != input_size || memcmp(output.data, reference_output, input_size) != 0)
+	{
+		printf("Error: cbcs output mismatch, chunk size %u\n", max_chunk_size);
+		goto done;
+	}
+
+	if (memcmp(input, input_copy, input_size) != 0)
+	{
+		printf("Error: cbcs writer modified its input\n");
+		goto done;
+	}
+
+	result = TRUE;
+
+done:
+
+	if (cipher != NULL)
+	{
+		EVP_CIPHER_CTX_free(cipher);
+	}
+	free(output.data);
+	free(reference_output);
+	free(input_copy);
+	free(input);
+	return result;
+}
+
+// aes-128 (hls) - encrypting in place or to separate buffers must give the same output as a single
+// encryption of the whole stream, the input buffers may be modified only when encrypting in place
+static bool_t
+test_aes_cbc_write(request_context_t* request_context, const u_char* key, const u_char* iv, bool_t encrypt_in_place)
+{
+	aes_cbc_encrypt_context_t* state;
+	EVP_CIPHER_CTX* cipher;
+	output_t output;
+	u_char* reference_output;
+	u_char* input_copy;
+	u_char* input;
+	size_t input_size = 4 * 1024 * 1024;
+	size_t offset;
+	size_t cur_size;
+	bool_t result = FALSE;
+	int out_size;
+	int final_size;
+	uint32_t i;
+
+	input = malloc(input_size);
+	input_copy = malloc(input_size);
+	reference_output = malloc(input_size + AES_BLOCK_SIZE);
+	output.data = malloc(input_size + AES_BLOCK_SIZE);
+	output.size = 0;
+	cipher = EVP_CIPHER_CTX_new();
+	if (input == NULL || input_copy == NULL || reference_output == NULL || output.data == NULL || cipher == NULL)
+	{
+		printf("Error: allocation failed\n");
+		goto done;
+	}
+
+	for (i = 0; i < input_size; i++)
+	{
+		input[i] = (u_char)rand();
+	}
+
+	memcpy(input_copy, input, input_size);
+
+	// reference
+	if (1 != EVP_EncryptInit_ex(cipher, EVP_aes_128_cbc(), NULL, key, iv) ||
+		1 != EVP_EncryptUpdate(cipher, reference_output, &out_size, input, input_size) ||
+		1 != EVP_EncryptFinal_ex(cipher, reference_output + out_size, &final_size))
+	{
+		printf("Error: reference encryption failed\n");
+		goto done;
+	}
+
+	out_size += final_size;
+
+	// writer - mixes block aligned and unaligned buffers, so that both the in place and the copy paths are used
+	if (aes_cbc_encrypt_init(&state, request_context, output_write, &output, NULL, encrypt_in_place, key, iv) != VOD_OK)
+	{
+		printf("Error: aes_cbc_encrypt_init failed\n");
+		goto done;
+	}
+
+	for (offset = 0; offset < input_size; offset += cur_size)
+	{
+		cur_size = (rand() % 2) ? AES_BLOCK_SIZE * (1 + rand() % 1024) : 1 + rand() % 20000;
+		cur_size = vod_min(cur_size, input_size - offset);
+
+		if (aes_cbc_encrypt_write(state, input + offset, cur_size) != VOD_OK)
+		{
+			printf("Error: aes_cbc_encrypt_write failed\n");
+			goto done;
+		}
+	}
+
+	if (aes_cbc_encrypt_write(state, NULL, 0) != VOD_OK)
+	{
+		printf("Error: aes_cbc_encrypt_write flush failed\n");
+		goto done;
+	}
+
+	if (output.size != (size_t)out_size || memcmp(output.data, reference_output, out_size) != 0)
+	{
+		printf("Error: aes cbc output mismatch, in place %d\n", (int)encrypt_in_place);
+		goto done;
+	}
+
+	if (!encrypt_in_place && memcmp(input, input_copy, input_size) != 0)
+	{
+		printf("Error: aes cbc modified its input\n");
+		goto done;
+	}
+
+	result = TRUE;
+
+done:
+
+	if (cipher != NULL)
+	{
+		EVP_CIPHER_CTX_free(cipher);
+	}
+	free(output.data);
+	free(reference_output);
+	free(input_copy);
+	free(input);
+	return result;
+}
+
+int
+main()
+{
+	static const uint32_t chunk_sizes[] = { 300, 4096, 70000, 4 * 1024 * 1024 };
+	request_context_t request_context;
+	ngx_pool_t* pool;
+	u_char key[AES_BLOCK_SIZE];
+	u_char iv[AES_BLOCK_SIZE];
+	uint32_t failed = 0;
+	uint32_t i;
+	uint32_t j;
+
+	ngx_pagesize = getpagesize();
+	srand(time(NULL));
+
+	for (i = 0; i < TEST_ITERATIONS; i++)
+	{
+		pool = ngx_create_pool(1024 * 1024, &ngx_log);
+		if (pool == NULL)
+		{
+			printf("Error: ngx_create_pool failed\n");
+			return 1;
+		}
+
+		ngx_memzero(&request_context, sizeof(request_context));
+		request_context.pool = pool;
+		request_context.log = &ngx_log;
+
+		for (j = 0; j < sizeof(key); j++)
+		{
+			key[j] = (u_char)rand();
+			iv[j] = (u_char)rand();
+		}
+
+		for (j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++)
+		{
+			if (!test_cbcs_video(&request_context, key, iv, chunk_sizes[j]))
+			{
+				failed++;
+			}
+		}
+
+		if (!test_aes_cbc_write(&request_context, key, iv, TRUE))
+		{
+			failed++;
+		}
+
+		if (!test_aes_cbc_write(&request_context, key, iv, FALSE))
+		{
+			failed++;
+		}
+
+		ngx_destroy_pool(pool);
+	}
+
+	if (failed > 0)
+	{
+		printf("%u tests failed\n", failed);
+		return 1;
+	}
+
+	printf("all tests passed\n");
+	return 0;
+}
@@ -0,0 +1,17 @@
+#!/bin/bash
+
+if [ -z "$NGX_ROOT" ]; then
+	echo "NGX_ROOT not set"
+	exit 1
+fi
+
+if [ -z "$VOD_ROOT" ]; then
+	echo "VOD_ROOT not set"
+	exit 1
+fi
+
+if [ -z "$CC" ]; then
+	CC=cc
+fi
+
+$CC -Wall -O2 -g -oaesctrbench -DNGX_HAVE_OPENSSL_EVP=1 $VOD_ROOT/vod/mp4/mp4_aes_ctr.c $VOD_ROOT/vod/aes_cipher_cache.c $VOD_ROOT/vod/write_buffer.c $VOD_ROOT/vod/buffer_pool.c $VOD_ROOT/test/aes_ctr/main.c $NGX_ROOT/src/core/ngx_palloc.c $NGX_ROOT/src/core/ngx_string.c $NGX_ROOT/src/os/unix/ngx_alloc.c -I $NGX_ROOT/src/core -I $NGX_ROOT/src/event -I $NGX_ROOT/src/event/modules -I $NGX_ROOT/src/os/unix -I $NGX_ROOT/objs -I $VOD_ROOT -lcrypto
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ngx_core.h>
+#include <vod/mp4/mp4_aes_ctr.h>
+
+#define BUFFER_SIZE (4 * 1024 * 1024)
+#define TOTAL_SIZE (1024LL * 1024 * 1024)
+#define REFERENCE_COUNTER_BUFFER_SIZE (AES_BLOCK_SIZE * 64)
+
+volatile ngx_cycle_t  *ngx_cycle;
+ngx_log_t ngx_log;
+
+#if (NGX_HAVE_VARIADIC_MACROS)
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, ...)
+
+#else
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, va_list args)
+
+#endif
+{
+}
+
+// reference implementation - ecb encryption of an explicitly built counter buffer, 
+// the way mp4_aes_ctr_process worked before moving to the native counter mode
+typedef struct {
+	EVP_CIPHER_CTX* cipher;
+	u_char counter[REFERENCE_COUNTER_BUFFER_SIZE];
+	u_char encrypted_counter[REFERENCE_COUNTER_BUFFER_SIZE];
+	u_char* encrypted_pos;
+	u_char* encrypted_end;
+} reference_state_t;
+
+static void
+reference_set_iv(reference_state_t* state, u_char* iv)
+{
+	memcpy(state->counter, iv, MP4_AES_CTR_IV_SIZE);
+	memset(state->counter + MP4_AES_CTR_IV_SIZE, 0, sizeof(state->counter) - MP4_AES_CTR_IV_SIZE);
+	state->encrypted_pos = NULL;
+	state->encrypted_end = NULL;
+}
+
+static void
+reference_process(reference_state_t* state, u_char* dest, const u_char* src, uint32_t size)
+{
+	const u_char* src_end = src + size;
+	const u_char* cur_end_pos;
+	u_char* encrypted_counter_pos;
+	u_char* cur_block;
+	u_char* next_block;
+	u_char* end_block;
+	size_t encrypted_size;
+	int out_size;
+
+	while (src < src_end)
+	{
+		if (state->encrypted_pos >= state->encrypted_end)
+		{
+			encrypted_size = aes_round_up_to_block_exact(src_end - src);
+			if (encrypted_size > sizeof(state->counter))
+			{
+				encrypted_size = sizeof(state->counter);
+			}
+
+			end_block = state->counter + encrypted_size - AES_BLOCK_SIZE;
+			for (cur_block = state->counter; cur_block < end_block; cur_block = next_block)
+			{
+				next_block = cur_block + AES_BLOCK_SIZE;
+				memcpy(next_block, cur_block, AES_BLOCK_SIZE);
+				mp4_aes_ctr_increment_be64(next_block + 8);
+			}
+
+			EVP_EncryptUpdate(state->cipher, state->encrypted_counter, &out_size, state->counter, encrypted_size);
+
+			if (encrypted_size > AES_BLOCK_SIZE)
+			{
+				memcpy(state->counter, end_block, AES_BLOCK_SIZE);
+			}
+			mp4_aes_ctr_increment_be64(state->counter + 8);
+
+			state->encrypted_end = state->encrypted_counter + encrypted_size;
+
+			encrypted_counter_pos = state->encrypted_counter;
+			cur_end_pos = src + encrypted_size;
+		}
+		else
+		{
+			encrypted_counter_pos = state->encrypted_pos;
+			cur_end_pos = src + (state->encrypted_end - encrypted_counter_pos);
+		}
+
+		if (src_end < cur_end_pos)
+		{
+			cur_end_pos = src_end;
+		}
+
+		while (src < cur_end_pos)
+		{
+			*dest++ = *src++ ^ *encrypted_counter_pos++;
+		}
+
+		state->encrypted_pos = encrypted_counter_pos;
+	}
+}
+
+static double
+get_time()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Note: the input is split to frames of frame_size, each frame is written in chunks of chunk_size
+//		with a new iv, the way the cenc encryption works
+static double
+run_engine(
+	mp4_aes_ctr_state_t* state,
+	u_char* dest,
+	u_char* src,
+	uint32_t frame_size,
+	uint32_t chunk_size)
+{
+	u_char iv[MP4_AES_CTR_IV_SIZE];
+	uint32_t frame_offset;
+	uint32_t cur_size;
+	uint32_t offset;
+	long long total;
+	double start;
+
+	memset(iv, 0x11, sizeof(iv));
+
+	start = get_time();
+
+	for (total = 0; total < TOTAL_SIZE; total += BUFFER_SIZE)
+	{
+		for (offset = 0; offset < BUFFER_SIZE; offset += frame_size)
+		{
+			mp4_aes_ctr_set_iv(state, iv);
+			mp4_aes_ctr_increment_be64(iv);
+
+			for (frame_offset = 0; frame_offset < frame_size; frame_offset += cur_size)
+			{
+				cur_size = vod_min(chunk_size, frame_size - frame_offset);
+				mp4_aes_ctr_process(state, dest + offset + frame_offset, src + offset + frame_offset, cur_size);
+			}
+		}
+	}
+
+	return TOTAL_SIZE / (get_time() - start) / (1024 * 1024 * 1024);
+}
+
+static double
+run_reference(
+	reference_state_t* state,
+	u_char* dest,
+	u_char* src,
+	uint32_t frame_size,
+	uint32_t chunk_size)
+{
+	u_char iv[MP4_AES_CTR_IV_SIZE];
+	uint32_t frame_offset;
+	uint32_t cur_size;
+	uint32_t offset;
+	long long total;
+	double start;
+
+	memset(iv, 0x11, sizeof(iv));
+
+	start = get_time();
+
+	for (total = 0; total < TOTAL_SIZE; total += BUFFER_SIZE)
+	{
+		for (offset = 0; offset < BUFFER_SIZE; offset += frame_size)
+		{
+			reference_set_iv(state, iv);
+			mp4_aes_ctr_increment_be64(iv);
+
+			for (frame_offset = 0; frame_offset < frame_size; frame_offset += cur_size)
+			{
+				cur_size = vod_min(chunk_size, frame_size - frame_offset);
+				reference_process(state, dest + offset + frame_offset, src + offset + frame_offset, cur_size);
+			}
+		}
+	}
+
+	return TOTAL_SIZE / (get_time() - start) / (1024 * 1024 * 1024);
+}
+
+int
+main()
+{
+	static const uint32_t frame_sizes[] = { 1000, 16384, 262144 };
+	static const uint32_t chunk_sizes[] = { 100, 4096, 1048576 };
+	request_context_t request_context;
+	reference_state_t reference;
+	mp4_aes_ctr_state_t state;
+	ngx_pool_t* pool;
+	u_char key[MP4_AES_CTR_KEY_SIZE];
+	u_char* reference_output;
+	u_char* output;
+	u_char* input;
+	double reference_rate;
+	double rate;
+	uint32_t i;
+	uint32_t j;
+
+	pool = ngx_create_pool(1024 * 1024, &ngx_log);
+	input = malloc(BUFFER_SIZE);
+	output = malloc(BUFFER_SIZE);
+	reference_output = malloc(BUFFER_SIZE);
+	if (pool == NULL || input == NULL || output == NULL || reference_output == NULL)
+	{
+		printf("Error: allocation failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < BUFFER_SIZE; i++)
+	{
+		input[i] = (u_char)rand();
+	}
+
+	for (i = 0; i < sizeof(key); i++)
+	{
+		key[i] = (u_char)rand();
+	}
+
+	ngx_memzero(&request_context, sizeof(request_context));
+	request_context.pool = pool;
+	request_context.log = &ngx_log;
+
+	if (mp4_aes_ctr_init(&state, &request_context, key) != VOD_OK)
+	{
+		printf("Error: mp4_aes_ctr_init failed\n");
+		return 1;
+	}
+
+	reference.cipher = EVP_CIPHER_CTX_new();
+	if (reference.cipher == NULL ||
+		1 != EVP_EncryptInit_ex(reference.cipher, EVP_aes_128_ecb(), NULL, key, NULL))
+	{
+		printf("Error: failed to initialize the reference cipher\n");
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(frame_sizes) / sizeof(frame_sizes[0]); i++)
+	{
+		for (j = 0; j < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); j++)
+		{
+			if (j > 0 && chunk_sizes[j - 1] >= frame_sizes[i])
+			{
+				// larger chunks are equivalent to the previous chunk size
+				continue;
+			}
+
+			rate = run_engine(&state, output, input, frame_sizes[i], chunk_sizes[j]);
+			reference_rate = run_reference(&reference, reference_output, input, frame_sizes[i], chunk_sizes[j]);
+
+			printf("frame_size=%6u chunk_size=%7u native ctr %.2f GB/s, reference %.2f GB/s%s\n",
+				frame_sizes[i],
+				chunk_sizes[j],
+				rate,
+				reference_rate,
+				memcmp(output, reference_output, BUFFER_SIZE) != 0 ? " - OUTPUT MISMATCH" : "");
+		}
+	}
+
+	EVP_CIPHER_CTX_free(reference.cipher);
+	ngx_destroy_pool(pool);
+	free(reference_output);
+	free(output);
+	free(input);
+
+	return 0;
+}
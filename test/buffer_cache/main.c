@@ -1,4 +1,6 @@
 // include
+#include <pthread.h>
+#include <sched.h>
 #include "ngx_cycle.h"
 #include "ngx_buffer_cache_internal.h"
 
@@ -6,11 +8,27 @@
 #define RAND(min, max) (rand() % ((max) - (min) + 1) + (min))
 //#define VERBOSE
 
+// constants
+#define CONCURRENT_SHARD_COUNT (4)
+#define CONCURRENT_KEY_COUNT (1024)
+#define CONCURRENT_READER_COUNT (4)
+#define CONCURRENT_WRITER_COUNT (2)
+#define CONCURRENT_OPERATIONS (200000)		// per thread
+
+// typedefs
+typedef struct {
+	ngx_buffer_cache_t* cache;
+	size_t max_size;
+	unsigned int seed;
+	ngx_uint_t hits;
+} concurrent_thread_t;
+
 // globals
 ngx_time_t ngx_time;
 ngx_shm_zone_t shm_zone;
 volatile ngx_cycle_t  *ngx_cycle;
 volatile ngx_time_t	 *ngx_cached_time = &ngx_time;
+volatile int concurrent_errors;
 
 // nginx function stubs
 #if (NGX_HAVE_VARIADIC_MACROS)
@@ -35,16 +53,60 @@ ngx_conf_log_error(ngx_uint_t level, ngx_conf_t *cf, ngx_err_t err,
 {
 }
 
+#if (NGX_HAVE_ATOMIC_OPS)
+// Note: the mutexes of the shards are spin locks, since the concurrent test accesses the cache from
+//		multiple threads. the slab pool mutex is not created (lock is NULL), it is used only by the 
+//		single shard tests, that are not concurrent
+ngx_int_t
+ngx_shmtx_create(ngx_shmtx_t *mtx, ngx_shmtx_sh_t *addr, u_char *name)
+{
+	addr->lock = 0;
+	mtx->lock = &addr->lock;
+	return NGX_OK;
+}
+
 void
 ngx_shmtx_lock(ngx_shmtx_t *mtx)
 {
+	if (mtx->lock == NULL)
+	{
+		return;
+	}
+
+	while (!ngx_atomic_cmp_set(mtx->lock, 0, 1))
+	{
+		sched_yield();
+	}
 }
 
 void
 ngx_shmtx_unlock(ngx_shmtx_t *mtx)
 {
+	if (mtx->lock == NULL)
+	{
+		return;
+	}
+
+	(void)ngx_atomic_cmp_set(mtx->lock, 1, 0);
+}
+#else
+ngx_int_t
+ngx_shmtx_create(ngx_shmtx_t *mtx, ngx_shmtx_sh_t *addr, u_char *name)
+{
+	return NGX_OK;
 }
 
+void
+ngx_shmtx_lock(ngx_shmtx_t *mtx)
+{
+}
+
+void
+ngx_shmtx_unlock(ngx_shmtx_t *mtx)
+{
+}
+#endif // NGX_HAVE_ATOMIC_OPS
+
 ngx_shm_zone_t *
 ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag)
 {
@@ -53,7 +115,7 @@ ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag)
 
 // buffer cache initialization
 static ngx_flag_t
-init_buffer_cache(size_t size)
+init_buffer_cache(size_t size, ngx_uint_t shard_count, ngx_uint_t policy)
 {
 	ngx_conf_t cf;
 	ngx_log_t log;
@@ -61,7 +123,7 @@ init_buffer_cache(size_t size)
 	ngx_time.sec = 0;
 	ngx_memzero(&shm_zone, sizeof(shm_zone));
 	shm_zone.shm.size = size;
-	shm_zone.shm.addr = malloc(shm_zone.shm.size);
+	shm_zone.shm.addr = calloc(shm_zone.shm.size, 1);
 	if (shm_zone.shm.addr == NULL)
 	{
 		return 0;
@@ -71,7 +133,7 @@ init_buffer_cache(size_t size)
 	ngx_memzero(&log, sizeof(log));
 	cf.log = &log;
 	cf.pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &log);
-	ngx_buffer_cache_create(&cf, NULL, 0, 0, NULL);
+	ngx_buffer_cache_create(&cf, NULL, 0, 0, shard_count, policy, NULL);
 
 	shm_zone.init(&shm_zone, NULL);
 	return 1;
@@ -152,19 +214,21 @@ int validate_random_buffer(unsigned int seed, const u_char* buffer, size_t size)
 	return 1;
 }
 
-int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_factor)
+int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_factor, ngx_uint_t policy)
 {
 	ngx_buffer_cache_stats_t stats;
 	u_char key[BUFFER_CACHE_KEY_SIZE];
 	ngx_str_t fetch_buffer;
+	uint32_t token;
 	u_char* store_buffer;
+	u_char* existing;
 	size_t* sizes_buffer;
 	size_t size;
 	size_t max_size;
-	int min_existing_index = 0;
+	int existing_count = 0;
 	int i, j;
 
-	printf("starting test - seed %llu cache_size %zu iterations %d size factor %d\n", (unsigned long long)seed, cache_size, iterations, size_factor);
+	printf("starting test - seed %llu cache_size %zu iterations %d size factor %d policy %d\n", (unsigned long long)seed, cache_size, iterations, size_factor, (int)policy);
 
 	srand(seed);
 	
@@ -175,6 +239,13 @@ int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_fact
 		return 0;
 	}
 	
+	existing = calloc(iterations, 1);
+	if (existing == NULL)
+	{
+		printf("Error: failed to allocate existing buffer\n");
+		return 0;
+	}
+
 	store_buffer = malloc(cache_size);
 	if (store_buffer == NULL)
 	{
@@ -182,7 +253,7 @@ int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_fact
 		return 0;
 	}
 
-	if (!init_buffer_cache(cache_size))
+	if (!init_buffer_cache(cache_size, 1, policy))
 	{
 		printf("Error: failed to initialize the buffer cache\n");
 		return 0;
@@ -212,7 +283,15 @@ int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_fact
 			sh->reset = 1;
 		}
 		
-		max_size = (sh->buffers_end - (u_char*)(sh->entries_end + ENTRIES_ALLOC_MARGIN + 1) - BUFFER_ALIGNMENT) / size_factor;
+		if (policy == BUFFER_CACHE_POLICY_SLAB)
+		{
+			// Note: the size classes are not tight, and the buffers of a class may need to be reclaimed from other classes
+			max_size = (sh->buffers_end - (u_char*)sh->entries_start) / 4 / size_factor;
+		}
+		else
+		{
+			max_size = (sh->buffers_end - (u_char*)(sh->entries_end + ENTRIES_ALLOC_MARGIN + 1) - BUFFER_ALIGNMENT) / size_factor;
+		}
 		size = RAND(0, max_size);
 		sizes_buffer[i] = size;
 		generate_random_buffer(i, store_buffer, size);
@@ -226,11 +305,19 @@ int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_fact
 			printf("Error: store failed\n");
 			return 0;
 		}
+
+		existing[i] = 1;
+		existing_count++;
 		
-		for (j = min_existing_index; j <= i; j++)
+		for (j = 0; j <= i; j++)
 		{
+			if (!existing[j])
+			{
+				continue;
+			}
+
 			((uint32_t*)&key)[0] = j;
-			if (ngx_buffer_cache_fetch(cache, key, &fetch_buffer))
+			if (ngx_buffer_cache_fetch(cache, key, &fetch_buffer, &token))
 			{
 				if (sizes_buffer[j] != fetch_buffer.len)
 				{
@@ -243,15 +330,19 @@ int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_fact
 					printf("Error: invalid buffer content\n");
 					return 0;
 				}
+
+				ngx_buffer_cache_release(cache, key, token);
 			}
 			else
 			{
-				min_existing_index++;
+				// Note: once evicted, an entry is never fetched again
+				existing[j] = 0;
+				existing_count--;
 			}			
 		}
 
 #ifdef VERBOSE
-		printf("validated %d buffers\n", i + 1 - min_existing_index);
+		printf("validated %d buffers\n", existing_count);
 #endif
 
 		ngx_buffer_cache_get_stats(cache, &stats);
@@ -261,9 +352,9 @@ int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_fact
 			return 0;
 		}
 		
-		if (stats.store_ok - stats.evicted != i + 1 - min_existing_index)
+		if (stats.store_ok - stats.evicted != existing_count)
 		{
-			printf("Error: unexpected number of items in the cache, stats=%lu fetched=%d\n", stats.store_ok - stats.evicted, i + 1 - min_existing_index);
+			printf("Error: unexpected number of items in the cache, stats=%lu fetched=%d\n", stats.store_ok - stats.evicted, existing_count);
 			return 0;
 		}
 		
@@ -278,6 +369,8 @@ int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_fact
 	free_buffer_cache();
 
 	free(store_buffer);
+
+	free(existing);
 	
 	free(sizes_buffer);
 	
@@ -286,11 +379,196 @@ int run_test_cycle(time_t seed, size_t cache_size, int iterations, int size_fact
 	return 1;
 }
 
+#if (NGX_HAVE_ATOMIC_OPS)
+// concurrent test
+static size_t
+concurrent_get_size(uint32_t index, size_t max_size)
+{
+	return (index * 2654435761u) % max_size;
+}
+
+static void*
+concurrent_writer(void* arg)
+{
+	concurrent_thread_t* thread = arg;
+	u_char key[BUFFER_CACHE_KEY_SIZE];
+	u_char* store_buffer;
+	uint32_t index;
+	size_t size;
+	int i;
+
+	store_buffer = malloc(thread->max_size);
+	if (store_buffer == NULL)
+	{
+		printf("Error: failed to allocate store buffer\n");
+		concurrent_errors++;
+		return NULL;
+	}
+
+	ngx_memzero(key, sizeof(key));
+
+	for (i = 0; i < CONCURRENT_OPERATIONS && !concurrent_errors; i++)
+	{
+		index = rand_r(&thread->seed) % CONCURRENT_KEY_COUNT;
+		((uint32_t*)&key)[0] = index;
+
+		size = concurrent_get_size(index, thread->max_size);
+		generate_random_buffer(index, store_buffer, size);
+
+		// Note: the store may fail when the entry already exists or when all the entries are locked
+		(void)ngx_buffer_cache_store(thread->cache, key, store_buffer, size);
+	}
+
+	free(store_buffer);
+
+	return NULL;
+}
+
+static void*
+concurrent_reader(void* arg)
+{
+	concurrent_thread_t* thread = arg;
+	u_char key[BUFFER_CACHE_KEY_SIZE];
+	ngx_str_t fetch_buffer;
+	uint32_t token;
+	uint32_t index;
+	int i;
+
+	ngx_memzero(key, sizeof(key));
+
+	for (i = 0; i < CONCURRENT_OPERATIONS && !concurrent_errors; i++)
+	{
+		index = rand_r(&thread->seed) % CONCURRENT_KEY_COUNT;
+		((uint32_t*)&key)[0] = index;
+
+		if (!ngx_buffer_cache_fetch(thread->cache, key, &fetch_buffer, &token))
+		{
+			continue;
+		}
+
+		thread->hits++;
+
+		if (fetch_buffer.len != concurrent_get_size(index, thread->max_size) ||
+			!validate_random_buffer(index, fetch_buffer.data, fetch_buffer.len) ||
+			fetch_buffer.data[fetch_buffer.len] != '\0')
+		{
+			printf("Error: invalid buffer fetched, key=%u size=%zu\n", index, fetch_buffer.len);
+			concurrent_errors++;
+		}
+
+		ngx_buffer_cache_release(thread->cache, key, token);
+	}
+
+	return NULL;
+}
+
+// Note: readers and writers run in parallel on a sharded cache (so that the fetches are lockless), the
+//		time does not advance, so the entries that are held by the readers can never be evicted. 
+//		when all the threads complete, the ref counts of all the entries must be zero
+int run_concurrent_test_cycle(time_t seed, size_t shard_size, size_t max_size, ngx_uint_t policy)
+{
+	concurrent_thread_t threads[CONCURRENT_READER_COUNT + CONCURRENT_WRITER_COUNT];
+	pthread_t thread_ids[CONCURRENT_READER_COUNT + CONCURRENT_WRITER_COUNT];
+	ngx_buffer_cache_entry_t* entry;
+	ngx_buffer_cache_stats_t stats;
+	ngx_buffer_cache_sh_t *sh;
+	ngx_buffer_cache_t *cache;
+	ngx_uint_t hits;
+	int i;
+
+	printf("starting concurrent test - seed %llu shard_size %zu max_size %zu policy %d\n", (unsigned long long)seed, shard_size, max_size, (int)policy);
+
+	if (!init_buffer_cache(shard_size * CONCURRENT_SHARD_COUNT, CONCURRENT_SHARD_COUNT, policy))
+	{
+		printf("Error: failed to initialize the buffer cache\n");
+		return 0;
+	}
+
+	cache = shm_zone.data;
+	concurrent_errors = 0;
+
+	for (i = 0; i < CONCURRENT_READER_COUNT + CONCURRENT_WRITER_COUNT; i++)
+	{
+		threads[i].cache = cache;
+		threads[i].max_size = max_size;
+		threads[i].seed = seed + i;
+		threads[i].hits = 0;
+
+		if (pthread_create(&thread_ids[i], NULL, 
+			i < CONCURRENT_WRITER_COUNT ? concurrent_writer : concurrent_reader, &threads[i]) != 0)
+		{
+			printf("Error: pthread_create failed\n");
+			return 0;
+		}
+	}
+
+	hits = 0;
+	for (i = 0; i < CONCURRENT_READER_COUNT + CONCURRENT_WRITER_COUNT; i++)
+	{
+		pthread_join(thread_ids[i], NULL);
+		hits += threads[i].hits;
+	}
+
+	if (concurrent_errors)
+	{
+		return 0;
+	}
+
+	for (sh = cache->sh; sh < cache->sh + cache->shard_count; sh++)
+	{
+		for (entry = sh->entries_start; entry < sh->entries_end; entry++)
+		{
+			if (entry->ref_count != 0)
+			{
+				printf("Error: unexpected ref count %lu, state=%lu\n", (unsigned long)entry->ref_count, (unsigned long)entry->state);
+				return 0;
+			}
+		}
+	}
+
+	ngx_buffer_cache_get_stats(cache, &stats);
+	if (hits <= 0 || stats.evicted <= 0)
+	{
+		printf("Error: the test did not exercise the cache, hits=%lu evicted=%lu\n", (unsigned long)hits, (unsigned long)stats.evicted);
+		return 0;
+	}
+
+	printf("hits=%lu stored=%lu evicted=%lu\n", (unsigned long)hits, (unsigned long)stats.store_ok, (unsigned long)stats.evicted);
+
+	free_buffer_cache();
+
+	return 1;
+}
+#endif // NGX_HAVE_ATOMIC_OPS
+
 int main()
 {
 	setbuf(stdout, NULL);		// disable stdout buffering (for progress indication)
 	
-	while (run_test_cycle(time(NULL), RAND(2 * 1024 * 1024, 16 * 1024 * 1024), 1000, 1 << RAND(0, 6)));
+	for (;;)
+	{
+		if (!run_test_cycle(time(NULL), RAND(2 * 1024 * 1024, 16 * 1024 * 1024), 1000, 1 << RAND(0, 6), BUFFER_CACHE_POLICY_RING))
+		{
+			break;
+		}
+
+		if (!run_test_cycle(time(NULL), RAND(BUFFER_CACHE_MIN_SLAB_SHARD_SIZE, 32 * 1024 * 1024), 1000, 1 << RAND(0, 6), BUFFER_CACHE_POLICY_SLAB))
+		{
+			break;
+		}
+
+#if (NGX_HAVE_ATOMIC_OPS)
+		if (!run_concurrent_test_cycle(time(NULL), RAND(BUFFER_CACHE_MIN_SHARD_SIZE, 4 * 1024 * 1024), 64 * 1024, BUFFER_CACHE_POLICY_RING))
+		{
+			break;
+		}
+
+		if (!run_concurrent_test_cycle(time(NULL), RAND(BUFFER_CACHE_MIN_SLAB_SHARD_SIZE, 16 * 1024 * 1024), 256 * 1024, BUFFER_CACHE_POLICY_SLAB))
+		{
+			break;
+		}
+#endif // NGX_HAVE_ATOMIC_OPS
+	}
 
 	return 0;
 }
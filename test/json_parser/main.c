@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <ngx_core.h>
 #include <vod/json_parser.h>
+#include <vod/json_binary.h>
 #include <vod/parse_utils.h>
 
 volatile ngx_cycle_t  *ngx_cycle;
@@ -220,6 +221,59 @@ void bad_jsons_test()
 	}
 }
 
+void binary_round_trip_tests()
+{
+	static char* tests[] = {
+		"null",
+		"-12",
+		"\"fsdaf\\\"fsaf\"",
+		"[[1.5,2.25],[3.0],[]]",
+		"{\"Sequences\":[{\"clips\":[{\"type\":\"source\",\"path\":\"/a.mp4\"}]}],\"empty\":{},\"flags\":[true,false]}",
+		NULL
+	};
+	vod_json_value_t result;
+	vod_str_t encoded1;
+	vod_str_t encoded2;
+	vod_str_t truncated;
+	char** cur_test;
+	ngx_int_t rc;
+	u_char error[128];
+	u_char buffer[512];
+
+	for (cur_test = tests; *cur_test; cur_test++)
+	{
+		// Note: the parser lower cases the keys in place, must work on a copy
+		ngx_cpystrn(buffer, (u_char*)*cur_test, sizeof(buffer));
+
+		rc = vod_json_parse(pool, buffer, &result, error, sizeof(error));
+		assert(rc == VOD_JSON_OK);
+
+		rc = vod_json_binary_encode(pool, &result, &encoded1);
+		assert(rc == VOD_JSON_OK);
+		assert(vod_json_binary_detect(&encoded1));
+
+		rc = vod_json_binary_decode(pool, &encoded1, &result, error, sizeof(error));
+		if (rc != VOD_JSON_OK)
+		{
+			printf("Error: %s - decode failed %" PRIdPTR " %s\n", *cur_test, rc, error);
+			continue;
+		}
+
+		// encode the decoded value, should be identical
+		rc = vod_json_binary_encode(pool, &result, &encoded2);
+		assert(rc == VOD_JSON_OK);
+		assert(encoded1.len == encoded2.len && memcmp(encoded1.data, encoded2.data, encoded1.len) == 0);
+
+		// truncated input must be rejected
+		truncated.data = encoded1.data;
+		for (truncated.len = 0; truncated.len < encoded1.len; truncated.len++)
+		{
+			rc = vod_json_binary_decode(pool, &truncated, &result, error, sizeof(error));
+			assert(rc != VOD_JSON_OK);
+		}
+	}
+}
+
 void get_element_guid_tests()
 {
 	static ngx_str_t tests[] = {
@@ -292,6 +346,7 @@ int main()
 	
 	sanity_tests();
 	bad_jsons_test();
+	binary_round_trip_tests();
 	get_element_guid_tests();
 	get_fixed_string_tests();
 	get_binary_string_tests();
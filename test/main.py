@@ -584,6 +584,25 @@ class BasicTestSuite(TestSuite):
 
         assert(clearSegment == decryptedSegment)
 
+    def testEncryptedSegmentCachedSize(self):
+        url = self.getUrl(HLS_PREFIX, HLS_SEGMENT_FILE)
+        if ENCRYPTED_PREFIX not in url:
+            return
+        # the first request saves the size of the segment to the segment cache, the following ones use it
+        fullResponse = urllib2.urlopen(url).read()
+        assertEquals(len(fullResponse) % 16, 0)
+        for i in xrange(3):
+            request = urllib2.Request(url)
+            request.get_method = lambda : 'HEAD'
+            headResponse = urllib2.urlopen(request)
+            assertEquals(int(headResponse.info().getheader('Content-Length')), len(fullResponse))
+            response = urllib2.urlopen(url)
+            contentLength = response.info().getheader('Content-Length')
+            curResponse = response.read()
+            if contentLength != None:
+                assertEquals(int(contentLength), len(fullResponse))
+            assert(curResponse == fullResponse)
+
     def testClipToSanity(self):
         # index
         url = self.getUrl(HLS_PREFIX, '/clipTo/10000' + HLS_PLAYLIST_FILE)
@@ -848,6 +867,28 @@ class FileServeTestSuite(TestSuite):
 
             cleanupStack.resetAndDestroy()
 
+    def testAccurateSegmentDurationsCache(self):
+        # the segment boundaries are saved to the metadata cache in the timescale of the file,
+        # the manifests must be identical to the ones that are built without the metadata cache
+        for curPrefix, curRequest in [(HLS_PREFIX, HLS_PLAYLIST_FILE), (DASH_PREFIX, DASH_MANIFEST_FILE)]:
+            linkPath = createRandomSymLink(TEST_FILES_ROOT + TEST_FLAVOR_FILE)
+            uncachedResponse = urllib2.urlopen(self.getServeUrl(curPrefix + '_accurate_nocache', linkPath) + curRequest).read()
+
+            url = self.getServeUrl(curPrefix + '_accurate', linkPath) + curRequest
+
+            logTracker = LogTracker()
+            missResponse = urllib2.urlopen(url).read()
+            logTracker.assertContains('segment boundaries cache miss')
+
+            logTracker = LogTracker()
+            hitResponse = urllib2.urlopen(url).read()
+            logTracker.assertContains('segment boundaries cache hit')
+
+            assert(missResponse == uncachedResponse)
+            assert(hitResponse == uncachedResponse)
+
+            cleanupStack.resetAndDestroy()
+
 class ModeTestSuite(TestSuite):
     def __init__(self, baseUrl, encryptionPrefix=''):
         super(ModeTestSuite, self).__init__()
@@ -0,0 +1,17 @@
+#!/bin/bash
+
+if [ -z "$NGX_ROOT" ]; then
+	echo "NGX_ROOT not set"
+	exit 1
+fi
+
+if [ -z "$VOD_ROOT" ]; then
+	echo "VOD_ROOT not set"
+	exit 1
+fi
+
+if [ -z "$CC" ]; then
+	CC=cc
+fi
+
+$CC -Wall -O2 -g -otsbench -DNGX_HAVE_LIB_AV_CODEC=0 $VOD_ROOT/vod/hls/mpegts_encoder_filter.c $VOD_ROOT/vod/write_buffer_queue.c $VOD_ROOT/vod/buffer_pool.c $VOD_ROOT/test/mpegts_encoder/main.c $NGX_ROOT/src/core/ngx_palloc.c $NGX_ROOT/src/core/ngx_string.c $NGX_ROOT/src/os/unix/ngx_alloc.c -I $NGX_ROOT/src/core -I $NGX_ROOT/src/event -I $NGX_ROOT/src/event/modules -I $NGX_ROOT/src/os/unix -I $NGX_ROOT/objs -I $VOD_ROOT
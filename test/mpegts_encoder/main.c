@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ngx_core.h>
+#include <vod/hls/mpegts_encoder_filter.h>
+
+#define PCR_PID (0x100)
+#define SEGMENT_COUNT (200)
+#define SEGMENT_SIZE (2 * 1024 * 1024)
+
+volatile ngx_cycle_t  *ngx_cycle;
+ngx_log_t ngx_log;
+
+#if (NGX_HAVE_VARIADIC_MACROS)
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, ...)
+
+#else
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, va_list args)
+
+#endif
+{
+}
+
+typedef struct {
+	size_t total_size;
+	unsigned cc;
+	ngx_flag_t error;
+} write_context_t;
+
+static vod_status_t
+write_callback(void* context, u_char* buffer, uint32_t size)
+{
+	write_context_t* ctx = context;
+	unsigned pid;
+	u_char* end = buffer + size;
+	u_char* p;
+
+	if (size % MPEGTS_PACKET_SIZE != 0)
+	{
+		printf("Error: buffer size %u is not a multiple of the packet size\n", size);
+		ctx->error = 1;
+	}
+
+	// validate the sync bytes and the continuity counters
+	for (p = buffer; p + MPEGTS_PACKET_SIZE <= end; p += MPEGTS_PACKET_SIZE)
+	{
+		pid = ((p[1] & 0x1f) << 8) | p[2];
+		if (p[0] != 0x47 || pid != PCR_PID || (p[3] & 0x0f) != (ctx->cc & 0x0f))
+		{
+			if (!ctx->error)
+			{
+				printf("Error: invalid packet at offset %zu\n", ctx->total_size + (p - buffer));
+			}
+			ctx->error = 1;
+		}
+		ctx->cc++;
+	}
+
+	ctx->total_size += size;
+	return VOD_OK;
+}
+
+static double
+get_time()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ngx_int_t
+run_segment(
+	u_char* frame_data,
+	uint32_t frame_size,
+	ngx_flag_t interleave_frames,
+	write_context_t* write_context)
+{
+	mpegts_encoder_init_streams_state_t stream_state;
+	hls_encryption_params_t encryption_params;
+	mpegts_encoder_state_t encoder_state;
+	media_filter_context_t filter_context;
+	request_context_t request_context;
+	write_buffer_queue_t queue;
+	media_filter_t filter;
+	media_track_t track;
+	output_frame_t frame;
+	ngx_pool_t* pool;
+	uint32_t frame_count;
+	uint32_t i;
+	vod_status_t rc;
+
+	pool = ngx_create_pool(1024 * 1024, &ngx_log);
+	if (pool == NULL)
+	{
+		return NGX_ERROR;
+	}
+
+	ngx_memzero(&request_context, sizeof(request_context));
+	request_context.pool = pool;
+	request_context.log = &ngx_log;
+
+	ngx_memzero(&encryption_params, sizeof(encryption_params));
+	encryption_params.type = HLS_ENC_NONE;
+
+	ngx_memzero(&track, sizeof(track));
+	track.media_info.media_type = MEDIA_TYPE_VIDEO;
+	track.media_info.codec_id = VOD_CODEC_ID_AVC;
+
+	write_buffer_queue_init(&queue, &request_context, write_callback, write_context, 1);
+
+	rc = mpegts_encoder_init_streams(&request_context, &encryption_params, &stream_state, 0);
+	if (rc != VOD_OK)
+	{
+		goto done;
+	}
+
+	rc = mpegts_encoder_init(&filter, &encoder_state, &stream_state, &track, &queue, interleave_frames, 0);
+	if (rc != VOD_OK)
+	{
+		goto done;
+	}
+
+	filter_context.request_context = &request_context;
+	filter_context.context[MEDIA_FILTER_MPEGTS] = &encoder_state;
+
+	ngx_memzero(&frame, sizeof(frame));
+	frame.size = frame_size;
+
+	frame_count = SEGMENT_SIZE / frame_size;
+	for (i = 0; i < frame_count; i++)
+	{
+		frame.pts = frame.dts = (uint64_t)i * 3000;
+		frame.key = (i == 0);
+
+		rc = filter.start_frame(&filter_context, &frame);
+		if (rc != VOD_OK)
+		{
+			goto done;
+		}
+
+		rc = filter.write(&filter_context, frame_data, frame_size);
+		if (rc != VOD_OK)
+		{
+			goto done;
+		}
+
+		rc = filter.flush_frame(&filter_context, i + 1 >= frame_count);
+		if (rc != VOD_OK)
+		{
+			goto done;
+		}
+	}
+
+	rc = write_buffer_queue_flush(&queue);
+
+done:
+
+	ngx_destroy_pool(pool);
+
+	return rc == VOD_OK ? NGX_OK : NGX_ERROR;
+}
+
+static void
+benchmark(u_char* frame_data, uint32_t frame_size, ngx_flag_t interleave_frames)
+{
+	write_context_t write_context;
+	double start;
+	double elapsed;
+	size_t input_size;
+	int i;
+
+	ngx_memzero(&write_context, sizeof(write_context));
+	input_size = 0;
+
+	start = get_time();
+
+	for (i = 0; i < SEGMENT_COUNT; i++)
+	{
+		write_context.cc = 0;
+
+		if (run_segment(frame_data, frame_size, interleave_frames, &write_context) != NGX_OK)
+		{
+			printf("Error: run_segment failed\n");
+			return;
+		}
+
+		input_size += (SEGMENT_SIZE / frame_size) * frame_size;
+	}
+
+	elapsed = get_time() - start;
+
+	printf("frame_size=%6u interleave=%d output=%zu bytes, %.1f MB/s (input %.1f MB/s)%s\n",
+		frame_size,
+		(int)interleave_frames,
+		write_context.total_size,
+		write_context.total_size / elapsed / (1024 * 1024),
+		input_size / elapsed / (1024 * 1024),
+		write_context.error ? " - ERRORS" : "");
+}
+
+int
+main()
+{
+	static const uint32_t frame_sizes[] = { 100, 1000, 20000, 200000 };
+	u_char* frame_data;
+	uint32_t i;
+
+	ngx_pagesize = getpagesize();
+
+	frame_data = malloc(SEGMENT_SIZE);
+	if (frame_data == NULL)
+	{
+		return 1;
+	}
+
+	for (i = 0; i < SEGMENT_SIZE; i++)
+	{
+		frame_data[i] = (u_char)rand();
+	}
+
+	for (i = 0; i < sizeof(frame_sizes) / sizeof(frame_sizes[0]); i++)
+	{
+		benchmark(frame_data, frame_sizes[i], 0);
+		benchmark(frame_data, frame_sizes[i], 1);
+	}
+
+	free(frame_data);
+
+	return 0;
+}
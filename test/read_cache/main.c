@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ngx_core.h>
+#include <vod/input/read_cache.h>
+#include <vod/media_clip.h>
+
+#define BUFFER_SIZE (64 * 1024)
+#define READ_AHEAD (3)
+#define SOURCE_SIZE (BUFFER_SIZE * 16)
+
+volatile ngx_cycle_t  *ngx_cycle;
+ngx_log_t ngx_log;
+
+#if (NGX_HAVE_VARIADIC_MACROS)
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, ...)
+
+#else
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, va_list args)
+
+#endif
+{
+}
+
+#define assert(cond) if (!(cond)) { printf("Error: assertion failed, file=%s line=%d\n", __FILE__, __LINE__); success = FALSE; }
+
+// Note: the buffers are allocated with malloc in the exact size, so that an overflow is caught by the address sanitizer
+
+static u_char
+test_source_byte(uint64_t offset)
+{
+	return (u_char)(offset * 31 + (offset >> 8));
+}
+
+// mirrors the allocation logic of ngx_http_vod_process_media_frames / ngx_http_vod_alloc_read_buffer
+static bool_t
+test_read(read_cache_state_t* state, vod_buf_t* buf, uint32_t* read_size)
+{
+	read_cache_get_read_buffer_t read_buf;
+	size_t alloc_size;
+	uint32_t i;
+
+	read_cache_get_read_buffer(state, &read_buf);
+
+	buf->start = read_buf.buffer;
+	buf->end = read_buf.buffer_end;
+
+	alloc_size = vod_max(BUFFER_SIZE, read_buf.size);
+	if (buf->start == NULL || buf->start + alloc_size > buf->end)
+	{
+		buf->start = malloc(alloc_size);
+		if (buf->start == NULL)
+		{
+			return FALSE;
+		}
+		buf->end = buf->start + alloc_size;
+	}
+
+	buf->pos = buf->start;
+	buf->last = buf->start;
+
+	for (i = 0; i < read_buf.size && read_buf.offset + i < SOURCE_SIZE; i++)
+	{
+		*buf->last++ = test_source_byte(read_buf.offset + i);
+	}
+
+	*read_size = read_buf.size;
+
+	read_cache_read_completed(state, buf);
+	return TRUE;
+}
+
+static bool_t
+test_slot_reused_for_read_ahead()
+{
+	read_cache_request_t request;
+	read_cache_state_t state;
+	request_context_t request_context;
+	media_clip_source_t source;
+	vod_buf_t first_buf;
+	vod_buf_t second_buf;
+	u_char* buffer;
+	uint32_t read_size;
+	uint32_t size;
+	bool_t success = TRUE;
+
+	vod_memzero(&request_context, sizeof(request_context));
+	request_context.pool = ngx_create_pool(1024, &ngx_log);
+	request_context.log = &ngx_log;
+
+	vod_memzero(&source, sizeof(source));
+	source.alignment = 1;
+	source.last_offset = SOURCE_SIZE;
+
+	read_cache_init(&state, &request_context, BUFFER_SIZE);
+	read_cache_set_read_ahead(&state, READ_AHEAD);
+	if (read_cache_allocate_buffer_slots(&state, 2) != VOD_OK)
+	{
+		printf("Error: read_cache_allocate_buffer_slots failed\n");
+		return FALSE;
+	}
+
+	vod_memzero(&request, sizeof(request));
+	request.source = &source;
+	request.cache_slot_id = 0;
+	request.hint.min_offset = ULLONG_MAX;
+
+	// a non sequential read - allocates a buffer of the configured size in slot 0
+	request.cur_offset = 0;
+	request.end_offset = 100;
+	assert(!read_cache_get_from_cache(&state, &request, &buffer, &size));
+
+	if (!test_read(&state, &first_buf, &read_size))
+	{
+		printf("Error: test_read failed (1)\n");
+		return FALSE;
+	}
+
+	assert(read_size == BUFFER_SIZE);
+	assert(first_buf.end - first_buf.start == BUFFER_SIZE);
+
+	// a sequential read into the same slot - extended by the read ahead, does not fit the existing buffer
+	request.cur_offset = BUFFER_SIZE;
+	request.end_offset = BUFFER_SIZE + 100;
+	assert(!read_cache_get_from_cache(&state, &request, &buffer, &size));
+
+	if (!test_read(&state, &second_buf, &read_size))
+	{
+		printf("Error: test_read failed (2)\n");
+		return FALSE;
+	}
+
+	assert(read_size == BUFFER_SIZE * (READ_AHEAD + 1));
+	assert(second_buf.start != first_buf.start);
+	assert(second_buf.end - second_buf.start >= read_size);
+
+	// the read ahead data is served from the cache
+	request.cur_offset = BUFFER_SIZE * (READ_AHEAD + 1);
+	assert(read_cache_get_from_cache(&state, &request, &buffer, &size));
+	assert(size == BUFFER_SIZE);
+	assert(*buffer == test_source_byte(BUFFER_SIZE * (READ_AHEAD + 1)));
+
+	free(first_buf.start);
+	free(second_buf.start);
+	ngx_destroy_pool(request_context.pool);
+
+	return success;
+}
+
+int main()
+{
+	ngx_pagesize = getpagesize();
+
+	if (!test_slot_reused_for_read_ahead())
+	{
+		return 1;
+	}
+
+	printf("all tests passed\n");
+	return 0;
+}
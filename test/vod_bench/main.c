@@ -0,0 +1,1962 @@
+// micro benchmarks for the vod core library
+// usage: vodbench [-i iterations] [-r repeats] [-b filter] [file.mp4 | mapping.json ...]
+// the benchmarks always run on synthetic fixtures (an in memory mp4 + a mapping json), the files passed on
+// the command line are added as real fixtures, files ending with .json are treated as mapping fixtures.
+// the thumbnail benchmarks (built with WITH_LIBAV=1) run only on real media fixtures, since the frames of
+// the synthetic fixture cannot be decoded.
+// each benchmark prints a single json line to stdout, so that the results can be collected and compared over time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <ngx_core.h>
+#include <vod/media_set.h>
+#include <vod/media_set_parser.h>
+#include <vod/json_parser.h>
+#include <vod/json_binary.h>
+#include <vod/segmenter.h>
+#include <vod/filters/filter.h>
+#include <vod/input/frames_source_memory.h>
+#include <vod/mp4/mp4_format.h>
+#include <vod/mp4/mp4_muxer.h>
+#include <vod/mp4/mp4_aes_ctr.h>
+#include <vod/mp4/mp4_write_stream.h>
+#include <vod/hls/hls_muxer.h>
+#include <vod/hls/m3u8_builder.h>
+#include <vod/hls/aes_cbc_encrypt.h>
+#include <vod/dash/dash_packager.h>
+#include <vod/cli/vod_cli_shim.h>
+#if (VOD_HAVE_LIB_AV_CODEC)
+#include <vod/thumb/thumb_grabber.h>
+#endif // VOD_HAVE_LIB_AV_CODEC
+
+// constants
+#define POOL_SIZE (1024 * 1024)
+#define CACHE_BUFFER_SIZE (256 * 1024)
+#define MAX_METADATA_SIZE (128 * 1024 * 1024)
+#define MAX_FRAME_COUNT (16 * 1024 * 1024)
+#define MAX_FRAMES_SIZE (~(size_t)0)
+#define SEGMENT_DURATION (10000)
+#define THUMB_TIMESCALE (1000)
+#define BENCH_THUMB_TIME (5000)
+#define BENCH_THUMB_WIDTH (160)
+
+#define DEFAULT_REPEATS (5)
+#define MAX_REPEATS (32)
+#define MIN_ROUND_DURATION (200000000)		// nsec
+#define MAX_ITERATIONS (1000000)
+
+// synthetic fixture - 10 minutes of 720p25 avc (gop of 2 sec) + 48khz aac
+#define SYNTHETIC_DURATION (600)
+#define SYNTHETIC_VIDEO_TIMESCALE (12800)
+#define SYNTHETIC_VIDEO_FRAME_DURATION (512)
+#define SYNTHETIC_VIDEO_GOP_SIZE (50)
+#define SYNTHETIC_AUDIO_TIMESCALE (48000)
+#define SYNTHETIC_AUDIO_FRAME_DURATION (1024)
+#define SYNTHETIC_CLIP_COUNT (256)
+
+#define BENCH_PARSE_TYPE \
+	(PARSE_FLAG_FRAMES_ALL | \
+	PARSE_FLAG_PARSED_EXTRA_DATA | \
+	PARSE_FLAG_INITIAL_PTS_DELAY | \
+	PARSE_FLAG_CODEC_NAME)
+
+#define BENCH_SUPPORTED_CODECS \
+	(VOD_CODEC_FLAG(AVC) | \
+	VOD_CODEC_FLAG(HEVC) | \
+	VOD_CODEC_FLAG(AAC) | \
+	VOD_CODEC_FLAG(AC3) | \
+	VOD_CODEC_FLAG(EAC3) | \
+	VOD_CODEC_FLAG(MP3))
+
+// macros
+#define bench_atom_start(p, c1, c2, c3, c4)			\
+	{												\
+	atom_stack[atom_depth++] = p;					\
+	write_atom_header(p, 0, c1, c2, c3, c4);		\
+	}
+
+#define bench_atom_end(p)							\
+	{												\
+	u_char* __start = atom_stack[--atom_depth];		\
+	uint32_t __size = p - __start;					\
+	write_be32(__start, __size);					\
+	}
+
+// enums
+enum {
+	BENCH_FIXTURE_MEDIA = 0x01,
+	BENCH_FIXTURE_MAPPING = 0x02,
+	BENCH_FIXTURE_FILE = 0x04,			// a real fixture, read from a file
+};
+
+// typedefs
+typedef struct {
+	uint64_t frames;
+	uint64_t bytes;
+} bench_counters_t;
+
+typedef struct {
+	media_set_t media_set;
+	media_sequence_t sequence;
+	media_clip_source_t source;
+	media_clip_t* clip;
+	uint64_t frame_count;
+	uint64_t frames_size;
+} bench_media_set_t;
+
+typedef struct {
+	int flags;
+	const char* name;
+	request_context_t request_context;		// owns the memory of the fixture
+	vod_str_t data;							// mp4 file / mapping json, null terminated
+	vod_str_t binary;						// mapping fixtures - the binary form of the json
+
+	// media fixtures
+	media_format_read_metadata_result_t metadata;
+	size_t metadata_size;
+	bench_media_set_t full;					// the whole file, used by the manifest benchmarks
+	bench_media_set_t segment;				// the first segment, used by the muxing benchmarks
+	bench_media_set_t thumb;				// the frames around BENCH_THUMB_TIME, used by the thumbnail benchmarks
+	u_char* encrypt_buffer;					// a copy of the frames of the segment
+	uint32_t* encrypt_frame_sizes;
+	uint32_t encrypt_frame_count;
+} bench_fixture_t;
+
+typedef vod_status_t(*bench_run_t)(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters);
+
+typedef struct {
+	const char* name;
+	int fixture_flags;						// the benchmark runs on fixtures that have all these flags
+	bench_run_t run;
+} bench_t;
+
+typedef struct {
+	uint32_t iterations;
+	uint32_t repeats;
+	const char* filter;
+} bench_options_t;
+
+typedef struct {
+	uint32_t track_id;
+	uint32_t media_type;
+	uint32_t timescale;
+	uint32_t frame_duration;
+	uint32_t frame_count;
+	uint32_t gop_size;			// 0 = no stss atom
+	uint32_t* frame_sizes;
+	uint64_t total_size;
+	u_char* stco_entry;
+} bench_synthetic_track_t;
+
+// globals
+static segmenter_conf_t bench_segmenter;
+static m3u8_config_t bench_m3u8_config;
+static hls_mpegts_muxer_conf_t bench_hls_muxer_conf;
+static dash_manifest_config_t bench_mpd_config;
+static uint32_t bench_random_state = 1;
+
+static const u_char bench_key[] = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+
+static const u_char unity_matrix[] = {
+	0x00, 0x01, 0x00, 0x00,	0x00, 0x00, 0x00, 0x00,	0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00,	0x00, 0x01, 0x00, 0x00,	0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00,	0x00, 0x00, 0x00, 0x00,	0x40, 0x00, 0x00, 0x00,
+};
+
+static const u_char avcc_atom[] = {
+	0x01, 0x64, 0x00, 0x1f, 0xff,		// version, profile (high), compatibility, level (3.1), nal length size (4)
+	0xe1, 0x00, 0x1a,					// sps count, sps size
+	0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50, 0x05, 0xbb, 0x01, 0x10, 0x00,
+	0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0x20, 0xf1, 0x83, 0x19, 0x60,
+	0x01, 0x00, 0x06,					// pps count, pps size
+	0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0,
+};
+
+static const u_char esds_atom[] = {
+	0x00, 0x00, 0x00, 0x00,				// version + flags
+	0x03, 0x19,							// es descriptor
+	0x00, 0x02, 0x00,
+	0x04, 0x11,							// decoder config descriptor
+	0x40, 0x15, 0x00, 0x00, 0x00,		// object type (aac), stream type, buffer size
+	0x00, 0x01, 0xf4, 0x00,				// max bitrate
+	0x00, 0x01, 0xf4, 0x00,				// avg bitrate
+	0x05, 0x02, 0x11, 0x90,				// decoder specific info - aac lc, 48khz, stereo
+	0x06, 0x01, 0x02,					// sl config descriptor
+};
+
+// utils
+static uint64_t
+bench_get_time_nsec()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Note: a fixed seed lcg, the synthetic fixtures must be identical on every run
+static uint32_t
+bench_random()
+{
+	bench_random_state = bench_random_state * 1103515245 + 12345;
+	return bench_random_state >> 16;
+}
+
+static u_char*
+bench_random_fill(u_char* p, uint32_t size)
+{
+	u_char* end = p + size;
+
+	while (p < end)
+	{
+		*p++ = bench_random() & 0xff;
+	}
+
+	return p;
+}
+
+static vod_status_t
+bench_write(void* context, u_char* buffer, uint32_t size)
+{
+	bench_counters_t* counters = context;
+
+	counters->bytes += size;
+
+	return VOD_OK;
+}
+
+static int
+bench_compare_samples(const void* p1, const void* p2)
+{
+	uint64_t s1 = *(const uint64_t*)p1;
+	uint64_t s2 = *(const uint64_t*)p2;
+
+	return s1 < s2 ? -1 : (s1 > s2 ? 1 : 0);
+}
+
+// conf
+static vod_status_t
+bench_init_conf(ngx_pool_t* pool)
+{
+	vod_status_t rc;
+
+	// Note: same as the defaults of the module, except for the segment durations mode - accurate,
+	//		in order to exercise the frame lists in the manifest benchmarks
+	bench_segmenter.segment_duration = SEGMENT_DURATION;
+	bench_segmenter.live_window_duration = 30000;
+	bench_segmenter.bootstrap_segments = NULL;
+	bench_segmenter.align_to_key_frames = 0;
+	bench_segmenter.get_segment_count = segmenter_get_segment_count_last_short;
+	bench_segmenter.get_segment_durations = segmenter_get_segment_durations_accurate;
+	bench_segmenter.manifest_duration_policy = MDP_MAX;
+	bench_segmenter.gop_look_ahead = 1000;
+	bench_segmenter.gop_look_behind = 10000;
+
+	rc = segmenter_init_config(&bench_segmenter, pool);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	bench_m3u8_config.output_iframes_playlist = FALSE;
+	bench_m3u8_config.force_unmuxed_segments = FALSE;
+	bench_m3u8_config.container_format = HLS_CONTAINER_MPEGTS;
+	ngx_str_set(&bench_m3u8_config.index_file_name_prefix, "index");
+	ngx_str_set(&bench_m3u8_config.iframes_file_name_prefix, "iframes");
+	ngx_str_set(&bench_m3u8_config.segment_file_name_prefix, "seg");
+	ngx_str_set(&bench_m3u8_config.init_file_name_prefix, "init");
+	ngx_str_set(&bench_m3u8_config.encryption_key_file_name, "encryption");
+	ngx_str_set(&bench_m3u8_config.encryption_key_format, "");
+	ngx_str_set(&bench_m3u8_config.encryption_key_format_versions, "");
+
+	m3u8_builder_init_config(&bench_m3u8_config, bench_segmenter.max_segment_duration, HLS_ENC_NONE);
+
+	bench_hls_muxer_conf.interleave_frames = FALSE;
+	bench_hls_muxer_conf.align_frames = TRUE;
+	bench_hls_muxer_conf.align_pts = FALSE;
+	bench_hls_muxer_conf.id3_data.len = 0;
+	bench_hls_muxer_conf.id3_data.data = NULL;
+
+	ngx_str_set(&bench_mpd_config.profiles, "urn:mpeg:dash:profile:isoff-main:2011");
+	ngx_str_set(&bench_mpd_config.init_file_name_prefix, "init");
+	ngx_str_set(&bench_mpd_config.fragment_file_name_prefix, "fragment");
+	ngx_str_set(&bench_mpd_config.subtitle_file_name_prefix, "sub");
+	bench_mpd_config.manifest_format = FORMAT_SEGMENT_TIMELINE;
+	bench_mpd_config.subtitle_format = SUBTITLE_FORMAT_WEBVTT;
+	bench_mpd_config.duplicate_bitrate_threshold = 4096;
+	bench_mpd_config.write_playready_kid = FALSE;
+	bench_mpd_config.use_base_url_tag = FALSE;
+
+	return VOD_OK;
+}
+
+// synthetic mp4
+static u_char*
+bench_synthetic_write_trak(u_char* p, bench_synthetic_track_t* track, uint32_t movie_duration)
+{
+	u_char* atom_stack[8];
+	uint32_t atom_depth = 0;
+	uint32_t i;
+
+	bench_atom_start(p, 't', 'r', 'a', 'k');
+
+	bench_atom_start(p, 't', 'k', 'h', 'd');
+	write_be32(p, 0x00000003);		// version + flags (enabled, in movie)
+	write_be32(p, 0);				// creation time
+	write_be32(p, 0);				// modification time
+	write_be32(p, track->track_id);
+	write_be32(p, 0);				// reserved
+	write_be32(p, movie_duration);
+	write_be32(p, 0);				// reserved
+	write_be32(p, 0);
+	write_be16(p, 0);				// layer
+	write_be16(p, 0);				// alternate group
+	write_be16(p, track->media_type == MEDIA_TYPE_AUDIO ? 0x0100 : 0);		// volume
+	write_be16(p, 0);				// reserved
+	p = vod_copy(p, unity_matrix, sizeof(unity_matrix));
+	write_be32(p, track->media_type == MEDIA_TYPE_VIDEO ? 1280 << 16 : 0);
+	write_be32(p, track->media_type == MEDIA_TYPE_VIDEO ? 720 << 16 : 0);
+	bench_atom_end(p);
+
+	bench_atom_start(p, 'm', 'd', 'i', 'a');
+
+	bench_atom_start(p, 'm', 'd', 'h', 'd');
+	write_be32(p, 0);				// version + flags
+	write_be32(p, 0);				// creation time
+	write_be32(p, 0);				// modification time
+	write_be32(p, track->timescale);
+	write_be32(p, track->frame_count * track->frame_duration);
+	write_be16(p, 0x55c4);			// language (und)
+	write_be16(p, 0);				// quality
+	bench_atom_end(p);
+
+	bench_atom_start(p, 'h', 'd', 'l', 'r');
+	write_be32(p, 0);				// version + flags
+	write_be32(p, 0);				// component type
+	if (track->media_type == MEDIA_TYPE_VIDEO)
+	{
+		write_atom_name(p, 'v', 'i', 'd', 'e');
+	}
+	else
+	{
+		write_atom_name(p, 's', 'o', 'u', 'n');
+	}
+	vod_memzero(p, 13);				// manufacturer, flags, flags mask, name
+	p += 13;
+	bench_atom_end(p);
+
+	bench_atom_start(p, 'm', 'i', 'n', 'f');
+	bench_atom_start(p, 's', 't', 'b', 'l');
+
+	// stsd
+	bench_atom_start(p, 's', 't', 's', 'd');
+	write_be32(p, 0);				// version + flags
+	write_be32(p, 1);				// entries
+	if (track->media_type == MEDIA_TYPE_VIDEO)
+	{
+		bench_atom_start(p, 'a', 'v', 'c', '1');
+		vod_memzero(p, 6);			// reserved
+		p += 6;
+		write_be16(p, 1);			// data reference index
+		vod_memzero(p, 16);			// version, revision, vendor, temporal / spatial quality
+		p += 16;
+		write_be16(p, 1280);
+		write_be16(p, 720);
+		write_be32(p, 0x00480000);	// horizontal resolution
+		write_be32(p, 0x00480000);	// vertical resolution
+		write_be32(p, 0);			// data size
+		write_be16(p, 1);			// frames per sample
+		vod_memzero(p, 32);			// codec name
+		p += 32;
+		write_be16(p, 0x18);		// bits per coded sample
+		write_be16(p, 0xffff);		// color table id
+
+		bench_atom_start(p, 'a', 'v', 'c', 'C');
+		p = vod_copy(p, avcc_atom, sizeof(avcc_atom));
+		bench_atom_end(p);
+	}
+	else
+	{
+		bench_atom_start(p, 'm', 'p', '4', 'a');
+		vod_memzero(p, 6);			// reserved
+		p += 6;
+		write_be16(p, 1);			// data reference index
+		vod_memzero(p, 8);			// version, revision, vendor
+		p += 8;
+		write_be16(p, 2);			// channels
+		write_be16(p, 16);			// bits per coded sample
+		write_be16(p, 0);			// audio cid
+		write_be16(p, 0);			// packet size
+		write_be32(p, SYNTHETIC_AUDIO_TIMESCALE << 16);
+
+		bench_atom_start(p, 'e', 's', 'd', 's');
+		p = vod_copy(p, esds_atom, sizeof(esds_atom));
+		bench_atom_end(p);
+	}
+	bench_atom_end(p);		// sample entry
+	bench_atom_end(p);		// stsd
+
+	// stts
+	bench_atom_start(p, 's', 't', 't', 's');
+	write_be32(p, 0);
+	write_be32(p, 1);
+	write_be32(p, track->frame_count);
+	write_be32(p, track->frame_duration);
+	bench_atom_end(p);
+
+	// stss
+	if (track->gop_size != 0)
+	{
+		bench_atom_start(p, 's', 't', 's', 's');
+		write_be32(p, 0);
+		write_be32(p, (track->frame_count + track->gop_size - 1) / track->gop_size);
+		for (i = 0; i < track->frame_count; i += track->gop_size)
+		{
+			write_be32(p, i + 1);
+		}
+		bench_atom_end(p);
+	}
+
+	// stsc - all the frames are in a single chunk
+	bench_atom_start(p, 's', 't', 's', 'c');
+	write_be32(p, 0);
+	write_be32(p, 1);
+	write_be32(p, 1);				// first chunk
+	write_be32(p, track->frame_count);
+	write_be32(p, 1);				// sample description
+	bench_atom_end(p);
+
+	// stsz
+	bench_atom_start(p, 's', 't', 's', 'z');
+	write_be32(p, 0);
+	write_be32(p, 0);				// uniform size
+	write_be32(p, track->frame_count);
+	for (i = 0; i < track->frame_count; i++)
+	{
+		write_be32(p, track->frame_sizes[i]);
+	}
+	bench_atom_end(p);
+
+	// stco - the offset is set after the moov size is known
+	bench_atom_start(p, 's', 't', 'c', 'o');
+	write_be32(p, 0);
+	write_be32(p, 1);
+	track->stco_entry = p;
+	write_be32(p, 0);
+	bench_atom_end(p);
+
+	bench_atom_end(p);		// stbl
+	bench_atom_end(p);		// minf
+	bench_atom_end(p);		// mdia
+	bench_atom_end(p);		// trak
+
+	return p;
+}
+
+static vod_status_t
+bench_synthetic_init_track(
+	request_context_t* request_context,
+	bench_synthetic_track_t* track,
+	uint32_t min_frame_size,
+	uint32_t max_frame_size,
+	uint32_t min_key_frame_size)
+{
+	uint32_t i;
+
+	track->frame_sizes = vod_alloc(request_context->pool, sizeof(track->frame_sizes[0]) * track->frame_count);
+	if (track->frame_sizes == NULL)
+	{
+		return VOD_ALLOC_FAILED;
+	}
+
+	track->total_size = 0;
+	for (i = 0; i < track->frame_count; i++)
+	{
+		if (track->gop_size != 0 && i % track->gop_size == 0)
+		{
+			track->frame_sizes[i] = min_key_frame_size + bench_random() % (max_frame_size - min_key_frame_size);
+		}
+		else
+		{
+			track->frame_sizes[i] = min_frame_size + bench_random() % (max_frame_size - min_frame_size) / 8;
+		}
+
+		track->total_size += track->frame_sizes[i];
+	}
+
+	return VOD_OK;
+}
+
+// Note: the synthetic file is a progressive mp4 with the moov before the mdat - the same path as a real file,
+//		the video frames are single nal units, so that they can be muxed to ts
+static vod_status_t
+bench_build_synthetic_mp4(request_context_t* request_context, vod_str_t* result)
+{
+	bench_synthetic_track_t tracks[2];
+	bench_synthetic_track_t* track;
+	u_char* atom_stack[4];
+	uint32_t atom_depth = 0;
+	uint32_t movie_duration = SYNTHETIC_DURATION * 1000;
+	uint64_t mdat_size;
+	uint64_t offset;
+	size_t alloc_size;
+	vod_status_t rc;
+	uint32_t size;
+	uint32_t i;
+	u_char* p;
+
+	vod_memzero(tracks, sizeof(tracks));
+
+	tracks[0].track_id = 1;
+	tracks[0].media_type = MEDIA_TYPE_VIDEO;
+	tracks[0].timescale = SYNTHETIC_VIDEO_TIMESCALE;
+	tracks[0].frame_duration = SYNTHETIC_VIDEO_FRAME_DURATION;
+	tracks[0].frame_count = (uint64_t)SYNTHETIC_DURATION * SYNTHETIC_VIDEO_TIMESCALE / SYNTHETIC_VIDEO_FRAME_DURATION;
+	tracks[0].gop_size = SYNTHETIC_VIDEO_GOP_SIZE;
+
+	rc = bench_synthetic_init_track(request_context, &tracks[0], 64, 24 * 1024, 12 * 1024);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	tracks[1].track_id = 2;
+	tracks[1].media_type = MEDIA_TYPE_AUDIO;
+	tracks[1].timescale = SYNTHETIC_AUDIO_TIMESCALE;
+	tracks[1].frame_duration = SYNTHETIC_AUDIO_FRAME_DURATION;
+	tracks[1].frame_count = (uint64_t)SYNTHETIC_DURATION * SYNTHETIC_AUDIO_TIMESCALE / SYNTHETIC_AUDIO_FRAME_DURATION;
+	tracks[1].gop_size = 0;
+
+	rc = bench_synthetic_init_track(request_context, &tracks[1], 256, 1536, 0);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	mdat_size = tracks[0].total_size + tracks[1].total_size;
+
+	alloc_size = 4096 + mdat_size;
+	for (track = tracks; track < tracks + 2; track++)
+	{
+		alloc_size += sizeof(uint32_t) * track->frame_count * 2;
+	}
+
+	result->data = vod_alloc(request_context->pool, alloc_size + 1);
+	if (result->data == NULL)
+	{
+		return VOD_ALLOC_FAILED;
+	}
+
+	p = result->data;
+
+	// ftyp
+	write_atom_header(p, 32, 'f', 't', 'y', 'p');
+	write_atom_name(p, 'i', 's', 'o', 'm');
+	write_be32(p, 0x200);
+	write_atom_name(p, 'i', 's', 'o', 'm');
+	write_atom_name(p, 'i', 's', 'o', '2');
+	write_atom_name(p, 'a', 'v', 'c', '1');
+	write_atom_name(p, 'm', 'p', '4', '1');
+
+	// moov
+	bench_atom_start(p, 'm', 'o', 'o', 'v');
+
+	bench_atom_start(p, 'm', 'v', 'h', 'd');
+	write_be32(p, 0);				// version + flags
+	write_be32(p, 0);				// creation time
+	write_be32(p, 0);				// modification time
+	write_be32(p, 1000);			// timescale
+	write_be32(p, movie_duration);
+	write_be32(p, 0x00010000);		// rate
+	write_be16(p, 0x0100);			// volume
+	vod_memzero(p, 10);				// reserved
+	p += 10;
+	p = vod_copy(p, unity_matrix, sizeof(unity_matrix));
+	vod_memzero(p, 24);				// pre defined
+	p += 24;
+	write_be32(p, 3);				// next track id
+	bench_atom_end(p);
+
+	for (track = tracks; track < tracks + 2; track++)
+	{
+		p = bench_synthetic_write_trak(p, track, movie_duration);
+	}
+
+	bench_atom_end(p);
+
+	// mdat
+	write_atom_header(p, mdat_size + 8, 'm', 'd', 'a', 't');
+
+	offset = p - result->data;
+	for (track = tracks; track < tracks + 2; track++)
+	{
+		write_be32(track->stco_entry, offset);
+		offset += track->total_size;
+
+		for (i = 0; i < track->frame_count; i++)
+		{
+			size = track->frame_sizes[i];
+
+			if (track->media_type == MEDIA_TYPE_VIDEO)
+			{
+				write_be32(p, size - 4);
+				*p++ = track->gop_size != 0 && i % track->gop_size == 0 ? 0x65 : 0x41;		// idr / non idr slice
+				size -= 5;
+			}
+
+			p = bench_random_fill(p, size);
+		}
+	}
+
+	result->len = p - result->data;
+	*p = '\0';
+
+	return VOD_OK;
+}
+
+// synthetic mapping
+static vod_status_t
+bench_build_synthetic_mapping(request_context_t* request_context, vod_str_t* result)
+{
+	uint32_t sequence;
+	uint32_t i;
+	u_char* p;
+
+	result->data = vod_alloc(request_context->pool, 1024 + SYNTHETIC_CLIP_COUNT * 256);
+	if (result->data == NULL)
+	{
+		return VOD_ALLOC_FAILED;
+	}
+
+	p = vod_copy(result->data, "{\"discontinuity\":false,\"durations\":[", sizeof("{\"discontinuity\":false,\"durations\":[") - 1);
+	for (i = 0; i < SYNTHETIC_CLIP_COUNT; i++)
+	{
+		p = vod_sprintf(p, "%s%uD", i > 0 ? "," : "", 10000 + (i % 16) * 1000);
+	}
+
+	p = vod_copy(p, "],\"sequences\":[", sizeof("],\"sequences\":[") - 1);
+	for (sequence = 0; sequence < 2; sequence++)
+	{
+		p = vod_sprintf(p, "%s{\"language\":\"%s\",\"clips\":[",
+			sequence > 0 ? "," : "",
+			sequence > 0 ? "fra" : "eng");
+
+		for (i = 0; i < SYNTHETIC_CLIP_COUNT; i++)
+		{
+			p = vod_sprintf(p, "%s{\"type\":\"source\",\"path\":\"/synthetic/clip%04uD_%uD.mp4\"}",
+				i > 0 ? "," : "", i, sequence);
+		}
+
+		*p++ = ']';
+		*p++ = '}';
+	}
+
+	*p++ = ']';
+	*p++ = '}';
+
+	result->len = p - result->data;
+	*p = '\0';
+
+	return VOD_OK;
+}
+
+// media parsing
+static void
+bench_init_media_set(bench_fixture_t* fixture, bench_media_set_t* set)
+{
+	media_clip_source_t* source = &set->source;
+	media_sequence_t* sequence = &set->sequence;
+	media_set_t* media_set = &set->media_set;
+
+	vod_memzero(set, sizeof(*set));
+
+	source->base.type = MEDIA_CLIP_SOURCE;
+	source->base.id = 1;
+	source->clip_to = ULLONG_MAX;
+	vod_memset(source->tracks_mask, 0xff, sizeof(source->tracks_mask));
+	source->uri.data = (u_char*)fixture->name;
+	source->uri.len = vod_strlen(fixture->name);
+	source->stripped_uri = source->uri;
+	source->mapped_uri = source->uri;
+	source->sequence = sequence;
+
+	set->clip = &source->base;
+
+	sequence->clips = &set->clip;
+	sequence->stripped_uri = source->uri;
+	sequence->mapped_uri = source->uri;
+	sequence->tags.is_default = -1;
+
+	media_set->segmenter_conf = &bench_segmenter;
+	media_set->type = MEDIA_SET_VOD;
+	media_set->sequences = sequence;
+	media_set->sequences_end = sequence + 1;
+	media_set->sequence_count = 1;
+	media_set->sources_head = source;
+	media_set->timing.total_count = 1;
+	media_set->clip_count = 1;
+	media_set->presentation_end = TRUE;
+	media_set->uri = source->uri;
+}
+
+// Note: parses the first track of each media type, as in hls index / segment requests
+static vod_status_t
+bench_parse_frames(
+	request_context_t* request_context,
+	bench_fixture_t* fixture,
+	int parse_type,
+	uint64_t range_end,
+	media_clip_source_t* source,
+	media_track_array_t* result)
+{
+	media_format_read_request_t read_req;
+	media_base_metadata_t* base_metadata;
+	media_parse_params_t parse_params;
+	read_cache_state_t read_cache_state;
+	media_range_t range;
+	track_mask_t tracks_mask[MEDIA_TYPE_COUNT];
+	vod_str_t frame_data;
+	vod_status_t rc;
+	uint32_t media_type;
+
+	for (media_type = 0; media_type < MEDIA_TYPE_COUNT; media_type++)
+	{
+		vod_track_mask_reset_all_bits(tracks_mask[media_type]);
+		vod_set_bit(tracks_mask[media_type], 0);
+	}
+
+	vod_memzero(&parse_params, sizeof(parse_params));
+	parse_params.required_tracks_mask = tracks_mask;
+	parse_params.clip_from = 0;
+	parse_params.clip_to = UINT_MAX;
+	parse_params.max_frame_count = MAX_FRAME_COUNT;
+	parse_params.max_frames_size = MAX_FRAMES_SIZE;
+	parse_params.codecs_mask = BENCH_SUPPORTED_CODECS;
+	parse_params.source = source;
+	parse_params.parse_type = parse_type | bench_segmenter.parse_type;
+
+	range.timescale = 1000;
+	range.original_clip_time = 0;
+	range.start = 0;
+	range.end = range_end;
+	parse_params.range = &range;
+
+	rc = mp4_format.parse_metadata(
+		request_context,
+		&parse_params,
+		fixture->metadata.parts,
+		fixture->metadata.part_count,
+		&base_metadata);
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_parse_frames: parse_metadata failed %i", rc);
+		return rc;
+	}
+
+	read_cache_init(&read_cache_state, request_context, CACHE_BUFFER_SIZE);
+
+	rc = mp4_format.read_frames(
+		request_context,
+		base_metadata,
+		&parse_params,
+		&bench_segmenter,
+		&read_cache_state,
+		NULL,
+		&read_req,
+		result);
+
+	while (rc == VOD_AGAIN)
+	{
+		// Note: the whole file is in memory, the reads are served from the fixture buffer
+		if (read_req.read_offset >= fixture->data.len)
+		{
+			vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+				"bench_parse_frames: read offset %uL exceeds the file size %uz",
+				read_req.read_offset, fixture->data.len);
+			return VOD_BAD_DATA;
+		}
+
+		frame_data.data = fixture->data.data + read_req.read_offset;
+		frame_data.len = fixture->data.len - read_req.read_offset;
+
+		rc = mp4_format.read_frames(
+			request_context,
+			base_metadata,
+			NULL,
+			&bench_segmenter,
+			&read_cache_state,
+			&frame_data,
+			&read_req,
+			result);
+	}
+
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_parse_frames: read_frames failed %i", rc);
+		return rc;
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_load_media_set(
+	bench_fixture_t* fixture,
+	bench_media_set_t* set,
+	int parse_type,
+	uint32_t timescale,
+	uint64_t range_end)
+{
+	request_context_t* request_context = &fixture->request_context;
+	frame_list_part_t* part;
+	media_track_t* track;
+	input_frame_t* cur_frame;
+	media_set_t* media_set = &set->media_set;
+	vod_status_t rc;
+
+	bench_init_media_set(fixture, set);
+
+	rc = bench_parse_frames(request_context, fixture, parse_type, range_end, &set->source, &set->source.track_array);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	// Note: the frames are served from the in memory copy of the file, so that the muxing benchmarks
+	//		do not include any io, the offsets are replaced with pointers, as expected by frames_source_memory
+	for (track = set->source.track_array.first_track; track < set->source.track_array.last_track; track++)
+	{
+		track->file_info.source = &set->source;
+		track->file_info.uri = set->source.uri;
+
+		for (part = &track->frames; part != NULL; part = part->next)
+		{
+			for (cur_frame = part->first_frame; cur_frame < part->last_frame; cur_frame++)
+			{
+				if (cur_frame->offset + cur_frame->size > fixture->data.len)
+				{
+					vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+						"bench_load_media_set: frame offset %uL exceeds the file size %uz",
+						cur_frame->offset, fixture->data.len);
+					return VOD_BAD_DATA;
+				}
+
+				cur_frame->offset += (uintptr_t)fixture->data.data;
+			}
+
+			rc = frames_source_memory_init(request_context, &part->frames_source_context);
+			if (rc != VOD_OK)
+			{
+				return rc;
+			}
+
+			part->frames_source = &frames_source_memory;
+		}
+	}
+
+	rc = filter_init_filtered_clips(request_context, media_set, TRUE);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	if (media_set->total_track_count == 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_load_media_set: no supported tracks in \"%s\"", fixture->name);
+		return VOD_BAD_DATA;
+	}
+
+	for (track = media_set->filtered_tracks; track < media_set->filtered_tracks_end; track++)
+	{
+		rc = media_format_update_track_timescale(request_context, track, timescale, 0);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+
+		set->frame_count += track->frame_count;
+		set->frames_size += track->total_frames_size;
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_init_encrypt_buffer(bench_fixture_t* fixture)
+{
+	request_context_t* request_context = &fixture->request_context;
+	frame_list_part_t* part;
+	media_track_t* track;
+	input_frame_t* cur_frame;
+	media_set_t* media_set = &fixture->segment.media_set;
+	u_char* p;
+
+	fixture->encrypt_buffer = vod_alloc(request_context->pool, fixture->segment.frames_size + 1);
+	fixture->encrypt_frame_sizes = vod_alloc(request_context->pool,
+		sizeof(fixture->encrypt_frame_sizes[0]) * (fixture->segment.frame_count + 1));
+	if (fixture->encrypt_buffer == NULL || fixture->encrypt_frame_sizes == NULL)
+	{
+		return VOD_ALLOC_FAILED;
+	}
+
+	p = fixture->encrypt_buffer;
+	fixture->encrypt_frame_count = 0;
+
+	for (track = media_set->filtered_tracks; track < media_set->filtered_tracks_end; track++)
+	{
+		for (part = &track->frames; part != NULL; part = part->next)
+		{
+			for (cur_frame = part->first_frame; cur_frame < part->last_frame; cur_frame++)
+			{
+				p = vod_copy(p, (u_char*)(uintptr_t)cur_frame->offset, cur_frame->size);
+				fixture->encrypt_frame_sizes[fixture->encrypt_frame_count++] = cur_frame->size;
+			}
+		}
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_read_metadata(bench_fixture_t* fixture)
+{
+	request_context_t* request_context = &fixture->request_context;
+	vod_status_t rc;
+	vod_str_t buffer;
+	uint64_t offset;
+	void* reader_context;
+	size_t i;
+
+	buffer = fixture->data;
+
+	rc = mp4_format.init_metadata_reader(request_context, &buffer, MAX_METADATA_SIZE, &reader_context);
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_read_metadata: init_metadata_reader failed %i, \"%s\" is not an mp4 file?", rc, fixture->name);
+		return rc;
+	}
+
+	offset = 0;
+
+	for (;;)
+	{
+		rc = mp4_format.read_metadata(reader_context, offset, &buffer, &fixture->metadata);
+		if (rc != VOD_AGAIN)
+		{
+			break;
+		}
+
+		offset = fixture->metadata.read_req.read_offset;
+		if (offset >= fixture->data.len)
+		{
+			vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+				"bench_read_metadata: read offset %uL exceeds the file size %uz", offset, fixture->data.len);
+			return VOD_BAD_DATA;
+		}
+
+		buffer.data = fixture->data.data + offset;
+		buffer.len = fixture->data.len - offset;
+	}
+
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_read_metadata: read_metadata failed %i", rc);
+		return rc;
+	}
+
+	fixture->metadata_size = 0;
+	for (i = 0; i < fixture->metadata.part_count; i++)
+	{
+		fixture->metadata_size += fixture->metadata.parts[i].len;
+	}
+
+	return VOD_OK;
+}
+
+// fixtures
+static vod_status_t
+bench_read_file(bench_fixture_t* fixture, const char* path)
+{
+	struct stat st;
+	vod_status_t rc;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+	{
+		vod_log_error(VOD_LOG_ERR, fixture->request_context.log, ngx_errno,
+			"bench_read_file: open \"%s\" failed", path);
+		return VOD_NOT_FOUND;
+	}
+
+	if (fstat(fd, &st) == -1)
+	{
+		vod_log_error(VOD_LOG_ERR, fixture->request_context.log, ngx_errno,
+			"bench_read_file: fstat \"%s\" failed", path);
+		close(fd);
+		return VOD_UNEXPECTED;
+	}
+
+	rc = vod_cli_read_file(&fixture->request_context, fd, 0, st.st_size, &fixture->data);
+
+	close(fd);
+
+	return rc;
+}
+
+static vod_status_t
+bench_init_fixture(bench_fixture_t* fixture, const char* path)
+{
+	const char* ext;
+	vod_status_t rc;
+
+	rc = vod_cli_init_request_context(&fixture->request_context, POOL_SIZE);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	ext = strrchr(path, '.');
+	if (ext != NULL && strcmp(ext, ".json") == 0)
+	{
+		fixture->flags = BENCH_FIXTURE_MAPPING | BENCH_FIXTURE_FILE;
+	}
+	else
+	{
+		fixture->flags = BENCH_FIXTURE_MEDIA | BENCH_FIXTURE_FILE;
+	}
+
+	fixture->name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+
+	rc = bench_read_file(fixture, path);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_init_media_fixture(bench_fixture_t* fixture)
+{
+	vod_status_t rc;
+
+	rc = bench_read_metadata(fixture);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	rc = bench_load_media_set(fixture, &fixture->full, BENCH_PARSE_TYPE, HLS_TIMESCALE, ULLONG_MAX);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	rc = bench_load_media_set(fixture, &fixture->segment, BENCH_PARSE_TYPE, HLS_TIMESCALE, SEGMENT_DURATION);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+#if (VOD_HAVE_LIB_AV_CODEC)
+	if ((fixture->flags & BENCH_FIXTURE_FILE) != 0)
+	{
+		// Note: the same parse flags / timescale as a thumb request of the module
+		rc = bench_load_media_set(fixture, &fixture->thumb, PARSE_FLAG_FRAMES_ALL | PARSE_FLAG_EXTRA_DATA,
+			THUMB_TIMESCALE, BENCH_THUMB_TIME + SEGMENT_DURATION);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+	}
+#endif // VOD_HAVE_LIB_AV_CODEC
+
+	return bench_init_encrypt_buffer(fixture);
+}
+
+static vod_status_t
+bench_init_mapping_fixture(bench_fixture_t* fixture)
+{
+	vod_json_value_t json;
+	vod_status_t rc;
+	u_char error[128];
+
+	rc = vod_json_parse(fixture->request_context.pool, fixture->data.data, &json, error, sizeof(error));
+	if (rc != VOD_JSON_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, fixture->request_context.log, 0,
+			"bench_init_mapping_fixture: failed to parse json %i %s", rc, error);
+		return VOD_BAD_DATA;
+	}
+
+	rc = vod_json_binary_encode(fixture->request_context.pool, &json, &fixture->binary);
+	if (rc != VOD_JSON_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, fixture->request_context.log, 0,
+			"bench_init_mapping_fixture: vod_json_binary_encode failed %i", rc);
+		return VOD_UNEXPECTED;
+	}
+
+	return VOD_OK;
+}
+
+// benchmarks
+static vod_status_t
+bench_mp4_parse_frames(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	media_track_array_t track_array;
+	media_track_t* track;
+	vod_status_t rc;
+
+	rc = bench_parse_frames(request_context, fixture, BENCH_PARSE_TYPE, ULLONG_MAX, &fixture->full.source, &track_array);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	for (track = track_array.first_track; track < track_array.last_track; track++)
+	{
+		counters->frames += track->frame_count;
+	}
+
+	counters->bytes = fixture->metadata_size;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_segment_durations_accurate(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	segment_durations_t segment_durations;
+
+	counters->frames = fixture->full.frame_count;
+
+	return segmenter_get_segment_durations_accurate(
+		request_context,
+		&bench_segmenter,
+		&fixture->full.media_set,
+		NULL,
+		MEDIA_TYPE_NONE,
+		&segment_durations);
+}
+
+static vod_status_t
+bench_build_index_playlist(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	hls_encryption_params_t encryption_params;
+	vod_str_t base_url = vod_null_string;
+	vod_str_t response;
+	vod_status_t rc;
+
+	encryption_params.type = HLS_ENC_NONE;
+
+	rc = m3u8_builder_build_index_playlist(
+		request_context,
+		&bench_m3u8_config,
+		&base_url,
+		&base_url,
+		&encryption_params,
+		HLS_CONTAINER_MPEGTS,
+		&fixture->full.media_set,
+		&response);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	counters->frames = fixture->full.frame_count;
+	counters->bytes = response.len;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_build_mpd(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	dash_manifest_extensions_t extensions;
+	vod_str_t base_url = vod_null_string;
+	vod_str_t response;
+	vod_status_t rc;
+
+	vod_memzero(&extensions, sizeof(extensions));
+
+	rc = dash_packager_build_mpd(
+		request_context,
+		&bench_mpd_config,
+		&base_url,
+		&fixture->full.media_set,
+		&extensions,
+		&response);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	counters->frames = fixture->full.frame_count;
+	counters->bytes = response.len;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_hls_muxer_process(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	hls_encryption_params_t encryption_params;
+	hls_muxer_state_t* state;
+	vod_str_t header;
+	vod_status_t rc;
+	size_t response_size;
+
+	encryption_params.type = HLS_ENC_NONE;
+
+	rc = hls_muxer_init_segment(
+		request_context,
+		&bench_hls_muxer_conf,
+		&encryption_params,
+		0,
+		&fixture->segment.media_set,
+		bench_write,
+		counters,
+		FALSE,
+		&response_size,
+		&header,
+		&state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	counters->bytes += header.len;
+
+	// Note: the frames are in memory, the muxer is not expected to return VOD_AGAIN
+	rc = hls_muxer_process(state);
+	if (rc != VOD_OK)
+	{
+		return rc == VOD_AGAIN ? VOD_UNEXPECTED : rc;
+	}
+
+	counters->frames = fixture->segment.frame_count;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_mp4_muxer_process_frames(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	mp4_muxer_state_t* state;
+	segment_writer_t writer;
+	vod_str_t header;
+	vod_status_t rc;
+	size_t total_size;
+
+	writer.write_tail = bench_write;
+	writer.write_head = bench_write;
+	writer.context = counters;
+
+	rc = mp4_muxer_init_fragment(
+		request_context,
+		0,
+		&fixture->segment.media_set,
+		&writer,
+		FALSE,
+		FALSE,
+		FALSE,
+		&header,
+		&total_size,
+		&state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	counters->bytes += header.len;
+
+	rc = mp4_muxer_process_frames(state);
+	if (rc != VOD_OK)
+	{
+		return rc == VOD_AGAIN ? VOD_UNEXPECTED : rc;
+	}
+
+	counters->frames = fixture->segment.frame_count;
+
+	return VOD_OK;
+}
+
+// Note: the encryption benchmarks encrypt the frames of the segment in place, the content of the buffer
+//		does not affect the speed of aes, so it is not restored between iterations
+static vod_status_t
+bench_mp4_aes_ctr_process(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	mp4_aes_ctr_state_t state;
+	vod_status_t rc;
+	uint32_t i;
+	u_char iv[MP4_AES_CTR_IV_SIZE];
+	u_char* p;
+
+	rc = mp4_aes_ctr_init(&state, request_context, (u_char*)bench_key);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	vod_memzero(iv, sizeof(iv));
+	p = fixture->encrypt_buffer;
+
+	for (i = 0; i < fixture->encrypt_frame_count; i++)
+	{
+		rc = mp4_aes_ctr_set_iv(&state, iv);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+
+		mp4_aes_ctr_increment_be64(iv);
+
+		rc = mp4_aes_ctr_process(&state, p, p, fixture->encrypt_frame_sizes[i]);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+
+		p += fixture->encrypt_frame_sizes[i];
+	}
+
+	counters->frames = fixture->encrypt_frame_count;
+	counters->bytes = p - fixture->encrypt_buffer;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_aes_cbc_encrypt_write(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	aes_cbc_encrypt_context_t* state;
+	bench_counters_t output;
+	vod_status_t rc;
+	uint32_t i;
+	u_char iv[AES_BLOCK_SIZE];
+	u_char* p;
+
+	vod_memzero(iv, sizeof(iv));
+	vod_memzero(&output, sizeof(output));
+
+	rc = aes_cbc_encrypt_init(&state, request_context, bench_write, &output, NULL, TRUE, bench_key, iv);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	p = fixture->encrypt_buffer;
+
+	for (i = 0; i < fixture->encrypt_frame_count; i++)
+	{
+		rc = aes_cbc_encrypt_write(state, p, fixture->encrypt_frame_sizes[i]);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+
+		p += fixture->encrypt_frame_sizes[i];
+	}
+
+	rc = aes_cbc_encrypt_write(state, NULL, 0);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	counters->frames = fixture->encrypt_frame_count;
+	counters->bytes = p - fixture->encrypt_buffer;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_vod_json_parse(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	vod_json_value_t json;
+	vod_status_t rc;
+	u_char error[128];
+
+	rc = vod_json_parse(request_context->pool, fixture->data.data, &json, error, sizeof(error));
+	if (rc != VOD_JSON_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_vod_json_parse: failed to parse json %i %s", rc, error);
+		return VOD_BAD_DATA;
+	}
+
+	counters->bytes = fixture->data.len;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_vod_json_binary_decode(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	vod_json_value_t json;
+	vod_status_t rc;
+	u_char error[128];
+
+	rc = vod_json_binary_decode(request_context->pool, &fixture->binary, &json, error, sizeof(error));
+	if (rc != VOD_JSON_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_vod_json_binary_decode: failed to decode %i %s", rc, error);
+		return VOD_BAD_DATA;
+	}
+
+	counters->bytes = fixture->binary.len;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_media_set_parse_value(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	vod_json_value_t* json)
+{
+	media_clip_source_t source;
+	request_params_t request_params;
+	media_set_t media_set;
+	uint32_t media_type;
+
+	// Note: same as a manifest request of a mapped media set
+	vod_memzero(&request_params, sizeof(request_params));
+	request_params.segment_index = INVALID_SEGMENT_INDEX;
+	request_params.segment_time = INVALID_SEGMENT_TIME;
+	request_params.clip_index = INVALID_CLIP_INDEX;
+	request_params.sequences_mask = 0xffffffff;
+	for (media_type = 0; media_type < MEDIA_TYPE_COUNT; media_type++)
+	{
+		vod_track_mask_set_all_bits(request_params.tracks_mask[media_type]);
+	}
+
+	vod_memzero(&source, sizeof(source));
+	source.base.type = MEDIA_CLIP_SOURCE;
+	source.clip_to = ULLONG_MAX;
+	source.uri.data = (u_char*)fixture->name;
+	source.uri.len = vod_strlen(fixture->name);
+
+	return media_set_parse_json_value(
+		request_context,
+		json,
+		NULL,
+		&request_params,
+		&bench_segmenter,
+		&source,
+		0,
+		&media_set);
+}
+
+static vod_status_t
+bench_media_set_parse_json(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	vod_json_value_t json;
+	vod_status_t rc;
+	u_char error[128];
+
+	rc = vod_json_parse(request_context->pool, fixture->data.data, &json, error, sizeof(error));
+	if (rc != VOD_JSON_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_media_set_parse_json: failed to parse json %i %s", rc, error);
+		return VOD_BAD_DATA;
+	}
+
+	rc = bench_media_set_parse_value(fixture, request_context, &json);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	counters->bytes = fixture->data.len;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_media_set_parse_binary(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	vod_json_value_t json;
+	vod_status_t rc;
+	u_char error[128];
+
+	rc = vod_json_binary_decode(request_context->pool, &fixture->binary, &json, error, sizeof(error));
+	if (rc != VOD_JSON_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"bench_media_set_parse_binary: failed to decode %i %s", rc, error);
+		return VOD_BAD_DATA;
+	}
+
+	rc = bench_media_set_parse_value(fixture, request_context, &json);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	counters->bytes = fixture->binary.len;
+
+	return VOD_OK;
+}
+
+#if (VOD_HAVE_LIB_AV_CODEC)
+// thumbnails
+static vod_status_t
+bench_thumb_grabber(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters,
+	thumb_grabber_mode_t mode)
+{
+	request_params_t request_params;
+	frame_list_part_t* src_part;
+	frame_list_part_t* dst_part;
+	media_track_t* track;
+	vod_status_t rc;
+	void* state;
+
+	// Note: thumb_grabber_init_state truncates the frame list of the track, the track and its frame
+	//		list parts are copied so that every operation starts from the same state
+	track = vod_alloc(request_context->pool, sizeof(*track));
+	if (track == NULL)
+	{
+		return VOD_ALLOC_FAILED;
+	}
+
+	*track = *fixture->thumb.media_set.filtered_tracks;
+
+	for (dst_part = &track->frames; dst_part->next != NULL; dst_part = dst_part->next)
+	{
+		src_part = dst_part->next;
+
+		dst_part->next = vod_alloc(request_context->pool, sizeof(*dst_part->next));
+		if (dst_part->next == NULL)
+		{
+			return VOD_ALLOC_FAILED;
+		}
+
+		*dst_part->next = *src_part;
+	}
+
+	vod_memzero(&request_params, sizeof(request_params));
+	request_params.segment_time = BENCH_THUMB_TIME;
+	request_params.width = BENCH_THUMB_WIDTH;
+
+	rc = thumb_grabber_init_state(
+		request_context,
+		track,
+		&request_params,
+		mode,
+		FALSE,
+		bench_write,
+		counters,
+		&state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	// Note: the frames are in memory, the grabber is not expected to return VOD_AGAIN
+	rc = thumb_grabber_process(state);
+	if (rc != VOD_OK)
+	{
+		return rc == VOD_AGAIN ? VOD_UNEXPECTED : rc;
+	}
+
+	counters->frames = 1;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+bench_thumb_grabber_accurate(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	return bench_thumb_grabber(fixture, request_context, counters, THUMB_GRABBER_MODE_ACCURATE);
+}
+
+static vod_status_t
+bench_thumb_grabber_key_frame(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	return bench_thumb_grabber(fixture, request_context, counters, THUMB_GRABBER_MODE_KEY_FRAME);
+}
+
+static vod_status_t
+bench_thumb_grabber_fast(
+	bench_fixture_t* fixture,
+	request_context_t* request_context,
+	bench_counters_t* counters)
+{
+	return bench_thumb_grabber(fixture, request_context, counters, THUMB_GRABBER_MODE_FAST);
+}
+#endif // VOD_HAVE_LIB_AV_CODEC
+
+static const bench_t benches[] = {
+	{ "mp4_parser_parse_frames", BENCH_FIXTURE_MEDIA, bench_mp4_parse_frames },
+	{ "segmenter_get_segment_durations_accurate", BENCH_FIXTURE_MEDIA, bench_segment_durations_accurate },
+	{ "m3u8_builder_build_index_playlist", BENCH_FIXTURE_MEDIA, bench_build_index_playlist },
+	{ "dash_packager_build_mpd", BENCH_FIXTURE_MEDIA, bench_build_mpd },
+	{ "hls_muxer_process", BENCH_FIXTURE_MEDIA, bench_hls_muxer_process },
+	{ "mp4_muxer_process_frames", BENCH_FIXTURE_MEDIA, bench_mp4_muxer_process_frames },
+	{ "mp4_aes_ctr_process", BENCH_FIXTURE_MEDIA, bench_mp4_aes_ctr_process },
+	{ "aes_cbc_encrypt_write", BENCH_FIXTURE_MEDIA, bench_aes_cbc_encrypt_write },
+	{ "vod_json_parse", BENCH_FIXTURE_MAPPING, bench_vod_json_parse },
+	{ "vod_json_binary_decode", BENCH_FIXTURE_MAPPING, bench_vod_json_binary_decode },
+	{ "media_set_parse_json", BENCH_FIXTURE_MAPPING, bench_media_set_parse_json },
+	{ "media_set_parse_binary", BENCH_FIXTURE_MAPPING, bench_media_set_parse_binary },
+#if (VOD_HAVE_LIB_AV_CODEC)
+	{ "thumb_grabber_accurate", BENCH_FIXTURE_MEDIA | BENCH_FIXTURE_FILE, bench_thumb_grabber_accurate },
+	{ "thumb_grabber_key_frame", BENCH_FIXTURE_MEDIA | BENCH_FIXTURE_FILE, bench_thumb_grabber_key_frame },
+	{ "thumb_grabber_fast", BENCH_FIXTURE_MEDIA | BENCH_FIXTURE_FILE, bench_thumb_grabber_fast },
+#endif // VOD_HAVE_LIB_AV_CODEC
+	{ NULL },
+};
+
+// runner
+// Note: each operation uses a new pool, the same as a request of the module, the creation / destruction
+//		of the pool is included in the measurement
+static vod_status_t
+bench_run_op(const bench_t* bench, bench_fixture_t* fixture, bench_counters_t* counters)
+{
+	request_context_t request_context;
+	vod_status_t rc;
+
+	rc = vod_cli_init_request_context(&request_context, POOL_SIZE);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	vod_memzero(counters, sizeof(*counters));
+
+	rc = bench->run(fixture, &request_context, counters);
+
+	vod_cli_free_request_context(&request_context);
+
+	return rc;
+}
+
+static void
+bench_execute(const bench_t* bench, bench_fixture_t* fixture, bench_options_t* options)
+{
+	bench_counters_t counters;
+	vod_status_t rc;
+	uint64_t samples[MAX_REPEATS];
+	uint64_t median;
+	uint64_t start;
+	uint64_t elapsed;
+	uint32_t iterations;
+	uint32_t i;
+	uint32_t j;
+
+	// warm up + calibration
+	start = bench_get_time_nsec();
+
+	rc = bench_run_op(bench, fixture, &counters);
+	if (rc != VOD_OK)
+	{
+		fprintf(stderr, "%s: failed on \"%s\" %d\n", bench->name, fixture->name, (int)rc);
+		return;
+	}
+
+	elapsed = bench_get_time_nsec() - start;
+
+	iterations = options->iterations;
+	if (iterations == 0)
+	{
+		iterations = vod_min(MIN_ROUND_DURATION / (elapsed + 1) + 1, MAX_ITERATIONS);
+	}
+
+	for (i = 0; i < options->repeats; i++)
+	{
+		start = bench_get_time_nsec();
+
+		for (j = 0; j < iterations; j++)
+		{
+			rc = bench_run_op(bench, fixture, &counters);
+			if (rc != VOD_OK)
+			{
+				fprintf(stderr, "%s: failed on \"%s\" %d\n", bench->name, fixture->name, (int)rc);
+				return;
+			}
+		}
+
+		samples[i] = (bench_get_time_nsec() - start) / iterations;
+	}
+
+	// Note: the median of the rounds is reported, it is less sensitive to noise than the average
+	qsort(samples, options->repeats, sizeof(samples[0]), bench_compare_samples);
+	median = samples[options->repeats / 2];
+
+	printf("{\"bench\":\"%s\",\"fixture\":\"%s\",\"iterations\":%u,\"repeats\":%u,\"ns_per_op\":%llu,\"ns_per_op_min\":%llu",
+		bench->name,
+		fixture->name,
+		iterations,
+		options->repeats,
+		(unsigned long long)median,
+		(unsigned long long)samples[0]);
+
+	if (counters.frames > 0)
+	{
+		printf(",\"frames\":%llu,\"ns_per_frame\":%.2f",
+			(unsigned long long)counters.frames,
+			(double)median / counters.frames);
+	}
+
+	if (counters.bytes > 0)
+	{
+		printf(",\"bytes\":%llu,\"bytes_per_sec\":%llu",
+			(unsigned long long)counters.bytes,
+			(unsigned long long)(counters.bytes * 1e9 / (median + 1)));
+	}
+
+	printf("}\n");
+	fflush(stdout);
+}
+
+static void
+bench_run_fixture(bench_fixture_t* fixture, bench_options_t* options)
+{
+	const bench_t* bench;
+
+	for (bench = benches; bench->name != NULL; bench++)
+	{
+		if ((fixture->flags & bench->fixture_flags) != bench->fixture_flags)
+		{
+			continue;
+		}
+
+		if (options->filter != NULL && strstr(bench->name, options->filter) == NULL)
+		{
+			continue;
+		}
+
+		bench_execute(bench, fixture, options);
+	}
+}
+
+static void
+bench_usage(const char* name)
+{
+	fprintf(stderr,
+		"usage: %s [options] [file.mp4 | mapping.json ...]\n"
+		"\n"
+		"options:\n"
+		"  -i <count>     iterations per round (default - calibrated to ~%d ms per round)\n"
+		"  -r <count>     rounds, the median round is reported (default %d, max %d)\n"
+		"  -b <filter>    run only the benchmarks whose name contains <filter>\n",
+		name,
+		MIN_ROUND_DURATION / 1000000,
+		DEFAULT_REPEATS,
+		MAX_REPEATS);
+}
+
+int
+main(int argc, char *argv[])
+{
+	bench_fixture_t fixture;
+	request_context_t conf_context;
+	bench_options_t options;
+	vod_status_t rc;
+	int opt;
+	int i;
+
+	options.iterations = 0;
+	options.repeats = DEFAULT_REPEATS;
+	options.filter = NULL;
+
+	while ((opt = getopt(argc, argv, "i:r:b:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'i':
+			options.iterations = atoi(optarg);
+			break;
+
+		case 'r':
+			options.repeats = atoi(optarg);
+			break;
+
+		case 'b':
+			options.filter = optarg;
+			break;
+
+		default:
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (options.repeats <= 0 || options.repeats > MAX_REPEATS)
+	{
+		bench_usage(argv[0]);
+		return 1;
+	}
+
+	vod_cli_init(NGX_LOG_ERR);
+
+	// the conf is allocated once, the same as in nginx
+	rc = vod_cli_init_request_context(&conf_context, POOL_SIZE);
+	if (rc != VOD_OK)
+	{
+		return 1;
+	}
+
+	rc = bench_init_conf(conf_context.pool);
+	if (rc != VOD_OK)
+	{
+		fprintf(stderr, "failed to initialize the configuration %d\n", (int)rc);
+		return 1;
+	}
+
+	rc = media_set_parser_init(conf_context.pool, conf_context.pool);
+	if (rc != VOD_OK)
+	{
+		fprintf(stderr, "failed to initialize the media set parser %d\n", (int)rc);
+		return 1;
+	}
+
+#if (VOD_HAVE_LIB_AV_CODEC)
+	thumb_grabber_process_init(conf_context.log);
+#endif // VOD_HAVE_LIB_AV_CODEC
+
+	// synthetic fixtures
+	vod_memzero(&fixture, sizeof(fixture));
+	rc = vod_cli_init_request_context(&fixture.request_context, POOL_SIZE);
+	if (rc != VOD_OK)
+	{
+		return 1;
+	}
+
+	fixture.flags = BENCH_FIXTURE_MEDIA;
+	fixture.name = "synthetic";
+
+	rc = bench_build_synthetic_mp4(&fixture.request_context, &fixture.data);
+	if (rc == VOD_OK)
+	{
+		rc = bench_init_media_fixture(&fixture);
+	}
+
+	if (rc != VOD_OK)
+	{
+		fprintf(stderr, "failed to initialize the synthetic media fixture %d\n", (int)rc);
+		return 1;
+	}
+
+	bench_run_fixture(&fixture, &options);
+	vod_cli_free_request_context(&fixture.request_context);
+
+	vod_memzero(&fixture, sizeof(fixture));
+	rc = vod_cli_init_request_context(&fixture.request_context, POOL_SIZE);
+	if (rc != VOD_OK)
+	{
+		return 1;
+	}
+
+	fixture.flags = BENCH_FIXTURE_MAPPING;
+	fixture.name = "synthetic";
+
+	rc = bench_build_synthetic_mapping(&fixture.request_context, &fixture.data);
+	if (rc == VOD_OK)
+	{
+		rc = bench_init_mapping_fixture(&fixture);
+	}
+
+	if (rc != VOD_OK)
+	{
+		fprintf(stderr, "failed to initialize the synthetic mapping fixture %d\n", (int)rc);
+		return 1;
+	}
+
+	bench_run_fixture(&fixture, &options);
+	vod_cli_free_request_context(&fixture.request_context);
+
+	// real fixtures
+	for (i = optind; i < argc; i++)
+	{
+		vod_memzero(&fixture, sizeof(fixture));
+
+		rc = bench_init_fixture(&fixture, argv[i]);
+		if (rc == VOD_OK)
+		{
+			rc = (fixture.flags & BENCH_FIXTURE_MEDIA) != 0 ?
+				bench_init_media_fixture(&fixture) :
+				bench_init_mapping_fixture(&fixture);
+		}
+
+		if (rc == VOD_OK)
+		{
+			bench_run_fixture(&fixture, &options);
+		}
+		else
+		{
+			fprintf(stderr, "failed to initialize fixture \"%s\" %d, skipping\n", argv[i], (int)rc);
+		}
+
+		vod_cli_free_request_context(&fixture.request_context);
+	}
+
+	vod_cli_free_request_context(&conf_context);
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include "aes_cipher_cache.h"
+
+// typedefs
+typedef struct aes_cipher_cache_entry_s {
+	vod_queue_t link;
+	struct aes_cipher_cache_entry_s* next;
+	const EVP_CIPHER* cipher;
+	u_char key[AES_CIPHER_CACHE_KEY_SIZE];
+	EVP_CIPHER_CTX* ctx;
+} aes_cipher_cache_entry_t;
+
+struct aes_cipher_cache_s {
+	vod_queue_t lru;			// most recently used first
+	aes_cipher_cache_entry_t** buckets;
+	aes_cipher_cache_entry_t* entries;
+	uint32_t size;
+	uint32_t used;
+	aes_cipher_cache_stats_t* stats;
+};
+
+// macros
+#define aes_cipher_cache_inc_stat(cache, name)						\
+	if ((cache)->stats != NULL)										\
+	{																\
+		(void)vod_atomic_fetch_add(&(cache)->stats->name, 1);		\
+	}
+
+static void
+aes_cipher_cache_cleanup(aes_cipher_cache_t* cache)
+{
+	uint32_t i;
+
+	for (i = 0; i < cache->used; i++)
+	{
+		EVP_CIPHER_CTX_free(cache->entries[i].ctx);
+	}
+}
+
+aes_cipher_cache_t*
+aes_cipher_cache_create(vod_pool_t* pool, vod_log_t* log, uint32_t size)
+{
+	aes_cipher_cache_t* cache;
+	vod_pool_cleanup_t* cln;
+
+	if (size <= 0)
+	{
+		vod_log_error(VOD_LOG_ERR, log, 0,
+			"aes_cipher_cache_create: invalid size %uD", size);
+		return NULL;
+	}
+
+	cache = vod_alloc(pool, sizeof(*cache) +
+		sizeof(cache->buckets[0]) * size +
+		sizeof(cache->entries[0]) * size);
+	if (cache == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, log, 0,
+			"aes_cipher_cache_create: vod_alloc failed");
+		return NULL;
+	}
+
+	cln = vod_pool_cleanup_add(pool, 0);
+	if (cln == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, log, 0,
+			"aes_cipher_cache_create: vod_pool_cleanup_add failed");
+		return NULL;
+	}
+
+	cln->handler = (vod_pool_cleanup_pt)aes_cipher_cache_cleanup;
+	cln->data = cache;
+
+	cache->buckets = (void*)(cache + 1);
+	cache->entries = (void*)(cache->buckets + size);
+	vod_memzero(cache->buckets, sizeof(cache->buckets[0]) * size);
+	vod_queue_init(&cache->lru);
+	cache->size = size;
+	cache->used = 0;
+	cache->stats = NULL;
+
+	return cache;
+}
+
+void
+aes_cipher_cache_set_stats(aes_cipher_cache_t* cache, aes_cipher_cache_stats_t* stats)
+{
+	cache->stats = stats;
+}
+
+static aes_cipher_cache_entry_t**
+aes_cipher_cache_get_bucket(aes_cipher_cache_t* cache, const EVP_CIPHER* cipher, const u_char* key)
+{
+	uint32_t hash;
+
+	// Note: the keys are expected to be random, so their first bytes are good enough for a hash
+	hash = ((uint32_t)key[0] << 24) | ((uint32_t)key[1] << 16) | ((uint32_t)key[2] << 8) | key[3];
+	hash ^= (uint32_t)((uintptr_t)cipher >> 4);
+
+	return &cache->buckets[hash % cache->size];
+}
+
+static aes_cipher_cache_entry_t*
+aes_cipher_cache_get_entry(
+	request_context_t* request_context,
+	aes_cipher_cache_t* cache,
+	const EVP_CIPHER* cipher,
+	const u_char* key)
+{
+	aes_cipher_cache_entry_t** bucket;
+	aes_cipher_cache_entry_t** cur;
+	aes_cipher_cache_entry_t* entry;
+
+	// lookup
+	bucket = aes_cipher_cache_get_bucket(cache, cipher, key);
+	for (entry = *bucket; entry != NULL; entry = entry->next)
+	{
+		if (entry->cipher == cipher &&
+			vod_memcmp(entry->key, key, AES_CIPHER_CACHE_KEY_SIZE) == 0)
+		{
+			aes_cipher_cache_inc_stat(cache, hit);
+
+			vod_queue_remove(&entry->link);
+			vod_queue_insert_head(&cache->lru, &entry->link);
+			return entry;
+		}
+	}
+
+	aes_cipher_cache_inc_stat(cache, miss);
+
+	// get a free entry
+	if (cache->used < cache->size)
+	{
+		entry = &cache->entries[cache->used];
+
+		entry->ctx = EVP_CIPHER_CTX_new();
+		if (entry->ctx == NULL)
+		{
+			vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+				"aes_cipher_cache_get_entry: EVP_CIPHER_CTX_new failed");
+			return NULL;
+		}
+
+		entry->cipher = NULL;
+		cache->used++;
+	}
+	else
+	{
+		// evict the least recently used entry
+		entry = vod_queue_data(vod_queue_last(&cache->lru), aes_cipher_cache_entry_t, link);
+		vod_queue_remove(&entry->link);
+
+		if (entry->cipher != NULL)
+		{
+			for (cur = aes_cipher_cache_get_bucket(cache, entry->cipher, entry->key); *cur != entry; cur = &(*cur)->next);
+			*cur = entry->next;
+
+			aes_cipher_cache_inc_stat(cache, evicted);
+		}
+	}
+
+	// initialize the entry
+	if (1 != EVP_EncryptInit_ex(entry->ctx, cipher, NULL, key, NULL))
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"aes_cipher_cache_get_entry: EVP_EncryptInit_ex failed");
+
+		// Note: the entry is not added to the hash, it is pushed to the end of the lru list so that it will be reused first
+		entry->cipher = NULL;
+		vod_queue_insert_tail(&cache->lru, &entry->link);
+		return NULL;
+	}
+
+	entry->cipher = cipher;
+	vod_memcpy(entry->key, key, sizeof(entry->key));
+
+	entry->next = *bucket;
+	*bucket = entry;
+	vod_queue_insert_head(&cache->lru, &entry->link);
+
+	return entry;
+}
+
+vod_status_t
+aes_cipher_cache_init_ctx(
+	request_context_t* request_context,
+	EVP_CIPHER_CTX* ctx,
+	const EVP_CIPHER* cipher,
+	const u_char* key)
+{
+	aes_cipher_cache_entry_t* entry;
+	aes_cipher_cache_t* cache = request_context->cipher_cache;
+
+	if (cache == NULL)
+	{
+		if (1 != EVP_EncryptInit_ex(ctx, cipher, NULL, key, NULL))
+		{
+			vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+				"aes_cipher_cache_init_ctx: EVP_EncryptInit_ex failed");
+			return VOD_ALLOC_FAILED;
+		}
+
+		return VOD_OK;
+	}
+
+	entry = aes_cipher_cache_get_entry(request_context, cache, cipher, key);
+	if (entry == NULL)
+	{
+		return VOD_ALLOC_FAILED;
+	}
+
+	if (1 != EVP_CIPHER_CTX_copy(ctx, entry->ctx))
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"aes_cipher_cache_init_ctx: EVP_CIPHER_CTX_copy failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	return VOD_OK;
+}
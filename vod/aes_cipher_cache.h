@@ -0,0 +1,34 @@
+#ifndef __AES_CIPHER_CACHE_H__
+#define __AES_CIPHER_CACHE_H__
+
+// includes
+#include "aes_defs.h"
+
+// Note: the cipher cache holds per process cipher contexts that were initialized with a key,
+//		the cipher context of a request is copied from the cached template, saving the need to
+//		fetch the cipher implementation and expand the key on every request.
+//		the cache is not shared between processes, only the stats are
+
+// constants
+#define AES_CIPHER_CACHE_KEY_SIZE (16)
+
+// typedefs
+typedef struct {
+	vod_atomic_t hit;
+	vod_atomic_t miss;
+	vod_atomic_t evicted;
+} aes_cipher_cache_stats_t;
+
+// functions
+aes_cipher_cache_t* aes_cipher_cache_create(vod_pool_t* pool, vod_log_t* log, uint32_t size);
+
+void aes_cipher_cache_set_stats(aes_cipher_cache_t* cache, aes_cipher_cache_stats_t* stats);
+
+// Note: equivalent to EVP_EncryptInit_ex(ctx, cipher, NULL, key, NULL), the IV has to be set by the caller
+vod_status_t aes_cipher_cache_init_ctx(
+	request_context_t* request_context,
+	EVP_CIPHER_CTX* ctx,
+	const EVP_CIPHER* cipher,
+	const u_char* key);
+
+#endif // __AES_CIPHER_CACHE_H__
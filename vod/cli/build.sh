@@ -0,0 +1,90 @@
+#!/bin/bash
+
+if [ -z "$NGX_ROOT" ]; then
+	echo "NGX_ROOT not set"
+	exit 1
+fi
+
+if [ -z "$VOD_ROOT" ]; then
+	echo "VOD_ROOT not set"
+	exit 1
+fi
+
+if [ -z "$CC" ]; then
+	CC=cc
+fi
+
+# sources shared by all tools
+VOD_SRCS="$VOD_ROOT/vod/aes_cipher_cache.c
+	$VOD_ROOT/vod/avc_hevc_parser.c
+	$VOD_ROOT/vod/avc_parser.c
+	$VOD_ROOT/vod/buffer_pool.c
+	$VOD_ROOT/vod/codec_config.c
+	$VOD_ROOT/vod/common.c
+	$VOD_ROOT/vod/hevc_parser.c
+	$VOD_ROOT/vod/input/frames_source_cache.c
+	$VOD_ROOT/vod/input/read_cache.c
+	$VOD_ROOT/vod/language_code.c
+	$VOD_ROOT/vod/media_format.c
+	$VOD_ROOT/vod/mp4/mp4_aes_ctr.c
+	$VOD_ROOT/vod/mp4/mp4_cenc_decrypt.c
+	$VOD_ROOT/vod/mp4/mp4_clipper.c
+	$VOD_ROOT/vod/mp4/mp4_format.c
+	$VOD_ROOT/vod/mp4/mp4_parser.c
+	$VOD_ROOT/vod/mp4/mp4_parser_base.c
+	$VOD_ROOT/vod/parse_utils.c
+	$VOD_ROOT/vod/segmenter.c
+	$VOD_ROOT/vod/write_buffer.c
+	$VOD_ROOT/vod/cli/vod_cli_shim.c"
+
+# packager sources (vod_cli)
+VOD_PACKAGER_SRCS="$VOD_ROOT/vod/dash/dash_packager.c
+	$VOD_ROOT/vod/dash/edash_packager.c
+	$VOD_ROOT/vod/dynamic_buffer.c
+	$VOD_ROOT/vod/filters/audio_filter.c
+	$VOD_ROOT/vod/filters/concat_clip.c
+	$VOD_ROOT/vod/filters/dynamic_clip.c
+	$VOD_ROOT/vod/filters/filter.c
+	$VOD_ROOT/vod/filters/gain_filter.c
+	$VOD_ROOT/vod/filters/mix_filter.c
+	$VOD_ROOT/vod/filters/rate_filter.c
+	$VOD_ROOT/vod/hls/adts_encoder_filter.c
+	$VOD_ROOT/vod/hls/buffer_filter.c
+	$VOD_ROOT/vod/hls/eac3_encrypt_filter.c
+	$VOD_ROOT/vod/hls/frame_encrypt_filter.c
+	$VOD_ROOT/vod/hls/frame_joiner_filter.c
+	$VOD_ROOT/vod/hls/hls_muxer.c
+	$VOD_ROOT/vod/hls/id3_encoder_filter.c
+	$VOD_ROOT/vod/hls/m3u8_builder.c
+	$VOD_ROOT/vod/hls/mp4_to_annexb_filter.c
+	$VOD_ROOT/vod/hls/mpegts_encoder_filter.c
+	$VOD_ROOT/vod/hls/sample_aes_avc_filter.c
+	$VOD_ROOT/vod/input/frames_source_memory.c
+	$VOD_ROOT/vod/input/silence_generator.c
+	$VOD_ROOT/vod/json_parser.c
+	$VOD_ROOT/vod/manifest_utils.c
+	$VOD_ROOT/vod/media_set_parser.c
+	$VOD_ROOT/vod/mp4/mp4_cenc_encrypt.c
+	$VOD_ROOT/vod/mp4/mp4_cenc_passthrough.c
+	$VOD_ROOT/vod/mp4/mp4_fragment.c
+	$VOD_ROOT/vod/mp4/mp4_init_segment.c
+	$VOD_ROOT/vod/mss/mss_packager.c
+	$VOD_ROOT/vod/write_buffer_queue.c"
+
+NGX_SRCS="$NGX_ROOT/src/core/ngx_array.c
+	$NGX_ROOT/src/core/ngx_crc32.c
+	$NGX_ROOT/src/core/ngx_hash.c
+	$NGX_ROOT/src/core/ngx_palloc.c
+	$NGX_ROOT/src/core/ngx_rbtree.c
+	$NGX_ROOT/src/core/ngx_string.c
+	$NGX_ROOT/src/core/ngx_times.c
+	$NGX_ROOT/src/os/unix/ngx_alloc.c
+	$NGX_ROOT/src/os/unix/ngx_time.c"
+
+NGX_INCS="-I $NGX_ROOT/src/core -I $NGX_ROOT/src/event -I $NGX_ROOT/src/event/modules -I $NGX_ROOT/src/os/unix -I $NGX_ROOT/objs"
+
+CFLAGS="-Wall -O2 -g -DNGX_HAVE_LIB_AV_CODEC=0"
+
+$CC $CFLAGS -ovodidx $VOD_SRCS $VOD_ROOT/vod/input/metadata_index.c $VOD_ROOT/vod/cli/vod_index_main.c $NGX_SRCS $NGX_INCS -I $VOD_ROOT -lz -lcrypto
+
+$CC $CFLAGS -ovod_cli $VOD_SRCS $VOD_PACKAGER_SRCS $VOD_ROOT/vod/cli/vod_cli_main.c $NGX_SRCS $NGX_INCS -I $VOD_ROOT -lz -lcrypto
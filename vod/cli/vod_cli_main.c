@@ -1,77 +1,1243 @@
-// gcc -Wall -g -o repack adts_encoder.c buffer_filter.c mp4_parser.c mp4_to_annexb.c mpegts_encoder.c repackTs.c vod_array.c muxer.c read_cache.c
-// ./repack /opt/kaltura/app/alpha/web/repack.ts 0 10
+// packages a local mp4 file to an hls / dash / mss manifest or segment, without nginx
+// usage: vod_cli [options] <protocol> <request> <file>, run without arguments for the full list
+// when -b is specified, the request is executed multiple times and the duration of each stage is reported,
+// the stages are aligned with the perf counters of the module (read_file, media_parse, build_manifest etc.)
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <ngx_core.h>
+#include <vod/media_set.h>
+#include <vod/segmenter.h>
+#include <vod/parse_utils.h>
+#include <vod/filters/filter.h>
+#include <vod/mp4/mp4_format.h>
+#include <vod/mp4/mp4_fragment.h>
+#include <vod/mp4/mp4_init_segment.h>
+#include <vod/hls/m3u8_builder.h>
+#include <vod/hls/hls_muxer.h>
+#include <vod/dash/dash_packager.h>
+#include <vod/mss/mss_packager.h>
+#include "vod_cli_shim.h"
 
-#include "mp4_parser.h"
-#include "read_cache.h"
-#include "muxer.h"
+// constants
+#define MAX_METADATA_SIZE (128 * 1024 * 1024)
+#define MAX_FRAMES_SIZE (16 * 1024 * 1024)
+#define MAX_FRAME_COUNT (1024 * 1024)
+#define SEGMENT_MAX_FRAME_COUNT (64 * 1024)
+#define CACHE_BUFFER_SIZE (256 * 1024)
+#define DEFAULT_SEGMENT_DURATION (10000)
+#define POOL_SIZE (1024 * 1024)
 
-static bool_t 
-write_file(void* context, const u_char* buffer, uint32_t size)
+#define CLI_REQUEST_CLASS_MANIFEST	(0x01)
+#define CLI_REQUEST_CLASS_SEGMENT	(0x02)
+#define CLI_REQUEST_CLASS_OTHER		(0x04)
+
+#define SUPPORTED_CODECS_TS \
+	(VOD_CODEC_FLAG(AVC) | \
+	VOD_CODEC_FLAG(HEVC) | \
+	VOD_CODEC_FLAG(AAC) | \
+	VOD_CODEC_FLAG(AC3) | \
+	VOD_CODEC_FLAG(EAC3) | \
+	VOD_CODEC_FLAG(MP3) | \
+	VOD_CODEC_FLAG(DTS))
+
+#define SUPPORTED_CODECS_DASH \
+	(VOD_CODEC_FLAG(AVC) | \
+	VOD_CODEC_FLAG(HEVC) | \
+	VOD_CODEC_FLAG(AAC) | \
+	VOD_CODEC_FLAG(AC3) | \
+	VOD_CODEC_FLAG(EAC3))
+
+#define SUPPORTED_CODECS_MSS \
+	(VOD_CODEC_FLAG(AVC) | \
+	VOD_CODEC_FLAG(AAC) | \
+	VOD_CODEC_FLAG(MP3))
+
+// enums
+enum {
+	STAGE_OPEN_FILE,
+	STAGE_READ_METADATA,
+	STAGE_MEDIA_PARSE,
+	STAGE_BUILD_MANIFEST,
+	STAGE_INIT_FRAME_PROCESS,
+	STAGE_PROCESS_FRAMES,
+	STAGE_READ_FRAMES,
+	STAGE_TOTAL,
+
+	STAGE_COUNT
+};
+
+// typedefs
+struct vod_cli_ctx_s;
+typedef struct vod_cli_ctx_s vod_cli_ctx_t;
+
+typedef vod_status_t(*vod_cli_frame_processor_t)(void* context);
+
+typedef struct {
+	const char* protocol;
+	const char* name;
+	uint32_t flags;
+	int parse_type;
+	int request_class;
+	int codecs_mask;
+	uint32_t timescale;
+
+	vod_status_t(*handle_metadata_request)(
+		vod_cli_ctx_t* ctx,
+		vod_str_t* response);
+
+	vod_status_t(*init_frame_processor)(
+		vod_cli_ctx_t* ctx,
+		vod_cli_frame_processor_t* frame_processor,
+		void** frame_processor_state,
+		vod_str_t* output_buffer);
+} vod_cli_request_t;
+
+typedef struct {
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+} vod_cli_stage_stats_t;
+
+struct vod_cli_ctx_s {
+	// params
+	const vod_cli_request_t* request;
+	const char* input_path;
+	uint32_t segment_index;
+	track_mask_t tracks_mask[MEDIA_TYPE_COUNT];
+
+	// conf
+	segmenter_conf_t segmenter;
+	m3u8_config_t m3u8_config;
+	hls_mpegts_muxer_conf_t hls_muxer_conf;
+	dash_manifest_config_t mpd_config;
+	mss_manifest_config_t mss_config;
+
+	// per iteration state
+	request_context_t request_context;
+	media_set_t media_set;
+	media_sequence_t sequence;
+	media_clip_source_t source;
+	media_clip_t* clip;
+	read_cache_state_t read_cache_state;
+	int input_fd;
+	int output_fd;
+	size_t output_size;
+	uint64_t stage_times[STAGE_COUNT];
+};
+
+static const char* stage_names[STAGE_COUNT] = {
+	"open_file",
+	"read_metadata",
+	"media_parse",
+	"build_manifest",
+	"init_frame_process",
+	"process_frames",
+	"read_frames",
+	"total",
+};
+
+// write / time utils
+static vod_status_t
+vod_cli_write(void* context, u_char* buffer, uint32_t size)
 {
-	int* output_fd = (int*)context;
-	int rc;
-	
-	rc = write(*output_fd, buffer, size);
-	if (rc < size)
+	vod_cli_ctx_t* ctx = context;
+	ssize_t rc;
+
+	ctx->output_size += size;
+
+	if (ctx->output_fd == -1)
 	{
-		return FALSE;
+		return VOD_OK;
+	}
+
+	while (size > 0)
+	{
+		rc = write(ctx->output_fd, buffer, size);
+		if (rc <= 0)
+		{
+			vod_log_error(VOD_LOG_ERR, ctx->request_context.log, ngx_errno,
+				"vod_cli_write: write failed");
+			return VOD_UNEXPECTED;
+		}
+
+		buffer += rc;
+		size -= rc;
 	}
-	
-	return TRUE;
+
+	return VOD_OK;
 }
 
-static size_t 
-read_file(void* context, u_char *buf, size_t size, off_t offset)
+#define vod_cli_stage_start(start) start = vod_cli_get_time_usec()
+
+#define vod_cli_stage_end(ctx, start, stage) (ctx)->stage_times[stage] += vod_cli_get_time_usec() - (start)
+
+// request handlers
+static vod_status_t
+vod_cli_hls_handle_master_playlist(vod_cli_ctx_t* ctx, vod_str_t* response)
 {
-	int* input_fd = (int*)context;
-	
-	return pread(*input_fd, buf, size, offset);
+	vod_str_t base_url = vod_null_string;
+
+	return m3u8_builder_build_master_playlist(
+		&ctx->request_context,
+		&ctx->m3u8_config,
+		HLS_ENC_NONE,
+		&base_url,
+		&ctx->media_set,
+		response);
 }
 
-int 
-main(int argc, const char *argv[])
+static vod_status_t
+vod_cli_hls_handle_index_playlist(vod_cli_ctx_t* ctx, vod_str_t* response)
 {
-	read_cache_state_t read_cache_state;
-	hls_muxer_state_t muxer;
-	media_track_array_t track_array;
-	input_params_t input_params;
-	int output_fd;
-	int input_fd;
+	hls_encryption_params_t encryption_params;
+	vod_str_t base_url = vod_null_string;
+
+	encryption_params.type = HLS_ENC_NONE;
+
+	return m3u8_builder_build_index_playlist(
+		&ctx->request_context,
+		&ctx->m3u8_config,
+		&base_url,
+		&base_url,
+		&encryption_params,
+		HLS_CONTAINER_MPEGTS,
+		&ctx->media_set,
+		response);
+}
 
-	vod_memzero(&track_array, sizeof(track_array));
-	input_params.start_sec = atoi(argv[2]);
-	input_params.end_sec = atoi(argv[3]);
+static vod_status_t
+vod_cli_hls_init_ts_frame_processor(
+	vod_cli_ctx_t* ctx,
+	vod_cli_frame_processor_t* frame_processor,
+	void** frame_processor_state,
+	vod_str_t* output_buffer)
+{
+	hls_encryption_params_t encryption_params;
+	hls_muxer_state_t* state;
+	size_t response_size;
+	vod_status_t rc;
+
+	encryption_params.type = HLS_ENC_NONE;
 
-	input_fd = open("/web/content/r70v1/entry/data/80/655/0_vriq23ct_0_g0vnoj5i_1.mp4", O_RDONLY);
-	if (input_fd == -1)
+	rc = hls_muxer_init_segment(
+		&ctx->request_context,
+		&ctx->hls_muxer_conf,
+		&encryption_params,
+		ctx->segment_index,
+		&ctx->media_set,
+		vod_cli_write,
+		ctx,
+		FALSE,
+		&response_size,
+		output_buffer,
+		&state);
+	if (rc != VOD_OK)
 	{
+		return rc;
 	}
 
-	output_fd = creat(argv[1], S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (output_fd == -1)
+	*frame_processor = (vod_cli_frame_processor_t)hls_muxer_process;
+	*frame_processor_state = state;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+vod_cli_dash_handle_manifest(vod_cli_ctx_t* ctx, vod_str_t* response)
+{
+	dash_manifest_extensions_t extensions;
+	vod_str_t base_url = vod_null_string;
+
+	vod_memzero(&extensions, sizeof(extensions));
+
+	return dash_packager_build_mpd(
+		&ctx->request_context,
+		&ctx->mpd_config,
+		&base_url,
+		&ctx->media_set,
+		&extensions,
+		response);
+}
+
+static vod_status_t
+vod_cli_dash_handle_init_segment(vod_cli_ctx_t* ctx, vod_str_t* response)
+{
+	return mp4_init_segment_build(
+		&ctx->request_context,
+		&ctx->media_set,
+		FALSE,
+		NULL,
+		NULL,
+		response);
+}
+
+static vod_status_t
+vod_cli_mp4_fragment_init_writer(
+	vod_cli_ctx_t* ctx,
+	vod_cli_frame_processor_t* frame_processor,
+	void** frame_processor_state)
+{
+	fragment_writer_state_t* state;
+	vod_status_t rc;
+
+	rc = mp4_fragment_frame_writer_init(
+		&ctx->request_context,
+		ctx->media_set.sequences,
+		vod_cli_write,
+		ctx,
+		FALSE,
+		&state);
+	if (rc != VOD_OK)
 	{
+		return rc;
 	}
-	
-	if (!parse_mpeg_file(read_file, &input_fd, &track_array, &input_params))
+
+	*frame_processor = (vod_cli_frame_processor_t)mp4_fragment_frame_writer_process;
+	*frame_processor_state = state;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+vod_cli_dash_init_frame_processor(
+	vod_cli_ctx_t* ctx,
+	vod_cli_frame_processor_t* frame_processor,
+	void** frame_processor_state,
+	vod_str_t* output_buffer)
+{
+	dash_fragment_header_extensions_t header_extensions;
+	size_t response_size;
+	vod_status_t rc;
+
+	vod_memzero(&header_extensions, sizeof(header_extensions));
+
+	rc = dash_packager_build_fragment_header(
+		&ctx->request_context,
+		&ctx->media_set,
+		ctx->segment_index,
+		0,
+		&header_extensions,
+		FALSE,
+		output_buffer,
+		&response_size);
+	if (rc != VOD_OK)
 	{
+		return rc;
 	}
 
-	if (!read_cache_init(&read_cache_state, read_file, &input_fd))
+	return vod_cli_mp4_fragment_init_writer(ctx, frame_processor, frame_processor_state);
+}
+
+static vod_status_t
+vod_cli_mss_handle_manifest(vod_cli_ctx_t* ctx, vod_str_t* response)
+{
+	return mss_packager_build_manifest(
+		&ctx->request_context,
+		&ctx->mss_config,
+		&ctx->media_set,
+		0,
+		NULL,
+		NULL,
+		response);
+}
+
+static vod_status_t
+vod_cli_mss_init_frame_processor(
+	vod_cli_ctx_t* ctx,
+	vod_cli_frame_processor_t* frame_processor,
+	void** frame_processor_state,
+	vod_str_t* output_buffer)
+{
+	size_t response_size;
+	vod_status_t rc;
+
+	rc = mss_packager_build_fragment_header(
+		&ctx->request_context,
+		&ctx->media_set,
+		ctx->segment_index,
+		0,
+		NULL,
+		NULL,
+		FALSE,
+		output_buffer,
+		&response_size);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	return vod_cli_mp4_fragment_init_writer(ctx, frame_processor, frame_processor_state);
+}
+
+// Note: the flags / parse types / codecs must be kept in sync with the request definitions of the submodules
+static const vod_cli_request_t requests[] = {
+	{
+		"hls", "master",
+		0,
+		PARSE_FLAG_DURATION_LIMITS_AND_TOTAL_SIZE | PARSE_FLAG_KEY_FRAME_BITRATE | PARSE_FLAG_CODEC_NAME | PARSE_FLAG_PARSED_EXTRA_DATA_SIZE | PARSE_FLAG_CODEC_TRANSFER_CHAR,
+		CLI_REQUEST_CLASS_OTHER,
+		SUPPORTED_CODECS_TS,
+		HLS_TIMESCALE,
+		vod_cli_hls_handle_master_playlist,
+		NULL,
+	},
+	{
+		"hls", "index",
+		REQUEST_FLAG_SINGLE_TRACK_PER_MEDIA_TYPE,
+		PARSE_BASIC_METADATA_ONLY,
+		CLI_REQUEST_CLASS_MANIFEST,
+		SUPPORTED_CODECS_TS,
+		HLS_TIMESCALE,
+		vod_cli_hls_handle_index_playlist,
+		NULL,
+	},
+	{
+		"hls", "segment",
+		REQUEST_FLAG_SINGLE_TRACK_PER_MEDIA_TYPE,
+		PARSE_FLAG_FRAMES_ALL | PARSE_FLAG_PARSED_EXTRA_DATA | PARSE_FLAG_INITIAL_PTS_DELAY,
+		CLI_REQUEST_CLASS_SEGMENT,
+		SUPPORTED_CODECS_TS,
+		HLS_TIMESCALE,
+		NULL,
+		vod_cli_hls_init_ts_frame_processor,
+	},
+	{
+		"dash", "manifest",
+		0,
+		PARSE_FLAG_DURATION_LIMITS_AND_TOTAL_SIZE | PARSE_FLAG_INITIAL_PTS_DELAY | PARSE_FLAG_CODEC_NAME,
+		CLI_REQUEST_CLASS_MANIFEST,
+		SUPPORTED_CODECS_DASH,
+		DASH_TIMESCALE,
+		vod_cli_dash_handle_manifest,
+		NULL,
+	},
+	{
+		"dash", "init",
+		REQUEST_FLAG_SINGLE_TRACK,
+		PARSE_BASIC_METADATA_ONLY | PARSE_FLAG_SAVE_RAW_ATOMS,
+		CLI_REQUEST_CLASS_OTHER,
+		SUPPORTED_CODECS_DASH,
+		DASH_TIMESCALE,
+		vod_cli_dash_handle_init_segment,
+		NULL,
+	},
+	{
+		"dash", "fragment",
+		REQUEST_FLAG_SINGLE_TRACK,
+		PARSE_FLAG_FRAMES_ALL | PARSE_FLAG_INITIAL_PTS_DELAY,
+		CLI_REQUEST_CLASS_SEGMENT,
+		SUPPORTED_CODECS_DASH,
+		DASH_TIMESCALE,
+		NULL,
+		vod_cli_dash_init_frame_processor,
+	},
+	{
+		"mss", "manifest",
+		0,
+		PARSE_FLAG_TOTAL_SIZE_ESTIMATE | PARSE_FLAG_PARSED_EXTRA_DATA,
+		CLI_REQUEST_CLASS_MANIFEST,
+		SUPPORTED_CODECS_MSS,
+		MSS_TIMESCALE,
+		vod_cli_mss_handle_manifest,
+		NULL,
+	},
+	{
+		"mss", "fragment",
+		REQUEST_FLAG_SINGLE_TRACK,
+		PARSE_FLAG_FRAMES_ALL,
+		CLI_REQUEST_CLASS_SEGMENT,
+		SUPPORTED_CODECS_MSS,
+		MSS_TIMESCALE,
+		NULL,
+		vod_cli_mss_init_frame_processor,
+	},
+	{ NULL },
+};
+
+// conf
+static vod_status_t
+vod_cli_init_conf(vod_cli_ctx_t* ctx, uint32_t segment_duration, ngx_pool_t* pool)
+{
+	vod_status_t rc;
+
+	// Note: the defaults below match the defaults of the module
+	ctx->segmenter.segment_duration = segment_duration;
+	ctx->segmenter.live_window_duration = 30000;
+	ctx->segmenter.bootstrap_segments = NULL;
+	ctx->segmenter.align_to_key_frames = 0;
+	ctx->segmenter.get_segment_count = segmenter_get_segment_count_last_short;
+	ctx->segmenter.get_segment_durations = segmenter_get_segment_durations_estimate;
+	ctx->segmenter.manifest_duration_policy = MDP_MAX;
+	ctx->segmenter.gop_look_ahead = 1000;
+	ctx->segmenter.gop_look_behind = 10000;
+
+	rc = segmenter_init_config(&ctx->segmenter, pool);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	ctx->m3u8_config.output_iframes_playlist = FALSE;
+	ctx->m3u8_config.force_unmuxed_segments = FALSE;
+	ctx->m3u8_config.container_format = HLS_CONTAINER_MPEGTS;
+	ngx_str_set(&ctx->m3u8_config.index_file_name_prefix, "index");
+	ngx_str_set(&ctx->m3u8_config.iframes_file_name_prefix, "iframes");
+	ngx_str_set(&ctx->m3u8_config.segment_file_name_prefix, "seg");
+	ngx_str_set(&ctx->m3u8_config.init_file_name_prefix, "init");
+	ngx_str_set(&ctx->m3u8_config.encryption_key_file_name, "encryption");
+	ngx_str_set(&ctx->m3u8_config.encryption_key_format, "");
+	ngx_str_set(&ctx->m3u8_config.encryption_key_format_versions, "");
+
+	m3u8_builder_init_config(&ctx->m3u8_config, ctx->segmenter.max_segment_duration, HLS_ENC_NONE);
+
+	ctx->hls_muxer_conf.interleave_frames = FALSE;
+	ctx->hls_muxer_conf.align_frames = TRUE;
+	ctx->hls_muxer_conf.align_pts = FALSE;
+	ctx->hls_muxer_conf.id3_data.len = 0;
+	ctx->hls_muxer_conf.id3_data.data = NULL;
+
+	ngx_str_set(&ctx->mpd_config.profiles, "urn:mpeg:dash:profile:isoff-main:2011");
+	ngx_str_set(&ctx->mpd_config.init_file_name_prefix, "init");
+	ngx_str_set(&ctx->mpd_config.fragment_file_name_prefix, "fragment");
+	ngx_str_set(&ctx->mpd_config.subtitle_file_name_prefix, "sub");
+	ctx->mpd_config.manifest_format = FORMAT_SEGMENT_TIMELINE;
+	ctx->mpd_config.subtitle_format = SUBTITLE_FORMAT_WEBVTT;
+	ctx->mpd_config.duplicate_bitrate_threshold = 4096;
+	ctx->mpd_config.write_playready_kid = FALSE;
+	ctx->mpd_config.use_base_url_tag = FALSE;
+
+	ctx->mss_config.duplicate_bitrate_threshold = 4096;
+
+	return VOD_OK;
+}
+
+// media set
+static void
+vod_cli_init_media_set(vod_cli_ctx_t* ctx)
+{
+	media_clip_source_t* source = &ctx->source;
+	media_sequence_t* sequence = &ctx->sequence;
+	media_set_t* media_set = &ctx->media_set;
+
+	// Note: equivalent to a local request for a single uri (ngx_http_vod_parse_uri_path)
+	vod_memzero(source, sizeof(*source));
+	source->base.type = MEDIA_CLIP_SOURCE;
+	source->base.id = 1;
+	source->clip_to = ULLONG_MAX;
+	vod_memset(source->tracks_mask, 0xff, sizeof(source->tracks_mask));
+	source->uri.data = (u_char*)ctx->input_path;
+	source->uri.len = vod_strlen(ctx->input_path);
+	source->stripped_uri = source->uri;
+	source->mapped_uri = source->uri;
+	source->sequence = sequence;
+
+	ctx->clip = &source->base;
+
+	vod_memzero(sequence, sizeof(*sequence));
+	sequence->clips = &ctx->clip;
+	sequence->index = 0;
+	sequence->stripped_uri = source->uri;
+	sequence->mapped_uri = source->uri;
+	sequence->tags.is_default = -1;
+
+	vod_memzero(media_set, sizeof(*media_set));
+	media_set->segmenter_conf = &ctx->segmenter;
+	media_set->type = MEDIA_SET_VOD;
+	media_set->sequences = sequence;
+	media_set->sequences_end = sequence + 1;
+	media_set->sequence_count = 1;
+	media_set->sources_head = source;
+	media_set->timing.total_count = 1;
+	media_set->clip_count = 1;
+	media_set->presentation_end = TRUE;
+	media_set->uri = source->uri;
+}
+
+static vod_status_t
+vod_cli_init_parse_range(
+	vod_cli_ctx_t* ctx,
+	media_base_metadata_t* base_metadata,
+	media_range_t* range,
+	media_parse_params_t* parse_params)
+{
+	get_clip_ranges_params_t get_ranges_params;
+	get_clip_ranges_result_t clip_ranges;
+	vod_status_t rc;
+	uint32_t duration_millis;
+
+	if ((ctx->request->request_class & (CLI_REQUEST_CLASS_MANIFEST | CLI_REQUEST_CLASS_OTHER)) != 0)
+	{
+		ctx->request_context.simulation_only = TRUE;
+
+		parse_params->max_frame_count = MAX_FRAME_COUNT;
+		range->timescale = 1000;
+		range->original_clip_time = 0;
+		range->start = 0;
+		range->end = ULLONG_MAX;
+		parse_params->range = range;
+		return VOD_OK;
+	}
+
+	ctx->request_context.simulation_only = FALSE;
+
+	parse_params->max_frame_count = SEGMENT_MAX_FRAME_COUNT;
+
+	// Note: same as ngx_http_vod_init_parse_params_frames, for a single clip with no rate filter
+	duration_millis = rescale_time(base_metadata->duration, base_metadata->timescale, 1000);
+
+	get_ranges_params.request_context = &ctx->request_context;
+	get_ranges_params.conf = &ctx->segmenter;
+	get_ranges_params.segment_index = ctx->segment_index;
+	get_ranges_params.last_segment_end = ULLONG_MAX;
+	get_ranges_params.key_frame_durations = NULL;
+	get_ranges_params.allow_last_segment = TRUE;
+
+	vod_memzero(&get_ranges_params.timing, sizeof(get_ranges_params.timing));
+	get_ranges_params.timing.durations = &duration_millis;
+	get_ranges_params.timing.total_count = 1;
+	get_ranges_params.timing.total_duration = duration_millis;
+	get_ranges_params.timing.times = &get_ranges_params.timing.first_time;
+	get_ranges_params.timing.original_times = &get_ranges_params.timing.first_time;
+
+	rc = segmenter_get_start_end_ranges_no_discontinuity(
+		&get_ranges_params,
+		&clip_ranges);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	if (clip_ranges.clip_count == 0)
+	{
+		return VOD_NOT_FOUND;
+	}
+
+	ctx->media_set.initial_segment_clip_relative_index = clip_ranges.clip_relative_segment_index;
+	ctx->media_set.segment_start_time = clip_ranges.clip_ranges->start;
+	if (clip_ranges.clip_ranges->end == ULLONG_MAX)
+	{
+		ctx->media_set.segment_duration = duration_millis - clip_ranges.clip_ranges->start;
+	}
+	else
+	{
+		ctx->media_set.segment_duration = clip_ranges.clip_ranges->end - clip_ranges.clip_ranges->start;
+	}
+
+	parse_params->range = clip_ranges.clip_ranges;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+vod_cli_parse_media(vod_cli_ctx_t* ctx, vod_str_t* metadata_parts, size_t metadata_part_count)
+{
+	media_format_read_request_t read_req;
+	media_base_metadata_t* base_metadata;
+	media_parse_params_t parse_params;
+	media_clip_source_t* source = &ctx->source;
+	media_format_t* format = &mp4_format;
+	media_track_t* cur_track;
+	media_range_t range;
+	track_mask_t tracks_mask[MEDIA_TYPE_COUNT];
+	vod_str_t frame_data;
+	vod_status_t rc;
+	uint32_t media_type;
+
+	vod_memzero(&parse_params, sizeof(parse_params));
+
+	for (media_type = 0; media_type < MEDIA_TYPE_COUNT; media_type++)
+	{
+		vod_track_mask_and_bits(tracks_mask[media_type], source->tracks_mask[media_type], ctx->tracks_mask[media_type]);
+	}
+
+	parse_params.required_tracks_mask = tracks_mask;
+	parse_params.clip_from = 0;
+	parse_params.clip_to = UINT_MAX;
+	parse_params.max_frames_size = MAX_FRAMES_SIZE;
+	parse_params.codecs_mask = ctx->request->codecs_mask;
+	parse_params.source = source;
+	parse_params.parse_type = ctx->request->parse_type;
+	if (ctx->request->request_class == CLI_REQUEST_CLASS_MANIFEST)
+	{
+		parse_params.parse_type |= ctx->segmenter.parse_type;
+	}
+
+	rc = format->parse_metadata(
+		&ctx->request_context,
+		&parse_params,
+		metadata_parts,
+		metadata_part_count,
+		&base_metadata);
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+			"vod_cli_parse_media: parse_metadata(%V) failed %i", &format->name, rc);
+		return rc;
+	}
+
+	if (base_metadata->tracks.nelts == 0)
+	{
+		vod_memzero(&source->track_array, sizeof(source->track_array));
+		return VOD_OK;
+	}
+
+	rc = vod_cli_init_parse_range(ctx, base_metadata, &range, &parse_params);
+	switch (rc)
+	{
+	case VOD_OK:
+		break;
+
+	case VOD_NOT_FOUND:
+		vod_memzero(&source->track_array, sizeof(source->track_array));
+		return VOD_OK;
+
+	default:
+		vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+			"vod_cli_parse_media: failed to get the segment range %i", rc);
+		return rc;
+	}
+
+	rc = format->read_frames(
+		&ctx->request_context,
+		base_metadata,
+		&parse_params,
+		&ctx->segmenter,
+		&ctx->read_cache_state,
+		NULL,
+		&read_req,
+		&source->track_array);
+
+	while (rc == VOD_AGAIN)
+	{
+		// Note: the duration of these reads is included in media parse
+		rc = vod_cli_read_file(
+			&ctx->request_context,
+			ctx->input_fd,
+			read_req.read_offset,
+			read_req.read_size != 0 ? read_req.read_size : VOD_CLI_INITIAL_READ_SIZE,
+			&frame_data);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+
+		rc = format->read_frames(
+			&ctx->request_context,
+			base_metadata,
+			NULL,
+			&ctx->segmenter,
+			&ctx->read_cache_state,
+			&frame_data,
+			&read_req,
+			&source->track_array);
+	}
+
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+			"vod_cli_parse_media: read_frames(%V) failed %i", &format->name, rc);
+		return rc;
+	}
+
+	// Note: equivalent to ngx_http_vod_update_source_tracks, the clip has no time shift
+	for (cur_track = source->track_array.first_track;
+		cur_track < source->track_array.last_track;
+		cur_track++)
+	{
+		cur_track->clip_start_time = source->clip_time;
+		cur_track->original_clip_time = source->clip_time;
+		cur_track->file_info.source = source;
+		cur_track->file_info.uri = source->uri;
+		cur_track->file_info.drm_info = NULL;
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+vod_cli_validate_streams(vod_cli_ctx_t* ctx)
+{
+	media_set_t* media_set = &ctx->media_set;
+
+	if (media_set->total_track_count == 0)
+	{
+		vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+			"vod_cli_validate_streams: no matching streams were found");
+		return VOD_BAD_REQUEST;
+	}
+
+	if ((ctx->request->flags & REQUEST_FLAG_SINGLE_TRACK) != 0)
+	{
+		if (media_set->total_track_count != 1)
+		{
+			vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+				"vod_cli_validate_streams: got %uD streams while only a single stream is supported, use -t",
+				media_set->total_track_count);
+			return VOD_BAD_REQUEST;
+		}
+	}
+	else if ((ctx->request->flags & REQUEST_FLAG_SINGLE_TRACK_PER_MEDIA_TYPE) != 0)
+	{
+		if (media_set->track_count[MEDIA_TYPE_VIDEO] > 1 ||
+			media_set->track_count[MEDIA_TYPE_AUDIO] > 1)
+		{
+			vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+				"vod_cli_validate_streams: one stream at most per media type is allowed video=%uD audio=%uD",
+				media_set->track_count[MEDIA_TYPE_VIDEO],
+				media_set->track_count[MEDIA_TYPE_AUDIO]);
+			return VOD_BAD_REQUEST;
+		}
+	}
+
+	return VOD_OK;
+}
+
+// frame processing
+static vod_status_t
+vod_cli_process_frames(vod_cli_ctx_t* ctx)
+{
+	read_cache_get_read_buffer_t read_buf;
+	vod_cli_frame_processor_t frame_processor;
+	vod_str_t output_buffer = vod_null_string;
+	vod_str_t read_result;
+	vod_buf_t buf;
+	vod_status_t rc;
+	uint64_t start;
+	void* frame_processor_state;
+
+	read_cache_init(&ctx->read_cache_state, &ctx->request_context, CACHE_BUFFER_SIZE);
+
+	vod_cli_stage_start(start);
+
+	rc = ctx->request->init_frame_processor(
+		ctx,
+		&frame_processor,
+		&frame_processor_state,
+		&output_buffer);
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+			"vod_cli_process_frames: init_frame_processor failed %i", rc);
+		return rc;
+	}
+
+	vod_cli_stage_end(ctx, start, STAGE_INIT_FRAME_PROCESS);
+
+	if (output_buffer.len != 0)
+	{
+		rc = vod_cli_write(ctx, output_buffer.data, output_buffer.len);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+	}
+
+	rc = read_cache_allocate_buffer_slots(&ctx->read_cache_state, 0);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	for (;;)
+	{
+		vod_cli_stage_start(start);
+
+		rc = frame_processor(frame_processor_state);
+
+		vod_cli_stage_end(ctx, start, STAGE_PROCESS_FRAMES);
+
+		switch (rc)
+		{
+		case VOD_OK:
+			return VOD_OK;
+
+		case VOD_AGAIN:
+			break;
+
+		default:
+			vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+				"vod_cli_process_frames: frame_processor failed %i", rc);
+			return rc;
+		}
+
+		read_cache_get_read_buffer(&ctx->read_cache_state, &read_buf);
+
+		// Note: the cli always allocates a new buffer, the source is always the single input file
+		vod_cli_stage_start(start);
+
+		rc = vod_cli_read_file(&ctx->request_context, ctx->input_fd, read_buf.offset, read_buf.size, &read_result);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+
+		vod_cli_stage_end(ctx, start, STAGE_READ_FRAMES);
+
+		vod_memzero(&buf, sizeof(buf));
+		buf.start = read_result.data;
+		buf.pos = read_result.data;
+		buf.last = read_result.data + read_result.len;
+		buf.end = read_result.data + read_buf.size + 1;
+
+		read_cache_read_completed(&ctx->read_cache_state, &buf);
+	}
+}
+
+// main flow
+static vod_status_t
+vod_cli_run(vod_cli_ctx_t* ctx)
+{
+	media_format_read_metadata_result_t metadata;
+	media_set_t* media_set = &ctx->media_set;
+	media_track_t* track;
+	vod_str_t response = vod_null_string;
+	vod_status_t rc;
+	uint64_t total_start;
+	uint64_t start;
+
+	vod_cli_stage_start(total_start);
+
+	vod_cli_init_media_set(ctx);
+
+	// open the file
+	vod_cli_stage_start(start);
+
+	ctx->input_fd = open(ctx->input_path, O_RDONLY);
+	if (ctx->input_fd == -1)
+	{
+		vod_log_error(VOD_LOG_ERR, ctx->request_context.log, ngx_errno,
+			"vod_cli_run: open \"%s\" failed", ctx->input_path);
+		return VOD_NOT_FOUND;
+	}
+
+	vod_cli_stage_end(ctx, start, STAGE_OPEN_FILE);
+
+	// read the metadata
+	vod_cli_stage_start(start);
+
+	rc = vod_cli_read_metadata(&ctx->request_context, ctx->input_fd, &mp4_format, MAX_METADATA_SIZE, &metadata);
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+			"vod_cli_run: failed to read the metadata of \"%s\" %i", ctx->input_path, rc);
+		goto done;
+	}
+
+	vod_cli_stage_end(ctx, start, STAGE_READ_METADATA);
+
+	// parse the metadata and the frames
+	vod_cli_stage_start(start);
+
+	rc = vod_cli_parse_media(ctx, metadata.parts, metadata.part_count);
+	if (rc != VOD_OK)
+	{
+		goto done;
+	}
+
+	rc = filter_init_filtered_clips(
+		&ctx->request_context,
+		media_set,
+		(ctx->request->parse_type & PARSE_FLAG_FRAMES_DURATION) != 0);
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+			"vod_cli_run: filter_init_filtered_clips failed %i", rc);
+		goto done;
+	}
+
+	rc = vod_cli_validate_streams(ctx);
+	if (rc != VOD_OK)
+	{
+		goto done;
+	}
+
+	for (track = media_set->filtered_tracks; track < media_set->filtered_tracks_end; track++)
+	{
+		rc = media_format_update_track_timescale(&ctx->request_context, track, ctx->request->timescale, 0);
+		if (rc != VOD_OK)
+		{
+			goto done;
+		}
+	}
+
+	vod_cli_stage_end(ctx, start, STAGE_MEDIA_PARSE);
+
+	if (ctx->request->handle_metadata_request != NULL)
+	{
+		// build the manifest
+		vod_cli_stage_start(start);
+
+		rc = ctx->request->handle_metadata_request(ctx, &response);
+		if (rc != VOD_OK)
+		{
+			vod_log_error(VOD_LOG_ERR, ctx->request_context.log, 0,
+				"vod_cli_run: handle_metadata_request failed %i", rc);
+			goto done;
+		}
+
+		vod_cli_stage_end(ctx, start, STAGE_BUILD_MANIFEST);
+
+		rc = vod_cli_write(ctx, response.data, response.len);
+	}
+	else
+	{
+		rc = vod_cli_process_frames(ctx);
+	}
+
+done:
+
+	close(ctx->input_fd);
+
+	vod_cli_stage_end(ctx, total_start, STAGE_TOTAL);
+
+	return rc;
+}
+
+static const vod_cli_request_t*
+vod_cli_get_request(const char* protocol, const char* name)
+{
+	const vod_cli_request_t* request;
+
+	for (request = requests; request->protocol != NULL; request++)
+	{
+		if (strcmp(request->protocol, protocol) == 0 &&
+			strcmp(request->name, name) == 0)
+		{
+			return request;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+vod_cli_usage(const char* name)
+{
+	const vod_cli_request_t* request;
+
+	fprintf(stderr,
+		"usage: %s [options] <protocol> <request> <file.mp4>\n"
+		"\n"
+		"options:\n"
+		"  -s <index>     segment index, 1-based (default 1)\n"
+		"  -t <tracks>    tracks, e.g. v1-a1 / a2 (default - all tracks for manifests, v1-a1 for other requests)\n"
+		"  -d <millis>    segment duration (default %d)\n"
+		"  -o <file>      output file (default stdout)\n"
+		"  -b <count>     benchmark - run the request <count> times and report the duration of each stage\n"
+		"  -v             verbose log\n"
+		"\n"
+		"requests:\n",
+		name,
+		DEFAULT_SEGMENT_DURATION);
+
+	for (request = requests; request->protocol != NULL; request++)
+	{
+		fprintf(stderr, "  %s %s\n", request->protocol, request->name);
+	}
+}
+
+static void
+vod_cli_print_stats(vod_cli_stage_stats_t* stats, int iterations, size_t output_size)
+{
+	int i;
+
+	fprintf(stderr, "%-20s %12s %12s %12s\n", "stage (usec)", "min", "avg", "max");
+
+	for (i = 0; i < STAGE_COUNT; i++)
+	{
+		fprintf(stderr, "%-20s %12llu %12llu %12llu\n",
+			stage_names[i],
+			(unsigned long long)stats[i].min,
+			(unsigned long long)(stats[i].sum / iterations),
+			(unsigned long long)stats[i].max);
+	}
+
+	fprintf(stderr, "iterations: %d, output size: %zu\n", iterations, output_size);
+}
+
+int
+main(int argc, char *argv[])
+{
+	vod_cli_stage_stats_t stats[STAGE_COUNT];
+	vod_cli_ctx_t ctx;
+	request_context_t conf_context;
+	const char* output_path = NULL;
+	const char* tracks = NULL;
+	ngx_uint_t log_level = NGX_LOG_ERR;
+	vod_status_t rc;
+	uint32_t segment_duration = DEFAULT_SEGMENT_DURATION;
+	uint32_t segment_index = 1;
+	uint32_t media_type;
+	int iterations = 1;
+	int bench = 0;
+	int opt;
+	int i;
+	int j;
+
+	while ((opt = getopt(argc, argv, "s:t:d:o:b:v")) != -1)
+	{
+		switch (opt)
+		{
+		case 's':
+			segment_index = atoi(optarg);
+			break;
+
+		case 't':
+			tracks = optarg;
+			break;
+
+		case 'd':
+			segment_duration = atoi(optarg);
+			break;
+
+		case 'o':
+			output_path = optarg;
+			break;
+
+		case 'b':
+			iterations = atoi(optarg);
+			bench = 1;
+			break;
+
+		case 'v':
+			log_level = NGX_LOG_DEBUG;
+			break;
+
+		default:
+			vod_cli_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - optind != 3 || segment_index <= 0 || segment_duration <= 0 || iterations <= 0)
+	{
+		vod_cli_usage(argv[0]);
+		return 1;
+	}
+
+	vod_cli_init(log_level);
+
+	vod_memzero(&ctx, sizeof(ctx));
+
+	ctx.request = vod_cli_get_request(argv[optind], argv[optind + 1]);
+	if (ctx.request == NULL)
+	{
+		fprintf(stderr, "unknown request \"%s %s\"\n", argv[optind], argv[optind + 1]);
+		vod_cli_usage(argv[0]);
+		return 1;
+	}
+
+	ctx.input_path = argv[optind + 2];
+	ctx.segment_index = segment_index - 1;
+
+	if (tracks != NULL)
+	{
+		parse_utils_extract_track_tokens((u_char*)tracks, (u_char*)tracks + strlen(tracks), ctx.tracks_mask);
+	}
+	else if (ctx.request->request_class == CLI_REQUEST_CLASS_SEGMENT ||
+		(ctx.request->flags & (REQUEST_FLAG_SINGLE_TRACK | REQUEST_FLAG_SINGLE_TRACK_PER_MEDIA_TYPE)) != 0)
+	{
+		parse_utils_extract_track_tokens(NULL, NULL, ctx.tracks_mask);
+	}
+	else
+	{
+		for (media_type = 0; media_type < MEDIA_TYPE_COUNT; media_type++)
+		{
+			vod_track_mask_set_all_bits(ctx.tracks_mask[media_type]);
+		}
+	}
+
+	// the conf is allocated once, the same as in nginx
+	rc = vod_cli_init_request_context(&conf_context, POOL_SIZE);
+	if (rc != VOD_OK)
+	{
+		return 1;
+	}
+
+	rc = vod_cli_init_conf(&ctx, segment_duration, conf_context.pool);
+	if (rc != VOD_OK)
+	{
+		fprintf(stderr, "failed to initialize the configuration %d\n", (int)rc);
+		return 1;
+	}
+
+	if (output_path != NULL)
+	{
+		ctx.output_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if (ctx.output_fd == -1)
+		{
+			fprintf(stderr, "failed to open output file \"%s\"\n", output_path);
+			return 1;
+		}
+	}
+	else if (bench)
+	{
+		ctx.output_fd = -1;		// don't flood the terminal when benchmarking
+	}
+	else
+	{
+		ctx.output_fd = STDOUT_FILENO;
+	}
+
+	for (i = 0; i < STAGE_COUNT; i++)
+	{
+		stats[i].min = ULLONG_MAX;
+		stats[i].max = 0;
+		stats[i].sum = 0;
+	}
+
+	for (i = 0; i < iterations; i++)
+	{
+		rc = vod_cli_init_request_context(&ctx.request_context, POOL_SIZE);
+		if (rc != VOD_OK)
+		{
+			break;
+		}
+
+		vod_memzero(ctx.stage_times, sizeof(ctx.stage_times));
+		ctx.output_size = 0;
+
+		rc = vod_cli_run(&ctx);
+
+		vod_cli_free_request_context(&ctx.request_context);
+
+		if (rc != VOD_OK)
+		{
+			break;
+		}
+
+		// the output is written only on the first iteration
+		if (ctx.output_fd != -1 && ctx.output_fd != STDOUT_FILENO)
+		{
+			close(ctx.output_fd);
+		}
+		ctx.output_fd = -1;
+
+		for (j = 0; j < STAGE_COUNT; j++)
+		{
+			stats[j].min = vod_min(stats[j].min, ctx.stage_times[j]);
+			stats[j].max = vod_max(stats[j].max, ctx.stage_times[j]);
+			stats[j].sum += ctx.stage_times[j];
+		}
+	}
+
+	vod_cli_free_request_context(&conf_context);
+
+	if (rc != VOD_OK)
 	{
+		fprintf(stderr, "request failed %d\n", (int)rc);
+		return 1;
 	}
 
-	if (!hls_muxer_init(&muxer, &track_array, &read_cache_state, write_file, &output_fd))
+	if (bench)
 	{
+		vod_cli_print_stats(stats, iterations, ctx.output_size);
 	}
-	
-	hls_muxer_process(&muxer);
-	
-	close(output_fd);
-	close(input_fd);
 
 	return 0;
 }
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "vod_cli_shim.h"
+
+// globals
+volatile ngx_cycle_t  *ngx_cycle;
+ngx_log_t vod_cli_log;
+
+#if (NGX_HAVE_VARIADIC_MACROS)
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, ...)
+
+#else
+
+void
+ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
+    const char *fmt, va_list args)
+
+#endif
+{
+#if (NGX_HAVE_VARIADIC_MACROS)
+	va_list args;
+#endif
+	u_char buf[NGX_MAX_ERROR_STR];
+	u_char* last = buf + sizeof(buf) - 1;
+	u_char* p;
+
+#if (NGX_HAVE_VARIADIC_MACROS)
+	va_start(args, fmt);
+	p = ngx_vslprintf(buf, last, fmt, args);
+	va_end(args);
+#else
+	p = ngx_vslprintf(buf, last, fmt, args);
+#endif
+
+	if (err)
+	{
+		p = ngx_slprintf(p, last, " (%d: %s)", err, strerror(err));
+	}
+
+	*p++ = '\n';
+	fwrite(buf, 1, p - buf, stderr);
+}
+
+void
+vod_cli_init(ngx_uint_t log_level)
+{
+	ngx_pagesize = getpagesize();
+
+	ngx_time_init();
+
+	vod_cli_log.log_level = log_level;
+}
+
+vod_status_t
+vod_cli_init_request_context(request_context_t* request_context, size_t pool_size)
+{
+	ngx_memzero(request_context, sizeof(*request_context));
+
+	request_context->pool = ngx_create_pool(pool_size, &vod_cli_log);
+	if (request_context->pool == NULL)
+	{
+		return VOD_ALLOC_FAILED;
+	}
+
+	request_context->log = &vod_cli_log;
+
+	return VOD_OK;
+}
+
+void
+vod_cli_free_request_context(request_context_t* request_context)
+{
+	if (request_context->pool != NULL)
+	{
+		ngx_destroy_pool(request_context->pool);
+		request_context->pool = NULL;
+	}
+}
+
+vod_status_t
+vod_cli_read_file(
+	request_context_t* request_context,
+	int fd,
+	uint64_t offset,
+	size_t size,
+	vod_str_t* result)
+{
+	ssize_t rc;
+
+	result->data = vod_alloc(request_context->pool, size + 1);
+	if (result->data == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"vod_cli_read_file: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	rc = pread(fd, result->data, size, offset);
+	if (rc < 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, ngx_errno,
+			"vod_cli_read_file: pread failed, offset=%uL size=%uz", offset, size);
+		return VOD_UNEXPECTED;
+	}
+
+	result->len = rc;
+	result->data[rc] = '\0';
+
+	return VOD_OK;
+}
+
+vod_status_t
+vod_cli_read_metadata(
+	request_context_t* request_context,
+	int fd,
+	media_format_t* format,
+	size_t max_metadata_size,
+	media_format_read_metadata_result_t* result)
+{
+	vod_status_t rc;
+	vod_str_t buffer;
+	uint64_t offset;
+	size_t size;
+	void* reader_context;
+
+	rc = vod_cli_read_file(request_context, fd, 0, VOD_CLI_INITIAL_READ_SIZE, &buffer);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	rc = format->init_metadata_reader(request_context, &buffer, max_metadata_size, &reader_context);
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"vod_cli_read_metadata: init_metadata_reader(%V) failed %i", &format->name, rc);
+		return rc;
+	}
+
+	offset = 0;
+
+	for (;;)
+	{
+		rc = format->read_metadata(reader_context, offset, &buffer, result);
+		if (rc != VOD_AGAIN)
+		{
+			return rc;
+		}
+
+		offset = result->read_req.read_offset;
+		size = result->read_req.read_size != 0 ? result->read_req.read_size : VOD_CLI_INITIAL_READ_SIZE;
+
+		rc = vod_cli_read_file(request_context, fd, offset, size, &buffer);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+	}
+}
+
+uint64_t
+vod_cli_get_time_usec()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,42 @@
+#ifndef __VOD_CLI_SHIM_H__
+#define __VOD_CLI_SHIM_H__
+
+// includes
+#include <ngx_core.h>
+#include <vod/media_format.h>
+
+// Note: the command line tools link the vod library and the nginx core sources that do not depend on
+//		the event loop (pools, strings, arrays, hashes, times). this file provides the few globals &
+//		functions that are normally provided by the rest of nginx.
+
+// globals
+extern ngx_log_t vod_cli_log;
+
+// constants
+#define VOD_CLI_INITIAL_READ_SIZE (64 * 1024)
+
+// functions
+void vod_cli_init(ngx_uint_t log_level);
+
+vod_status_t vod_cli_init_request_context(request_context_t* request_context, size_t pool_size);
+
+void vod_cli_free_request_context(request_context_t* request_context);
+
+// Note: the returned buffer is null terminated, result->len may be smaller than size on eof
+vod_status_t vod_cli_read_file(
+	request_context_t* request_context,
+	int fd,
+	uint64_t offset,
+	size_t size,
+	vod_str_t* result);
+
+vod_status_t vod_cli_read_metadata(
+	request_context_t* request_context,
+	int fd,
+	media_format_t* format,
+	size_t max_metadata_size,
+	media_format_read_metadata_result_t* result);
+
+uint64_t vod_cli_get_time_usec();
+
+#endif // __VOD_CLI_SHIM_H__
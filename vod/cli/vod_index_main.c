@@ -0,0 +1,169 @@
+// generates metadata index (.vodidx) files for mp4 files, see vod/input/metadata_index.h
+// usage: vodidx file1.mp4 [file2.mp4 ...]
+// the index file is written next to the media file, and is used by nginx when vod_metadata_index is enabled
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ngx_core.h>
+#include <vod/mp4/mp4_format.h>
+#include <vod/input/metadata_index.h>
+#include "vod_cli_shim.h"
+
+// constants
+#define MAX_METADATA_SIZE (128 * 1024 * 1024)
+
+static vod_status_t
+write_index(
+	request_context_t* request_context,
+	const char* path,
+	metadata_index_source_t* source,
+	uint32_t format_id,
+	media_format_read_metadata_result_t* metadata)
+{
+	u_char* index_path;
+	u_char* temp_path;
+	u_char* buffer;
+	u_char* end;
+	size_t size;
+	int fd;
+
+	size = metadata_index_get_size(metadata->parts, metadata->part_count);
+
+	buffer = vod_alloc(request_context->pool, size);
+	index_path = vod_alloc(request_context->pool, vod_strlen(path) + sizeof(METADATA_INDEX_FILE_EXT) + sizeof(".tmp") - 1);
+	temp_path = vod_alloc(request_context->pool, vod_strlen(path) + sizeof(METADATA_INDEX_FILE_EXT) + sizeof(".tmp") - 1);
+	if (buffer == NULL || index_path == NULL || temp_path == NULL)
+	{
+		return VOD_ALLOC_FAILED;
+	}
+
+	end = metadata_index_write(buffer, source, format_id, metadata->parts, metadata->part_count);
+	if ((size_t)(end - buffer) != size)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"write_index: result length %uz different than allocated length %uz",
+			(size_t)(end - buffer), size);
+		return VOD_UNEXPECTED;
+	}
+
+	*ngx_sprintf(index_path, "%s%s", path, METADATA_INDEX_FILE_EXT) = '\0';
+	*ngx_sprintf(temp_path, "%s.tmp", index_path) = '\0';
+
+	// write to a temporary file and rename, so that nginx never reads a partial index
+	fd = open((char*)temp_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd == -1)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, ngx_errno,
+			"write_index: open \"%s\" failed", temp_path);
+		return VOD_UNEXPECTED;
+	}
+
+	if (write(fd, buffer, size) != (ssize_t)size)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, ngx_errno,
+			"write_index: write \"%s\" failed", temp_path);
+		close(fd);
+		unlink((char*)temp_path);
+		return VOD_UNEXPECTED;
+	}
+
+	close(fd);
+
+	if (rename((char*)temp_path, (char*)index_path) != 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, ngx_errno,
+			"write_index: rename \"%s\" failed", temp_path);
+		unlink((char*)temp_path);
+		return VOD_UNEXPECTED;
+	}
+
+	printf("%s: wrote %zu bytes\n", (char*)index_path, size);
+
+	return VOD_OK;
+}
+
+static vod_status_t
+generate_index(const char* path)
+{
+	media_format_read_metadata_result_t metadata;
+	metadata_index_source_t source;
+	request_context_t request_context;
+	struct stat file_info;
+	vod_status_t rc;
+	int fd;
+
+	rc = vod_cli_init_request_context(&request_context, 1024 * 1024);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context.log, ngx_errno,
+			"generate_index: open \"%s\" failed", path);
+		rc = VOD_NOT_FOUND;
+		goto done;
+	}
+
+	if (fstat(fd, &file_info) != 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context.log, ngx_errno,
+			"generate_index: fstat \"%s\" failed", path);
+		close(fd);
+		rc = VOD_UNEXPECTED;
+		goto done;
+	}
+
+	rc = vod_cli_read_metadata(&request_context, fd, &mp4_format, MAX_METADATA_SIZE, &metadata);
+
+	close(fd);
+
+	if (rc != VOD_OK)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context.log, 0,
+			"generate_index: failed to read the metadata of \"%s\" %i", path, rc);
+		goto done;
+	}
+
+	// Note: must match the values used by nginx (ngx_file_size / ngx_file_mtime)
+	source.size = file_info.st_size;
+	source.mtime = file_info.st_mtime;
+
+	rc = write_index(&request_context, path, &source, mp4_format.id, &metadata);
+
+done:
+
+	vod_cli_free_request_context(&request_context);
+
+	return rc;
+}
+
+int
+main(int argc, const char *argv[])
+{
+	int result = 0;
+	int i;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s file1.mp4 [file2.mp4 ...]\n", argv[0]);
+		return 1;
+	}
+
+	vod_cli_init(NGX_LOG_ERR);
+
+	for (i = 1; i < argc; i++)
+	{
+		if (generate_index(argv[i]) != VOD_OK)
+		{
+			result = 1;
+		}
+	}
+
+	return result;
+}
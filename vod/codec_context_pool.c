@@ -0,0 +1,310 @@
+#include "codec_context_pool.h"
+
+// typedefs
+typedef struct codec_context_pool_entry_s {
+	vod_queue_t link;
+	struct codec_context_pool_entry_s* next;
+	codec_context_key_t key;
+	uint32_t hash;
+	AVCodecContext* context;
+} codec_context_pool_entry_t;
+
+struct codec_context_pool_s {
+	vod_queue_t lru;			// most recently used first
+	codec_context_pool_entry_t** buckets;
+	codec_context_pool_entry_t* entries;
+	codec_context_pool_entry_t* free;
+	uint32_t size;
+	codec_context_pool_stats_t* stats;
+};
+
+// macros
+#define codec_context_pool_inc_stat(pool, name)						\
+	if ((pool)->stats != NULL)										\
+	{																\
+		(void)vod_atomic_fetch_add(&(pool)->stats->name, 1);		\
+	}
+
+static void
+codec_context_pool_cleanup(codec_context_pool_t* pool)
+{
+	uint32_t i;
+
+	for (i = 0; i < pool->size; i++)
+	{
+		avcodec_free_context(&pool->entries[i].context);
+	}
+}
+
+codec_context_pool_t*
+codec_context_pool_create(vod_pool_t* pool, vod_log_t* log, uint32_t size)
+{
+	codec_context_pool_t* result;
+	vod_pool_cleanup_t* cln;
+	uint32_t i;
+
+	if (size <= 0)
+	{
+		vod_log_error(VOD_LOG_ERR, log, 0,
+			"codec_context_pool_create: invalid size %uD", size);
+		return NULL;
+	}
+
+	result = vod_alloc(pool, sizeof(*result) +
+		sizeof(result->buckets[0]) * size +
+		sizeof(result->entries[0]) * size);
+	if (result == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, log, 0,
+			"codec_context_pool_create: vod_alloc failed");
+		return NULL;
+	}
+
+	cln = vod_pool_cleanup_add(pool, 0);
+	if (cln == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, log, 0,
+			"codec_context_pool_create: vod_pool_cleanup_add failed");
+		return NULL;
+	}
+
+	cln->handler = (vod_pool_cleanup_pt)codec_context_pool_cleanup;
+	cln->data = result;
+
+	result->buckets = (void*)(result + 1);
+	result->entries = (void*)(result->buckets + size);
+	vod_memzero(result->buckets, sizeof(result->buckets[0]) * size);
+	vod_memzero(result->entries, sizeof(result->entries[0]) * size);
+	vod_queue_init(&result->lru);
+	result->size = size;
+	result->stats = NULL;
+
+	result->free = NULL;
+	for (i = size; i > 0; i--)
+	{
+		result->entries[i - 1].next = result->free;
+		result->free = &result->entries[i - 1];
+	}
+
+	return result;
+}
+
+void
+codec_context_pool_set_stats(codec_context_pool_t* pool, codec_context_pool_stats_t* stats)
+{
+	pool->stats = stats;
+}
+
+static uint32_t
+codec_context_pool_get_hash(codec_context_key_t* key)
+{
+	uint32_t hash;
+
+	hash = vod_crc32_short(key->extra_data.data, key->extra_data.len);
+	hash ^= (uint32_t)((uintptr_t)key->codec >> 4);
+	hash = hash * 31 + key->codec_tag;
+	hash = hash * 31 + key->timescale;
+	hash = hash * 31 + key->width;
+	hash = hash * 31 + key->height;
+	hash = hash * 31 + key->lowres;
+	hash = hash * 31 + key->sample_rate;
+	hash = hash * 31 + (uint32_t)key->channel_layout;
+	hash = hash * 31 + key->bitrate;
+
+	return hash;
+}
+
+static bool_t
+codec_context_pool_key_equals(codec_context_key_t* key1, codec_context_key_t* key2)
+{
+	return key1->codec == key2->codec &&
+		key1->codec_tag == key2->codec_tag &&
+		key1->timescale == key2->timescale &&
+		key1->width == key2->width &&
+		key1->height == key2->height &&
+		key1->lowres == key2->lowres &&
+		key1->sample_rate == key2->sample_rate &&
+		key1->channel_layout == key2->channel_layout &&
+		key1->bitrate == key2->bitrate &&
+		key1->extra_data.len == key2->extra_data.len &&
+		vod_memcmp(key1->extra_data.data, key2->extra_data.data, key1->extra_data.len) == 0;
+}
+
+static void
+codec_context_pool_remove_entry(codec_context_pool_t* pool, codec_context_pool_entry_t* entry)
+{
+	codec_context_pool_entry_t** cur;
+
+	for (cur = &pool->buckets[entry->hash % pool->size]; *cur != entry; cur = &(*cur)->next);
+	*cur = entry->next;
+
+	vod_queue_remove(&entry->link);
+}
+
+AVCodecContext*
+codec_context_pool_checkout(
+	request_context_t* request_context,
+	codec_context_key_t* key)
+{
+	codec_context_pool_entry_t* entry;
+	codec_context_pool_t* pool = request_context->codec_context_pool;
+	AVCodecContext* result;
+	uint32_t hash;
+
+	if (pool == NULL)
+	{
+		return NULL;
+	}
+
+	hash = codec_context_pool_get_hash(key);
+
+	for (entry = pool->buckets[hash % pool->size]; entry != NULL; entry = entry->next)
+	{
+		if (entry->hash != hash || !codec_context_pool_key_equals(&entry->key, key))
+		{
+			continue;
+		}
+
+		codec_context_pool_inc_stat(pool, hit);
+
+		codec_context_pool_remove_entry(pool, entry);
+
+		result = entry->context;
+		entry->context = NULL;
+		entry->next = pool->free;
+		pool->free = entry;
+		return result;
+	}
+
+	codec_context_pool_inc_stat(pool, miss);
+
+	return NULL;
+}
+
+vod_status_t
+codec_context_pool_set_extra_data(
+	request_context_t* request_context,
+	AVCodecContext* context,
+	vod_str_t* extra_data)
+{
+	if (request_context->codec_context_pool == NULL)
+	{
+		context->extradata = extra_data->data;
+		context->extradata_size = extra_data->len;
+		return VOD_OK;
+	}
+
+	if (extra_data->len <= 0)
+	{
+		// Note: a pooled context may be freed by avcodec_free_context, it must not point to the request pool
+		context->extradata = NULL;
+		context->extradata_size = 0;
+		return VOD_OK;
+	}
+
+	// Note: the buffer is freed by avcodec_free_context
+	context->extradata = av_mallocz(extra_data->len + AV_INPUT_BUFFER_PADDING_SIZE);
+	if (context->extradata == NULL)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"codec_context_pool_set_extra_data: av_mallocz failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	vod_memcpy(context->extradata, extra_data->data, extra_data->len);
+	context->extradata_size = extra_data->len;
+
+	return VOD_OK;
+}
+
+static bool_t
+codec_context_pool_reset(AVCodecContext* context)
+{
+	if (!avcodec_is_open(context))
+	{
+		return FALSE;
+	}
+
+	if (av_codec_is_decoder(context->codec))
+	{
+		avcodec_flush_buffers(context);
+		return TRUE;
+	}
+
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+	if ((context->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH) != 0)
+	{
+		avcodec_flush_buffers(context);
+		return TRUE;
+	}
+#endif // AV_CODEC_CAP_ENCODER_FLUSH
+
+	// Note: an encoder that does not buffer frames (e.g. mjpeg) returns to its initial state after
+	//		every packet, other encoders were drained at the end of the request and cannot be reused
+	return (context->codec->capabilities & AV_CODEC_CAP_DELAY) == 0;
+}
+
+void
+codec_context_pool_checkin(
+	request_context_t* request_context,
+	codec_context_key_t* key,
+	AVCodecContext** context)
+{
+	codec_context_pool_entry_t** bucket;
+	codec_context_pool_entry_t* entry;
+	codec_context_pool_t* pool;
+	AVCodecContext* cur_context = *context;
+
+	if (cur_context == NULL)
+	{
+		return;
+	}
+
+	*context = NULL;
+
+	pool = request_context->codec_context_pool;
+
+	if (pool == NULL)
+	{
+		avcodec_close(cur_context);
+		av_free(cur_context);
+		return;
+	}
+
+	if (!codec_context_pool_reset(cur_context))
+	{
+		avcodec_free_context(&cur_context);
+		return;
+	}
+
+	// get a free entry
+	entry = pool->free;
+	if (entry != NULL)
+	{
+		pool->free = entry->next;
+	}
+	else
+	{
+		// evict the least recently used entry
+		entry = vod_queue_data(vod_queue_last(&pool->lru), codec_context_pool_entry_t, link);
+		codec_context_pool_remove_entry(pool, entry);
+		avcodec_free_context(&entry->context);
+
+		codec_context_pool_inc_stat(pool, evicted);
+	}
+
+	// initialize the entry
+	entry->key = *key;
+	if (key->extra_data.len > 0)
+	{
+		// Note: the extra data of the request is freed with the request, the context holds a copy of it
+		entry->key.extra_data.data = cur_context->extradata;
+	}
+	entry->hash = codec_context_pool_get_hash(&entry->key);
+	entry->context = cur_context;
+
+	bucket = &pool->buckets[entry->hash % pool->size];
+	entry->next = *bucket;
+	*bucket = entry;
+	vod_queue_insert_head(&pool->lru, &entry->link);
+}
@@ -0,0 +1,61 @@
+#ifndef __CODEC_CONTEXT_POOL_H__
+#define __CODEC_CONTEXT_POOL_H__
+
+// includes
+#include "common.h"
+#include <libavcodec/avcodec.h>
+
+// Note: the codec context pool holds per process libavcodec contexts that were already opened,
+//		a request checks out a context that matches its codec parameters, and checks it back in
+//		when it is freed, saving the avcodec_open2 call (and the allocation of the codec tables).
+//		decoders are flushed when checked in, encoders are kept only when they can be flushed
+//		or when they do not buffer frames. the pool is not shared between processes, only the stats are.
+//		the pool must be accessed only from the event loop - contexts are checked out when the
+//		request state is initialized and checked in from pool cleanups.
+
+// typedefs
+typedef struct {
+	vod_atomic_t hit;
+	vod_atomic_t miss;
+	vod_atomic_t evicted;
+} codec_context_pool_stats_t;
+
+typedef struct {
+	const AVCodec* codec;
+	uint32_t codec_tag;
+	uint32_t timescale;
+	uint32_t width;
+	uint32_t height;
+	uint32_t lowres;
+	uint32_t sample_rate;
+	uint64_t channel_layout;
+	uint32_t bitrate;
+	vod_str_t extra_data;
+} codec_context_key_t;
+
+// functions
+codec_context_pool_t* codec_context_pool_create(vod_pool_t* pool, vod_log_t* log, uint32_t size);
+
+void codec_context_pool_set_stats(codec_context_pool_t* pool, codec_context_pool_stats_t* stats);
+
+// Note: returns an opened context matching the key, or NULL when there is none.
+//		the caller should keep the key, it has to be passed to codec_context_pool_checkin
+AVCodecContext* codec_context_pool_checkout(
+	request_context_t* request_context,
+	codec_context_key_t* key);
+
+// Note: sets the extra data of a newly allocated decoder context, when the pool is enabled
+//		the data is copied, so that the context can outlive the request
+vod_status_t codec_context_pool_set_extra_data(
+	request_context_t* request_context,
+	AVCodecContext* context,
+	vod_str_t* extra_data);
+
+// Note: returns the context to the pool, or frees it when it cannot be reused.
+//		the context pointer is set to NULL
+void codec_context_pool_checkin(
+	request_context_t* request_context,
+	codec_context_key_t* key,
+	AVCodecContext** context);
+
+#endif // __CODEC_CONTEXT_POOL_H__
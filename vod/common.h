@@ -180,7 +180,13 @@ void vod_log_error(vod_uint_t level, vod_log_t *log, int err,
 #define vod_queue_empty(h) ngx_queue_empty(h)
 #define vod_queue_insert_tail(h, x) ngx_queue_insert_tail(h, x)
 #define vod_queue_head(h) ngx_queue_head(h)
+#define vod_queue_last(h) ngx_queue_last(h)
+#define vod_queue_insert_head(h, x) ngx_queue_insert_head(h, x)
 #define vod_queue_remove(x) ngx_queue_remove(x)
+#define vod_queue_data(q, type, link) ngx_queue_data(q, type, link)
+
+// atomic functions
+#define vod_atomic_fetch_add(value, add) ngx_atomic_fetch_add(value, add)
 
 // rbtree functions
 #define vod_rbtree_init(tree, s, i) ngx_rbtree_init(tree, s, i)
@@ -225,6 +231,7 @@ void vod_log_error(vod_uint_t level, vod_log_t *log, int err,
 #define vod_chain_t ngx_chain_t
 #define vod_tm_t ngx_tm_t
 #define vod_queue_t ngx_queue_t
+#define vod_atomic_t ngx_atomic_t
 #define vod_rbtree_t ngx_rbtree_t
 #define vod_rbtree_node_t ngx_rbtree_node_t
 
@@ -352,10 +359,18 @@ typedef struct {
 struct buffer_pool_s;
 typedef struct buffer_pool_s buffer_pool_t;
 
+struct aes_cipher_cache_s;
+typedef struct aes_cipher_cache_s aes_cipher_cache_t;
+
+struct codec_context_pool_s;
+typedef struct codec_context_pool_s codec_context_pool_t;
+
 typedef struct {
 	vod_pool_t* pool;
 	vod_log_t *log;
 	buffer_pool_t* output_buffer_pool;
+	aes_cipher_cache_t* cipher_cache;
+	codec_context_pool_t* codec_context_pool;
 	bool_t simulation_only;
 	time_t time_offset;
 #if (VOD_DEBUG)
@@ -1,4 +1,5 @@
 #include "audio_decoder.h"
+#include "../input/frames_source_memory.h"
 
 // globals
 static const AVCodec *decoder_codec = NULL;
@@ -27,7 +28,9 @@ audio_decoder_init_decoder(
 	audio_decoder_state_t* state,
 	media_info_t* media_info)
 {
+	codec_context_key_t* key = &state->key;
 	AVCodecContext* decoder;
+	vod_status_t rc;
 	int avrc;
 
 	if (media_info->codec_id != VOD_CODEC_ID_AAC)
@@ -37,6 +40,21 @@ audio_decoder_init_decoder(
 		return VOD_BAD_REQUEST;
 	}
 
+	vod_memzero(key, sizeof(*key));
+	key->codec = decoder_codec;
+	key->codec_tag = media_info->format;
+	key->timescale = media_info->frames_timescale;
+	key->sample_rate = media_info->u.audio.sample_rate;
+	key->channel_layout = media_info->u.audio.channel_layout;
+	key->bitrate = media_info->bitrate;
+	key->extra_data = media_info->extra_data;
+
+	state->decoder = codec_context_pool_checkout(state->request_context, key);
+	if (state->decoder != NULL)
+	{
+		return VOD_OK;
+	}
+
 	// init the decoder	
 	decoder = avcodec_alloc_context3(decoder_codec);
 	if (decoder == NULL)
@@ -53,8 +71,12 @@ audio_decoder_init_decoder(
 	decoder->time_base.num = 1;
 	decoder->time_base.den = media_info->frames_timescale;
 	decoder->pkt_timebase = decoder->time_base;
-	decoder->extradata = media_info->extra_data.data;
-	decoder->extradata_size = media_info->extra_data.len;
+
+	rc = codec_context_pool_set_extra_data(state->request_context, decoder, &media_info->extra_data);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
 
 #if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 23, 100)
 	av_channel_layout_from_mask(&decoder->ch_layout, media_info->u.audio.channel_layout);
@@ -144,6 +166,8 @@ audio_decoder_init(
 	state->data_handled = TRUE;
 	state->frame_started = FALSE;
 	state->frame_buffer = NULL;
+	state->memory_frames = NULL;
+	state->memory_frames_end = NULL;
 
 	state->cur_frame_part = track->frames;
 	state->cur_frame = track->frames.first_frame;
@@ -159,9 +183,7 @@ audio_decoder_init(
 void
 audio_decoder_free(audio_decoder_state_t* state)
 {
-	avcodec_close(state->decoder);
-	av_free(state->decoder);
-	state->decoder = NULL;
+	codec_context_pool_checkin(state->request_context, &state->key, &state->decoder);
 	av_frame_free(&state->decoded_frame);
 }
 
@@ -240,6 +262,144 @@ audio_decoder_decode_frame(
 	return VOD_OK;
 }
 
+vod_status_t
+audio_decoder_read_frames(audio_decoder_state_t* state)
+{
+	frame_list_part_t* part;
+	input_frame_t* cur_frame;
+	u_char* read_buffer;
+	uint32_t frame_count;
+	uint32_t read_size;
+	vod_status_t rc;
+	bool_t frame_done;
+
+	if (state->memory_frames == NULL)
+	{
+		frame_count = 0;
+		for (part = &state->cur_frame_part; part != NULL; part = part->next)
+		{
+			frame_count += part->last_frame - part->first_frame;
+		}
+
+		state->memory_frames = vod_alloc(state->request_context->pool, sizeof(state->memory_frames[0]) * frame_count);
+		if (state->memory_frames == NULL)
+		{
+			vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+				"audio_decoder_read_frames: vod_alloc failed (1)");
+			return VOD_ALLOC_FAILED;
+		}
+
+		state->memory_frames_end = state->memory_frames;
+	}
+
+	for (;;)
+	{
+		// start a frame if needed
+		if (!state->frame_started)
+		{
+			if (state->cur_frame >= state->cur_frame_part.last_frame)
+			{
+				if (state->cur_frame_part.next == NULL)
+				{
+					break;
+				}
+
+				state->cur_frame_part = *state->cur_frame_part.next;
+				state->cur_frame = state->cur_frame_part.first_frame;
+				continue;
+			}
+
+			rc = state->cur_frame_part.frames_source->start_frame(
+				state->cur_frame_part.frames_source_context,
+				state->cur_frame,
+				NULL);
+			if (rc != VOD_OK)
+			{
+				return rc;
+			}
+
+			state->frame_buffer = vod_alloc(
+				state->request_context->pool,
+				state->cur_frame->size + VOD_BUFFER_PADDING_SIZE);
+			if (state->frame_buffer == NULL)
+			{
+				vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+					"audio_decoder_read_frames: vod_alloc failed (2)");
+				return VOD_ALLOC_FAILED;
+			}
+
+			state->cur_frame_pos = 0;
+			state->frame_started = TRUE;
+		}
+
+		// read some data from the frame
+		rc = state->cur_frame_part.frames_source->read(
+			state->cur_frame_part.frames_source_context,
+			&read_buffer,
+			&read_size,
+			&frame_done);
+		if (rc != VOD_OK)
+		{
+			if (rc != VOD_AGAIN)
+			{
+				return rc;
+			}
+
+			if (!state->data_handled)
+			{
+				vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+					"audio_decoder_read_frames: no data was handled, probably a truncated file");
+				return VOD_BAD_DATA;
+			}
+
+			state->data_handled = FALSE;
+			return VOD_AGAIN;
+		}
+
+		state->data_handled = TRUE;
+
+		if (state->cur_frame_pos + read_size > state->cur_frame->size)
+		{
+			vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+				"audio_decoder_read_frames: frame size %uD exceeded", state->cur_frame->size);
+			return VOD_UNEXPECTED;
+		}
+
+		vod_memcpy(state->frame_buffer + state->cur_frame_pos, read_buffer, read_size);
+		state->cur_frame_pos += read_size;
+
+		if (!frame_done)
+		{
+			continue;
+		}
+
+		cur_frame = state->memory_frames_end++;
+		*cur_frame = *state->cur_frame;
+		cur_frame->offset = (uintptr_t)state->frame_buffer;
+
+		state->cur_frame++;
+		state->frame_started = FALSE;
+	}
+
+	// switch to reading the frames from memory
+	rc = frames_source_memory_init(state->request_context, &state->cur_frame_part.frames_source_context);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	state->cur_frame_part.frames_source = &frames_source_memory;
+	state->cur_frame_part.first_frame = state->memory_frames;
+	state->cur_frame_part.last_frame = state->memory_frames_end;
+	state->cur_frame_part.next = NULL;
+	state->cur_frame = state->memory_frames;
+
+	state->frame_buffer = NULL;
+	state->cur_frame_pos = 0;
+
+	return VOD_OK;
+}
+
 vod_status_t
 audio_decoder_get_frame(
 	audio_decoder_state_t* state,
@@ -3,6 +3,7 @@
 
 // includes
 #include "../media_format.h"
+#include "../codec_context_pool.h"
 #include <libavcodec/avcodec.h>
 
 // macros
@@ -13,6 +14,7 @@
 typedef struct {
 	request_context_t* request_context;
 	AVCodecContext* decoder;
+	codec_context_key_t key;
 	AVFrame* decoded_frame;
 
 	frame_list_part_t cur_frame_part;
@@ -24,6 +26,9 @@ typedef struct {
 	uint32_t cur_frame_pos;
 	bool_t data_handled;
 	bool_t frame_started;
+
+	input_frame_t* memory_frames;
+	input_frame_t* memory_frames_end;
 } audio_decoder_state_t;
 
 // functions
@@ -37,6 +42,10 @@ vod_status_t audio_decoder_init(
 
 void audio_decoder_free(audio_decoder_state_t* state);
 
+// Note: reads all the remaining input frames to memory, once it returns VOD_OK,
+//		audio_decoder_get_frame does not perform any I/O or allocations
+vod_status_t audio_decoder_read_frames(audio_decoder_state_t* state);
+
 vod_status_t audio_decoder_get_frame(
 	audio_decoder_state_t* state,
 	AVFrame** result);
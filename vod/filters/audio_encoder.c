@@ -1,5 +1,6 @@
 #include "audio_encoder.h"
 #include "audio_filter.h"
+#include "../codec_context_pool.h"
 
 // constants
 #define AUDIO_ENCODER_BITS_PER_SAMPLE (16)
@@ -10,6 +11,7 @@ typedef struct
 	request_context_t* request_context;
 	vod_array_t* frames_array;
 	AVCodecContext *encoder;
+	codec_context_key_t key;
 } audio_encoder_state_t;
 
 // globals
@@ -102,6 +104,23 @@ audio_encoder_init(
 		return VOD_ALLOC_FAILED;
 	}
 
+	state->request_context = request_context;
+	state->frames_array = frames_array;
+
+	vod_memzero(&state->key, sizeof(state->key));
+	state->key.codec = encoder_codec;
+	state->key.timescale = params->timescale;
+	state->key.sample_rate = params->sample_rate;
+	state->key.channel_layout = params->channel_layout;
+	state->key.bitrate = params->bitrate;
+
+	state->encoder = codec_context_pool_checkout(request_context, &state->key);
+	if (state->encoder != NULL)
+	{
+		*result = state;
+		return VOD_OK;
+	}
+
 	// init the encoder
 	encoder = avcodec_alloc_context3(encoder_codec);
 	if (encoder == NULL)
@@ -137,9 +156,6 @@ audio_encoder_init(
 		return VOD_UNEXPECTED;
 	}
 
-	state->request_context = request_context;
-	state->frames_array = frames_array;
-
 	*result = state;
 
 	return VOD_OK;
@@ -156,8 +172,7 @@ audio_encoder_free(
 		return;
 	}
 	
-	avcodec_close(state->encoder);
-	av_free(state->encoder);
+	codec_context_pool_checkin(state->request_context, &state->key, &state->encoder);
 }
 
 size_t
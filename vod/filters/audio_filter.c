@@ -25,6 +25,9 @@
 #define BUFFERSINK_PARAM_CHANNEL_LAYOUTS ("channel_layouts")
 #define BUFFERSINK_PARAM_SAMPLE_RATES ("sample_rates")
 
+#define AUDIO_FILTER_CACHE_MAGIC (0x63666661)		// afc
+#define AUDIO_FILTER_CACHE_ALIGNMENT (sizeof(uint64_t))
+
 // uncomment to save intermediate streams to temporary files
 /*
 #define AUDIO_FILTER_DEBUG
@@ -46,6 +49,8 @@ typedef struct
 	audio_decoder_state_t decoder;
 	AVFilterContext *buffer_src;
 	bool_t buffersrc_flushed;
+	media_clip_source_t* source;
+	media_track_t* track;
 } audio_filter_source_t;
 
 typedef struct
@@ -56,6 +61,41 @@ typedef struct
 	vod_array_t frames_array;
 } audio_filter_sink_t;
 
+typedef struct {
+	u_char file_key[MEDIA_CLIP_KEY_SIZE];
+	uint64_t first_frame_time_offset;
+	uint64_t first_frame_offset;
+	uint64_t total_frames_size;
+	uint32_t frame_count;
+	uint32_t timescale;
+} audio_filter_cache_key_source_t;
+
+typedef struct {
+	uint64_t channel_layout;
+	uint32_t sample_rate;
+	uint32_t bitrate;
+} audio_filter_cache_key_output_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t frame_count;
+	uint32_t timescale;
+	uint32_t bitrate;
+	uint64_t channel_layout;
+	uint32_t sample_rate;
+	uint32_t extra_data_size;
+	uint16_t channels;
+	uint16_t bits_per_sample;
+	uint16_t packet_size;
+	uint8_t object_type_id;
+} audio_filter_cache_header_t;
+
+// Note: the layout of a cached filter output is -
+//		audio_filter_cache_header_t (padded to 8 bytes)
+//		extra data (padded to 8 bytes)
+//		input_frame_t frames[frame_count] - the offsets are relative to the start of the frames data
+//		frames data
+
 // constants
 static audio_filter_encoder_t libav_encoder = {
 	AUDIO_ENCODER_INPUT_SAMPLE_FORMAT,
@@ -260,8 +300,13 @@ typedef struct {
 	media_sequence_t* sequence;
 	media_track_t* output;
 
+	// cache key
+	u_char* graph_desc;
+	size_t graph_desc_len;
+
 	// processing state
 	audio_filter_source_t* cur_source;
+	audio_filter_source_t* read_source;
 } audio_filter_state_t;
 
 // globals
@@ -495,6 +540,9 @@ audio_filter_init_sources_and_graph_desc(audio_filter_init_context_t* state, med
 		cur_source = state->cur_source;
 		state->cur_source++;
 
+		cur_source->source = source;
+		cur_source->track = audio_track;
+
 		rc = audio_decoder_init(
 			&cur_source->decoder,
 			state->request_context,
@@ -665,6 +713,9 @@ audio_filter_alloc_state(
 
 	*init_context.graph_desc_pos = '\0';
 
+	state->graph_desc = init_context.graph_desc;
+	state->graph_desc_len = init_context.graph_desc_pos - init_context.graph_desc;
+
 	// init the encoder
 	if (output_codec_id == VOD_CODEC_ID_VOLUME_MAP)
 	{
@@ -793,6 +844,7 @@ audio_filter_alloc_state(
 	state->request_context = request_context;
 	state->sequence = sequence;
 	state->output = output_track;
+	state->read_source = state->sources;
 
 	*cache_buffer_count = init_context.cache_slot_id;
 	*result = state;
@@ -828,7 +880,10 @@ audio_filter_free_state(void* context)
 }
 
 static vod_status_t 
-audio_filter_update_track(audio_filter_state_t* state)
+audio_filter_update_track(
+	audio_filter_state_t* state,
+	vod_status_t(*update_media_info)(void* context, media_info_t* media_info),
+	void* context)
 {
 	media_track_t* output = state->output;
 	input_frame_t* cur_frame;
@@ -891,9 +946,7 @@ audio_filter_update_track(audio_filter_state_t* state)
 	// update media info
 	old_timescale = output->media_info.timescale;
 
-	rc = state->sink.encoder->update_media_info(
-		state->sink.encoder_context,
-		&output->media_info);
+	rc = update_media_info(context, &output->media_info);
 	if (rc != VOD_OK)
 	{
 		return rc;
@@ -1115,7 +1168,10 @@ audio_filter_process(void* context)
 					}
 				}
 
-				return audio_filter_update_track(state);
+				return audio_filter_update_track(
+					state,
+					state->sink.encoder->update_media_info,
+					state->sink.encoder_context);
 			}
 
 			if (rc != VOD_OK)
@@ -1142,6 +1198,235 @@ audio_filter_process(void* context)
 	}
 }
 
+vod_status_t
+audio_filter_read_frames(void* context)
+{
+	audio_filter_state_t* state = context;
+	vod_status_t rc;
+
+	for (; state->read_source < state->sources_end; state->read_source++)
+	{
+		rc = audio_decoder_read_frames(&state->read_source->decoder);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+	}
+
+	return VOD_OK;
+}
+
+vod_status_t
+audio_filter_get_cache_key(void* context, vod_str_t* result)
+{
+	audio_filter_cache_key_output_t* output;
+	audio_filter_cache_key_source_t* cur_key;
+	audio_filter_state_t* state = context;
+	audio_filter_source_t* sources_cur;
+	media_track_t* track;
+	u_char* p;
+
+	if (state->sink.encoder != &libav_encoder)
+	{
+		return VOD_NOT_FOUND;
+	}
+
+	p = vod_alloc(state->request_context->pool, state->graph_desc_len + sizeof(*output) +
+		sizeof(*cur_key) * (state->sources_end - state->sources));
+	if (p == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+			"audio_filter_get_cache_key: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	result->data = p;
+
+	p = vod_copy(p, state->graph_desc, state->graph_desc_len);
+
+	output = (void*)p;
+	vod_memzero(output, sizeof(*output));
+	output->channel_layout = state->output->media_info.u.audio.channel_layout;
+	output->sample_rate = state->output->media_info.u.audio.sample_rate;
+	output->bitrate = state->output->media_info.bitrate;
+	p += sizeof(*output);
+
+	for (sources_cur = state->sources; sources_cur < state->sources_end; sources_cur++)
+	{
+		track = sources_cur->track;
+
+		cur_key = (void*)p;
+		vod_memzero(cur_key, sizeof(*cur_key));
+		vod_memcpy(cur_key->file_key, sources_cur->source->file_key, sizeof(cur_key->file_key));
+		cur_key->first_frame_time_offset = track->first_frame_time_offset;
+		cur_key->first_frame_offset = track->frames.first_frame < track->frames.last_frame ?
+			track->frames.first_frame->offset : 0;
+		cur_key->total_frames_size = track->total_frames_size;
+		cur_key->frame_count = track->frame_count;
+		cur_key->timescale = track->media_info.timescale;
+		p += sizeof(*cur_key);
+	}
+
+	result->len = p - result->data;
+
+	return VOD_OK;
+}
+
+vod_status_t
+audio_filter_cache_write(void* context, vod_str_t* result)
+{
+	audio_filter_cache_header_t* header;
+	audio_filter_state_t* state = context;
+	media_track_t* output = state->output;
+	input_frame_t* cur_frame;
+	input_frame_t* last_frame;
+	input_frame_t* dest_frame;
+	uint64_t data_offset;
+	size_t size;
+	u_char* p;
+
+	size = vod_align(sizeof(*header), AUDIO_FILTER_CACHE_ALIGNMENT) +
+		vod_align(output->media_info.extra_data.len, AUDIO_FILTER_CACHE_ALIGNMENT) +
+		sizeof(input_frame_t) * output->frame_count +
+		output->total_frames_size;
+
+	p = vod_alloc(state->request_context->pool, size);
+	if (p == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+			"audio_filter_cache_write: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	result->data = p;
+	result->len = size;
+
+	header = (void*)p;
+	vod_memzero(header, sizeof(*header));
+	header->magic = AUDIO_FILTER_CACHE_MAGIC;
+	header->frame_count = output->frame_count;
+	header->timescale = output->media_info.timescale;
+	header->bitrate = output->media_info.bitrate;
+	header->channel_layout = output->media_info.u.audio.channel_layout;
+	header->sample_rate = output->media_info.u.audio.sample_rate;
+	header->extra_data_size = output->media_info.extra_data.len;
+	header->channels = output->media_info.u.audio.channels;
+	header->bits_per_sample = output->media_info.u.audio.bits_per_sample;
+	header->packet_size = output->media_info.u.audio.packet_size;
+	header->object_type_id = output->media_info.u.audio.object_type_id;
+	p += vod_align(sizeof(*header), AUDIO_FILTER_CACHE_ALIGNMENT);
+
+	vod_memcpy(p, output->media_info.extra_data.data, output->media_info.extra_data.len);
+	p += vod_align(output->media_info.extra_data.len, AUDIO_FILTER_CACHE_ALIGNMENT);
+
+	// Note: always a single part here
+	data_offset = 0;
+	dest_frame = (void*)p;
+	last_frame = output->frames.first_frame + output->frame_count;
+	for (cur_frame = output->frames.first_frame; cur_frame < last_frame; cur_frame++, dest_frame++)
+	{
+		*dest_frame = *cur_frame;
+		dest_frame->offset = data_offset;
+		data_offset += cur_frame->size;
+	}
+
+	p = (void*)dest_frame;
+	for (cur_frame = output->frames.first_frame; cur_frame < last_frame; cur_frame++)
+	{
+		p = vod_copy(p, (void*)(uintptr_t)cur_frame->offset, cur_frame->size);
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+audio_filter_cache_update_media_info(void* context, media_info_t* media_info)
+{
+	audio_filter_cache_header_t* header = context;
+
+	media_info->timescale = header->timescale;
+	media_info->bitrate = header->bitrate;
+
+	media_info->u.audio.object_type_id = header->object_type_id;
+	media_info->u.audio.channels = header->channels;
+	media_info->u.audio.channel_layout = header->channel_layout;
+	media_info->u.audio.bits_per_sample = header->bits_per_sample;
+	media_info->u.audio.packet_size = header->packet_size;
+	media_info->u.audio.sample_rate = header->sample_rate;
+
+	media_info->extra_data.data = (u_char*)header + vod_align(sizeof(*header), AUDIO_FILTER_CACHE_ALIGNMENT);
+	media_info->extra_data.len = header->extra_data_size;
+
+	return VOD_OK;
+}
+
+vod_status_t
+audio_filter_cache_read(void* context, vod_str_t* buffer)
+{
+	audio_filter_cache_header_t* header;
+	audio_filter_state_t* state = context;
+	input_frame_t* cur_frame;
+	input_frame_t* last_frame;
+	uint64_t data_size;
+	u_char* data;
+	u_char* end = buffer->data + buffer->len;
+	u_char* p = buffer->data;
+
+	if (buffer->len < vod_align(sizeof(*header), AUDIO_FILTER_CACHE_ALIGNMENT))
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"audio_filter_cache_read: buffer size %uz too small", buffer->len);
+		return VOD_BAD_DATA;
+	}
+
+	header = (void*)p;
+	if (header->magic != AUDIO_FILTER_CACHE_MAGIC)
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"audio_filter_cache_read: invalid magic 0x%uxD", header->magic);
+		return VOD_BAD_DATA;
+	}
+
+	p += vod_align(sizeof(*header), AUDIO_FILTER_CACHE_ALIGNMENT);
+
+	if ((size_t)(end - p) < vod_align(header->extra_data_size, AUDIO_FILTER_CACHE_ALIGNMENT) +
+		(uint64_t)header->frame_count * sizeof(input_frame_t))
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"audio_filter_cache_read: buffer size %uz too small to hold %uD frames", buffer->len, header->frame_count);
+		return VOD_BAD_DATA;
+	}
+
+	p += vod_align(header->extra_data_size, AUDIO_FILTER_CACHE_ALIGNMENT);
+
+	// Note: the frames are used in place, the buffer must remain valid until the end of the request
+	cur_frame = (void*)p;
+	last_frame = cur_frame + header->frame_count;
+	data = (void*)last_frame;
+
+	data_size = 0;
+	for (; cur_frame < last_frame; cur_frame++)
+	{
+		if (cur_frame->offset != data_size || cur_frame->size > (size_t)(end - data) - data_size)
+		{
+			vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+				"audio_filter_cache_read: invalid frame offset %uL size %uD", cur_frame->offset, cur_frame->size);
+			return VOD_BAD_DATA;
+		}
+
+		data_size += cur_frame->size;
+		cur_frame->offset = (uintptr_t)(data + cur_frame->offset);
+	}
+
+	state->sink.frames_array.elts = p;
+	state->sink.frames_array.nelts = header->frame_count;
+
+	return audio_filter_update_track(
+		state,
+		audio_filter_cache_update_media_info,
+		header);
+}
+
 #else
 
 // empty stubs in case libavfilter/libavcodec are missing
@@ -1205,4 +1490,28 @@ audio_filter_process(void* context)
 	return VOD_UNEXPECTED;
 }
 
+vod_status_t
+audio_filter_read_frames(void* context)
+{
+	return VOD_UNEXPECTED;
+}
+
+vod_status_t
+audio_filter_get_cache_key(void* context, vod_str_t* result)
+{
+	return VOD_NOT_FOUND;
+}
+
+vod_status_t
+audio_filter_cache_write(void* context, vod_str_t* result)
+{
+	return VOD_UNEXPECTED;
+}
+
+vod_status_t
+audio_filter_cache_read(void* context, vod_str_t* buffer)
+{
+	return VOD_UNEXPECTED;
+}
+
 #endif
@@ -29,6 +29,19 @@ void audio_filter_free_state(void* context);
 
 vod_status_t audio_filter_process(void* context);
 
+// Note: audio_filter_read_frames reads the input frames of all the sources to memory. once it returns VOD_OK,
+//		audio_filter_process does not perform any I/O and allocates only from the pool of the request context
+//		that was passed to audio_filter_alloc_state, so it can run on a different thread.
+vod_status_t audio_filter_read_frames(void* context);
+
+// Note: the cache key is built from the filter graph description, the source frames and the output params,
+//		the caller is expected to hash it. returns VOD_NOT_FOUND when the output should not be cached.
+vod_status_t audio_filter_get_cache_key(void* context, vod_str_t* result);
+
+vod_status_t audio_filter_cache_write(void* context, vod_str_t* result);
+
+vod_status_t audio_filter_cache_read(void* context, vod_str_t* buffer);
+
 vod_status_t audio_filter_alloc_memory_frame(
 	request_context_t* request_context,
 	vod_array_t* frames_array,
@@ -29,6 +29,10 @@ typedef struct {
 	void* audio_filter;
 	uint32_t max_frame_count;
 	uint32_t output_codec_id;
+	request_context_t* deferred_context;
+	filter_cache_t* cache;
+	vod_str_t cache_key;
+	bool_t deferred;
 } apply_filters_state_t;
 
 static void
@@ -476,6 +480,8 @@ filter_init_state(
 	media_set_t* media_set,
 	uint32_t max_frame_count,
 	uint32_t output_codec_id,
+	request_context_t* deferred_context,
+	filter_cache_t* cache,
 	void** context)
 {
 	apply_filters_state_t* state;
@@ -497,12 +503,67 @@ filter_init_state(
 	state->max_frame_count = max_frame_count;
 	state->output_codec_id = output_codec_id;
 	state->audio_filter = NULL;
+	state->deferred_context = deferred_context;
+	state->cache = cache;
+	state->deferred = FALSE;
 
 	*context = state;
 
 	return VOD_OK;
 }
 
+static bool_t
+filter_cache_fetch(apply_filters_state_t* state)
+{
+	vod_str_t buffer;
+	vod_status_t rc;
+
+	rc = audio_filter_get_cache_key(state->audio_filter, &state->cache_key);
+	if (rc != VOD_OK)
+	{
+		state->cache_key.len = 0;
+		return FALSE;
+	}
+
+	if (!state->cache->fetch(state->cache->context, &state->cache_key, &buffer))
+	{
+		return FALSE;
+	}
+
+	rc = audio_filter_cache_read(state->audio_filter, &buffer);
+	if (rc != VOD_OK)
+	{
+		// fall back to filtering the frames
+		vod_log_debug1(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+			"filter_cache_fetch: audio_filter_cache_read failed %i", rc);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+filter_cache_store(apply_filters_state_t* state)
+{
+	vod_str_t buffer;
+	vod_status_t rc;
+
+	if (state->cache_key.len == 0)
+	{
+		return;
+	}
+
+	rc = audio_filter_cache_write(state->audio_filter, &buffer);
+	if (rc != VOD_OK)
+	{
+		vod_log_debug1(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+			"filter_cache_store: audio_filter_cache_write failed %i", rc);
+		return;
+	}
+
+	state->cache->store(state->cache->context, &state->cache_key, &buffer);
+}
+
 vod_status_t
 filter_run_state_machine(void* context)
 {
@@ -514,11 +575,35 @@ filter_run_state_machine(void* context)
 	{
 		if (state->audio_filter != NULL)
 		{
-			// run the audio filter
-			rc = audio_filter_process(state->audio_filter);
-			if (rc != VOD_OK)
+			if (state->deferred_context == NULL)
+			{
+				// run the audio filter
+				rc = audio_filter_process(state->audio_filter);
+				if (rc != VOD_OK)
+				{
+					return rc;
+				}
+			}
+			else if (!state->deferred)
+			{
+				// read the input frames, the audio filter is executed by filter_run_deferred
+				rc = audio_filter_read_frames(state->audio_filter);
+				if (rc != VOD_OK)
+				{
+					return rc;
+				}
+
+				state->deferred = TRUE;
+				return VOD_OK;
+			}
+			else
+			{
+				state->deferred = FALSE;
+			}
+
+			if (state->cache != NULL)
 			{
-				return rc;
+				filter_cache_store(state);
 			}
 
 			audio_filter_free_state(state->audio_filter);
@@ -554,7 +639,7 @@ filter_run_state_machine(void* context)
 
 		// initialize the audio filter
 		rc = audio_filter_alloc_state(
-			state->request_context,
+			state->deferred_context != NULL ? state->deferred_context : state->request_context,
 			state->sequence,
 			state->cur_track->source_clip,
 			state->cur_track,
@@ -570,15 +655,39 @@ filter_run_state_machine(void* context)
 		if (state->audio_filter == NULL)
 		{
 			state->cur_track++;
+			continue;
 		}
-		else
+
+		if (state->cache != NULL && filter_cache_fetch(state))
 		{
-			// make sure the cache has enough slots
-			rc = read_cache_allocate_buffer_slots(state->read_cache_state, cache_buffer_count);
-			if (rc != VOD_OK)
-			{
-				return rc;
-			}
+			audio_filter_free_state(state->audio_filter);
+			state->audio_filter = NULL;
+
+			state->cur_track++;
+			continue;
+		}
+
+		// make sure the cache has enough slots
+		rc = read_cache_allocate_buffer_slots(state->read_cache_state, cache_buffer_count);
+		if (rc != VOD_OK)
+		{
+			return rc;
 		}
 	}
 }
+
+bool_t
+filter_has_deferred(void* context)
+{
+	apply_filters_state_t* state = context;
+
+	return state->deferred;
+}
+
+vod_status_t
+filter_run_deferred(void* context)
+{
+	apply_filters_state_t* state = context;
+
+	return audio_filter_process(state->audio_filter);
+}
@@ -5,6 +5,13 @@
 #include "../input/read_cache.h"
 #include "../media_set.h"
 
+// typedefs
+typedef struct {
+	bool_t (*fetch)(void* context, vod_str_t* key, vod_str_t* result);
+	void (*store)(void* context, vod_str_t* key, vod_str_t* buffer);
+	void* context;
+} filter_cache_t;
+
 // functions
 vod_status_t filter_init_filtered_clips(
 	request_context_t* request_context,
@@ -17,8 +24,19 @@ vod_status_t filter_init_state(
 	media_set_t* media_set, 
 	uint32_t max_frame_count,
 	uint32_t output_codec_id,
+	request_context_t* deferred_context,
+	filter_cache_t* cache,
 	void** context);
 
+// Note: when a deferred context is passed to filter_init_state, filter_run_state_machine only reads the
+//		input frames of each filtered track, and returns VOD_OK with filter_has_deferred returning TRUE.
+//		the caller then has to run filter_run_deferred (which can be executed on a different thread),
+//		and call filter_run_state_machine again. the audio processing allocates only from the pool
+//		of the deferred context.
 vod_status_t filter_run_state_machine(void* context);
 
+bool_t filter_has_deferred(void* context);
+
+vod_status_t filter_run_deferred(void* context);
+
 #endif // __FILTER_H__
@@ -6,6 +6,10 @@
 #include "../mp4/mp4_fragment.h"
 #include "../aes_defs.h"
 
+#if (VOD_HAVE_OPENSSL_EVP)
+#include "../aes_cipher_cache.h"
+#endif // VOD_HAVE_OPENSSL_EVP
+
 // adobe mux packet definitions
 #define TAG_TYPE_AUDIO (8)
 #define TAG_TYPE_VIDEO (9)
@@ -36,7 +40,6 @@
 #define TRUN_SIZE_SINGLE_VIDEO_FRAME (ATOM_HEADER_SIZE + sizeof(trun_atom_t) + sizeof(trun_video_frame_t))
 #define TRUN_SIZE_SINGLE_AUDIO_FRAME (ATOM_HEADER_SIZE + sizeof(trun_atom_t) + sizeof(trun_audio_frame_t))
 
-#define HDS_AES_KEY_SIZE (16)
 
 // macros
 #define write_be24(p, dw)			\
@@ -143,7 +146,6 @@ struct hds_muxer_state_s {
 	// encryption state
 	hds_encryption_type_t enc_type;
 #if (VOD_HAVE_OPENSSL_EVP)
-	u_char enc_key[HDS_AES_KEY_SIZE];
 	u_char enc_iv[AES_BLOCK_SIZE];
 	EVP_CIPHER_CTX* cipher;
 #endif //(VOD_HAVE_OPENSSL_EVP)
@@ -179,6 +181,7 @@ hds_muxer_encrypt_init(
 	hds_encryption_params_t* encryption_params)
 {
 	vod_pool_cleanup_t *cln;
+	vod_status_t rc;
 
 	cln = vod_pool_cleanup_add(state->request_context->pool, 0);
 	if (cln == NULL)
@@ -199,7 +202,12 @@ hds_muxer_encrypt_init(
 	cln->handler = (vod_pool_cleanup_pt)hds_muxer_encrypt_cleanup;
 	cln->data = state;
 
-	vod_memcpy(state->enc_key, encryption_params->key, sizeof(state->enc_key));
+	rc = aes_cipher_cache_init_ctx(state->request_context, state->cipher, EVP_aes_128_cbc(), encryption_params->key);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
 	vod_memcpy(state->enc_iv, encryption_params->iv, sizeof(state->enc_iv));
 
 	state->video_tag_type = TAG_TYPE_ENCRYPTED_VIDEO;
@@ -223,8 +231,8 @@ hds_muxer_encrypt_write_header(hds_muxer_state_t* state, u_char* p)
 static vod_status_t
 hds_muxer_encrypt_start_frame(hds_muxer_state_t* state)
 {
-	// reset the IV (it is ok to call EVP_EncryptInit_ex several times without cleanup)
-	if (1 != EVP_EncryptInit_ex(state->cipher, EVP_aes_128_cbc(), NULL, state->enc_key, state->enc_iv))
+	// reset the IV (the cipher and key set on init are retained)
+	if (1 != EVP_EncryptInit_ex(state->cipher, NULL, NULL, NULL, state->enc_iv))
 	{
 		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
 			"hds_muxer_encrypt_start_frame: EVP_EncryptInit_ex failed");
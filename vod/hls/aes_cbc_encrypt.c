@@ -1,4 +1,5 @@
 #include "aes_cbc_encrypt.h"
+#include "../aes_cipher_cache.h"
 #include "../buffer_pool.h"
 
 static void 
@@ -14,11 +15,13 @@ aes_cbc_encrypt_init(
 	write_callback_t callback,
 	void* callback_context,
 	buffer_pool_t* buffer_pool,
+	bool_t encrypt_in_place,
 	const u_char* key,
 	const u_char* iv)
 {
 	aes_cbc_encrypt_context_t* state;
 	vod_pool_cleanup_t *cln;
+	vod_status_t rc;
 
 	state = vod_alloc(request_context->pool, sizeof(*state));
 	if (state == NULL)
@@ -51,8 +54,16 @@ aes_cbc_encrypt_init(
 	state->callback_context = callback_context;
 	state->request_context = request_context;
 	state->buffer_pool = buffer_pool;
+	state->encrypt_in_place = encrypt_in_place;
+	state->partial_block_size = 0;
 	
-	if (1 != EVP_EncryptInit_ex(state->cipher, EVP_aes_128_cbc(), NULL, key, iv))
+	rc = aes_cipher_cache_init_ctx(request_context, state->cipher, EVP_aes_128_cbc(), key);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	if (1 != EVP_EncryptInit_ex(state->cipher, NULL, NULL, NULL, iv))
 	{
 		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
 			"aes_cbc_encrypt_init: EVP_EncryptInit_ex failed");
@@ -144,6 +155,28 @@ aes_cbc_encrypt_write(
 		return aes_cbc_encrypt_flush(state);
 	}
 
+	if (state->encrypt_in_place && state->partial_block_size == 0)
+	{
+		// no pending bytes in the cipher, the output is never larger than the input - encrypt in place
+		state->partial_block_size = size & (AES_BLOCK_SIZE - 1);
+
+		if (1 != EVP_EncryptUpdate(state->cipher, buffer, &out_size, buffer, size))
+		{
+			vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+				"aes_cbc_encrypt_write: EVP_EncryptUpdate failed (1)");
+			return VOD_UNEXPECTED;
+		}
+
+		if (out_size == 0)
+		{
+			return VOD_OK;
+		}
+
+		return state->callback(state->callback_context, buffer, out_size);
+	}
+
+	state->partial_block_size = (state->partial_block_size + size) & (AES_BLOCK_SIZE - 1);
+
 	required_size = aes_round_up_to_block(size);
 	buffer_size = required_size;
 
@@ -170,7 +203,7 @@ aes_cbc_encrypt_write(
 	if (1 != EVP_EncryptUpdate(state->cipher, encrypted_buffer, &out_size, buffer, size))
 	{
 		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
-			"aes_cbc_encrypt_write: EVP_EncryptUpdate failed");
+			"aes_cbc_encrypt_write: EVP_EncryptUpdate failed (2)");
 		return VOD_UNEXPECTED;
 	}
 
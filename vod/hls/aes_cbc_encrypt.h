@@ -11,16 +11,23 @@ typedef struct {
 	write_callback_t callback;
 	void* callback_context;
 	EVP_CIPHER_CTX* cipher;
+	bool_t encrypt_in_place;
+	uint32_t partial_block_size;
 	u_char last_block[AES_BLOCK_SIZE];
 } aes_cbc_encrypt_context_t;
 
 // functions
+
+// Note: encrypt_in_place should be set only when the buffers passed to aes_cbc_encrypt_write are owned by
+//		the caller and are not reused after the call (e.g. write_buffer_queue with reuse_buffers off).
+//		otherwise, the encrypted data is written to buffers allocated from buffer_pool
 vod_status_t aes_cbc_encrypt_init(
 	aes_cbc_encrypt_context_t** ctx,
 	request_context_t* request_context,
 	write_callback_t callback, 
 	void* callback_context, 
 	buffer_pool_t* buffer_pool,
+	bool_t encrypt_in_place,
 	const u_char* key,
 	const u_char* iv);
 
@@ -5,8 +5,8 @@
 #define get_context(ctx) ((frame_encrypt_filter_state_t*)ctx->context[THIS_FILTER])
 
 #include "aes_cbc_encrypt.h"
+#include "../aes_cipher_cache.h"
 
-#define FRAME_ENCRYPT_KEY_SIZE (16)
 #define CLEAR_LEAD_SIZE (16)
 #define ENCRYPTED_BUFFER_SIZE (256)
 
@@ -17,7 +17,6 @@ typedef struct
 	media_filter_start_frame_t start_frame;
 	media_filter_write_t write;
 	u_char iv[AES_BLOCK_SIZE];
-	u_char key[FRAME_ENCRYPT_KEY_SIZE];
 
 	// state
 	EVP_CIPHER_CTX* cipher;
@@ -35,8 +34,8 @@ frame_encrypt_start_frame(media_filter_context_t* context, output_frame_t* frame
 
 	if (state->max_encrypt_offset > CLEAR_LEAD_SIZE)
 	{
-		// reset the IV (it is ok to call EVP_EncryptInit_ex several times without cleanup)
-		if (1 != EVP_EncryptInit_ex(state->cipher, EVP_aes_128_cbc(), NULL, state->key, state->iv))
+		// reset the IV (the cipher and key set on init are retained)
+		if (1 != EVP_EncryptInit_ex(state->cipher, NULL, NULL, NULL, state->iv))
 		{
 			vod_log_error(VOD_LOG_ERR, context->request_context->log, 0,
 				"frame_encrypt_start_frame: EVP_EncryptInit_ex failed");
@@ -137,6 +136,7 @@ frame_encrypt_filter_init(
 	frame_encrypt_filter_state_t* state;
 	request_context_t* request_context = context->request_context;
 	vod_pool_cleanup_t *cln;
+	vod_status_t rc;
 
 	// allocate state
 	state = vod_alloc(request_context->pool, sizeof(*state));
@@ -167,8 +167,14 @@ frame_encrypt_filter_init(
 	cln->handler = (vod_pool_cleanup_pt)frame_encrypt_cleanup;
 	cln->data = state;
 
+	// Note: the key is set once here, only the IV is reset on each frame
+	rc = aes_cipher_cache_init_ctx(request_context, state->cipher, EVP_aes_128_cbc(), encryption_params->key);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
 	vod_memcpy(state->iv, encryption_params->iv, sizeof(state->iv));
-	vod_memcpy(state->key, encryption_params->key, sizeof(state->key));
 
 	// save required functions
 	state->start_frame = filter->start_frame;
@@ -502,7 +502,11 @@ hls_muxer_init_segment(
 		return rc;
 	}
 
-	if (simulation_supported)
+	if (!simulation_supported)
+	{
+		*response_size = 0;
+	}
+	else if (*response_size == 0)
 	{
 		rc = hls_muxer_simulate_get_segment_size(state, response_size);
 		if (rc != VOD_OK)
@@ -88,6 +88,8 @@ typedef struct {
 } hls_muxer_state_t;
 
 // functions
+// Note: response_size is an in/out param, in case the input value is nonzero, it is assumed to be the
+//		size of the segment (calculated by a previous request) and the size simulation is skipped
 vod_status_t hls_muxer_init_segment(
 	request_context_t* request_context,
 	hls_mpegts_muxer_conf_t* conf,
@@ -51,6 +51,8 @@ static const u_char m3u8_url_suffix[] = ".m3u8";
 static const u_char m3u8_map_prefix[] = "#EXT-X-MAP:URI=\"";
 static const u_char m3u8_map_suffix[] = ".mp4\"\n";
 static const char m3u8_clip_index[] = "-c%uD";
+static const char m3u8_image_header_format[] = "#EXTM3U\n#EXT-X-TARGETDURATION:%uL\n#EXT-X-VERSION:7\n#EXT-X-MEDIA-SEQUENCE:1\n#EXT-X-PLAYLIST-TYPE:VOD\n#EXT-X-IMAGES-ONLY\n";
+static const char m3u8_tiles_tag_format[] = "#EXT-X-TILES:RESOLUTION=%uDx%uD,LAYOUT=%uDx%uD,DURATION=";
 
 
 static const char encryption_key_tag_method[] = "#EXT-X-KEY:METHOD=";
@@ -337,6 +339,75 @@ m3u8_builder_build_iframe_playlist(
 	return VOD_OK;
 }
 
+vod_status_t
+m3u8_builder_build_image_playlist(
+	request_context_t* request_context,
+	thumb_tile_layout_t* layout,
+	vod_str_t* base_url,
+	vod_str_t* file_name_prefix,
+	vod_str_t* name_suffix,
+	vod_str_t* result)
+{
+	uint64_t duration;
+	uint64_t start;
+	size_t tile_length;
+	size_t result_size;
+	uint32_t index;
+	u_char* p;
+
+	tile_length = sizeof("#EXTINF:.000,\n") - 1 + vod_get_int_print_len(vod_div_ceil(layout->duration, 1000)) +
+		sizeof(m3u8_tiles_tag_format) + 4 * VOD_INT32_LEN + VOD_INT32_LEN + sizeof(".000\n") - 1 +
+		base_url->len + file_name_prefix->len + 1 + VOD_INT32_LEN + name_suffix->len + 1;
+
+	result_size =
+		sizeof(m3u8_image_header_format) + VOD_INT64_LEN +
+		tile_length * layout->count +
+		sizeof(m3u8_footer);
+
+	// allocate the buffer
+	result->data = vod_alloc(request_context->pool, result_size);
+	if (result->data == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"m3u8_builder_build_image_playlist: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	// fill out the buffer
+	p = vod_sprintf(result->data, m3u8_image_header_format, vod_div_ceil(layout->duration, 1000));
+
+	for (index = 0, start = 0; index < layout->count; index++, start += layout->duration)
+	{
+		duration = layout->total_duration - start;
+		if (duration > layout->duration)
+		{
+			duration = layout->duration;
+		}
+
+		p = m3u8_builder_append_extinf_tag(p, duration, 1000);
+
+		p = vod_sprintf(p, m3u8_tiles_tag_format, layout->width, layout->height, layout->columns, layout->rows);
+		p = m3u8_builder_format_double(p, layout->interval, 1000);
+		*p++ = '\n';
+
+		p = m3u8_builder_append_segment_name(p, base_url, file_name_prefix, index, name_suffix);
+		*p++ = '\n';
+	}
+
+	p = vod_copy(p, m3u8_footer, sizeof(m3u8_footer) - 1);
+	result->len = p - result->data;
+
+	if (result->len > result_size)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"m3u8_builder_build_image_playlist: result length %uz exceeded allocated length %uz",
+			result->len, result_size);
+		return VOD_UNEXPECTED;
+	}
+
+	return VOD_OK;
+}
+
 #if (NGX_HAVE_OPENSSL_EVP)
 static vod_status_t
 m3u8_builder_write_psshs(
@@ -4,6 +4,7 @@
 // includes
 #include "../media_format.h"
 #include "../segmenter.h"
+#include "../thumb/thumb_tile.h"
 #include "hls_muxer.h"
 
 // constants
@@ -61,6 +62,16 @@ vod_status_t m3u8_builder_build_iframe_playlist(
 	media_set_t* media_set,
 	vod_str_t* result);
 
+// Note: builds an image media playlist (images only, tiled), that can be referenced from a master
+//		playlist using an EXT-X-IMAGE-STREAM-INF tag. the tiles are named <prefix>-<index><name_suffix>
+vod_status_t m3u8_builder_build_image_playlist(
+	request_context_t* request_context,
+	thumb_tile_layout_t* layout,
+	vod_str_t* base_url,
+	vod_str_t* file_name_prefix,
+	vod_str_t* name_suffix,
+	vod_str_t* result);
+
 void m3u8_builder_init_config(
 	m3u8_config_t* conf,
 	uint32_t max_segment_duration,
@@ -925,13 +925,62 @@ mpegts_encoder_start_frame(media_filter_context_t* context, output_frame_t* fram
 	return VOD_OK;
 }
 
+static vod_status_t
+mpegts_encoder_write_packets(mpegts_encoder_state_t* state, const u_char* buffer, uint32_t packet_count)
+{
+	unsigned pid = state->stream_info.pid;
+	unsigned cc = state->cc;
+	uint32_t count;
+	u_char* packets_start;
+	u_char* packets_end;
+	u_char* p;
+
+	// Note: the packets are allocated in batches from the queue, and the continuity counter is
+	//		updated once at the end. the last packet is left as the current packet (full).
+	//		the payload is copied, rather than referenced from the read buffers, since a ts header has
+	//		to be inserted every 184 bytes - a chain of header / payload buffers would cost two chain
+	//		links per packet, and would prevent both sendfile and aes-128 encryption of the output
+	do
+	{
+		count = packet_count;
+		packets_start = write_buffer_queue_get_buffers(state->queue, MPEGTS_PACKET_SIZE, &count, state);
+		if (packets_start == NULL)
+		{
+			vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+				"mpegts_encoder_write_packets: write_buffer_queue_get_buffers failed");
+			return VOD_ALLOC_FAILED;
+		}
+
+		packets_end = packets_start + count * MPEGTS_PACKET_SIZE;
+		for (p = packets_start; p < packets_end; p += MPEGTS_PACKET_SIZE)
+		{
+			mpegts_write_packet_header(p, pid, cc);
+			cc++;
+
+			vod_memcpy(p + SIZEOF_MPEGTS_HEADER, buffer, MPEGTS_PACKET_USABLE_SIZE);
+			buffer += MPEGTS_PACKET_USABLE_SIZE;
+		}
+
+		packet_count -= count;
+	} while (packet_count > 0);
+
+	state->cc = cc;
+	state->last_queue_offset = state->queue->cur_offset - MPEGTS_PACKET_SIZE;
+	state->last_frame_pts = NO_TIMESTAMP;
+	state->cur_packet_start = packets_end - MPEGTS_PACKET_SIZE;
+	state->cur_packet_end = packets_end;
+	state->cur_pos = packets_end;
+
+	return VOD_OK;
+}
+
 static vod_status_t 
 mpegts_encoder_write(media_filter_context_t* context, const u_char* buffer, uint32_t size)
 {
 	mpegts_encoder_state_t* state = get_context(context);
 	uint32_t packet_used_size;
+	uint32_t packet_count;
 	uint32_t cur_size;
-	uint32_t initial_size;
 	u_char* cur_packet;
 	vod_status_t rc;
 	bool_t write_direct;
@@ -999,22 +1048,21 @@ mpegts_encoder_write(media_filter_context_t* context, const u_char* buffer, uint
 	size -= cur_size;
 
 	// write full packets
-	initial_size = size;
-
-	while (size >= MPEGTS_PACKET_USABLE_SIZE)
+	packet_count = size / MPEGTS_PACKET_USABLE_SIZE;
+	if (packet_count > 0)
 	{
-		rc = mpegts_encoder_init_packet(state, TRUE);
+		rc = mpegts_encoder_write_packets(state, buffer, packet_count);
 		if (rc != VOD_OK)
 		{
 			return rc;
 		}
 
-		vod_memcpy(state->cur_pos, buffer, MPEGTS_PACKET_USABLE_SIZE);
-		buffer += MPEGTS_PACKET_USABLE_SIZE;
-		size -= MPEGTS_PACKET_USABLE_SIZE;
-	}
+		cur_size = packet_count * MPEGTS_PACKET_USABLE_SIZE;
+		buffer += cur_size;
+		size -= cur_size;
 
-	state->flushed_frame_bytes += initial_size - size;
+		state->flushed_frame_bytes += cur_size;
+	}
 
 	// write any residue
 	if (size > 0)
@@ -6,9 +6,9 @@
 
 #include <openssl/evp.h>
 #include "aes_cbc_encrypt.h"
+#include "../aes_cipher_cache.h"
 #include "../avc_defs.h"
 
-#define SAMPLE_AES_KEY_SIZE (16)
 #define MAX_UNENCRYPTED_UNIT_SIZE (48)
 #define FIRST_ENCRYPTED_OFFSET (32)
 #define ENCRYPTED_BLOCK_PERIOD (10)			// 1 out of 10 blocks is encrypted
@@ -18,7 +18,6 @@ typedef struct
 	// fixed input data
 	media_filter_write_t write;
 	u_char iv[AES_BLOCK_SIZE];
-	u_char key[SAMPLE_AES_KEY_SIZE];
 	EVP_CIPHER_CTX* cipher;
 
 	// state
@@ -47,6 +46,7 @@ sample_aes_avc_filter_init(
 	sample_aes_avc_filter_state_t* state;
 	request_context_t* request_context = context->request_context;
 	vod_pool_cleanup_t *cln;
+	vod_status_t rc;
 
 	// allocate state
 	state = vod_alloc(request_context->pool, sizeof(*state));
@@ -77,9 +77,15 @@ sample_aes_avc_filter_init(
 	cln->handler = (vod_pool_cleanup_pt)sample_aes_avc_cleanup;
 	cln->data = state;
 
+	// Note: the key is set once here, only the IV is reset on each nal unit
+	rc = aes_cipher_cache_init_ctx(request_context, state->cipher, EVP_aes_128_cbc(), key);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
 	state->write = filter->write;
 	vod_memcpy(state->iv, iv, sizeof(state->iv));
-	vod_memcpy(state->key, key, sizeof(state->key));
 
 	state->encrypt = FALSE;
 
@@ -162,8 +168,8 @@ sample_aes_avc_start_nal_unit(
 	state->max_encrypt_offset = unit_size - AES_BLOCK_SIZE;
 	state->zero_run = 0;
 
-	// reset the IV (it is ok to call EVP_EncryptInit_ex several times without cleanup)
-	if (1 != EVP_EncryptInit_ex(state->cipher, EVP_aes_128_cbc(), NULL, state->key, state->iv))
+	// reset the IV (the cipher and key set on init are retained)
+	if (1 != EVP_EncryptInit_ex(state->cipher, NULL, NULL, NULL, state->iv))
 	{
 		vod_log_error(VOD_LOG_ERR, context->request_context->log, 0,
 			"sample_aes_avc_start_nal_unit: EVP_EncryptInit_ex failed");
@@ -0,0 +1,169 @@
+#include "metadata_index.h"
+
+// constants
+#define METADATA_INDEX_MAGIC (0x78646976)		// vidx
+#define METADATA_INDEX_VERSION (1)
+#define METADATA_INDEX_ALIGNMENT (sizeof(uint64_t))
+
+// typedefs
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format_id;
+	uint32_t part_count;
+	uint64_t source_size;
+	uint64_t source_mtime;
+} metadata_index_header_t;
+
+// Note: the layout of the file is -
+//		metadata_index_header_t
+//		uint64_t part_sizes[part_count]
+//		parts (each padded to 8 bytes)
+
+size_t
+metadata_index_get_size(vod_str_t* parts, uint32_t part_count)
+{
+	size_t result;
+	uint32_t i;
+
+	result = sizeof(metadata_index_header_t) + sizeof(uint64_t) * part_count;
+
+	for (i = 0; i < part_count; i++)
+	{
+		result += vod_align(parts[i].len, METADATA_INDEX_ALIGNMENT);
+	}
+
+	return result;
+}
+
+u_char*
+metadata_index_write(
+	u_char* p,
+	metadata_index_source_t* source,
+	uint32_t format_id,
+	vod_str_t* parts,
+	uint32_t part_count)
+{
+	metadata_index_header_t* header;
+	uint64_t* part_sizes;
+	size_t size;
+	uint32_t i;
+
+	header = (void*)p;
+	header->magic = METADATA_INDEX_MAGIC;
+	header->version = METADATA_INDEX_VERSION;
+	header->format_id = format_id;
+	header->part_count = part_count;
+	header->source_size = source->size;
+	header->source_mtime = source->mtime;
+	p += sizeof(*header);
+
+	part_sizes = (void*)p;
+	for (i = 0; i < part_count; i++)
+	{
+		part_sizes[i] = parts[i].len;
+	}
+	p += sizeof(part_sizes[0]) * part_count;
+
+	for (i = 0; i < part_count; i++)
+	{
+		p = vod_copy(p, parts[i].data, parts[i].len);
+
+		size = vod_align(parts[i].len, METADATA_INDEX_ALIGNMENT) - parts[i].len;
+		vod_memzero(p, size);
+		p += size;
+	}
+
+	return p;
+}
+
+vod_status_t
+metadata_index_read(
+	request_context_t* request_context,
+	vod_str_t* buffer,
+	metadata_index_source_t* source,
+	uint32_t* format_id,
+	vod_str_t** parts,
+	uint32_t* part_count)
+{
+	metadata_index_header_t* header;
+	uint64_t* part_sizes;
+	vod_str_t* cur_part;
+	uint32_t i;
+	u_char* end;
+	u_char* p;
+
+	p = buffer->data;
+	end = p + buffer->len;
+
+	if (buffer->len < sizeof(*header))
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"metadata_index_read: buffer size %uz smaller than header size", buffer->len);
+		return VOD_BAD_DATA;
+	}
+
+	header = (void*)p;
+	p += sizeof(*header);
+
+	if (header->magic != METADATA_INDEX_MAGIC ||
+		header->version != METADATA_INDEX_VERSION ||
+		header->part_count <= 0 ||
+		header->part_count > METADATA_INDEX_MAX_PARTS)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"metadata_index_read: invalid header, magic=%uD, version=%uD, part_count=%uD",
+			header->magic, header->version, header->part_count);
+		return VOD_BAD_DATA;
+	}
+
+	if (header->source_size != source->size ||
+		header->source_mtime != source->mtime)
+	{
+		vod_log_error(VOD_LOG_WARN, request_context->log, 0,
+			"metadata_index_read: the index is stale, source size=%uL/%uL, mtime=%uL/%uL",
+			header->source_size, source->size, header->source_mtime, source->mtime);
+		return VOD_BAD_DATA;
+	}
+
+	if ((size_t)(end - p) < sizeof(part_sizes[0]) * header->part_count)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"metadata_index_read: buffer too small to hold %uD part sizes", header->part_count);
+		return VOD_BAD_DATA;
+	}
+
+	part_sizes = (void*)p;
+	p += sizeof(part_sizes[0]) * header->part_count;
+
+	cur_part = vod_alloc(request_context->pool, sizeof(cur_part[0]) * header->part_count);
+	if (cur_part == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"metadata_index_read: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	*parts = cur_part;
+
+	for (i = 0; i < header->part_count; i++, cur_part++)
+	{
+		if ((size_t)(end - p) < part_sizes[i])
+		{
+			vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+				"metadata_index_read: size left %uz smaller than part size %uL",
+				(size_t)(end - p), part_sizes[i]);
+			return VOD_BAD_DATA;
+		}
+
+		cur_part->data = p;
+		cur_part->len = part_sizes[i];
+
+		p += vod_min(vod_align(part_sizes[i], METADATA_INDEX_ALIGNMENT), (size_t)(end - p));
+	}
+
+	*format_id = header->format_id;
+	*part_count = header->part_count;
+
+	return VOD_OK;
+}
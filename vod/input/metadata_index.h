@@ -0,0 +1,43 @@
+#ifndef __METADATA_INDEX_H__
+#define __METADATA_INDEX_H__
+
+// includes
+#include "../common.h"
+
+// Note: a metadata index (.vodidx) is a sidecar file that holds the metadata parts of a media file,
+//		as returned by the read_metadata function of its format (for mp4 - the ftyp atom and the moov
+//		atom, after decompression). it is generated offline, and allows loading the metadata of the
+//		file with a single small read, regardless of the position of the moov atom in the file.
+//		the index is saved in native byte order, and is bound to the size and modification time of
+//		the media file, so that it is ignored once the media file changes.
+
+// constants
+#define METADATA_INDEX_FILE_EXT ".vodidx"
+#define METADATA_INDEX_MAX_PARTS (8)
+
+// typedefs
+typedef struct {
+	uint64_t size;
+	uint64_t mtime;
+} metadata_index_source_t;
+
+// functions
+size_t metadata_index_get_size(vod_str_t* parts, uint32_t part_count);
+
+u_char* metadata_index_write(
+	u_char* p,
+	metadata_index_source_t* source,
+	uint32_t format_id,
+	vod_str_t* parts,
+	uint32_t part_count);
+
+// Note: the returned parts point to the buffer
+vod_status_t metadata_index_read(
+	request_context_t* request_context,
+	vod_str_t* buffer,
+	metadata_index_source_t* source,
+	uint32_t* format_id,
+	vod_str_t** parts,
+	uint32_t* part_count);
+
+#endif //__METADATA_INDEX_H__
@@ -9,6 +9,7 @@ read_cache_init(read_cache_state_t* state, request_context_t* request_context, s
 	state->request_context = request_context;
 	state->buffer_size = buffer_size;
 	state->buffer_count = 0;
+	state->read_ahead = 0;
 	state->reuse_buffers = TRUE;
 }
 
@@ -60,18 +61,29 @@ read_cache_get_from_cache(
 	uint64_t aligned_last_offset;
 	uint64_t offset = request->cur_offset;
 	size_t alignment;
+	bool_t sequential;
 	int cache_slot_id;
 
 	// check whether we already have the requested offset
+	sequential = FALSE;
 	for (cur_buffer = state->buffers; cur_buffer < state->buffers_end; cur_buffer++)
 	{
-		if (cur_buffer->source == source && 
-			offset >= cur_buffer->start_offset && offset < cur_buffer->end_offset)
+		if (cur_buffer->source != source)
+		{
+			continue;
+		}
+
+		if (offset >= cur_buffer->start_offset && offset < cur_buffer->end_offset)
 		{
 			*buffer = cur_buffer->buffer_pos + (offset - cur_buffer->start_offset);
 			*size = cur_buffer->end_offset - offset;
 			return TRUE;
 		}
+
+		if (offset == cur_buffer->end_offset && cur_buffer->end_offset > cur_buffer->start_offset)
+		{
+			sequential = TRUE;
+		}
 	}
 
 	// don't have the offset in cache
@@ -94,7 +106,15 @@ read_cache_get_from_cache(
 	offset &= ~alignment;
 
 	// calculate the read size
+	// Note: when the requested offset immediately follows a buffer that was already read, the frames
+	//		are consumed sequentially, read ahead to save the round trips of the subsequent reads.
+	//		the read size is later capped by source->last_offset, so data that is not required 
+	//		by any frame is never read
 	read_size = state->buffer_size;
+	if (sequential)
+	{
+		read_size *= state->read_ahead + 1;
+	}
 	target_buffer = &state->buffers[cache_slot_id % state->buffer_count];
 
 	// don't read anything that is already in the cache
@@ -134,6 +154,12 @@ read_cache_get_from_cache(
 	return FALSE;
 }
 
+void
+read_cache_set_read_ahead(read_cache_state_t* state, size_t buffer_count)
+{
+	state->read_ahead = buffer_count;
+}
+
 void
 read_cache_disable_buffer_reuse(read_cache_state_t* state)
 {
@@ -150,7 +176,16 @@ read_cache_get_read_buffer(
 	// return the target buffer pointer and size
 	result->source = target_buffer->source;
 	result->offset = target_buffer->start_offset;
-	result->buffer = state->reuse_buffers ? target_buffer->buffer_start : NULL;
+	if (state->reuse_buffers)
+	{
+		result->buffer = target_buffer->buffer_start;
+		result->buffer_end = target_buffer->buffer_end;
+	}
+	else
+	{
+		result->buffer = NULL;
+		result->buffer_end = NULL;
+	}
 	result->size = target_buffer->buffer_size;
 }
 
@@ -161,6 +196,7 @@ read_cache_read_completed(read_cache_state_t* state, vod_buf_t* buf)
 
 	// update the buffer size
 	target_buffer->buffer_start = buf->start;
+	target_buffer->buffer_end = buf->end;
 	target_buffer->buffer_pos = buf->pos;
 	target_buffer->buffer_size = buf->last - buf->pos;
 	target_buffer->end_offset = target_buffer->start_offset + target_buffer->buffer_size;
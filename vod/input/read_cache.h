@@ -9,6 +9,7 @@ struct media_clip_source_s;
 
 typedef struct {
 	u_char* buffer_start;
+	u_char* buffer_end;			// end of the allocated buffer, may be larger than the size of the data read
 	u_char* buffer_pos;
 	uint32_t buffer_size;		// size of data read
 	void* source;				// opaque context that indicates from where the buffer should be read
@@ -23,6 +24,7 @@ typedef struct {
 	cache_buffer_t* target_buffer;
 	size_t buffer_count;
 	size_t buffer_size;
+	size_t read_ahead;			// number of additional buffers to read when the access is sequential
 	bool_t reuse_buffers;
 } read_cache_state_t;
 
@@ -43,6 +45,7 @@ typedef struct {
 	struct media_clip_source_s* source;
 	uint64_t offset;
 	u_char* buffer;
+	u_char* buffer_end;
 	uint32_t size;
 } read_cache_get_read_buffer_t;
 
@@ -62,6 +65,10 @@ bool_t read_cache_get_from_cache(
 	u_char** buffer,
 	uint32_t* size);
 
+void read_cache_set_read_ahead(
+	read_cache_state_t* state,
+	size_t buffer_count);
+
 void read_cache_disable_buffer_reuse(
 	read_cache_state_t* state);
 
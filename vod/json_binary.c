@@ -0,0 +1,646 @@
+#include "json_binary.h"
+#include "read_stream.h"
+#include "write_stream.h"
+
+// Binary format (all integers are big endian) -
+//	header:
+//		magic			4 bytes, VOD_JSON_BINARY_MAGIC
+//		version			uint32
+//		object members	uint32, total number of key/value pairs in all objects
+//		array elements	uint32 x 7, total number of array elements per element type
+//	value:
+//		type			uint8 (VOD_JSON_xxx)
+//		payload			according to the type
+//	payloads:
+//		null			empty
+//		bool			uint8
+//		int				int64
+//		frac			int64 num, uint64 denom
+//		string			uint32 length, data
+//		array			uint8 element type, uint32 count, count x untyped payloads
+//		object			uint32 count, count x (uint32 key length, key data, value)
+
+// constants
+#define VOD_JSON_BINARY_VERSION (1)
+#define VOD_JSON_TYPE_COUNT (VOD_JSON_OBJECT + 1)
+#define VOD_JSON_BINARY_HEADER_SIZE (VOD_JSON_BINARY_MAGIC_SIZE + sizeof(uint32_t) * (2 + VOD_JSON_TYPE_COUNT))
+
+#define MAX_JSON_ELEMENTS (524288)
+#define MAX_RECURSION_DEPTH (32)
+
+// macros
+#define write_u8(p, b) *(p)++ = (u_char)(b)
+
+#define CHECK_READ_SIZE(state, size)							\
+	if ((size_t)((state)->end_pos - (state)->cur_pos) < (size))	\
+	{															\
+		vod_snprintf((state)->error, (state)->error_size, "unexpected end of data%Z");	\
+		return VOD_JSON_BAD_LENGTH;								\
+	}
+
+// typedefs
+typedef struct {
+	size_t size;
+	uint32_t object_members;
+	uint32_t array_elements[VOD_JSON_TYPE_COUNT];
+} vod_json_binary_size_state_t;
+
+typedef struct {
+	const u_char* cur_pos;
+	const u_char* end_pos;
+	u_char* elements_pos[VOD_JSON_TYPE_COUNT];
+	u_char* elements_end[VOD_JSON_TYPE_COUNT];
+	vod_json_key_value_t* members_pos;
+	vod_json_key_value_t* members_end;
+	vod_pool_t* pool;
+	int depth;
+	u_char* error;
+	size_t error_size;
+} vod_json_binary_decode_state_t;
+
+// globals
+static const size_t vod_json_element_size[VOD_JSON_TYPE_COUNT] = {
+	0,								// VOD_JSON_NULL
+	sizeof(bool_t),					// VOD_JSON_BOOL
+	sizeof(int64_t),				// VOD_JSON_INT
+	sizeof(vod_json_fraction_t),	// VOD_JSON_FRAC
+	sizeof(vod_str_t),				// VOD_JSON_STRING
+	sizeof(vod_json_array_t),		// VOD_JSON_ARRAY
+	sizeof(vod_json_object_t),		// VOD_JSON_OBJECT
+};
+
+// Note: the decoded elements are carved out of a single allocation, the types are ordered
+//		so that the larger / pointer aligned elements come first
+static const int vod_json_element_alloc_order[] = {
+	VOD_JSON_ARRAY,
+	VOD_JSON_OBJECT,
+	VOD_JSON_STRING,
+	VOD_JSON_FRAC,
+	VOD_JSON_INT,
+	VOD_JSON_BOOL,
+};
+
+// size calculation
+
+static void vod_json_binary_get_payload_size(vod_json_binary_size_state_t* state, int type, void* value);
+
+static void
+vod_json_binary_get_array_size(vod_json_binary_size_state_t* state, vod_json_array_t* array)
+{
+	vod_array_part_t* part;
+	size_t element_size;
+	u_char* cur;
+
+	state->size += sizeof(uint8_t) + sizeof(uint32_t);
+	state->array_elements[array->type] += array->count;
+
+	element_size = vod_json_element_size[array->type];
+	for (part = &array->part; part != NULL; part = part->next)
+	{
+		for (cur = part->first; cur < (u_char*)part->last; cur += element_size)
+		{
+			vod_json_binary_get_payload_size(state, array->type, cur);
+		}
+	}
+}
+
+static void
+vod_json_binary_get_object_size(vod_json_binary_size_state_t* state, vod_json_object_t* object)
+{
+	vod_json_key_value_t* cur;
+	vod_json_key_value_t* last;
+
+	state->size += sizeof(uint32_t);
+	state->object_members += object->nelts;
+
+	cur = object->elts;
+	last = cur + object->nelts;
+	for (; cur < last; cur++)
+	{
+		state->size += sizeof(uint32_t) + cur->key.len + sizeof(uint8_t);
+		vod_json_binary_get_payload_size(state, cur->value.type, &cur->value.v);
+	}
+}
+
+static void
+vod_json_binary_get_payload_size(vod_json_binary_size_state_t* state, int type, void* value)
+{
+	switch (type)
+	{
+	case VOD_JSON_BOOL:
+		state->size += sizeof(uint8_t);
+		break;
+
+	case VOD_JSON_INT:
+		state->size += sizeof(uint64_t);
+		break;
+
+	case VOD_JSON_FRAC:
+		state->size += 2 * sizeof(uint64_t);
+		break;
+
+	case VOD_JSON_STRING:
+		state->size += sizeof(uint32_t) + ((vod_str_t*)value)->len;
+		break;
+
+	case VOD_JSON_ARRAY:
+		vod_json_binary_get_array_size(state, value);
+		break;
+
+	case VOD_JSON_OBJECT:
+		vod_json_binary_get_object_size(state, value);
+		break;
+	}
+}
+
+// encoding
+
+static u_char* vod_json_binary_write_payload(u_char* p, int type, void* value);
+
+static u_char*
+vod_json_binary_write_array(u_char* p, vod_json_array_t* array)
+{
+	vod_array_part_t* part;
+	size_t element_size;
+	u_char* cur;
+
+	write_u8(p, array->type);
+	write_be32(p, (uint32_t)array->count);
+
+	element_size = vod_json_element_size[array->type];
+	for (part = &array->part; part != NULL; part = part->next)
+	{
+		for (cur = part->first; cur < (u_char*)part->last; cur += element_size)
+		{
+			p = vod_json_binary_write_payload(p, array->type, cur);
+		}
+	}
+
+	return p;
+}
+
+static u_char*
+vod_json_binary_write_object(u_char* p, vod_json_object_t* object)
+{
+	vod_json_key_value_t* cur;
+	vod_json_key_value_t* last;
+
+	write_be32(p, (uint32_t)object->nelts);
+
+	cur = object->elts;
+	last = cur + object->nelts;
+	for (; cur < last; cur++)
+	{
+		write_be32(p, (uint32_t)cur->key.len);
+		p = vod_copy(p, cur->key.data, cur->key.len);
+
+		write_u8(p, cur->value.type);
+		p = vod_json_binary_write_payload(p, cur->value.type, &cur->value.v);
+	}
+
+	return p;
+}
+
+static u_char*
+vod_json_binary_write_payload(u_char* p, int type, void* value)
+{
+	vod_json_fraction_t* frac;
+	vod_str_t* str;
+
+	switch (type)
+	{
+	case VOD_JSON_BOOL:
+		write_u8(p, *(bool_t*)value ? 1 : 0);
+		break;
+
+	case VOD_JSON_INT:
+		write_be64(p, (uint64_t)*(int64_t*)value);
+		break;
+
+	case VOD_JSON_FRAC:
+		frac = value;
+		write_be64(p, (uint64_t)frac->num);
+		write_be64(p, frac->denom);
+		break;
+
+	case VOD_JSON_STRING:
+		str = value;
+		write_be32(p, (uint32_t)str->len);
+		p = vod_copy(p, str->data, str->len);
+		break;
+
+	case VOD_JSON_ARRAY:
+		p = vod_json_binary_write_array(p, value);
+		break;
+
+	case VOD_JSON_OBJECT:
+		p = vod_json_binary_write_object(p, value);
+		break;
+	}
+
+	return p;
+}
+
+vod_json_status_t
+vod_json_binary_encode(
+	vod_pool_t* pool,
+	vod_json_value_t* value,
+	vod_str_t* result)
+{
+	vod_json_binary_size_state_t size_state;
+	u_char* end;
+	u_char* p;
+	int type;
+
+	// get the total size and element counts
+	vod_memzero(&size_state, sizeof(size_state));
+	size_state.size = VOD_JSON_BINARY_HEADER_SIZE + sizeof(uint8_t);
+	vod_json_binary_get_payload_size(&size_state, value->type, &value->v);
+
+	p = vod_alloc(pool, size_state.size);
+	if (p == NULL)
+	{
+		return VOD_JSON_ALLOC_FAILED;
+	}
+	result->data = p;
+	end = p + size_state.size;
+
+	// header
+	p = vod_copy(p, VOD_JSON_BINARY_MAGIC, VOD_JSON_BINARY_MAGIC_SIZE);
+	write_be32(p, VOD_JSON_BINARY_VERSION);
+	write_be32(p, size_state.object_members);
+	for (type = 0; type < VOD_JSON_TYPE_COUNT; type++)
+	{
+		write_be32(p, size_state.array_elements[type]);
+	}
+
+	// value
+	write_u8(p, value->type);
+	p = vod_json_binary_write_payload(p, value->type, &value->v);
+
+	result->len = p - result->data;
+	if (p != end)
+	{
+		return VOD_JSON_BAD_LENGTH;
+	}
+
+	return VOD_JSON_OK;
+}
+
+// decoding
+
+static vod_json_status_t vod_json_binary_read_payload(vod_json_binary_decode_state_t* state, int type, void* result);
+
+static vod_json_status_t
+vod_json_binary_read_type(vod_json_binary_decode_state_t* state, int* result)
+{
+	CHECK_READ_SIZE(state, sizeof(uint8_t));
+
+	*result = *state->cur_pos++;
+	if (*result >= VOD_JSON_TYPE_COUNT)
+	{
+		vod_snprintf(state->error, state->error_size, "invalid value type %d%Z", *result);
+		return VOD_JSON_BAD_TYPE;
+	}
+
+	return VOD_JSON_OK;
+}
+
+static vod_json_status_t
+vod_json_binary_read_str(vod_json_binary_decode_state_t* state, vod_str_t* result)
+{
+	uint32_t len;
+
+	CHECK_READ_SIZE(state, sizeof(uint32_t));
+	read_be32(state->cur_pos, len);
+
+	CHECK_READ_SIZE(state, len);
+	result->data = (u_char*)state->cur_pos;
+	result->len = len;
+	state->cur_pos += len;
+
+	return VOD_JSON_OK;
+}
+
+static vod_json_status_t
+vod_json_binary_read_array(vod_json_binary_decode_state_t* state, vod_json_array_t* result)
+{
+	vod_json_status_t rc;
+	size_t element_size;
+	uint32_t count;
+	u_char* cur;
+	u_char* last;
+	int type;
+
+	rc = vod_json_binary_read_type(state, &type);
+	if (rc != VOD_JSON_OK)
+	{
+		return rc;
+	}
+
+	CHECK_READ_SIZE(state, sizeof(uint32_t));
+	read_be32(state->cur_pos, count);
+
+	if (count == 0)
+	{
+		result->type = VOD_JSON_NULL;
+		result->count = 0;
+		result->part.first = NULL;
+		result->part.last = NULL;
+		result->part.count = 0;
+		result->part.next = NULL;
+		return VOD_JSON_OK;
+	}
+
+	element_size = vod_json_element_size[type];
+	if (element_size == 0 || count > MAX_JSON_ELEMENTS)
+	{
+		vod_snprintf(state->error, state->error_size, "invalid array type %d count %uD%Z", type, count);
+		return VOD_JSON_BAD_DATA;
+	}
+
+	cur = state->elements_pos[type];
+	if ((size_t)(state->elements_end[type] - cur) < count * element_size)
+	{
+		vod_snprintf(state->error, state->error_size, "array element count exceeds the header count%Z");
+		return VOD_JSON_BAD_DATA;
+	}
+	last = cur + count * element_size;
+	state->elements_pos[type] = last;
+
+	result->type = type;
+	result->count = count;
+	result->part.first = cur;
+	result->part.last = last;
+	result->part.count = count;
+	result->part.next = NULL;
+
+	for (; cur < last; cur += element_size)
+	{
+		rc = vod_json_binary_read_payload(state, type, cur);
+		if (rc != VOD_JSON_OK)
+		{
+			return rc;
+		}
+	}
+
+	return VOD_JSON_OK;
+}
+
+static vod_json_status_t
+vod_json_binary_read_object(vod_json_binary_decode_state_t* state, vod_json_object_t* result)
+{
+	vod_json_key_value_t* cur;
+	vod_json_key_value_t* last;
+	vod_json_status_t rc;
+	vod_uint_t hash;
+	uint32_t count;
+	u_char* p;
+	u_char* end;
+
+	CHECK_READ_SIZE(state, sizeof(uint32_t));
+	read_be32(state->cur_pos, count);
+
+	if (count > MAX_JSON_ELEMENTS || (size_t)(state->members_end - state->members_pos) < count)
+	{
+		vod_snprintf(state->error, state->error_size, "object member count %uD exceeds the header count%Z", count);
+		return VOD_JSON_BAD_DATA;
+	}
+
+	cur = state->members_pos;
+	last = cur + count;
+	state->members_pos = last;
+
+	result->elts = count > 0 ? cur : NULL;
+	result->nelts = count;
+	result->size = sizeof(*cur);
+	result->nalloc = count;
+	result->pool = state->pool;
+
+	for (; cur < last; cur++)
+	{
+		rc = vod_json_binary_read_str(state, &cur->key);
+		if (rc != VOD_JSON_OK)
+		{
+			return rc;
+		}
+
+		// Note: same hash as vod_json_parse_object_key, the key is expected to be lower case already
+		hash = 0;
+		p = cur->key.data;
+		end = p + cur->key.len;
+		for (; p < end; p++)
+		{
+			if (*p >= 'A' && *p <= 'Z')
+			{
+				vod_snprintf(state->error, state->error_size, "object key is not lower case%Z");
+				return VOD_JSON_BAD_DATA;
+			}
+
+			hash = vod_hash(hash, *p);
+
+			if (*p == '\\')
+			{
+				p++;		// the escaped char is not hashed
+			}
+		}
+		cur->key_hash = hash;
+
+		rc = vod_json_binary_read_type(state, &cur->value.type);
+		if (rc != VOD_JSON_OK)
+		{
+			return rc;
+		}
+
+		rc = vod_json_binary_read_payload(state, cur->value.type, &cur->value.v);
+		if (rc != VOD_JSON_OK)
+		{
+			return rc;
+		}
+	}
+
+	return VOD_JSON_OK;
+}
+
+static vod_json_status_t
+vod_json_binary_read_payload(vod_json_binary_decode_state_t* state, int type, void* result)
+{
+	vod_json_fraction_t* frac;
+	vod_json_status_t rc;
+	uint64_t value;
+
+	switch (type)
+	{
+	case VOD_JSON_BOOL:
+		CHECK_READ_SIZE(state, sizeof(uint8_t));
+		*(bool_t*)result = *state->cur_pos++ ? TRUE : FALSE;
+		break;
+
+	case VOD_JSON_INT:
+		CHECK_READ_SIZE(state, sizeof(uint64_t));
+		read_be64(state->cur_pos, value);
+		*(int64_t*)result = (int64_t)value;
+		break;
+
+	case VOD_JSON_FRAC:
+		CHECK_READ_SIZE(state, 2 * sizeof(uint64_t));
+		frac = result;
+		read_be64(state->cur_pos, value);
+		frac->num = (int64_t)value;
+		read_be64(state->cur_pos, frac->denom);
+		break;
+
+	case VOD_JSON_STRING:
+		return vod_json_binary_read_str(state, result);
+
+	case VOD_JSON_ARRAY:
+	case VOD_JSON_OBJECT:
+		if (state->depth >= MAX_RECURSION_DEPTH)
+		{
+			vod_snprintf(state->error, state->error_size, "max recursion depth exceeded%Z");
+			return VOD_JSON_BAD_DATA;
+		}
+		state->depth++;
+
+		if (type == VOD_JSON_ARRAY)
+		{
+			rc = vod_json_binary_read_array(state, result);
+		}
+		else
+		{
+			rc = vod_json_binary_read_object(state, result);
+		}
+
+		state->depth--;
+		return rc;
+	}
+
+	return VOD_JSON_OK;
+}
+
+vod_json_status_t
+vod_json_binary_decode(
+	vod_pool_t* pool,
+	vod_str_t* buffer,
+	vod_json_value_t* result,
+	u_char* error,
+	size_t error_size)
+{
+	vod_json_binary_decode_state_t state;
+	vod_json_status_t rc;
+	uint32_t counts[VOD_JSON_TYPE_COUNT];
+	uint32_t object_members;
+	uint32_t version;
+	size_t alloc_size;
+	size_t max_count;
+	u_char* p;
+	int type;
+	int i;
+
+	error[0] = '\0';
+
+	state.cur_pos = buffer->data;
+	state.end_pos = buffer->data + buffer->len;
+	state.pool = pool;
+	state.depth = 0;
+	state.error = error;
+	state.error_size = error_size;
+
+	// header
+	if (buffer->len < VOD_JSON_BINARY_HEADER_SIZE ||
+		!vod_json_binary_detect(buffer))
+	{
+		vod_snprintf(error, error_size, "invalid binary json header%Z");
+		rc = VOD_JSON_BAD_DATA;
+		goto error;
+	}
+	state.cur_pos += VOD_JSON_BINARY_MAGIC_SIZE;
+
+	read_be32(state.cur_pos, version);
+	if (version != VOD_JSON_BINARY_VERSION)
+	{
+		vod_snprintf(error, error_size, "unsupported binary json version %uD%Z", version);
+		rc = VOD_JSON_BAD_DATA;
+		goto error;
+	}
+
+	// Note: every element takes at least one byte, this bounds the allocation by the input size
+	max_count = buffer->len;
+
+	read_be32(state.cur_pos, object_members);
+	if (object_members > max_count)
+	{
+		vod_snprintf(error, error_size, "invalid object member count %uD%Z", object_members);
+		rc = VOD_JSON_BAD_DATA;
+		goto error;
+	}
+	alloc_size = object_members * sizeof(vod_json_key_value_t);
+
+	for (type = 0; type < VOD_JSON_TYPE_COUNT; type++)
+	{
+		read_be32(state.cur_pos, counts[type]);
+		if (counts[type] > max_count)
+		{
+			vod_snprintf(error, error_size, "invalid array element count %uD%Z", counts[type]);
+			rc = VOD_JSON_BAD_DATA;
+			goto error;
+		}
+
+		alloc_size += counts[type] * vod_json_element_size[type];
+	}
+
+	// allocate all elements at once
+	if (alloc_size > 0)
+	{
+		p = vod_alloc(pool, alloc_size);
+		if (p == NULL)
+		{
+			return VOD_JSON_ALLOC_FAILED;
+		}
+	}
+	else
+	{
+		p = NULL;
+	}
+
+	state.members_pos = (vod_json_key_value_t*)p;
+	state.members_end = state.members_pos + object_members;
+	p = (u_char*)state.members_end;
+
+	vod_memzero(state.elements_pos, sizeof(state.elements_pos));
+	vod_memzero(state.elements_end, sizeof(state.elements_end));
+	for (i = 0; i < (int)vod_array_entries(vod_json_element_alloc_order); i++)
+	{
+		type = vod_json_element_alloc_order[i];
+		state.elements_pos[type] = p;
+		p += counts[type] * vod_json_element_size[type];
+		state.elements_end[type] = p;
+	}
+
+	// value
+	rc = vod_json_binary_read_type(&state, &result->type);
+	if (rc != VOD_JSON_OK)
+	{
+		goto error;
+	}
+
+	rc = vod_json_binary_read_payload(&state, result->type, &result->v);
+	if (rc != VOD_JSON_OK)
+	{
+		goto error;
+	}
+
+	if (state.cur_pos != state.end_pos)
+	{
+		vod_snprintf(error, error_size, "trailing data after binary json value%Z");
+		rc = VOD_JSON_BAD_DATA;
+		goto error;
+	}
+
+	return VOD_JSON_OK;
+
+error:
+
+	error[error_size - 1] = '\0';			// make sure it's null terminated
+	return rc;
+}
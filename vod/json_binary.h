@@ -0,0 +1,37 @@
+#ifndef __JSON_BINARY_H__
+#define __JSON_BINARY_H__
+
+// includes
+#include "json_parser.h"
+
+// constants
+#define VOD_JSON_BINARY_MAGIC "\0vjb"
+#define VOD_JSON_BINARY_MAGIC_SIZE (sizeof(VOD_JSON_BINARY_MAGIC) - 1)
+
+// functions
+
+// Note: the binary form is a pre-tokenized serialization of a vod_json_value_t tree.
+//		strings are kept exactly as they appear in the json (not unescaped), object keys
+//		are lower cased, so decoding yields the same tree vod_json_parse would have produced.
+//		decoded strings point into the binary buffer, the buffer must outlive the result.
+
+static vod_inline bool_t
+vod_json_binary_detect(vod_str_t* buffer)
+{
+	return buffer->len >= VOD_JSON_BINARY_MAGIC_SIZE &&
+		vod_memcmp(buffer->data, VOD_JSON_BINARY_MAGIC, VOD_JSON_BINARY_MAGIC_SIZE) == 0;
+}
+
+vod_json_status_t vod_json_binary_encode(
+	vod_pool_t* pool,
+	vod_json_value_t* value,
+	vod_str_t* result);
+
+vod_json_status_t vod_json_binary_decode(
+	vod_pool_t* pool,
+	vod_str_t* buffer,
+	vod_json_value_t* result,
+	u_char* error,
+	size_t error_size);
+
+#endif // __JSON_BINARY_H__
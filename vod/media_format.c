@@ -2,6 +2,7 @@
 #include "avc_hevc_parser.h"
 #include "avc_parser.h"
 #include "hevc_parser.h"
+#include "segmenter.h"
 
 vod_status_t
 media_format_finalize_track(
@@ -163,3 +164,238 @@ media_format_finalize_track(
 
 	return VOD_OK;
 }
+
+// Note: the segment boundaries are calculated while parsing, in the timescale of the source track. the frames
+//		may not be available (when the boundaries are read from cache), the boundaries are rescaled the same way 
+//		as the frames - each boundary is the sum of the rescaled frame durations that precede it, and the end 
+//		of the last frame is adjusted to the clip end. a new array is allocated since the source boundaries
+//		may be shared by several tracks
+static vod_status_t
+media_format_update_segment_boundaries_timescale(
+	request_context_t* request_context,
+	media_track_t* track,
+	uint32_t cur_timescale,
+	uint32_t new_timescale)
+{
+	segment_boundaries_t* boundaries = track->segment_boundaries;
+	segment_boundaries_t* result;
+	uint64_t first_frame_dts = boundaries->first_frame_time_offset;
+	uint64_t last_frame_dts;
+	uint64_t clip_end_dts;
+	uint64_t scaled_start;
+	uint64_t scaled_end;
+	uint32_t i;
+
+	result = vod_alloc(request_context->pool, sizeof(*result) + sizeof(result->boundaries[0]) * boundaries->count);
+	if (result == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"media_format_update_segment_boundaries_timescale: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	*result = *boundaries;
+	result->boundaries = (void*)(result + 1);
+
+	scaled_start = rescale_time(first_frame_dts, cur_timescale, new_timescale);
+
+	for (i = 0; i < boundaries->count; i++)
+	{
+		result->boundaries[i] = rescale_time(first_frame_dts + boundaries->boundaries[i], cur_timescale, new_timescale) - 
+			scaled_start;
+	}
+
+	scaled_end = rescale_time(first_frame_dts + boundaries->total_duration, cur_timescale, new_timescale);
+	last_frame_dts = rescale_time(first_frame_dts + boundaries->total_duration - boundaries->last_frame_duration, 
+		cur_timescale, new_timescale);
+	if (boundaries->clip_to != UINT_MAX)
+	{
+		clip_end_dts = rescale_time(boundaries->clip_to, 1000, new_timescale);
+		if (clip_end_dts > last_frame_dts)
+		{
+			scaled_end = clip_end_dts;
+		}
+	}
+
+	result->total_duration = scaled_end - scaled_start;
+	result->first_frame_time_offset = scaled_start;
+	result->last_frame_duration = scaled_end - last_frame_dts;
+	result->clip_to = UINT_MAX;
+
+	track->segment_boundaries = result;
+
+	return VOD_OK;
+}
+
+vod_status_t
+media_format_update_track_timescale(
+	request_context_t* request_context,
+	media_track_t* track, 
+	uint32_t new_timescale, 
+	uint32_t pts_delay)
+{
+	frame_list_part_t* part;
+	input_frame_t* last_frame;
+	input_frame_t* cur_frame;
+	uint64_t next_scaled_dts;
+	uint64_t last_frame_dts;
+	uint64_t clip_start_dts;
+	uint64_t clip_end_pts;
+	uint64_t clip_end_dts;
+	uint64_t scaled_dts;
+	uint64_t scaled_pts;
+	uint64_t dts;
+	uint64_t pts;
+	uint32_t cur_timescale = track->media_info.timescale;
+	vod_status_t rc;
+
+	// frames
+	dts = track->first_frame_time_offset;
+	scaled_dts = rescale_time(dts, cur_timescale, new_timescale);
+	clip_start_dts = scaled_dts;
+
+	track->first_frame_time_offset = scaled_dts;
+	track->total_frames_duration = 0;
+
+	// initialize the first part
+	part = &track->frames;
+	cur_frame = part->first_frame;
+	last_frame = part->last_frame;
+	if (part->clip_to != UINT_MAX && cur_frame < last_frame)
+	{
+		clip_end_dts = rescale_time(part->clip_to, 1000, new_timescale);
+		if (track->media_info.media_type == MEDIA_TYPE_VIDEO)
+		{
+			clip_end_pts = clip_end_dts + rescale_time(track->media_info.u.video.initial_pts_delay,
+				cur_timescale, new_timescale);
+		}
+		else
+		{
+			clip_end_pts = ULLONG_MAX;
+		}
+	}
+	else
+	{
+		clip_end_dts = ULLONG_MAX;
+		clip_end_pts = ULLONG_MAX;
+	}
+
+	for (;; cur_frame++)
+	{
+		if (cur_frame >= last_frame)
+		{
+			if (clip_end_dts != ULLONG_MAX)
+			{
+				clip_end_dts = rescale_time(part->clip_to, 1000, new_timescale);
+				last_frame_dts = scaled_dts - cur_frame[-1].duration;
+
+				if (clip_end_dts > last_frame_dts)
+				{
+					cur_frame[-1].duration = clip_end_dts - last_frame_dts;
+					scaled_dts = clip_end_dts;
+				}
+				else
+				{
+					vod_log_error(VOD_LOG_WARN, request_context->log, 0,
+						"media_format_update_track_timescale: last frame dts %uL greater than clip end dts %uL",
+						last_frame_dts, clip_end_dts);
+				}
+
+				track->total_frames_duration += scaled_dts - clip_start_dts;
+
+				dts = 0;
+				scaled_dts = 0;
+				clip_start_dts = 0;
+			}
+
+			if (part->next == NULL)
+			{
+				break;
+			}
+
+			// initialize the next part
+			part = part->next;
+			cur_frame = part->first_frame;
+			last_frame = part->last_frame;
+			if (part->clip_to != UINT_MAX && cur_frame < last_frame)
+			{
+				clip_end_dts = rescale_time(part->clip_to, 1000, new_timescale);
+				if (track->media_info.media_type == MEDIA_TYPE_VIDEO)
+				{
+					clip_end_pts = clip_end_dts + rescale_time(track->media_info.u.video.initial_pts_delay,
+						cur_timescale, new_timescale);
+				}
+			}
+			else
+			{
+				clip_end_dts = ULLONG_MAX;
+				clip_end_pts = ULLONG_MAX;
+			}
+		}
+
+		// get the pts delay
+		pts = dts + cur_frame->pts_delay;
+		scaled_pts = rescale_time(pts, cur_timescale, new_timescale);
+		if (scaled_pts > clip_end_pts)
+		{
+			scaled_pts = vod_max(clip_end_pts, scaled_dts);
+		}
+		cur_frame->pts_delay = scaled_pts - scaled_dts + pts_delay;
+
+		// get the duration
+		dts += cur_frame->duration;
+		next_scaled_dts = rescale_time(dts, cur_timescale, new_timescale);
+		cur_frame->duration = next_scaled_dts - scaled_dts;
+		scaled_dts = next_scaled_dts;
+	}
+
+	track->total_frames_duration += scaled_dts - clip_start_dts;
+	track->clip_from_frame_offset = rescale_time(track->clip_from_frame_offset, cur_timescale, new_timescale);
+
+	// segment boundaries
+	if (track->segment_boundaries != NULL)
+	{
+		rc = media_format_update_segment_boundaries_timescale(
+			request_context, 
+			track, 
+			cur_timescale, 
+			new_timescale);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+	}
+
+	// media info
+	track->media_info.duration = rescale_time(track->media_info.duration, cur_timescale, new_timescale);
+	track->media_info.full_duration = rescale_time(track->media_info.full_duration, cur_timescale, new_timescale);
+	if (track->media_info.full_duration == 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"media_format_update_track_timescale: full duration is zero following rescale");
+		return VOD_BAD_DATA;
+	}
+
+	if (track->media_info.media_type == MEDIA_TYPE_VIDEO)
+	{
+		if (track->media_info.min_frame_duration != 0)
+		{
+			track->media_info.min_frame_duration =
+				rescale_time(track->media_info.min_frame_duration, cur_timescale, new_timescale);
+			if (track->media_info.min_frame_duration == 0)
+			{
+				vod_log_error(VOD_LOG_WARN, request_context->log, 0,
+					"media_format_update_track_timescale: min frame duration is zero following rescale");
+				track->media_info.min_frame_duration = 1;
+			}
+		}
+
+		track->media_info.u.video.initial_pts_delay =
+			rescale_time(track->media_info.u.video.initial_pts_delay, cur_timescale, new_timescale);
+	}
+
+	track->media_info.timescale = new_timescale;
+	track->media_info.frames_timescale = new_timescale;
+
+	return VOD_OK;
+}
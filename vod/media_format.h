@@ -81,6 +81,7 @@
 #define REQUEST_FLAG_LOOK_AHEAD_SEGMENTS			(0x10)
 #define REQUEST_FLAG_NO_DISCONTINUITY				(0x20)
 #define REQUEST_FLAG_FORCE_PLAYLIST_TYPE_VOD		(0x40)
+#define REQUEST_FLAG_CACHE_RESPONSE_SIZE			(0x80)
 
 // audio channels (aligned with ffmpeg AV_CH_XXX)
 #define VOD_CH_FRONT_LEFT				0x00000001
@@ -307,6 +308,7 @@ typedef struct media_track_s {
 	raw_atom_t raw_atoms[RTA_COUNT];		// mp4 only
 	void* source_clip;
 	media_encryption_t encryption_info;
+	struct segment_boundaries_s* segment_boundaries;	// optional, saves the need to iterate the frames in segmenter_get_segment_durations_accurate
 	struct media_track_s* next;
 } media_track_t;
 
@@ -405,4 +407,12 @@ vod_status_t media_format_finalize_track(
 	int parse_type,
 	media_info_t* media_info);
 
+// Note: rescales the frames and the media info of the track to the timescale of the output,
+//		pts_delay is added to the pts delay of all frames
+vod_status_t media_format_update_track_timescale(
+	request_context_t* request_context,
+	media_track_t* track,
+	uint32_t new_timescale,
+	uint32_t pts_delay);
+
 #endif //__MEDIA_FORMAT_H__
@@ -173,6 +173,7 @@ typedef struct {
 typedef struct {
 	int64_t segment_time;		// used in mss
 	segment_time_type_t segment_time_type;
+	uint64_t segment_time_span;	// used in thumb tiles, 0 = single frame
 	uint32_t segment_index;
 	uint32_t clip_index;
 	uint32_t pts_delay;
@@ -185,6 +186,7 @@ typedef struct {
 	uint32_t version;
 	uint32_t width;
 	uint32_t height;
+	bool_t thumb_fast_mode;
 } request_params_t;
 
 
@@ -2323,20 +2323,10 @@ media_set_parse_json(
 	int request_flags,
 	media_set_t* result)
 {
-	media_set_parse_context_t context;
-	get_clip_ranges_params_t get_ranges_params;
-	vod_json_value_t* params[MEDIA_SET_PARAM_COUNT];
-	vod_json_value_t override_json;
 	vod_json_value_t json;
 	vod_status_t rc;
-	uint64_t last_clip_end;
-	uint64_t segment_time;
-	int64_t current_time;
-	uint32_t margin;
-	bool_t parse_all_clips;
 	u_char error[128];
 
-	// parse the json and get the media set object values
 	rc = vod_json_parse(request_context->pool, string, &json, error, sizeof(error));
 	if (rc != VOD_JSON_OK)
 	{
@@ -2345,6 +2335,40 @@ media_set_parse_json(
 		return VOD_BAD_MAPPING;
 	}
 
+	return media_set_parse_json_value(
+		request_context,
+		&json,
+		override,
+		request_params,
+		segmenter,
+		source,
+		request_flags,
+		result);
+}
+
+vod_status_t
+media_set_parse_json_value(
+	request_context_t* request_context, 
+	vod_json_value_t* json, 
+	u_char* override,
+	request_params_t* request_params,
+	segmenter_conf_t* segmenter,
+	media_clip_source_t* source,
+	int request_flags,
+	media_set_t* result)
+{
+	media_set_parse_context_t context;
+	get_clip_ranges_params_t get_ranges_params;
+	vod_json_value_t* params[MEDIA_SET_PARAM_COUNT];
+	vod_json_value_t override_json;
+	vod_status_t rc;
+	uint64_t last_clip_end;
+	uint64_t segment_time;
+	int64_t current_time;
+	uint32_t margin;
+	bool_t parse_all_clips;
+	u_char error[128];
+
 	if (override != NULL)
 	{
 		rc = vod_json_parse(request_context->pool, override, &override_json, error, sizeof(error));
@@ -2355,24 +2379,25 @@ media_set_parse_json(
 			return VOD_BAD_REQUEST;
 		}
 
-		rc = vod_json_replace(&json, &override_json);
+		rc = vod_json_replace(json, &override_json);
 		if (rc != VOD_OK)
 		{
 			return rc;
 		}
 	}
 
-	if (json.type != VOD_JSON_OBJECT)
+	// get the media set object values
+	if (json->type != VOD_JSON_OBJECT)
 	{
 		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
-			"media_set_parse_json: invalid root element type %d expected object", json.type);
+			"media_set_parse_json: invalid root element type %d expected object", json->type);
 		return VOD_BAD_MAPPING;
 	}
 
 	vod_memzero(params, sizeof(params));
 
 	vod_json_get_object_values(
-		&json.v.obj,
+		&json->v.obj,
 		&media_set_hash,
 		params);
 
@@ -2811,10 +2836,16 @@ media_set_parse_json(
 						&result->timing,
 						segment_time);
 				}
-				return VOD_REDIRECT;
+
+				// Note: tiles are addressed by index, the absolute time is used only internally
+				if (request_params->segment_time_span == 0)
+				{
+					return VOD_REDIRECT;
+				}
 			}
 
 			get_ranges_params.time = request_params->segment_time;
+			get_ranges_params.time_span = request_params->segment_time_span;
 			rc = segmenter_get_start_end_ranges_gop(
 				&get_ranges_params,
 				&context.clip_ranges);
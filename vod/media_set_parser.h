@@ -34,6 +34,16 @@ vod_status_t media_set_parse_json(
 	int request_flags,
 	media_set_t* result);
 
+vod_status_t media_set_parse_json_value(
+	request_context_t* request_context,
+	vod_json_value_t* json,
+	u_char* override,
+	request_params_t* request_params,
+	struct segmenter_conf_s* segmenter,
+	media_clip_source_t* source,
+	int request_flags,
+	media_set_t* result);
+
 vod_status_t media_set_map_source(
 	request_context_t* request_context,
 	u_char* string,
@@ -8,20 +8,21 @@
 #include "../avc_parser.h"
 #include "../avc_defs.h"
 #include "../aes_defs.h"
+#include "../aes_cipher_cache.h"
 #include "../udrm.h"
 
 // constants
 #define MIN_ENCRYPTED_PACKET_SIZE (1 + AES_BLOCK_SIZE)		// minimum 1 byte for slice header
 #define ENCRYPTED_BLOCK_PERIOD (10)							// 1 out of 10 blocks is encrypted
+#define ENCRYPTED_PERIOD_SIZE (ENCRYPTED_BLOCK_PERIOD * AES_BLOCK_SIZE)
+#define MAX_PATTERN_BATCH_PERIODS (64)
 #define MAX_SLICE_HEADER_SIZE (128)
-#define ENCRYPT_KEY_SIZE (16)
 
 // typedefs
 typedef struct {
 	// fixed
 	request_context_t* request_context;
 	u_char iv[AES_BLOCK_SIZE];
-	u_char key[ENCRYPT_KEY_SIZE];
 
 	write_buffer_state_t write_buffer;
 	EVP_CIPHER_CTX* cipher;
@@ -121,7 +122,7 @@ mp4_cbcs_encrypt_free_cipher(mp4_cbcs_encrypt_state_t* state)
 }
 
 static vod_status_t
-mp4_cbcs_encrypt_init_cipher(mp4_cbcs_encrypt_state_t* state)
+mp4_cbcs_encrypt_init_cipher(mp4_cbcs_encrypt_state_t* state, const u_char* key)
 {
 	vod_pool_cleanup_t *cln;
 	request_context_t* request_context = state->request_context;
@@ -146,13 +147,14 @@ mp4_cbcs_encrypt_init_cipher(mp4_cbcs_encrypt_state_t* state)
 	cln->handler = (vod_pool_cleanup_pt)mp4_cbcs_encrypt_free_cipher;
 	cln->data = state;
 
-	return VOD_OK;
+	// Note: the key is set once here, mp4_cbcs_encrypt_reset_cipher only resets the IV
+	return aes_cipher_cache_init_ctx(request_context, state->cipher, EVP_aes_128_cbc(), key);
 }
 
 static vod_status_t
 mp4_cbcs_encrypt_reset_cipher(mp4_cbcs_encrypt_state_t* state)
 {
-	if (1 != EVP_EncryptInit_ex(state->cipher, EVP_aes_128_cbc(), NULL, state->key, state->iv))
+	if (1 != EVP_EncryptInit_ex(state->cipher, NULL, NULL, NULL, state->iv))
 	{
 		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
 			"mp4_cbcs_encrypt_reset_cipher: EVP_EncryptInit_ex failed");
@@ -200,6 +202,71 @@ mp4_cbcs_encrypt_write_encrypted(
 	return VOD_OK;
 }
 
+static vod_status_t
+mp4_cbcs_encrypt_write_pattern(
+	mp4_cbcs_encrypt_state_t* state,
+	u_char* buffer,
+	uint32_t* period_count)
+{
+	u_char blocks[MAX_PATTERN_BATCH_PERIODS * AES_BLOCK_SIZE];
+	u_char* cur_block;
+	u_char* output;
+	size_t output_size;
+	uint32_t count;
+	uint32_t i;
+	vod_status_t rc;
+	int written;
+
+	// Note: must be called on a block boundary, the buffer holds period_count whole periods, each
+	//		starting with an encrypted block. the encrypted blocks are gathered so that the whole
+	//		batch is chained with a single EVP call, and then scattered between the clear blocks
+	rc = write_buffer_get_bytes(
+		&state->write_buffer,
+		ENCRYPTED_PERIOD_SIZE,
+		&output_size,
+		&output);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	count = output_size / ENCRYPTED_PERIOD_SIZE;
+	count = vod_min(count, *period_count);
+	count = vod_min(count, MAX_PATTERN_BATCH_PERIODS);
+
+	cur_block = blocks;
+	for (i = 0; i < count; i++)
+	{
+		cur_block = vod_copy(cur_block, buffer + i * ENCRYPTED_PERIOD_SIZE, AES_BLOCK_SIZE);
+	}
+
+	if (1 != EVP_EncryptUpdate(
+		state->cipher,
+		blocks,
+		&written,
+		blocks,
+		count * AES_BLOCK_SIZE))
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"mp4_cbcs_encrypt_write_pattern: EVP_EncryptUpdate failed");
+		return VOD_UNEXPECTED;
+	}
+
+	cur_block = blocks;
+	for (i = 0; i < count; i++)
+	{
+		output = vod_copy(output, cur_block, AES_BLOCK_SIZE);
+		output = vod_copy(output, buffer + AES_BLOCK_SIZE, ENCRYPTED_PERIOD_SIZE - AES_BLOCK_SIZE);
+		cur_block += AES_BLOCK_SIZE;
+		buffer += ENCRYPTED_PERIOD_SIZE;
+	}
+
+	state->write_buffer.cur_pos = output;
+	*period_count = count;
+
+	return VOD_OK;
+}
+
 static vod_status_t
 mp4_cbcs_encrypt_flush(mp4_cbcs_encrypt_state_t* state)
 {
@@ -344,6 +411,7 @@ mp4_cbcs_encrypt_video_write_buffer(void* context, u_char* buffer, uint32_t size
 	u_char* output;
 	uint32_t slice_header_buf_size;
 	uint32_t slice_header_size;
+	uint32_t period_count;
 	uint32_t write_size;
 	uint32_t size_left;
 	int32_t cur_shift;
@@ -454,7 +522,7 @@ mp4_cbcs_encrypt_video_write_buffer(void* context, u_char* buffer, uint32_t size
 			if (!is_slice || stream_state->packet_size_left < MIN_ENCRYPTED_PACKET_SIZE)
 			{
 				stream_state->cur_state = STATE_PACKET_COPY;
-				continue;
+				goto packet_copy;
 			}
 
 			// TODO: parse in-stream SPS/PPS
@@ -505,7 +573,7 @@ mp4_cbcs_encrypt_video_write_buffer(void* context, u_char* buffer, uint32_t size
 
 				stream_state->packet_size_left -= slice_header_buf_size - 1;
 				stream_state->cur_state = STATE_PACKET_COPY;
-				break;
+				goto packet_copy;
 			}
 
 			// write the slice header
@@ -563,6 +631,29 @@ mp4_cbcs_encrypt_video_write_buffer(void* context, u_char* buffer, uint32_t size
 			// fall through
 
 		case STATE_PACKET_ENCRYPT:
+			if (stream_state->packet_size_left == stream_state->next_block_size_left &&
+				stream_state->next_block_size_left >= ENCRYPTED_PERIOD_SIZE + AES_BLOCK_SIZE)
+			{
+				// encrypt whole pattern periods in batches, keeping at least one block for the regular path below
+				size_left = buffer_end - cur_pos;
+				period_count = stream_state->next_block_size_left - AES_BLOCK_SIZE;
+				period_count = vod_min(period_count, size_left) / ENCRYPTED_PERIOD_SIZE;
+				if (period_count > 1)
+				{
+					rc = mp4_cbcs_encrypt_write_pattern(state, cur_pos, &period_count);
+					if (rc != VOD_OK)
+					{
+						return rc;
+					}
+
+					write_size = period_count * ENCRYPTED_PERIOD_SIZE;
+					cur_pos += write_size;
+					stream_state->packet_size_left -= write_size;
+					stream_state->next_block_size_left -= write_size;
+					continue;
+				}
+			}
+
 			if (stream_state->packet_size_left > 0 && 
 				stream_state->packet_size_left <= stream_state->next_block_size_left)
 			{
@@ -601,6 +692,9 @@ mp4_cbcs_encrypt_video_write_buffer(void* context, u_char* buffer, uint32_t size
 			// fall through
 
 		case STATE_PACKET_COPY:
+		packet_copy:
+			// Note: must be reached also when the packet ends at the end of the buffer, otherwise the
+			//		last frame is not completed and the output is not flushed
 			// write clear bytes
 			size_left = buffer_end - cur_pos;
 			write_size = stream_state->packet_size_left - stream_state->next_block_size_left;
@@ -874,7 +968,7 @@ mp4_cbcs_encrypt_get_writers(
 	// initialize the state
 	state->request_context = request_context;
 
-	rc = mp4_cbcs_encrypt_init_cipher(state);
+	rc = mp4_cbcs_encrypt_init_cipher(state, key);
 	if (rc != VOD_OK)
 	{
 		return rc;
@@ -888,7 +982,6 @@ mp4_cbcs_encrypt_get_writers(
 		FALSE);
 
 	vod_memcpy(state->iv, iv, sizeof(state->iv));
-	vod_memcpy(state->key, key, sizeof(state->key));
 	state->flush_left = 0;
 
 	for (i = 0; i < media_set->total_track_count; i++)
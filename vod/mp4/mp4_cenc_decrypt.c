@@ -112,7 +112,12 @@ mp4_cenc_decrypt_start_frame(void* ctx, input_frame_t* frame, read_cache_hint_t*
 		return VOD_BAD_DATA;
 	}
 
-	mp4_aes_ctr_set_iv(&state->cipher, state->auxiliary_info_pos);
+	rc = mp4_aes_ctr_set_iv(&state->cipher, state->auxiliary_info_pos);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
 	state->auxiliary_info_pos += MP4_AES_CTR_IV_SIZE;
 
 	if (!state->use_subsamples)
@@ -3395,6 +3395,7 @@ mp4_parser_parse_frames(
 		result_track->first_frame_time_offset = context.first_frame_time_offset;
 		result_track->clip_from_frame_offset = context.clip_from_frame_offset;
 		result_track->source_clip = NULL;
+		result_track->segment_boundaries = NULL;
 
 		// update the last offset of the source clip
 		if (context.frame_count > 0 && 
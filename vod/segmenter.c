@@ -2,6 +2,8 @@
 
 // constants
 #define MAX_SEGMENT_COUNT (100000)
+#define SEGMENT_BOUNDARIES_MAGIC (0x32696273)		// sbi2
+#define SEGMENT_BOUNDARIES_NONE (0xffffffff)
 
 // typedefs
 typedef struct {
@@ -25,6 +27,24 @@ typedef struct {
 	uint64_t aligned_time;
 } segmenter_get_segment_durations_context_t;
 
+typedef struct {
+	uint32_t magic;
+	uint32_t track_count;
+} segment_boundaries_header_t;
+
+typedef struct {
+	uint64_t total_duration;
+	uint64_t first_frame_time_offset;
+	uint32_t last_frame_duration;
+	uint32_t clip_to;
+	uint32_t media_type;
+	uint32_t count;
+} segment_boundaries_track_t;
+
+// Note: the layout of each track is -
+//		segment_boundaries_track_t
+//		uint64_t boundaries[count]
+
 typedef struct {
 	segmenter_conf_t* conf;
 	uint32_t segment_index;
@@ -450,7 +470,7 @@ segmenter_get_start_end_ranges_gop(
 		start = 0;
 	}
 
-	end = time - clip_time + conf->gop_look_ahead;
+	end = time - clip_time + params->time_span + conf->gop_look_ahead;
 	if (end > clip_duration)
 	{
 		end = clip_duration;
@@ -1791,6 +1811,117 @@ segmenter_boundary_iterator_skip(segmenter_boundary_iterator_context_t* context,
 	}
 }
 
+vod_status_t
+segmenter_get_segment_boundaries(
+	request_context_t* request_context,
+	segmenter_conf_t* conf,
+	media_track_t* track,
+	segment_boundaries_t* result)
+{
+	input_frame_t* last_frame;
+	input_frame_t* cur_frame;
+	vod_array_t boundaries;
+	uint64_t* cur_boundary;
+	uint64_t accum_duration = 0;
+	uint64_t segment_limit_millis;
+	uint64_t segment_limit;
+	uint32_t segment_index = 0;
+	uint32_t timescale;
+	bool_t align_to_key_frames;
+
+	if (vod_array_init(&boundaries, request_context->pool, 
+		conf->bootstrap_segments_count + track->media_info.duration_millis / conf->segment_duration + 1, 
+		sizeof(uint64_t)) != VOD_OK)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"segmenter_get_segment_boundaries: vod_array_init failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	timescale = track->media_info.timescale;
+
+	// Note: assuming a single frame list part
+	last_frame = track->frames.last_frame;
+	cur_frame = track->frames.first_frame;
+
+	align_to_key_frames = conf->align_to_key_frames && track->media_info.media_type == MEDIA_TYPE_VIDEO;
+
+	// bootstrap segments
+	if (conf->bootstrap_segments_count > 0)
+	{
+		segment_limit = rescale_time(conf->bootstrap_segments_end[0], 1000, timescale);
+
+		for (; cur_frame < last_frame; cur_frame++)
+		{
+			while (accum_duration >= segment_limit && (!align_to_key_frames || cur_frame->key_frame))
+			{
+				cur_boundary = vod_array_push(&boundaries);
+				if (cur_boundary == NULL)
+				{
+					vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+						"segmenter_get_segment_boundaries: vod_array_push failed (1)");
+					return VOD_ALLOC_FAILED;
+				}
+				*cur_boundary = accum_duration;
+
+				// move to the next segment
+				segment_index++;
+				if (segment_index >= conf->bootstrap_segments_count)
+				{
+					goto post_bootstrap;
+				}
+				segment_limit = rescale_time(conf->bootstrap_segments_end[segment_index], 1000, timescale);
+			}
+			accum_duration += cur_frame->duration;
+		}
+	}
+
+post_bootstrap:
+
+	// remaining segments
+	segment_limit_millis = conf->bootstrap_segments_total_duration + conf->segment_duration;
+	segment_limit = rescale_time(segment_limit_millis, 1000, timescale);
+
+	for (; cur_frame < last_frame; cur_frame++)
+	{
+		while (accum_duration >= segment_limit && boundaries.nelts < MAX_SEGMENT_COUNT &&
+			(!align_to_key_frames || cur_frame->key_frame))
+		{
+			cur_boundary = vod_array_push(&boundaries);
+			if (cur_boundary == NULL)
+			{
+				vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+					"segmenter_get_segment_boundaries: vod_array_push failed (2)");
+				return VOD_ALLOC_FAILED;
+			}
+			*cur_boundary = accum_duration;
+
+			// move to the next segment
+			segment_limit_millis += conf->segment_duration;
+			segment_limit = rescale_time(segment_limit_millis, 1000, timescale);
+		}
+		accum_duration += cur_frame->duration;
+	}
+
+	result->boundaries = boundaries.elts;
+	result->count = boundaries.nelts;
+	result->total_duration = accum_duration;
+
+	result->first_frame_time_offset = track->first_frame_time_offset;
+	if (track->frames.first_frame < last_frame)
+	{
+		result->last_frame_duration = last_frame[-1].duration;
+		result->clip_to = track->frames.clip_to;
+	}
+	else
+	{
+		result->last_frame_duration = 0;
+		result->clip_to = UINT_MAX;
+	}
+
+	return VOD_OK;
+}
+
 vod_status_t 
 segmenter_get_segment_durations_accurate(
 	request_context_t* request_context,
@@ -1801,6 +1932,8 @@ segmenter_get_segment_durations_accurate(
 	segment_durations_t* result)
 {
 	segmenter_boundary_iterator_context_t boundary_iterator;
+	segment_boundaries_t boundaries_buffer;
+	segment_boundaries_t* boundaries;
 	media_track_t* cur_track;
 	media_track_t* last_track;
 	media_track_t* main_track = NULL;
@@ -1808,17 +1941,16 @@ segmenter_get_segment_durations_accurate(
 	segment_duration_item_t* cur_item;
 	media_sequence_t* sequences_end;
 	media_sequence_t* cur_sequence;
-	input_frame_t* last_frame;
-	input_frame_t* cur_frame;
 	uint64_t total_duration;
 	uint32_t segment_index = 0;
-	uint64_t accum_duration = 0;
+	uint32_t boundary_count;
+	uint64_t accum_duration;
 	uint64_t segment_start = 0;
 	uint64_t segment_limit_millis;
 	uint64_t segment_limit;
 	uint64_t cur_duration;
 	uint32_t duration_millis;
-	bool_t align_to_key_frames;
+	vod_status_t rc;
 
 	if (media_set->timing.durations != NULL)
 	{
@@ -1942,85 +2074,47 @@ segmenter_get_segment_durations_accurate(
 	result->timescale = main_track->media_info.timescale;
 	result->discontinuities = 0;
 
-	// Note: assuming a single frame list part
-	cur_item = result->items - 1;
-	last_frame = main_track->frames.last_frame;
-	cur_frame = main_track->frames.first_frame;
-
-	align_to_key_frames = conf->align_to_key_frames && main_track->media_info.media_type == MEDIA_TYPE_VIDEO;
-
-	// bootstrap segments
-	if (conf->bootstrap_segments_count > 0)
+	// get the segment boundaries
+	boundaries = main_track->segment_boundaries;
+	if (boundaries == NULL)
 	{
-		segment_limit = rescale_time(conf->bootstrap_segments_end[0], 1000, result->timescale);
-
-		for (; cur_frame < last_frame; cur_frame++)
+		rc = segmenter_get_segment_boundaries(request_context, conf, main_track, &boundaries_buffer);
+		if (rc != VOD_OK)
 		{
-			while (accum_duration >= segment_limit && segment_index + 1 < result->segment_count &&
-				(!align_to_key_frames || cur_frame->key_frame))
-			{
-				// get the current duration and update to array
-				cur_duration = accum_duration - segment_start;
-				if (cur_item < result->items || cur_duration != cur_item->duration)
-				{
-					cur_item++;
-					cur_item->repeat_count = 0;
-					cur_item->segment_index = segment_index;
-					cur_item->time = segment_start;
-					cur_item->duration = cur_duration;
-					cur_item->discontinuity = FALSE;
-				}
-				cur_item->repeat_count++;
-
-				// move to the next segment
-				segment_start = accum_duration;
-				segment_index++;
-				if (segment_index >= conf->bootstrap_segments_count)
-				{
-					goto post_bootstrap;
-				}
-				segment_limit = rescale_time(conf->bootstrap_segments_end[segment_index], 1000, result->timescale);
-			}
-			accum_duration += cur_frame->duration;
+			return rc;
 		}
-	}
 
-post_bootstrap:
+		boundaries = &boundaries_buffer;
+	}
 
-	// remaining segments
-	segment_limit_millis = conf->bootstrap_segments_total_duration + conf->segment_duration;
-	segment_limit = rescale_time(segment_limit_millis, 1000, result->timescale);
+	cur_item = result->items - 1;
 
-	for (; cur_frame < last_frame; cur_frame++)
+	boundary_count = result->segment_count > 0 ? vod_min(boundaries->count, result->segment_count - 1) : 0;
+	for (; segment_index < boundary_count; segment_index++)
 	{
-		while (accum_duration >= segment_limit && segment_index + 1 < result->segment_count &&
-			(!align_to_key_frames || cur_frame->key_frame))
+		// get the current duration and update to array
+		accum_duration = boundaries->boundaries[segment_index];
+		cur_duration = accum_duration - segment_start;
+		if (cur_item < result->items || cur_duration != cur_item->duration)
 		{
-			// get the current duration and update to array
-			cur_duration = accum_duration - segment_start;
-			if (cur_item < result->items || cur_duration != cur_item->duration)
-			{
-				cur_item++;
-				cur_item->repeat_count = 0;
-				cur_item->segment_index = segment_index;
-				cur_item->time = segment_start;
-				cur_item->duration = cur_duration;
-				cur_item->discontinuity = FALSE;
-			}
-			cur_item->repeat_count++;
-
-			// move to the next segment
-			segment_index++;
-			segment_start = accum_duration;
-			segment_limit_millis += conf->segment_duration;
-			segment_limit = rescale_time(segment_limit_millis, 1000, result->timescale);
+			cur_item++;
+			cur_item->repeat_count = 0;
+			cur_item->segment_index = segment_index;
+			cur_item->time = segment_start;
+			cur_item->duration = cur_duration;
+			cur_item->discontinuity = FALSE;
 		}
-		accum_duration += cur_frame->duration;
+		cur_item->repeat_count++;
+
+		// move to the next segment
+		segment_start = accum_duration;
 	}
+
+	accum_duration = boundaries->total_duration;
 	
 	// in case the main video track is shorter than the audio track, add the estimated durations of the remaining audio-only segments
 	if (main_track->media_info.duration_millis < duration_millis && 
-		!align_to_key_frames)
+		!(conf->align_to_key_frames && main_track->media_info.media_type == MEDIA_TYPE_VIDEO))
 	{
 		segmenter_boundary_iterator_init(&boundary_iterator, conf, result->segment_count);
 		segmenter_boundary_iterator_skip(&boundary_iterator, segment_index);
@@ -2092,3 +2186,148 @@ post_bootstrap:
 
 	return VOD_OK;
 }
+
+size_t
+segmenter_segment_boundaries_get_size(media_track_array_t* track_array)
+{
+	media_track_t* cur_track;
+	size_t result;
+
+	result = sizeof(segment_boundaries_header_t);
+
+	for (cur_track = track_array->first_track; cur_track < track_array->last_track; cur_track++)
+	{
+		result += sizeof(segment_boundaries_track_t);
+		if (cur_track->segment_boundaries != NULL)
+		{
+			result += sizeof(uint64_t) * cur_track->segment_boundaries->count;
+		}
+	}
+
+	return result;
+}
+
+u_char*
+segmenter_segment_boundaries_write(u_char* p, media_track_array_t* track_array)
+{
+	segment_boundaries_header_t* header;
+	segment_boundaries_track_t* track;
+	segment_boundaries_t* boundaries;
+	media_track_t* cur_track;
+
+	header = (void*)p;
+	header->magic = SEGMENT_BOUNDARIES_MAGIC;
+	header->track_count = track_array->last_track - track_array->first_track;
+	p += sizeof(*header);
+
+	for (cur_track = track_array->first_track; cur_track < track_array->last_track; cur_track++)
+	{
+		boundaries = cur_track->segment_boundaries;
+
+		track = (void*)p;
+		track->media_type = cur_track->media_info.media_type;
+		if (boundaries == NULL)
+		{
+			track->total_duration = 0;
+			track->first_frame_time_offset = 0;
+			track->last_frame_duration = 0;
+			track->clip_to = UINT_MAX;
+			track->count = SEGMENT_BOUNDARIES_NONE;
+			p += sizeof(*track);
+			continue;
+		}
+
+		track->total_duration = boundaries->total_duration;
+		track->first_frame_time_offset = boundaries->first_frame_time_offset;
+		track->last_frame_duration = boundaries->last_frame_duration;
+		track->clip_to = boundaries->clip_to;
+		track->count = boundaries->count;
+		p += sizeof(*track);
+
+		p = vod_copy(p, boundaries->boundaries, sizeof(uint64_t) * boundaries->count);
+	}
+
+	return p;
+}
+
+vod_status_t
+segmenter_segment_boundaries_read(
+	request_context_t* request_context,
+	vod_str_t* buffer,
+	media_track_array_t* track_array)
+{
+	segment_boundaries_header_t* header;
+	segment_boundaries_track_t* track;
+	segment_boundaries_t* boundaries;
+	media_track_t* cur_track;
+	u_char* end;
+	u_char* p;
+
+	p = buffer->data;
+	end = p + buffer->len;
+
+	header = (void*)p;
+	if (buffer->len < sizeof(*header) ||
+		header->magic != SEGMENT_BOUNDARIES_MAGIC ||
+		header->track_count != (uint32_t)(track_array->last_track - track_array->first_track))
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"segmenter_segment_boundaries_read: invalid header");
+		return VOD_BAD_DATA;
+	}
+	p += sizeof(*header);
+
+	boundaries = vod_alloc(request_context->pool, sizeof(boundaries[0]) * header->track_count);
+	if (boundaries == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"segmenter_segment_boundaries_read: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	for (cur_track = track_array->first_track; cur_track < track_array->last_track; cur_track++, boundaries++)
+	{
+		track = (void*)p;
+		if ((size_t)(end - p) < sizeof(*track) ||
+			track->media_type != cur_track->media_info.media_type)
+		{
+			vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+				"segmenter_segment_boundaries_read: invalid track %uD", 
+				(uint32_t)(cur_track - track_array->first_track));
+			return VOD_BAD_DATA;
+		}
+		p += sizeof(*track);
+
+		if (track->count == SEGMENT_BOUNDARIES_NONE)
+		{
+			continue;
+		}
+
+		if ((size_t)(end - p) < sizeof(uint64_t) * track->count)
+		{
+			vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+				"segmenter_segment_boundaries_read: invalid track %uD", 
+				(uint32_t)(cur_track - track_array->first_track));
+			return VOD_BAD_DATA;
+		}
+
+		switch (track->media_type)
+		{
+		case MEDIA_TYPE_VIDEO:
+		case MEDIA_TYPE_AUDIO:
+			// Note: the buffer must remain valid while the track is used
+			boundaries->boundaries = (void*)p;
+			boundaries->count = track->count;
+			boundaries->total_duration = track->total_duration;
+			boundaries->first_frame_time_offset = track->first_frame_time_offset;
+			boundaries->last_frame_duration = track->last_frame_duration;
+			boundaries->clip_to = track->clip_to;
+			cur_track->segment_boundaries = boundaries;
+			break;
+		}
+
+		p += sizeof(uint64_t) * track->count;
+	}
+
+	return VOD_OK;
+}
@@ -40,6 +40,22 @@ typedef struct {
 	uint64_t duration;
 } segment_durations_t;
 
+// Note: the segment boundaries of a track are the cumulative frame durations at which 
+//		segmenter_get_segment_durations_accurate splits the track, they depend only on the 
+//		frames of the track and on the segmenter conf, so they can be saved and reused 
+//		instead of iterating the frames on every manifest request. the boundaries are calculated in the
+//		timescale of the source track, media_format_update_track_timescale rescales them with the frames
+typedef struct segment_boundaries_s {
+	uint64_t* boundaries;		// in track timescale
+	uint32_t count;
+	uint64_t total_duration;	// in track timescale
+
+	// the frames info that is required in order to rescale the boundaries
+	uint64_t first_frame_time_offset;
+	uint32_t last_frame_duration;
+	uint32_t clip_to;			// UINT_MAX when the frames are not clipped
+} segment_boundaries_t;
+
 typedef struct {
 	request_context_t* request_context;
 	segmenter_conf_t* conf;
@@ -57,6 +73,7 @@ typedef struct {
 
 	// gop
 	uint64_t time;
+	uint64_t time_span;
 } get_clip_ranges_params_t;
 
 typedef struct {
@@ -151,6 +168,12 @@ vod_status_t segmenter_get_segment_durations_estimate(
 	uint32_t media_type,
 	segment_durations_t* result);
 
+vod_status_t segmenter_get_segment_boundaries(
+	request_context_t* request_context,
+	segmenter_conf_t* conf,
+	media_track_t* track,
+	segment_boundaries_t* result);
+
 vod_status_t segmenter_get_segment_durations_accurate(
 	request_context_t* request_context,
 	segmenter_conf_t* conf,
@@ -185,4 +208,14 @@ vod_status_t segmenter_get_start_end_ranges_discontinuity(
 	get_clip_ranges_params_t* params,
 	get_clip_ranges_result_t* result);
 
+// segment boundaries serialization
+size_t segmenter_segment_boundaries_get_size(media_track_array_t* track_array);
+
+u_char* segmenter_segment_boundaries_write(u_char* p, media_track_array_t* track_array);
+
+vod_status_t segmenter_segment_boundaries_read(
+	request_context_t* request_context,
+	vod_str_t* buffer,
+	media_track_array_t* track_array);
+
 #endif // __SEGMENTER_H__
@@ -1,4 +1,5 @@
 #include "thumb_grabber.h"
+#include "../codec_context_pool.h"
 #include "../media_set.h"
 
 #include <libavcodec/avcodec.h>
@@ -9,16 +10,53 @@
 #endif // VOD_HAVE_LIB_SW_SCALE
 
 // typedefs
+typedef struct
+{
+	input_frame_t* frame;
+	u_char* buffer;
+} thumb_grabber_frame_t;
+
+#if (VOD_HAVE_LIB_SW_SCALE)
+typedef struct
+{
+	uint64_t pts;
+	uint32_t index;
+	uint32_t key_frame_index;
+} thumb_grabber_tile_candidate_t;
+
+typedef struct
+{
+	uint64_t pts;
+	uint32_t index;
+	uint32_t key_frame_index;
+	uint32_t x;
+	uint32_t y;
+	bool_t drawn;
+} thumb_grabber_tile_position_t;
+
+typedef struct
+{
+	frame_list_part_t* part;
+	input_frame_t* frame;
+	u_char* buffer;
+	uint64_t dts;
+	bool_t gap;			// the previous frame in decode order was not read
+} thumb_grabber_tile_frame_t;
+#endif // VOD_HAVE_LIB_SW_SCALE
+
 typedef struct
 {
 	// fixed
 	request_context_t* request_context;
 	write_callback_t write_callback;
 	void* write_context;
+	bool_t deferred;
 
 	// libavcodec
 	AVCodecContext *decoder;
 	AVCodecContext *encoder;
+	codec_context_key_t decoder_key;
+	codec_context_key_t encoder_key;
 	AVFrame *decoded_frame;
 	AVPacket *output_packet;
 	void* resize_buffer;
@@ -38,6 +76,23 @@ typedef struct
 	u_char* frame_buffer;
 	uint32_t cur_frame_pos;
 
+	// deferred mode - the frames that were read, decoded by thumb_grabber_encode
+	thumb_grabber_frame_t* frames;
+	uint32_t frame_count;
+
+#if (VOD_HAVE_LIB_SW_SCALE)
+	// tile mode
+	thumb_grabber_tile_position_t* positions;
+	uint32_t position_count;
+	thumb_grabber_tile_frame_t* tile_frames;
+	thumb_grabber_tile_frame_t* tile_frames_end;
+	thumb_grabber_tile_frame_t* cur_tile_frame;
+	uint32_t cell_width;
+	uint32_t cell_height;
+	AVFrame* tile_frame;
+	struct SwsContext* sws_ctx;
+#endif // VOD_HAVE_LIB_SW_SCALE
+
 } thumb_grabber_state_t;
 
 typedef struct {
@@ -107,21 +162,86 @@ thumb_grabber_free_state(void* context)
 		av_freep(state->resize_buffer);
 	}
 	av_frame_free(&state->decoded_frame);
-	avcodec_close(state->encoder);
-	av_free(state->encoder);
-	avcodec_close(state->decoder);
-	av_free(state->decoder);
+#if (VOD_HAVE_LIB_SW_SCALE)
+	av_frame_free(&state->tile_frame);
+	sws_freeContext(state->sws_ctx);
+#endif // VOD_HAVE_LIB_SW_SCALE
+	codec_context_pool_checkin(state->request_context, &state->encoder_key, &state->encoder);
+	codec_context_pool_checkin(state->request_context, &state->decoder_key, &state->decoder);
+}
+
+// Note: returns the maximum lowres factor (log2 of the downscale) that keeps the decoded frame
+//		at least as large as the output, decoding at a lower resolution skips most of the idct work
+static uint32_t
+thumb_grabber_get_lowres(
+	const AVCodec* codec,
+	media_info_t* media_info,
+	uint32_t output_width,
+	uint32_t output_height)
+{
+	uint32_t lowres;
+
+	for (lowres = 0; lowres < codec->max_lowres; lowres++)
+	{
+		if ((media_info->u.video.width >> (lowres + 1)) < output_width ||
+			(media_info->u.video.height >> (lowres + 1)) < output_height)
+		{
+			break;
+		}
+	}
+
+	return lowres;
+}
+
+static void
+thumb_grabber_set_discard(AVCodecContext* decoder, thumb_grabber_mode_t mode)
+{
+	// Note: set on every request, since pooled contexts are shared between the modes
+	if (mode == THUMB_GRABBER_MODE_FAST)
+	{
+		decoder->skip_frame = AVDISCARD_NONKEY;
+		decoder->skip_loop_filter = AVDISCARD_ALL;
+	}
+	else
+	{
+		decoder->skip_frame = AVDISCARD_DEFAULT;
+		decoder->skip_loop_filter = AVDISCARD_DEFAULT;
+	}
 }
 
 static vod_status_t
 thumb_grabber_init_decoder(
 	request_context_t* request_context,
 	media_info_t* media_info,
+	thumb_grabber_mode_t mode,
+	uint32_t output_width,
+	uint32_t output_height,
+	codec_context_key_t* key,
 	AVCodecContext** result)
 {
 	AVCodecContext *decoder;
+	vod_status_t rc;
 	int avrc;
 
+	vod_memzero(key, sizeof(*key));
+	key->codec = decoder_codec[media_info->codec_id];
+	key->codec_tag = media_info->format;
+	key->timescale = media_info->frames_timescale;
+	key->width = media_info->u.video.width;
+	key->height = media_info->u.video.height;
+	key->extra_data = media_info->extra_data;
+	if (mode == THUMB_GRABBER_MODE_FAST)
+	{
+		key->lowres = thumb_grabber_get_lowres(key->codec, media_info, output_width, output_height);
+	}
+
+	*result = codec_context_pool_checkout(request_context, key);
+	if (*result != NULL)
+	{
+		thumb_grabber_set_discard(*result, mode);
+		return VOD_OK;
+	}
+
 	decoder = avcodec_alloc_context3(decoder_codec[media_info->codec_id]);
 	if (decoder == NULL) 
 	{
@@ -136,10 +256,16 @@ thumb_grabber_init_decoder(
 	decoder->time_base.num = 1;
 	decoder->time_base.den = media_info->frames_timescale;
 	decoder->pkt_timebase = decoder->time_base;
-	decoder->extradata = media_info->extra_data.data;
-	decoder->extradata_size = media_info->extra_data.len;
 	decoder->width = media_info->u.video.width;
 	decoder->height = media_info->u.video.height;
+	decoder->lowres = key->lowres;
+	thumb_grabber_set_discard(decoder, mode);
+
+	rc = codec_context_pool_set_extra_data(request_context, decoder, &media_info->extra_data);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
 
 	avrc = avcodec_open2(decoder, decoder_codec[media_info->codec_id], NULL);
 	if (avrc < 0)
@@ -157,11 +283,23 @@ thumb_grabber_init_encoder(
 	request_context_t* request_context,
 	uint32_t width,
 	uint32_t height,
+	codec_context_key_t* key,
 	AVCodecContext** result)
 {
 	AVCodecContext *encoder;
 	int avrc;
 
+	vod_memzero(key, sizeof(*key));
+	key->codec = encoder_codec;
+	key->width = width;
+	key->height = height;
+
+	*result = codec_context_pool_checkout(request_context, key);
+	if (*result != NULL)
+	{
+		return VOD_OK;
+	}
+
 	encoder = avcodec_alloc_context3(encoder_codec);
 	if (encoder == NULL)
 	{
@@ -314,51 +452,24 @@ thumb_grabber_truncate_frames(
 	return VOD_OK;
 }
 
-vod_status_t
-thumb_grabber_init_state(
+static vod_status_t
+thumb_grabber_alloc_state(
 	request_context_t* request_context,
-	media_track_t* track, 
-	request_params_t* request_params,
-	bool_t accurate,
-	write_callback_t write_callback,
-	void* write_context,
-	void** result)
+	media_track_t* track,
+	thumb_grabber_mode_t mode,
+	uint32_t output_width,
+	uint32_t output_height,
+	thumb_grabber_state_t** result)
 {
 	thumb_grabber_state_t* state;
 	vod_pool_cleanup_t *cln;
 	vod_status_t rc;
-	uint32_t output_width;
-	uint32_t output_height;
-	uint32_t frame_index;
-
-	if (decoder_codec[track->media_info.codec_id] == NULL)
-	{
-		vod_log_debug1(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
-			"thumb_grabber_init_state: no decoder was initialized for codec %uD", track->media_info.codec_id);
-		return VOD_BAD_REQUEST;
-	}
-
-	if (track->media_info.u.video.width <= 0 || track->media_info.u.video.height <= 0)
-	{
-		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
-			"thumb_grabber_init_state: input width/height is zero");
-		return VOD_BAD_DATA;
-	}
-
-	rc = thumb_grabber_truncate_frames(request_context, track, request_params->segment_time, accurate, &frame_index);
-	if (rc != VOD_OK)
-	{
-		return rc;
-	}
-
-	vod_log_debug1(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
-		"thumb_grabber_init_state: frame index is %uD", frame_index);
 
 	state = vod_alloc(request_context->pool, sizeof(*state));
 	if (state == NULL)
 	{
 		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
-			"thumb_grabber_init_state: vod_alloc failed (1)");
+			"thumb_grabber_alloc_state: vod_alloc failed");
 		return VOD_ALLOC_FAILED;
 	}
 
@@ -368,25 +479,118 @@ thumb_grabber_init_state(
 	state->decoder = NULL;
 	state->encoder = NULL;
 	state->output_packet = NULL;
+#if (VOD_HAVE_LIB_SW_SCALE)
+	state->tile_frame = NULL;
+	state->sws_ctx = NULL;
+	state->positions = NULL;
+#endif // VOD_HAVE_LIB_SW_SCALE
+	state->request_context = request_context;
 
 	// add to the cleanup pool
 	cln = vod_pool_cleanup_add(request_context->pool, 0);
 	if (cln == NULL)
 	{
 		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
-			"thumb_grabber_init_state: vod_pool_cleanup_add failed");
+			"thumb_grabber_alloc_state: vod_pool_cleanup_add failed");
 		return VOD_ALLOC_FAILED;
 	}
 
 	cln->handler = thumb_grabber_free_state;
 	cln->data = state;
 
-	rc = thumb_grabber_init_decoder(request_context, &track->media_info, &state->decoder);
+	rc = thumb_grabber_init_decoder(
+		request_context,
+		&track->media_info,
+		mode,
+		output_width,
+		output_height,
+		&state->decoder_key,
+		&state->decoder);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	state->decoded_frame = av_frame_alloc();
+	if (state->decoded_frame == NULL)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"thumb_grabber_alloc_state: av_frame_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	state->output_packet = av_packet_alloc();
+	if (state->output_packet == NULL)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"thumb_grabber_alloc_state: av_packet_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	*result = state;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_validate_track(
+	request_context_t* request_context,
+	media_track_t* track)
+{
+	if (decoder_codec[track->media_info.codec_id] == NULL)
+	{
+		vod_log_debug1(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"thumb_grabber_validate_track: no decoder was initialized for codec %uD", track->media_info.codec_id);
+		return VOD_BAD_REQUEST;
+	}
+
+	if (track->media_info.u.video.width <= 0 || track->media_info.u.video.height <= 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"thumb_grabber_validate_track: input width/height is zero");
+		return VOD_BAD_DATA;
+	}
+
+	return VOD_OK;
+}
+
+vod_status_t
+thumb_grabber_init_state(
+	request_context_t* request_context,
+	media_track_t* track, 
+	request_params_t* request_params,
+	thumb_grabber_mode_t mode,
+	bool_t deferred,
+	write_callback_t write_callback,
+	void* write_context,
+	void** result)
+{
+	thumb_grabber_state_t* state;
+	vod_status_t rc;
+	uint32_t output_width;
+	uint32_t output_height;
+	uint32_t frame_index;
+
+	rc = thumb_grabber_validate_track(request_context, track);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	rc = thumb_grabber_truncate_frames(
+		request_context,
+		track,
+		request_params->segment_time,
+		mode == THUMB_GRABBER_MODE_ACCURATE,
+		&frame_index);
 	if (rc != VOD_OK)
 	{
 		return rc;
 	}
 
+	vod_log_debug1(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+		"thumb_grabber_init_state: frame index is %uD", frame_index);
+
 	if (request_params->width != 0)
 	{
 		output_width = request_params->width;
@@ -420,33 +624,39 @@ thumb_grabber_init_state(
 		return VOD_BAD_REQUEST;
 	}
 
+	rc = thumb_grabber_alloc_state(request_context, track, mode, output_width, output_height, &state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
 	// TODO: postpone the initialization of the encoder to after a frame is decoded
 
-	rc = thumb_grabber_init_encoder(request_context, output_width, output_height, &state->encoder);
+	rc = thumb_grabber_init_encoder(request_context, output_width, output_height, &state->encoder_key, &state->encoder);
 	if (rc != VOD_OK)
 	{
 		return rc;
 	}
 
-	state->decoded_frame = av_frame_alloc();
-	if (state->decoded_frame == NULL)
+	if (deferred)
 	{
-		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
-			"thumb_grabber_init_state: av_frame_alloc failed");
-		return VOD_ALLOC_FAILED;
+		state->frames = vod_alloc(request_context->pool, sizeof(state->frames[0]) * (frame_index + 1));
+		if (state->frames == NULL)
+		{
+			vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+				"thumb_grabber_init_state: vod_alloc failed");
+			return VOD_ALLOC_FAILED;
+		}
 	}
-
-	state->output_packet = av_packet_alloc();
-	if (state->output_packet == NULL)
+	else
 	{
-		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
-			"thumb_grabber_init_state: av_packet_alloc failed");
-		return VOD_ALLOC_FAILED;
+		state->frames = NULL;
 	}
 
-	state->request_context = request_context;
 	state->write_callback = write_callback;
 	state->write_context = write_context;
+	state->deferred = deferred;
+	state->frame_count = 0;
 	state->cur_frame_part = track->frames;
 	state->cur_frame = track->frames.first_frame;
 	state->max_frame_size = thumb_grabber_get_max_frame_size(track, frame_index + 1);
@@ -512,9 +722,8 @@ thumb_grabber_decode_flush(thumb_grabber_state_t* state)
 }
 
 static vod_status_t 
-thumb_grabber_decode_frame(thumb_grabber_state_t* state, u_char* buffer)
+thumb_grabber_decode_frame(thumb_grabber_state_t* state, input_frame_t* frame, u_char* buffer)
 {
-	input_frame_t* frame = state->cur_frame;
 	AVPacket* input_packet;
 	u_char original_pad[VOD_BUFFER_PADDING_SIZE];
 	u_char* frame_end;
@@ -639,7 +848,7 @@ end:
 #endif // VOD_HAVE_LIB_SW_SCALE
 
 static vod_status_t
-thumb_grabber_write_frame(thumb_grabber_state_t* state)
+thumb_grabber_encode_frame(thumb_grabber_state_t* state)
 {
 	vod_status_t rc;
 	int avrc;
@@ -688,47 +897,772 @@ thumb_grabber_write_frame(thumb_grabber_state_t* state)
 		return VOD_UNEXPECTED;
 	}
 
-	rc = state->write_callback(state->write_context, state->output_packet->data, state->output_packet->size);
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_write_frame(thumb_grabber_state_t* state)
+{
+	vod_status_t rc;
+
+	rc = thumb_grabber_encode_frame(state);
 	if (rc != VOD_OK)
 	{
 		return rc;
 	}
 
-	return VOD_OK;
+	return state->write_callback(state->write_context, state->output_packet->data, state->output_packet->size);
 }
 
-vod_status_t
-thumb_grabber_process(void* context)
+#if (VOD_HAVE_LIB_SW_SCALE)
+static int
+thumb_grabber_compare_tile_candidates(const void* p1, const void* p2)
 {
-	thumb_grabber_state_t* state = context;
-	u_char* read_buffer;
-	uint32_t read_size;
-	bool_t processed_data = FALSE;
-	vod_status_t rc;
-	bool_t frame_done;
+	const thumb_grabber_tile_candidate_t* candidate1 = p1;
+	const thumb_grabber_tile_candidate_t* candidate2 = p2;
 
-	for (;;)
+	if (candidate1->pts != candidate2->pts)
 	{
-		// start a frame if needed
-		if (!state->frame_started)
+		return candidate1->pts < candidate2->pts ? -1 : 1;
+	}
+
+	if (candidate1->index != candidate2->index)
+	{
+		return candidate1->index < candidate2->index ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static vod_status_t
+thumb_grabber_tile_select_frames(
+	request_context_t* request_context,
+	media_track_t* track,
+	thumb_grabber_tile_position_t* positions,
+	uint32_t* position_count,
+	uint32_t interval,
+	uint64_t start_time,
+	bool_t accurate)
+{
+	thumb_grabber_tile_candidate_t* candidates;
+	thumb_grabber_tile_candidate_t* cur_candidate;
+	thumb_grabber_tile_candidate_t* last_candidate;
+	thumb_grabber_tile_position_t* cur_position;
+	thumb_grabber_tile_position_t* end_position;
+	frame_list_part_t* part;
+	input_frame_t* cur_frame;
+	input_frame_t* last_frame;
+	uint64_t dts = track->clip_start_time + track->first_frame_time_offset;
+	uint64_t time;
+	uint32_t candidate_count = 0;
+	uint32_t key_frame_index = 0;
+	uint32_t index;
+	bool_t found_key_frame = FALSE;
+
+	candidates = vod_alloc(request_context->pool, sizeof(candidates[0]) * track->frame_count);
+	if (candidates == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"thumb_grabber_tile_select_frames: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	part = &track->frames;
+	last_frame = part->last_frame;
+	cur_frame = part->first_frame;
+
+	time = start_time + cur_frame->pts_delay;
+
+	// collect the frames that can be decoded
+	for (index = 0;; cur_frame++, index++)
+	{
+		if (cur_frame >= last_frame)
 		{
-			if (state->cur_frame >= state->cur_frame_part.last_frame)
+			if (part->next == NULL)
 			{
-				state->cur_frame_part = *state->cur_frame_part.next;
-				state->cur_frame = state->cur_frame_part.first_frame;
+				break;
 			}
+			part = part->next;
+			cur_frame = part->first_frame;
+			last_frame = part->last_frame;
+		}
 
-			// start the frame
-			rc = state->cur_frame_part.frames_source->start_frame(
-				state->cur_frame_part.frames_source_context,
-				state->cur_frame,
-				NULL);
-			if (rc != VOD_OK)
-			{
-				return rc;
-			}
+		if (cur_frame->key_frame)
+		{
+			key_frame_index = index;
+			found_key_frame = TRUE;
+		}
 
-			state->frame_started = TRUE;
+		if (cur_frame->key_frame || (accurate && found_key_frame))
+		{
+			cur_candidate = &candidates[candidate_count++];
+			cur_candidate->pts = dts + cur_frame->pts_delay;
+			cur_candidate->index = index;
+			cur_candidate->key_frame_index = key_frame_index;
+		}
+
+		dts += cur_frame->duration;
+	}
+
+	if (candidate_count <= 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"thumb_grabber_tile_select_frames: did not find any frames");
+		return VOD_UNEXPECTED;
+	}
+
+	// drop the positions that start after the end of the clip
+	if (start_time + (uint64_t)(*position_count - 1) * interval >= dts)
+	{
+		*position_count = start_time < dts ? vod_div_ceil(dts - start_time, interval) : 1;
+	}
+
+	qsort(candidates, candidate_count, sizeof(candidates[0]), thumb_grabber_compare_tile_candidates);
+
+	// match each position with the closest frame, both are sorted by time
+	cur_candidate = candidates;
+	last_candidate = candidates + candidate_count - 1;
+	end_position = positions + *position_count;
+	for (cur_position = positions; cur_position < end_position; cur_position++, time += interval)
+	{
+		while (cur_candidate < last_candidate && cur_candidate[1].pts <= time)
+		{
+			cur_candidate++;
+		}
+
+		if (cur_candidate < last_candidate && cur_candidate->pts < time &&
+			cur_candidate[1].pts - time < time - cur_candidate->pts)
+		{
+			cur_candidate++;
+		}
+
+		cur_position->pts = cur_candidate->pts;
+		cur_position->index = cur_candidate->index;
+		cur_position->key_frame_index = cur_candidate->key_frame_index;
+		cur_position->drawn = FALSE;
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_tile_init_frames(
+	thumb_grabber_state_t* state,
+	media_track_t* track)
+{
+	request_context_t* request_context = state->request_context;
+	thumb_grabber_tile_position_t* cur_position;
+	thumb_grabber_tile_position_t* end_position;
+	thumb_grabber_tile_frame_t* cur_tile_frame;
+	frame_list_part_t* part;
+	input_frame_t* cur_frame;
+	input_frame_t* last_frame;
+	uint64_t dts = track->clip_start_time + track->first_frame_time_offset;
+	uint32_t frame_count;
+	uint32_t index;
+	u_char* needed;
+	bool_t gap;
+
+	// mark the frames that have to be decoded - each position requires the frames from its key frame
+	needed = vod_alloc(request_context->pool, track->frame_count);
+	if (needed == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"thumb_grabber_tile_init_frames: vod_alloc failed (1)");
+		return VOD_ALLOC_FAILED;
+	}
+
+	vod_memzero(needed, track->frame_count);
+
+	end_position = state->positions + state->position_count;
+	for (cur_position = state->positions; cur_position < end_position; cur_position++)
+	{
+		vod_memset(needed + cur_position->key_frame_index, 1,
+			cur_position->index - cur_position->key_frame_index + 1);
+	}
+
+	frame_count = 0;
+	for (index = 0; index < track->frame_count; index++)
+	{
+		frame_count += needed[index];
+	}
+
+	state->tile_frames = vod_alloc(request_context->pool, sizeof(state->tile_frames[0]) * frame_count);
+	if (state->tile_frames == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"thumb_grabber_tile_init_frames: vod_alloc failed (2)");
+		return VOD_ALLOC_FAILED;
+	}
+
+	vod_log_debug1(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+		"thumb_grabber_tile_init_frames: decoding %uD frames", frame_count);
+
+	// build the list of frames in decode order
+	cur_tile_frame = state->tile_frames;
+	gap = FALSE;
+
+	part = &track->frames;
+	last_frame = part->last_frame;
+	cur_frame = part->first_frame;
+	for (index = 0;; cur_frame++, index++)
+	{
+		if (cur_frame >= last_frame)
+		{
+			if (part->next == NULL)
+			{
+				break;
+			}
+			part = part->next;
+			cur_frame = part->first_frame;
+			last_frame = part->last_frame;
+		}
+
+		if (!needed[index])
+		{
+			gap = cur_tile_frame > state->tile_frames;
+			dts += cur_frame->duration;
+			continue;
+		}
+
+		cur_tile_frame->part = part;
+		cur_tile_frame->frame = cur_frame;
+		cur_tile_frame->buffer = NULL;
+		cur_tile_frame->dts = dts;
+		cur_tile_frame->gap = gap;
+		cur_tile_frame++;
+
+		gap = FALSE;
+		dts += cur_frame->duration;
+	}
+
+	state->tile_frames_end = cur_tile_frame;
+	state->cur_tile_frame = state->tile_frames;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_tile_init_frame(thumb_grabber_state_t* state, uint32_t width, uint32_t height)
+{
+	AVFrame* tile_frame;
+	uint32_t y;
+	int avrc;
+
+	tile_frame = av_frame_alloc();
+	if (tile_frame == NULL)
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"thumb_grabber_tile_init_frame: av_frame_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	state->tile_frame = tile_frame;
+
+	tile_frame->width = width;
+	tile_frame->height = height;
+	tile_frame->format = AV_PIX_FMT_YUV420P;
+
+	avrc = av_image_alloc(
+		tile_frame->data, tile_frame->linesize,
+		tile_frame->width, tile_frame->height, tile_frame->format, 16);
+	if (avrc < 0)
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"thumb_grabber_tile_init_frame: av_image_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	state->resize_buffer = &tile_frame->data[0];
+
+	// fill with black, positions that are not drawn remain black
+	for (y = 0; y < height; y++)
+	{
+		vod_memset(tile_frame->data[0] + y * tile_frame->linesize[0], 16, width);
+	}
+
+	for (y = 0; y < height / 2; y++)
+	{
+		vod_memset(tile_frame->data[1] + y * tile_frame->linesize[1], 128, width / 2);
+		vod_memset(tile_frame->data[2] + y * tile_frame->linesize[2], 128, width / 2);
+	}
+
+	return VOD_OK;
+}
+
+vod_status_t
+thumb_grabber_init_tile_state(
+	request_context_t* request_context,
+	media_track_t* track,
+	thumb_tile_layout_t* layout,
+	uint64_t start_time,
+	thumb_grabber_mode_t mode,
+	bool_t deferred,
+	write_callback_t write_callback,
+	void* write_context,
+	void** result)
+{
+	thumb_grabber_tile_position_t* positions;
+	thumb_grabber_state_t* state;
+	vod_status_t rc;
+	uint32_t position_count;
+	uint32_t i;
+
+	rc = thumb_grabber_validate_track(request_context, track);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	if (track->frame_count <= 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"thumb_grabber_init_tile_state: did not find any frames");
+		return VOD_BAD_REQUEST;
+	}
+
+	position_count = layout->columns * layout->rows;
+
+	positions = vod_alloc(request_context->pool, sizeof(positions[0]) * position_count);
+	if (positions == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"thumb_grabber_init_tile_state: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	rc = thumb_grabber_tile_select_frames(
+		request_context,
+		track,
+		positions,
+		&position_count,
+		layout->interval,
+		start_time,
+		mode == THUMB_GRABBER_MODE_ACCURATE);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	for (i = 0; i < position_count; i++)
+	{
+		positions[i].x = (i % layout->columns) * layout->width;
+		positions[i].y = (i / layout->columns) * layout->height;
+	}
+
+	rc = thumb_grabber_alloc_state(request_context, track, mode, layout->width, layout->height, &state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	state->positions = positions;
+	state->position_count = position_count;
+	state->cell_width = layout->width;
+	state->cell_height = layout->height;
+
+	rc = thumb_grabber_tile_init_frames(state, track);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	rc = thumb_grabber_init_encoder(
+		request_context,
+		layout->columns * layout->width,
+		layout->rows * layout->height,
+		&state->encoder_key,
+		&state->encoder);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	rc = thumb_grabber_tile_init_frame(state, state->encoder->width, state->encoder->height);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	state->write_callback = write_callback;
+	state->write_context = write_context;
+	state->deferred = deferred;
+	state->frames = NULL;
+	state->frame_count = 0;
+	state->frame_buffer = NULL;
+	state->cur_frame_pos = 0;
+	state->first_time = TRUE;
+	state->frame_started = FALSE;
+	state->missing_frames = 0;
+	state->dts = 0;
+	state->has_frame = 0;
+
+	*result = state;
+
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_tile_read_frames(thumb_grabber_state_t* state)
+{
+	thumb_grabber_tile_frame_t* cur_tile_frame;
+	frame_list_part_t* part;
+	u_char* read_buffer;
+	uint32_t read_size;
+	bool_t processed_data = FALSE;
+	vod_status_t rc;
+	bool_t frame_done;
+
+	while (state->cur_tile_frame < state->tile_frames_end)
+	{
+		cur_tile_frame = state->cur_tile_frame;
+		part = cur_tile_frame->part;
+
+		// start the frame if needed
+		if (!state->frame_started)
+		{
+			rc = part->frames_source->start_frame(
+				part->frames_source_context,
+				cur_tile_frame->frame,
+				NULL);
+			if (rc != VOD_OK)
+			{
+				return rc;
+			}
+
+			cur_tile_frame->buffer = vod_alloc(
+				state->request_context->pool,
+				cur_tile_frame->frame->size + VOD_BUFFER_PADDING_SIZE);
+			if (cur_tile_frame->buffer == NULL)
+			{
+				vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+					"thumb_grabber_tile_read_frames: vod_alloc failed");
+				return VOD_ALLOC_FAILED;
+			}
+
+			state->cur_frame_pos = 0;
+			state->frame_started = TRUE;
+		}
+
+		// read some data from the frame
+		rc = part->frames_source->read(
+			part->frames_source_context,
+			&read_buffer,
+			&read_size,
+			&frame_done);
+		if (rc != VOD_OK)
+		{
+			if (rc != VOD_AGAIN)
+			{
+				return rc;
+			}
+
+			if (!processed_data && !state->first_time)
+			{
+				vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+					"thumb_grabber_tile_read_frames: no data was handled, probably a truncated file");
+				return VOD_BAD_DATA;
+			}
+
+			state->first_time = FALSE;
+			return VOD_AGAIN;
+		}
+
+		processed_data = TRUE;
+
+		if (read_size > cur_tile_frame->frame->size - state->cur_frame_pos)
+		{
+			vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+				"thumb_grabber_tile_read_frames: read size %uD exceeds the frame size %uD",
+				state->cur_frame_pos + read_size, cur_tile_frame->frame->size);
+			return VOD_UNEXPECTED;
+		}
+
+		vod_memcpy(cur_tile_frame->buffer + state->cur_frame_pos, read_buffer, read_size);
+		state->cur_frame_pos += read_size;
+
+		if (!frame_done)
+		{
+			continue;
+		}
+
+		vod_memzero(cur_tile_frame->buffer + state->cur_frame_pos, VOD_BUFFER_PADDING_SIZE);
+
+		state->cur_tile_frame++;
+		state->frame_started = FALSE;
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_tile_draw_frame(thumb_grabber_state_t* state, AVFrame* frame)
+{
+	thumb_grabber_tile_position_t* cur_position;
+	thumb_grabber_tile_position_t* end_position;
+	AVFrame* tile_frame = state->tile_frame;
+	uint8_t* dst[4];
+	int64_t pts;
+
+	pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+
+	end_position = state->positions + state->position_count;
+	for (cur_position = state->positions; cur_position < end_position; cur_position++)
+	{
+		if (cur_position->drawn || cur_position->pts != (uint64_t)pts)
+		{
+			continue;
+		}
+
+		state->sws_ctx = sws_getCachedContext(state->sws_ctx,
+			frame->width, frame->height, frame->format,
+			state->cell_width, state->cell_height, tile_frame->format,
+			SWS_BICUBIC, NULL, NULL, NULL);
+		if (state->sws_ctx == NULL)
+		{
+			vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+				"thumb_grabber_tile_draw_frame: sws_getCachedContext failed");
+			return VOD_UNEXPECTED;
+		}
+
+		// Note: the cell position and size are even, the chroma planes are subsampled by 2 in both axes
+		dst[0] = tile_frame->data[0] + cur_position->y * tile_frame->linesize[0] + cur_position->x;
+		dst[1] = tile_frame->data[1] + cur_position->y / 2 * tile_frame->linesize[1] + cur_position->x / 2;
+		dst[2] = tile_frame->data[2] + cur_position->y / 2 * tile_frame->linesize[2] + cur_position->x / 2;
+		dst[3] = NULL;
+
+		sws_scale(state->sws_ctx,
+			(const uint8_t* const*)frame->data, frame->linesize, 0, frame->height,
+			dst, tile_frame->linesize);
+
+		cur_position->drawn = TRUE;
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_tile_receive_frames(thumb_grabber_state_t* state)
+{
+	vod_status_t rc;
+	int avrc;
+
+	for (;;)
+	{
+		avrc = avcodec_receive_frame(state->decoder, state->decoded_frame);
+		if (avrc == AVERROR(EAGAIN) || avrc == AVERROR_EOF)
+		{
+			return VOD_OK;
+		}
+
+		if (avrc < 0)
+		{
+			vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+				"thumb_grabber_tile_receive_frames: avcodec_receive_frame failed %d", avrc);
+			return VOD_BAD_DATA;
+		}
+
+		rc = thumb_grabber_tile_draw_frame(state, state->decoded_frame);
+		av_frame_unref(state->decoded_frame);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+	}
+}
+
+static vod_status_t
+thumb_grabber_tile_drain(thumb_grabber_state_t* state)
+{
+	vod_status_t rc;
+	int avrc;
+
+	avrc = avcodec_send_packet(state->decoder, NULL);
+	if (avrc < 0)
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"thumb_grabber_tile_drain: avcodec_send_packet failed %d", avrc);
+		return VOD_BAD_DATA;
+	}
+
+	rc = thumb_grabber_tile_receive_frames(state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	// reset the eof state, so that the decoder can accept more packets
+	avcodec_flush_buffers(state->decoder);
+
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_tile_encode(thumb_grabber_state_t* state)
+{
+	thumb_grabber_tile_position_t* cur_position;
+	thumb_grabber_tile_position_t* end_position;
+	thumb_grabber_tile_frame_t* cur_tile_frame;
+	AVPacket* input_packet;
+	vod_status_t rc;
+	bool_t drawn = FALSE;
+	int avrc;
+
+	for (cur_tile_frame = state->tile_frames; cur_tile_frame < state->tile_frames_end; cur_tile_frame++)
+	{
+		// the frames are decoded from a new key frame, output the pending frames of the previous gop
+		if (cur_tile_frame->gap)
+		{
+			rc = thumb_grabber_tile_drain(state);
+			if (rc != VOD_OK)
+			{
+				return rc;
+			}
+		}
+
+		input_packet = av_packet_alloc();
+		if (input_packet == NULL)
+		{
+			vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+				"thumb_grabber_tile_encode: av_packet_alloc failed");
+			return VOD_ALLOC_FAILED;
+		}
+
+		input_packet->data = cur_tile_frame->buffer;
+		input_packet->size = cur_tile_frame->frame->size;
+		input_packet->dts = cur_tile_frame->dts;
+		input_packet->pts = cur_tile_frame->dts + cur_tile_frame->frame->pts_delay;
+		input_packet->duration = cur_tile_frame->frame->duration;
+		input_packet->flags = cur_tile_frame->frame->key_frame ? AV_PKT_FLAG_KEY : 0;
+
+		avrc = avcodec_send_packet(state->decoder, input_packet);
+		av_packet_free(&input_packet);
+		if (avrc < 0)
+		{
+			vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+				"thumb_grabber_tile_encode: avcodec_send_packet failed %d", avrc);
+			return VOD_BAD_DATA;
+		}
+
+		rc = thumb_grabber_tile_receive_frames(state);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+	}
+
+	rc = thumb_grabber_tile_drain(state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	end_position = state->positions + state->position_count;
+	for (cur_position = state->positions; cur_position < end_position; cur_position++)
+	{
+		if (cur_position->drawn)
+		{
+			drawn = TRUE;
+		}
+		else
+		{
+			vod_log_error(VOD_LOG_WARN, state->request_context->log, 0,
+				"thumb_grabber_tile_encode: frame with pts %uL was not decoded", cur_position->pts);
+		}
+	}
+
+	if (!drawn)
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"thumb_grabber_tile_encode: no frames were decoded");
+		return VOD_UNEXPECTED;
+	}
+
+	avrc = avcodec_send_frame(state->encoder, state->tile_frame);
+	if (avrc < 0)
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"thumb_grabber_tile_encode: avcodec_send_frame failed %d", avrc);
+		return VOD_UNEXPECTED;
+	}
+
+	avrc = avcodec_receive_packet(state->encoder, state->output_packet);
+	if (avrc < 0)
+	{
+		vod_log_error(VOD_LOG_ERR, state->request_context->log, 0,
+			"thumb_grabber_tile_encode: avcodec_receive_packet failed %d", avrc);
+		return VOD_UNEXPECTED;
+	}
+
+	return VOD_OK;
+}
+
+static vod_status_t
+thumb_grabber_tile_process(thumb_grabber_state_t* state)
+{
+	vod_status_t rc;
+
+	rc = thumb_grabber_tile_read_frames(state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	// the frames are decoded by thumb_grabber_encode
+	if (state->deferred)
+	{
+		return VOD_OK;
+	}
+
+	rc = thumb_grabber_tile_encode(state);
+	if (rc != VOD_OK)
+	{
+		return rc;
+	}
+
+	return state->write_callback(state->write_context, state->output_packet->data, state->output_packet->size);
+}
+#endif // VOD_HAVE_LIB_SW_SCALE
+
+vod_status_t
+thumb_grabber_process(void* context)
+{
+	thumb_grabber_state_t* state = context;
+	u_char* read_buffer;
+	uint32_t read_size;
+	bool_t processed_data = FALSE;
+	vod_status_t rc;
+	bool_t frame_done;
+
+#if (VOD_HAVE_LIB_SW_SCALE)
+	if (state->positions != NULL)
+	{
+		return thumb_grabber_tile_process(state);
+	}
+#endif // VOD_HAVE_LIB_SW_SCALE
+
+	for (;;)
+	{
+		// start a frame if needed
+		if (!state->frame_started)
+		{
+			if (state->cur_frame >= state->cur_frame_part.last_frame)
+			{
+				state->cur_frame_part = *state->cur_frame_part.next;
+				state->cur_frame = state->cur_frame_part.first_frame;
+			}
+
+			// start the frame
+			rc = state->cur_frame_part.frames_source->start_frame(
+				state->cur_frame_part.frames_source_context,
+				state->cur_frame,
+				NULL);
+			if (rc != VOD_OK)
+			{
+				return rc;
+			}
+
+			state->frame_started = TRUE;
 		}
 
 		// read some data from the frame
@@ -757,6 +1691,48 @@ thumb_grabber_process(void* context)
 
 		processed_data = TRUE;
 
+		if (state->deferred)
+		{
+			// keep a copy of the frame, the read buffer may be reused before the frame is decoded
+			if (state->cur_frame_pos == 0)
+			{
+				state->frame_buffer = vod_alloc(
+					state->request_context->pool,
+					state->cur_frame->size + VOD_BUFFER_PADDING_SIZE);
+				if (state->frame_buffer == NULL)
+				{
+					vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
+						"thumb_grabber_process: vod_alloc failed (1)");
+					return VOD_ALLOC_FAILED;
+				}
+			}
+
+			vod_memcpy(state->frame_buffer + state->cur_frame_pos, read_buffer, read_size);
+			state->cur_frame_pos += read_size;
+
+			if (!frame_done)
+			{
+				continue;
+			}
+
+			state->frames[state->frame_count].frame = state->cur_frame;
+			state->frames[state->frame_count].buffer = state->frame_buffer;
+			state->frame_count++;
+			state->cur_frame_pos = 0;
+
+			// the frames are decoded by thumb_grabber_encode
+			if (state->skip_count <= 0)
+			{
+				return VOD_OK;
+			}
+
+			state->skip_count--;
+
+			state->cur_frame++;
+			state->frame_started = FALSE;
+			continue;
+		}
+
 		if (!frame_done)
 		{
 			// didn't finish the frame, append to the frame buffer
@@ -768,7 +1744,7 @@ thumb_grabber_process(void* context)
 				if (state->frame_buffer == NULL)
 				{
 					vod_log_debug0(VOD_LOG_DEBUG_LEVEL, state->request_context->log, 0,
-						"thumb_grabber_process: vod_alloc failed");
+						"thumb_grabber_process: vod_alloc failed (2)");
 					return VOD_ALLOC_FAILED;
 				}
 			}
@@ -787,7 +1763,7 @@ thumb_grabber_process(void* context)
 		}
 
 		// decode the frame
-		rc = thumb_grabber_decode_frame(state, read_buffer);
+		rc = thumb_grabber_decode_frame(state, state->cur_frame, read_buffer);
 		if (rc != VOD_OK)
 		{
 			return rc;
@@ -806,3 +1782,40 @@ thumb_grabber_process(void* context)
 		state->frame_started = FALSE;
 	}
 }
+
+vod_status_t
+thumb_grabber_encode(void* context)
+{
+	thumb_grabber_state_t* state = context;
+	thumb_grabber_frame_t* cur_frame;
+	thumb_grabber_frame_t* last_frame;
+	vod_status_t rc;
+
+#if (VOD_HAVE_LIB_SW_SCALE)
+	if (state->positions != NULL)
+	{
+		return thumb_grabber_tile_encode(state);
+	}
+#endif // VOD_HAVE_LIB_SW_SCALE
+
+	cur_frame = state->frames;
+	last_frame = cur_frame + state->frame_count;
+	for (; cur_frame < last_frame; cur_frame++)
+	{
+		rc = thumb_grabber_decode_frame(state, cur_frame->frame, cur_frame->buffer);
+		if (rc != VOD_OK)
+		{
+			return rc;
+		}
+	}
+
+	return thumb_grabber_encode_frame(state);
+}
+
+vod_status_t
+thumb_grabber_write(void* context)
+{
+	thumb_grabber_state_t* state = context;
+
+	return state->write_callback(state->write_context, state->output_packet->data, state->output_packet->size);
+}
@@ -4,6 +4,14 @@
 // includes
 #include "../media_format.h"
 #include "../media_set.h"
+#include "thumb_tile.h"
+
+// typedefs
+typedef enum {
+	THUMB_GRABBER_MODE_ACCURATE,		// the frame closest to the offset
+	THUMB_GRABBER_MODE_KEY_FRAME,		// the key frame closest to the offset
+	THUMB_GRABBER_MODE_FAST,			// the key frame closest to the offset, decoded with reduced quality
+} thumb_grabber_mode_t;
 
 // functions
 void thumb_grabber_process_init(vod_log_t* log);
@@ -12,11 +20,35 @@ vod_status_t thumb_grabber_init_state(
 	request_context_t* request_context,
 	media_track_t* track,
 	request_params_t* request_params,
-	bool_t accurate,
+	thumb_grabber_mode_t mode,
+	bool_t deferred,
 	write_callback_t write_callback,
 	void* write_context,
 	void** result);
 
+#if (VOD_HAVE_LIB_SW_SCALE)
+// Note: grabs up to columns x rows thumbnails, layout->interval millis apart starting from start_time,
+//		and draws them on a single image. positions that start after the end of the clip are left blank
+vod_status_t thumb_grabber_init_tile_state(
+	request_context_t* request_context,
+	media_track_t* track,
+	thumb_tile_layout_t* layout,
+	uint64_t start_time,
+	thumb_grabber_mode_t mode,
+	bool_t deferred,
+	write_callback_t write_callback,
+	void* write_context,
+	void** result);
+#endif // VOD_HAVE_LIB_SW_SCALE
+
+// Note: in deferred mode, thumb_grabber_process only reads the frames, returning VOD_OK once the
+//		target frame was read. thumb_grabber_encode then decodes / resizes / encodes the frame, it does
+//		not allocate from the request pool, and can therefore run on a thread pool.
+//		thumb_grabber_write writes the result, and must be called on the thread that owns the request.
 vod_status_t thumb_grabber_process(void* context);
 
+vod_status_t thumb_grabber_encode(void* context);
+
+vod_status_t thumb_grabber_write(void* context);
+
 #endif //__THUMB_GRABBER_H__
@@ -0,0 +1,157 @@
+#include "thumb_tile.h"
+
+// constants
+#define WEBVTT_HEADER "WEBVTT\n\n"
+#define WEBVTT_TIMESTAMP_FORMAT "%02uD:%02uD:%02uD.%03uD"
+#define WEBVTT_TIMESTAMP_DELIM " --> "
+#define WEBVTT_TIMESTAMP_MAX_SIZE (VOD_INT32_LEN + sizeof(":00:00.000") - 1)
+#define WEBVTT_XYWH_FORMAT "#xywh=%uD,%uD,%uD,%uD\n\n"
+
+static u_char*
+thumb_tile_write_timestamp(u_char* p, uint64_t timestamp)
+{
+	return vod_sprintf(p, WEBVTT_TIMESTAMP_FORMAT,
+		(uint32_t)(timestamp / 3600000),
+		(uint32_t)((timestamp / 60000) % 60),
+		(uint32_t)((timestamp / 1000) % 60),
+		(uint32_t)(timestamp % 1000));
+}
+
+vod_status_t
+thumb_tile_get_layout(
+	request_context_t* request_context,
+	thumb_tile_conf_t* conf,
+	media_info_t* media_info,
+	uint64_t total_duration,
+	thumb_tile_layout_t* result)
+{
+	uint32_t video_width = media_info->u.video.width;
+	uint32_t video_height = media_info->u.video.height;
+	uint64_t width = conf->width;
+	uint64_t height = conf->height;
+
+	if (video_width <= 0 || video_height <= 0)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"thumb_tile_get_layout: input width/height is zero");
+		return VOD_BAD_DATA;
+	}
+
+	if (width == 0)
+	{
+		width = height != 0 ? (height * video_width) / video_height : video_width;
+	}
+
+	if (height == 0)
+	{
+		height = (width * video_height) / video_width;
+	}
+
+	// the thumbnails are scaled into yuv420 planes, use even dimensions
+	width &= ~1;
+	height &= ~1;
+
+	if (width <= 0 || height <= 0 ||
+		width * conf->columns > THUMB_TILE_MAX_SIZE ||
+		height * conf->rows > THUMB_TILE_MAX_SIZE)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"thumb_tile_get_layout: invalid thumbnail size %uLx%uL", width, height);
+		return VOD_BAD_REQUEST;
+	}
+
+	result->columns = conf->columns;
+	result->rows = conf->rows;
+	result->interval = conf->interval;
+	result->width = width;
+	result->height = height;
+	result->duration = (uint64_t)conf->columns * conf->rows * conf->interval;
+	result->total_duration = total_duration;
+	result->count = vod_div_ceil(total_duration, result->duration);
+
+	return VOD_OK;
+}
+
+vod_status_t
+thumb_tile_build_webvtt(
+	request_context_t* request_context,
+	thumb_tile_layout_t* layout,
+	vod_str_t* base_url,
+	vod_str_t* file_name_prefix,
+	vod_str_t* name_suffix,
+	vod_str_t* result)
+{
+	uint64_t thumb_count;
+	uint64_t start;
+	uint64_t end;
+	uint32_t index;
+	uint32_t tile;
+	size_t cue_size;
+	size_t result_size;
+	u_char* p;
+
+	thumb_count = vod_div_ceil(layout->total_duration, layout->interval);
+
+	cue_size = WEBVTT_TIMESTAMP_MAX_SIZE * 2 + sizeof(WEBVTT_TIMESTAMP_DELIM) - 1 + 1 +
+		base_url->len + file_name_prefix->len + 1 + VOD_INT32_LEN + name_suffix->len +
+		sizeof(WEBVTT_XYWH_FORMAT) + 4 * VOD_INT32_LEN;
+
+	result_size = sizeof(WEBVTT_HEADER) - 1 + cue_size * thumb_count;
+
+	p = vod_alloc(request_context->pool, result_size);
+	if (p == NULL)
+	{
+		vod_log_debug0(VOD_LOG_DEBUG_LEVEL, request_context->log, 0,
+			"thumb_tile_build_webvtt: vod_alloc failed");
+		return VOD_ALLOC_FAILED;
+	}
+
+	result->data = p;
+
+	p = vod_copy(p, WEBVTT_HEADER, sizeof(WEBVTT_HEADER) - 1);
+
+	index = 0;
+	tile = 0;
+	for (start = 0; start < layout->total_duration; start = end)
+	{
+		end = start + layout->interval;
+		if (end > layout->total_duration)
+		{
+			end = layout->total_duration;
+		}
+
+		p = thumb_tile_write_timestamp(p, start);
+		p = vod_copy(p, WEBVTT_TIMESTAMP_DELIM, sizeof(WEBVTT_TIMESTAMP_DELIM) - 1);
+		p = thumb_tile_write_timestamp(p, end);
+		*p++ = '\n';
+
+		p = vod_copy(p, base_url->data, base_url->len);
+		p = vod_copy(p, file_name_prefix->data, file_name_prefix->len);
+		p = vod_sprintf(p, "-%uD", tile + 1);
+		p = vod_copy(p, name_suffix->data, name_suffix->len);
+		p = vod_sprintf(p, WEBVTT_XYWH_FORMAT,
+			(index % layout->columns) * layout->width,
+			(index / layout->columns) * layout->height,
+			layout->width,
+			layout->height);
+
+		index++;
+		if (index >= layout->columns * layout->rows)
+		{
+			index = 0;
+			tile++;
+		}
+	}
+
+	result->len = p - result->data;
+
+	if (result->len > result_size)
+	{
+		vod_log_error(VOD_LOG_ERR, request_context->log, 0,
+			"thumb_tile_build_webvtt: result length %uz exceeded allocated length %uz",
+			result->len, result_size);
+		return VOD_UNEXPECTED;
+	}
+
+	return VOD_OK;
+}
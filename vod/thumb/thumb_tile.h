@@ -0,0 +1,50 @@
+#ifndef __THUMB_TILE_H__
+#define __THUMB_TILE_H__
+
+// includes
+#include "../media_set.h"
+
+// constants
+#define THUMB_TILE_MAX_THUMBNAILS (1024)	// per tile
+#define THUMB_TILE_MAX_SIZE (8192)			// tile width / height
+
+// typedefs
+typedef struct {
+	vod_uint_t columns;
+	vod_uint_t rows;
+	vod_uint_t interval;		// milliseconds between consecutive thumbnails
+	vod_uint_t width;			// of a single thumbnail, 0 = derive from the height and the aspect ratio
+	vod_uint_t height;			// of a single thumbnail, 0 = derive from the width and the aspect ratio
+} thumb_tile_conf_t;
+
+typedef struct {
+	uint32_t columns;
+	uint32_t rows;
+	uint32_t interval;
+	uint32_t width;
+	uint32_t height;
+	uint64_t duration;			// of a single tile, in millis
+	uint64_t total_duration;	// in millis
+	uint32_t count;
+} thumb_tile_layout_t;
+
+// functions
+
+// Note: thumbnail i (0 based) of tile n (0 based) is positioned at n * layout->duration + i * layout->interval,
+//		in row major order, tiles whose thumbnails exceed the total duration are partially filled
+vod_status_t thumb_tile_get_layout(
+	request_context_t* request_context,
+	thumb_tile_conf_t* conf,
+	media_info_t* media_info,
+	uint64_t total_duration,
+	thumb_tile_layout_t* result);
+
+vod_status_t thumb_tile_build_webvtt(
+	request_context_t* request_context,
+	thumb_tile_layout_t* layout,
+	vod_str_t* base_url,
+	vod_str_t* file_name_prefix,
+	vod_str_t* name_suffix,
+	vod_str_t* result);
+
+#endif // __THUMB_TILE_H__
@@ -99,6 +99,34 @@ write_buffer_queue_get_buffer(write_buffer_queue_t* queue, uint32_t size, void*
 	return result;
 }
 
+u_char*
+write_buffer_queue_get_buffers(write_buffer_queue_t* queue, uint32_t size, uint32_t* count, void* writer_context)
+{
+	buffer_header_t* write_buffer;
+	uint32_t extra_count;
+	u_char* result;
+
+	result = write_buffer_queue_get_buffer(queue, size, writer_context);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+
+	// extend the allocation with as many units as the current buffer can hold
+	write_buffer = queue->cur_write_buffer;
+	extra_count = (write_buffer->end_pos - write_buffer->cur_pos) / size;
+	if (extra_count > *count - 1)
+	{
+		extra_count = *count - 1;
+	}
+
+	write_buffer->cur_pos += extra_count * size;
+	queue->cur_offset += extra_count * size;
+	*count = extra_count + 1;
+
+	return result;
+}
+
 vod_status_t
 write_buffer_queue_send(write_buffer_queue_t* queue, off_t max_offset)
 {